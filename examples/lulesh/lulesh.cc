@@ -2819,33 +2819,18 @@ void grabCoords(
         Domain& domain,
         int    indexes[])
 {
-    char dimensions[4096] = {0};
-    Real_t coords[3][8];
-    const int X = 0;
-    const int Y = 1;
-    const int Z = 2;
+    // x, y, z for each of the 8 vertices, in that order:
+    double coords[24];
     int i;
 
     for (i = 0; i < 8; i++) {
-        coords[X][i] = domain.x(indexes[i]);
-        coords[Y][i] = domain.y(indexes[i]);
-        coords[Z][i] = domain.z(indexes[i]);
+        coords[(i * 3) + 0] = (double) domain.x(indexes[i]);
+        coords[(i * 3) + 1] = (double) domain.y(indexes[i]);
+        coords[(i * 3) + 2] = (double) domain.z(indexes[i]);
     }
 
-    snprintf(dimensions, 4096,
-                "%1.5f %1.5f %1.5f %1.5f %1.5f %1.5f %1.5f %1.5f "
-                "%1.5f %1.5f %1.5f %1.5f %1.5f %1.5f %1.5f %1.5f "
-                "%1.5f %1.5f %1.5f %1.5f %1.5f %1.5f %1.5f %1.5f",
-                coords[X][0], coords[Y][0], coords[Z][0],
-                coords[X][1], coords[Y][1], coords[Z][1],
-                coords[X][2], coords[Y][2], coords[Z][2],
-                coords[X][3], coords[Y][3], coords[Z][3],
-                coords[X][4], coords[Y][4], coords[Z][4],
-                coords[X][5], coords[Y][5], coords[Z][5],
-                coords[X][6], coords[Y][6], coords[Z][6],
-                coords[X][7], coords[Y][7], coords[Z][7]);
-    
-    SOS_pack(g_pub, "lulesh.coords", SOS_VAL_TYPE_STRING, dimensions);
+    SOS_pack_vector(g_pub, "lulesh.coords", SOS_VAL_TYPE_DOUBLE_ARRAY,
+            24, coords);
 
     return;
 }
@@ -22,7 +22,7 @@ void SOS_init_wrapper(int* argc, char** argv[]) {
     _runtime->config.comm_size = commsize;
     // ...but it has to be done before the pub creation.
     SOS_pub_create(_runtime, &example_pub, pub_name, SOS_NATURE_DEFAULT);
-    strcpy (example_pub->prog_ver, app_version);
+    SOS_pub_config(example_pub, SOS_PUB_OPTION_PROG_VER, app_version);
     example_pub->meta.channel       = 1;
     example_pub->meta.nature        = SOS_NATURE_EXEC_WORK;
     example_pub->meta.layer         = SOS_LAYER_LIB;
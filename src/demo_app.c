@@ -279,7 +279,7 @@ int main(int argc, char *argv[]) {
         if (rank == 0) dlog(1, "  ... pub->cache_depth = %d\n", pub->cache_depth);
 
         if (rank == 0) dlog(1, "Manually configuring some pub metadata...\n");
-        strcpy (pub->prog_ver, str_prog_ver);
+        SOS_pub_config(pub, SOS_PUB_OPTION_PROG_VER, str_prog_ver);
         pub->meta.channel     = 1;
         pub->meta.nature      = SOS_NATURE_EXEC_WORK;
         pub->meta.layer       = SOS_LAYER_APP;
@@ -4,6 +4,7 @@ import sys
 import subprocess
 import time
 import os
+import struct
 from mpl_toolkits.mplot3d import Axes3D
 import matplotlib.cm as cm
 from matplotlib.colors import Normalize
@@ -42,7 +43,7 @@ def queryAndPlot():
     SELECT
     DISTINCT value_name
     FROM viewCombined
-    WHERE value_type != 3
+    WHERE value_type < 3
     AND frame = """ + str(max_cycle) + """
     ;
     """
@@ -74,7 +75,7 @@ def queryAndPlot():
           sql_string += ' THEN value END) AS "' + field_name + '" '
       sql_string += """, GROUP_CONCAT( CASE WHEN """
       sql_string += ' value_name LIKE "lulesh.coords" '
-      sql_string += ' THEN value END) AS "lulesh.coords" '
+      sql_string += ' THEN hex(value) END) AS "lulesh.coords" '
       sql_string += """ FROM viewCombined """
       sql_string += " WHERE frame = " + str(c) + " " 
       sql_string += """ GROUP BY """
@@ -128,7 +129,8 @@ def queryAndPlot():
 
       rank_max = len(attr['comm_rank'])
       coords = list()
-      coords = [el.split() for el in res_coords]
+      # lulesh.coords is a DOUBLE_ARRAY, stored as a blob of 24 doubles:
+      coords = [struct.unpack('24d', el.decode('hex')) for el in res_coords]
       #print attr
       dset = vtk_writer.vtk_hex_data_set()
       dset.clear()
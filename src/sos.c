@@ -23,6 +23,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <libgen.h>
 #include <sys/socket.h>
 #include <netdb.h>
@@ -40,6 +41,14 @@
 #include "sos_pipe.h"
 #include "sos_qhashtbl.h"
 #include "sos_target.h"
+#include "sos_shm.h"
+#include "sos_async.h"
+#include "sos_name_index.h"
+#include "sos_intern.h"
+#include "sos_record.h"
+#include "sos_snap_pool.h"
+#include "sos_pack_stage.h"
+#include "sos_coalesce.h"
 
 // Private functions (not in the header file)
 
@@ -60,6 +69,10 @@ void         SOS_expand_data(SOS_pub *pub);
  */
 void SOS_receiver_init(SOS_runtime *sos_context);
 
+static void SOS_uid_join_prefetch(SOS_uid *id);
+static int  SOS_pack_snap_place_in_pub(SOS_pub *pub, SOS_val_snap *snap,
+        const char *name, SOS_val_type type);
+
 char global_placeholder_RETURN_FAIL;
 char global_placeholder_RETURN_BUSY;
 
@@ -364,6 +377,10 @@ SOS_init_existing_runtime(
         }
         SOS_target_init(SOS, &SOS->daemon, SOS->config.daemon_host,
                 atoi(portStr));
+        SOS->daemon->is_persistent = SOS->config.options->persistent_connection;
+        if (SOS->config.options->unix_socket) {
+            SOS_target_use_unix(SOS->daemon);
+        }
         rc = SOS_target_connect(SOS->daemon);
 
         if (rc != 0) {
@@ -397,6 +414,17 @@ SOS_init_existing_runtime(
         SOS_buffer_pack(buffer, &offset, "i",
                 client_uid);
 
+        // Offer the encodings we can use, see SOS_WIRE_*.
+        int wire_flags = 0;
+        if (SOS->config.options->compact_snaps) {
+            wire_flags |= SOS_WIRE_COMPACT_SNAPS;
+        }
+        if (SOS->config.options->no_ack) {
+            wire_flags |= SOS_WIRE_NO_ACK;
+        }
+        SOS_buffer_pack(buffer, &offset, "i",
+                wire_flags);
+
         header.msg_size = offset;
         offset = 0;
         SOS_msg_zip(buffer, header, 0, &offset);
@@ -412,6 +440,7 @@ SOS_init_existing_runtime(
             fprintf(stderr, "ERROR: Could not write to server socket!"
                     "  (%s:%s)\n",
             SOS->daemon->remote_host, SOS->daemon->remote_port);
+            SOS_target_disconnect(SOS->daemon);
             SOS_target_destroy(SOS->daemon);
             free(SOS->config.node_id);
             free(SOS->config.program_name);
@@ -460,6 +489,14 @@ SOS_init_existing_runtime(
         SOS_buffer_unpack(buffer, &offset, "i",
                 &server_uid);
 
+        // Older daemons do not answer the offer, and get the defaults.
+        SOS->daemon->wire_flags = 0;
+        if (offset < header.msg_size) {
+            SOS_buffer_unpack(buffer, &offset, "i",
+                    &SOS->daemon->wire_flags);
+            SOS->daemon->wire_flags &= wire_flags;
+        }
+
         if (server_uid != client_uid) {
             fprintf(stderr, "ERROR: SOS daemon's UID (%d) does not"
                     " match yours (%d)!  Connection refused.\n",
@@ -492,12 +529,21 @@ SOS_init_existing_runtime(
         SOS_uid_init(SOS, &SOS->uid.local_serial, 0, SOS_DEFAULT_UID_MAX);
         SOS_uid_init(SOS, &SOS->uid.my_guid_pool,
             guid_pool_from, guid_pool_to);
+        SOS->uid.my_guid_pool->low_water = SOS_DEFAULT_GUID_LOW_WATER;
 
         SOS->my_guid = SOS_uid_next(SOS->uid.my_guid_pool);
         dlog(4, "  ... SOS->my_guid == %" SOS_GUID_FMT "\n", SOS->my_guid);
 
         SOS_buffer_destroy(buffer);
 
+        if (SOS->config.options->shm_transport) {
+            dlog(4, "  ... setting up shared-memory transport.\n");
+            SOS_shm_transport_init(SOS);
+        }
+
+        SOS_async_init(SOS);
+        SOS_coalesce_init(SOS);
+
 
     } else {
          //
@@ -837,10 +883,168 @@ SOS_msg_seal(
 
 
 
+void SOS_shm_transport_init(SOS_runtime *sos_context) {
+    SOS_SET_CONTEXT(sos_context, "SOS_shm_transport_init");
+
+    SOS_shm_ring   *ring = NULL;
+    SOS_msg_header  header;
+    SOS_buffer     *msg = NULL;
+    SOS_buffer     *reply = NULL;
+    char            name[SOS_DEFAULT_STRING_LEN] = {0};
+    int             offset;
+    int             rc;
+
+    snprintf(name, SOS_DEFAULT_STRING_LEN, "/sos.%d.%d.%" SOS_GUID_FMT,
+            (int) getuid(), (int) getpid(), SOS->my_guid);
+
+    rc = SOS_shm_ring_create(SOS, &ring, name, SOS_DEFAULT_SHM_RING_SIZE);
+    if (rc != 0) {
+        dlog(0, "WARNING: Unable to create a shared-memory ring."
+                "  Using the socket for everything.\n");
+        return;
+    }
+
+    SOS_buffer_init_sized_locking(SOS, &msg, 1024, false);
+    SOS_buffer_init_sized_locking(SOS, &reply, SOS_DEFAULT_REPLY_LEN, false);
+
+    header.msg_size = -1;
+    header.msg_type = SOS_MSG_TYPE_SHM_ATTACH;
+    header.msg_from = SOS->my_guid;
+    header.ref_guid = 0;
+
+    offset = 0;
+    SOS_msg_zip(msg, header, 0, &offset);
+    SOS_buffer_pack(msg, &offset, "s", name);
+    header.msg_size = offset;
+    offset = 0;
+    SOS_msg_zip(msg, header, 0, &offset);
+
+    SOS_send_to_daemon(msg, reply);
+
+    // The daemon has mapped the ring (or failed to), either way the
+    // name is no longer needed and nothing is left behind if we crash.
+    shm_unlink(name);
+
+    rc = -1;
+    if (reply->len >= sizeof(SOS_msg_header)) {
+        offset = 0;
+        SOS_msg_unzip(reply, &header, 0, &offset);
+        if (header.msg_type == SOS_MSG_TYPE_SHM_ATTACH) {
+            SOS_buffer_unpack(reply, &offset, "i", &rc);
+        }
+    }
+
+    if (rc == 0) {
+        dlog(4, "  ... daemon attached to ring %s\n", name);
+        SOS->shm_ring = ring;
+    } else {
+        dlog(0, "WARNING: The daemon did not attach to the shared-memory"
+                " ring.  Using the socket for everything.\n");
+        SOS_shm_ring_destroy(ring);
+    }
+
+    SOS_buffer_destroy(msg);
+    SOS_buffer_destroy(reply);
+
+    return;
+}
+
+
+
+// How many times messages to the daemon may have been lost.  A pub that
+// announced before the latest loss announces itself in full again.
+static int
+SOS_daemon_losses(SOS_runtime *SOS) {
+    if (SOS->daemon == NULL) {
+        return 0;
+    }
+    return __atomic_load_n(&SOS->daemon->losses, __ATOMIC_RELAXED);
+}
+
+
+// The daemon puts credits and a delay in its ACKs when it is falling
+// behind, see SOSD_backpressure().  The credits cap the SOS_WIRE_NO_ACK
+// window, and SOS_coalesce_defer_publish() spaces publishes by the delay.
+static void
+SOS_take_backpressure(SOS_runtime *SOS, SOS_buffer *reply) {
+    SOS_msg_header header;
+    int credits = 0;
+    int backoff_usec = 0;
+    int offset = 0;
+
+    SOS_msg_unzip(reply, &header, 0, &offset);
+    if (header.msg_type != SOS_MSG_TYPE_ACK) {
+        return;
+    }
+    // Older daemons send a bare ACK.
+    if ((offset + 8) <= header.msg_size) {
+        SOS_buffer_unpack(reply, &offset, "ii",
+                &credits,
+                &backoff_usec);
+    }
+    if ((backoff_usec > 0)
+     && (__atomic_load_n(&SOS->daemon->backoff_usec, __ATOMIC_RELAXED) == 0)) {
+        dlog(1, "The daemon is falling behind, spacing publishes by"
+                " %d usec.\n", backoff_usec);
+    }
+    SOS->daemon->credits = credits;
+    __atomic_store_n(&SOS->daemon->backoff_usec, backoff_usec,
+            __ATOMIC_RELAXED);
+    return;
+}
+
+
 void SOS_send_to_daemon(SOS_buffer *message, SOS_buffer *reply ) {
     SOS_SET_CONTEXT(message->sos_context, "SOS_send_to_daemon");
 
-    int rc = 0;
+    int  rc = 0;
+    int  msg_size = -1;
+    int  msg_type = -1;
+    int  offset = 0;
+    int  window;
+    bool is_ingest = false;
+    bool is_idempotent = false;
+    bool want_ack = true;
+    bool sent = false;
+
+    SOS_buffer_unpack(message, &offset, "ii", &msg_size, &msg_type);
+    switch (msg_type) {
+    case SOS_MSG_TYPE_ANNOUNCE:
+    case SOS_MSG_TYPE_PUBLISH:
+    case SOS_MSG_TYPE_VAL_SNAPS:
+    case SOS_MSG_TYPE_PUB_FRAME:
+        // These are only ever ACK'ed.
+        is_ingest = true;
+        break;
+    case SOS_MSG_TYPE_ECHO:
+    case SOS_MSG_TYPE_PROBE:
+    case SOS_MSG_TYPE_MANIFEST:
+    case SOS_MSG_TYPE_QUERY:
+    case SOS_MSG_TYPE_CACHE_GRAB:
+    case SOS_MSG_TYPE_CACHE_SIZE:
+        // These change nothing in the daemon, so they can be sent twice.
+        is_idempotent = true;
+        break;
+    default:
+        break;
+    }
+
+    if (SOS->config.offline_test_mode == true) {
+        // There is no daemon to send to.
+        return;
+    }
+
+    if (SOS->shm_ring != NULL) {
+        if (is_ingest) {
+            // ...so over shared memory there is nothing to wait for.
+            if (SOS_shm_ring_write(SOS->shm_ring, message) == 0) {
+                return;
+            }
+        }
+        // Let the daemon catch up so it sees messages in order.
+        SOS_shm_ring_wait_drained(SOS->shm_ring);
+    }
+
     rc = SOS_target_connect(SOS->daemon);
     if (rc != 0) {
         dlog(0, "ERROR: Failed attempt to connect to target at %s:%s   (%d)\n",
@@ -848,19 +1052,77 @@ void SOS_send_to_daemon(SOS_buffer *message, SOS_buffer *reply ) {
                 SOS->daemon->remote_port,
                 rc);
         dlog(0, "ERROR: Ignoring transmission request and returning.\n");
+        __atomic_add_fetch(&SOS->daemon->losses, 1, __ATOMIC_RELAXED);
         return;
     }
 
+    // Under SOS_WIRE_NO_ACK only one ingest message in every window waits
+    // on its ACK.  The daemon works through a connection's messages in
+    // order, so that ACK, or the reply to anything else, also answers for
+    // every message sent since the last one.  This keeps a client from
+    // getting more than a window ahead of the daemon.
+    if ((is_ingest) && (SOS->daemon->wire_flags & SOS_WIRE_NO_ACK)) {
+        window = SOS->config.options->no_ack_window;
+        if ((SOS->daemon->credits > 0) && (SOS->daemon->credits < window)) {
+            window = SOS->daemon->credits;
+        }
+        SOS->daemon->unacked++;
+        if (SOS->daemon->unacked < window) {
+            want_ack = false;
+            SOS_buffer_packi32(message->data + sizeof(int),
+                    (msg_type | SOS_MSG_NO_ACK));
+        }
+    }
+
     rc = SOS_target_send_msg(SOS->daemon, message);
+    if (rc > 0) {
+        sent = true;
+        if (want_ack) {
+            rc = SOS_target_recv_msg(SOS->daemon, reply);
+        }
+    }
+
+    // A connection the daemon had already closed is caught before the
+    // send by SOS_target_connect().  Losing it here means the daemon may
+    // or may not have acted on the message, so it is only sent again if
+    // it did not get all the way out, or doing it twice is harmless.
+    if ((rc < 1) && (SOS->daemon->is_persistent)
+     && ((!sent) || (is_idempotent))) {
+        dlog(1, "Persistent connection to the daemon was lost,"
+                " reconnecting...  (%d unacknowledged)\n",
+                SOS->daemon->unacked);
+        rc = SOS_target_reconnect(SOS->daemon);
+        if (rc == 0) {
+            rc = SOS_target_send_msg(SOS->daemon, message);
+            if ((rc > 0) && (want_ack)) {
+                rc = SOS_target_recv_msg(SOS->daemon, reply);
+            }
+        } else {
+            rc = -1;
+        }
+    }
+
+    if ((rc > 0) && (want_ack)) {
+        SOS->daemon->unacked = 0;
+        if (SOS->config.options->backpressure) {
+            SOS_take_backpressure(SOS, reply);
+        }
+    }
+    if (!want_ack) {
+        // Hand the message back the way it came in.
+        SOS_buffer_packi32(message->data + sizeof(int), msg_type);
+    }
 
     if (rc < 1) {
         fprintf(stderr, "ERROR: Unable to send message to the SOS daemon.\n");
         fflush(stderr);
-        return;
+        __atomic_add_fetch(&SOS->daemon->losses, 1, __ATOMIC_RELAXED);
+        if (SOS->daemon->remote_socket_fd > -1) {
+            close(SOS->daemon->remote_socket_fd);
+            SOS->daemon->remote_socket_fd = -1;
+        }
     }
 
-    SOS_target_recv_msg(SOS->daemon, reply);
-
     SOS_target_disconnect(SOS->daemon);
 
     return;
@@ -880,12 +1142,25 @@ void SOS_finalize(SOS_runtime *sos_context) {
 
     SOS_SET_CONTEXT(sos_context, "SOS_finalize");
 
+    // Queued publishes still need to go out while sends are allowed.
+    if (SOS->task.coalesce != NULL) {
+        dlog(1, "Sending rate-limited publishes...\n");
+        SOS_coalesce_destroy(SOS);
+    }
+    if (SOS->task.async != NULL) {
+        dlog(1, "Flushing asynchronous publishes...\n");
+        SOS_async_destroy(SOS);
+    }
+
     // Any SOS threads will leave their loops next time they wake up.
     dlog(1, "SOS->status = SOS_STATUS_SHUTDOWN\n");
     SOS->status = SOS_STATUS_SHUTDOWN;
 
     if (SOS->role == SOS_ROLE_CLIENT) {
         dlog(1, "    Closing down client-related items...\n");
+        if (SOS->uid.my_guid_pool != NULL) {
+            SOS_uid_join_prefetch(SOS->uid.my_guid_pool);
+        }
         if (SOS->config.receives == SOS_RECEIVES_DIRECT_MESSAGES) {
             dlog(1, "  ... This client RECEIVES_DIRECT_MESSAGES:\n");
             dlog(1, "      ... establishing connection it self...\n");
@@ -932,9 +1207,22 @@ void SOS_finalize(SOS_runtime *sos_context) {
             //dlog(1, "      ... done joining threads.\n");
         }
 
+        if (SOS->shm_ring != NULL) {
+            dlog(1, "  ... Releasing shared-memory ring...\n");
+            // The daemon keeps its own mapping and drains what is left.
+            SOS->shm_ring->ctl->closed = 1;
+            SOS_shm_ring_destroy(SOS->shm_ring);
+            SOS->shm_ring = NULL;
+        }
+
         dlog(1, "  ... Removing send lock...\n");
         if (SOS->daemon != NULL) {
             pthread_mutex_lock(SOS->daemon->send_lock);
+            if (SOS->daemon->remote_socket_fd > -1) {
+                dlog(1, "  ... Closing persistent daemon connection...\n");
+                close(SOS->daemon->remote_socket_fd);
+                SOS->daemon->remote_socket_fd = -1;
+            }
             pthread_mutex_destroy(SOS->daemon->send_lock);
             free(SOS->daemon->send_lock);
         }
@@ -1132,29 +1420,79 @@ SOS_uid_init(SOS_runtime *sos_context,
     SOS_uid *id;
 
     dlog(3, "  ... allocating uid sets\n");
-    id = *id_var = (SOS_uid *) malloc(sizeof(SOS_uid));
-    id->next = (set_from > 0) ? set_from : 1;
-    id->last = (set_to   < SOS_DEFAULT_UID_MAX) ? set_to : SOS_DEFAULT_UID_MAX;
-    dlog(3, "     ... default set for uid range"
-            " (%" SOS_GUID_FMT " -> %" SOS_GUID_FMT ").\n",
-            id->next, id->last);
+    id = *id_var = (SOS_uid *) calloc(1, sizeof(SOS_uid));
+    id->sos_context = sos_context;
+    id->block       = NULL;
+    id->spare       = NULL;
+    id->low_water   = 0;
     dlog(3, "     ... initializing uid mutex.\n");
     id->lock = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
     pthread_mutex_init(id->lock, NULL );
+    id->prefetched = (pthread_cond_t *) malloc(sizeof(pthread_cond_t));
+    pthread_cond_init(id->prefetched, NULL);
 
-    id->sos_context = sos_context;
+    SOS_uid_set_block(id,
+            ((set_from > 0) ? set_from : 1),
+            ((set_to < SOS_DEFAULT_UID_MAX) ? set_to : SOS_DEFAULT_UID_MAX));
+    dlog(3, "     ... default set for uid range"
+            " (%" SOS_GUID_FMT " -> %" SOS_GUID_FMT ").\n",
+            id->block->next, id->block->last);
+
+    return;
+}
+
+
+void
+SOS_uid_set_block(SOS_uid *id, SOS_guid from, SOS_guid to) {
+    SOS_uid_block *block;
+
+    block = (SOS_uid_block *) malloc(sizeof(SOS_uid_block));
+    block->next    = from;
+    block->last    = to;
+    block->retired = (void *) id->block;
+    __atomic_store_n(&id->block, block, __ATOMIC_RELEASE);
+
+    return;
+}
+
+
+// Wait out a prefetch that is still talking to the daemon.
+static void
+SOS_uid_join_prefetch(SOS_uid *id) {
+    bool started;
+
+    pthread_mutex_lock(id->lock);
+    started = id->prefetch_started;
+    id->prefetch_started = false;
+    pthread_mutex_unlock(id->lock);
 
+    if (started) {
+        pthread_join(id->prefetcher, NULL);
+    }
     return;
 }
 
+
 void SOS_uid_destroy( SOS_uid *id ) {
     SOS_SET_CONTEXT(id->sos_context, "SOS_uid_destroy");
+    SOS_uid_block *block;
+
+    SOS_uid_join_prefetch(id);
 
     dlog(5, "  ... destroying uid mutex     &(%ld)\n", (long) &id->lock );
     pthread_mutex_lock( id->lock );
     pthread_mutex_destroy( id->lock );
+    pthread_cond_destroy(id->prefetched);
     dlog(5, "  ... freeing uid mutex space  &(%ld)\n", (long) &id->lock );
     free(id->lock);
+    free(id->prefetched);
+    dlog(5, "  ... freeing uid blocks\n");
+    while (id->block != NULL) {
+        block     = id->block;
+        id->block = (SOS_uid_block *) block->retired;
+        free(block);
+    }
+    if (id->spare != NULL) { free(id->spare); }
     dlog(5, "  ... freeing uid memory       &(%ld)\n", (long) id);
     memset(id, '\0', sizeof(SOS_uid));
     free(id);
@@ -1163,86 +1501,195 @@ void SOS_uid_destroy( SOS_uid *id ) {
 }
 
 
-SOS_guid
-SOS_uid_next( SOS_uid *id ) {
-    SOS_SET_CONTEXT(id->sos_context, "SOS_uid_next");
-    long next_serial;
-    if (id == NULL) { return -1; }
+// Ask the daemon for a fresh block of GUIDs.  Returns -1 if none came back.
+static int
+SOS_uid_request_block(SOS_uid *id, SOS_guid *from, SOS_guid *to) {
+    SOS_SET_CONTEXT(id->sos_context, "SOS_uid_request_block");
+    SOS_msg_header header;
+    SOS_buffer *buf;
+    SOS_buffer *reply;
+    int offset;
+    int rc;
 
-    dlog(7, "LOCK id->lock\n");
-    pthread_mutex_lock( id->lock );
+    if (SOS->config.offline_test_mode == true) {
+        return -1;
+    }
 
-    next_serial = id->next++;
+    buf = NULL;
+    SOS_buffer_init_sized_locking(SOS, &buf,
+            sizeof(SOS_msg_header), false);
 
-    if (id->next > id->last) {
-    // The assumption here is that we're dealing with a GUID, as the other
-    // 'local' uid ranges are so large as to effectively guarantee this case
-    // will not occur for them.
+    header.msg_size = -1;
+    header.msg_type = SOS_MSG_TYPE_GUID_BLOCK;
+    header.msg_from = SOS->my_guid;
+    header.ref_guid = 0;
 
-        if ((SOS->role == SOS_ROLE_LISTENER)
-                || (SOS->role == SOS_ROLE_AGGREGATOR)) {
-            // NOTE: There is no recourse if a sosd daemon runs out of GUIDs.
-            //       That should *never* happen.
-            dlog(0, "ERROR:  This sosd instance has run out of GUIDs!"
-                    "  Terminating.\n");
-            exit(EXIT_FAILURE);
-        } else {
-            // Acquire a fresh block of GUIDs from the sosd daemon...
-            //TODO:{MEMORY, THREADS} Race condition when requesting new
-            //GUID block during the middle of a receive from the daemon.
+    offset = 0;
+    SOS_msg_zip(buf, header, 0, &offset);
 
-             SOS_msg_header header;
-            SOS_buffer *buf;
-            int offset;
+    header.msg_size = offset;
+    offset = 0;
+    SOS_msg_zip(buf, header, 0, &offset);
 
-            buf = NULL;
-            SOS_buffer_init_sized_locking(SOS, &buf,
-                    sizeof(SOS_msg_header), false);
+    reply = NULL;
+    SOS_buffer_init_sized_locking(SOS, &reply,
+            SOS_DEFAULT_BUFFER_MAX, false);
 
-            dlog(1, "The last guid has been used from SOS->uid.my_guid_pool!"
-                    "  Requesting a new block...\n");
-            header.msg_size = -1;
-            header.msg_type = SOS_MSG_TYPE_GUID_BLOCK;
-            header.msg_from = SOS->my_guid;
-            header.ref_guid = 0;
+    SOS_send_to_daemon(buf, reply);
 
-            offset = 0;
-            SOS_msg_zip(buf, header, 0, &offset);
+    rc = -1;
+    offset = 0;
+    SOS_msg_unzip(reply, &header, 0, &offset);
+    if (header.msg_type == SOS_MSG_TYPE_GUID_BLOCK) {
+        SOS_buffer_unpack(reply, &offset, "g", from);
+        SOS_buffer_unpack(reply, &offset, "g", to);
+        if (*from <= *to) {
+            dlog(1, "  ... recieved a new guid block from %"
+                    SOS_GUID_FMT " to %" SOS_GUID_FMT ".\n", *from, *to);
+            rc = 0;
+        }
+    }
 
-            header.msg_size = offset;
-            offset = 0;
-            SOS_msg_zip(buf, header, 0, &offset);
+    SOS_buffer_destroy(buf);
+    SOS_buffer_destroy(reply);
 
-            SOS_buffer *reply;
+    return rc;
+}
 
-            reply = NULL;
-            SOS_buffer_init_sized_locking(SOS, &reply,
-                    SOS_DEFAULT_BUFFER_MAX, false);
 
-            SOS_send_to_daemon(buf, reply);
+static void*
+SOS_THREAD_uid_prefetch(void *args) {
+    SOS_uid *id = (SOS_uid *) args;
+    SOS_SET_CONTEXT(id->sos_context, "SOS_THREAD_uid_prefetch");
+    SOS_guid from;
+    SOS_guid to;
+    int      rc;
 
-            offset = 0;
-            SOS_msg_unzip(reply, &header, 0, &offset);
+    dlog(4, "Prefetching the next guid block...\n");
+    rc = SOS_uid_request_block(id, &from, &to);
 
-            if (SOS->config.offline_test_mode == true) {
-                //Do nothing.
-            } else {
-                // We are a normal client, move us to the next block.
-                SOS_buffer_unpack(reply, &offset, "g", &id->next);
-                SOS_buffer_unpack(reply, &offset, "g", &id->last);
-                dlog(1, "  ... recieved a new guid block from %"
-                        SOS_GUID_FMT " to %" SOS_GUID_FMT ".\n",
-                        id->next, id->last);
-            }
-            SOS_buffer_destroy(buf);
-            SOS_buffer_destroy(reply);
+    pthread_mutex_lock(id->lock);
+    if (rc == 0) {
+        id->spare = (SOS_uid_block *) malloc(sizeof(SOS_uid_block));
+        id->spare->next    = from;
+        id->spare->last    = to;
+        id->spare->retired = NULL;
+    } else {
+        dlog(1, "WARNING: Unable to prefetch a guid block, one will be"
+                " requested when this one runs out.\n");
+    }
+    id->prefetching = false;
+    pthread_cond_broadcast(id->prefetched);
+    pthread_mutex_unlock(id->lock);
+
+    return NULL;
+}
+
+
+// Only clients have anywhere to get another block from.
+// CONCURRENCY: Assumes id->lock is held.
+static void
+SOS_uid_start_prefetch(SOS_uid *id) {
+    SOS_SET_CONTEXT(id->sos_context, "SOS_uid_start_prefetch");
+    int rc;
+
+    if ((SOS->role != SOS_ROLE_CLIENT)
+     || (SOS->status != SOS_STATUS_RUNNING)
+     || (SOS->config.offline_test_mode == true)
+     || id->prefetching || (id->spare != NULL)) {
+        return;
+    }
+
+    if (id->prefetch_started) {
+        // The last one is done, prefetching is false.
+        pthread_join(id->prefetcher, NULL);
+    }
+    id->prefetching      = true;
+    id->prefetch_started = true;
+    rc = pthread_create(&id->prefetcher, NULL, SOS_THREAD_uid_prefetch,
+            (void *) id);
+    if (rc != 0) {
+        dlog(1, "WARNING: Unable to start the guid prefetch thread.  (%d)\n",
+                rc);
+        id->prefetching      = false;
+        id->prefetch_started = false;
+    }
+    return;
+}
+
+
+// The block ran out.  Move on to the prefetched one if it is here, or
+// ask the daemon for one right now.
+static void
+SOS_uid_next_block(SOS_uid *id, SOS_uid_block *used_up) {
+    SOS_SET_CONTEXT(id->sos_context, "SOS_uid_next_block");
+    SOS_guid from;
+    SOS_guid to;
+
+    pthread_mutex_lock(id->lock);
+
+    if ((SOS->role == SOS_ROLE_LISTENER)
+     || (SOS->role == SOS_ROLE_AGGREGATOR)) {
+        // NOTE: There is no recourse if a sosd daemon runs out of GUIDs.
+        //       That should *never* happen.
+        dlog(0, "ERROR:  This sosd instance has run out of GUIDs!"
+                "  Terminating.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // The block the prefetch is bringing back is the one to move on to.
+    while (id->prefetching && (id->block == used_up)) {
+        pthread_cond_wait(id->prefetched, id->lock);
+    }
+
+    if (id->block != used_up) {
+        // Another thread got here first.
+        pthread_mutex_unlock(id->lock);
+        return;
+    }
+
+    if (id->spare != NULL) {
+        dlog(4, "Moving on to the prefetched guid block.\n");
+        id->spare->retired = (void *) id->block;
+        __atomic_store_n(&id->block, id->spare, __ATOMIC_RELEASE);
+        id->spare = NULL;
+    } else {
+        dlog(1, "The last guid has been used from SOS->uid.my_guid_pool!"
+                "  Requesting a new block...\n");
+        if (SOS_uid_request_block(id, &from, &to) < 0) {
+            dlog(0, "ERROR: Unable to obtain a new block of GUIDs."
+                    "  Terminating.\n");
+            exit(EXIT_FAILURE);
         }
+        SOS_uid_set_block(id, from, to);
+    }
+
+    pthread_mutex_unlock(id->lock);
+    return;
+}
+
+
+SOS_guid
+SOS_uid_next( SOS_uid *id ) {
+    if (id == NULL) { return -1; }
+    SOS_uid_block *block;
+    SOS_guid       serial;
+
+    for (;;) {
+        block  = __atomic_load_n(&id->block, __ATOMIC_ACQUIRE);
+        serial = __atomic_fetch_add(&block->next, 1, __ATOMIC_RELAXED);
+        if (serial <= block->last) break;
+        SOS_uid_next_block(id, block);
     }
 
-    dlog(7, "UNLOCK id->lock\n");
-    pthread_mutex_unlock( id->lock );
+    // Exactly one caller draws the id at the mark, it starts the prefetch.
+    if ((id->low_water > 0) && ((block->last - serial) == id->low_water)) {
+        pthread_mutex_lock(id->lock);
+        SOS_uid_start_prefetch(id);
+        pthread_mutex_unlock(id->lock);
+    }
 
-    return next_serial;
+    return serial;
 }
 
 
@@ -1289,9 +1736,10 @@ SOS_pub_init_sized(SOS_runtime *sos_context,
     new_pub->thread_id    = 0;
     new_pub->comm_rank    = SOS->config.comm_rank;
     new_pub->pragma_len   = 0;
-    memset(new_pub->title, 0, SOS_DEFAULT_STRING_LEN);
-    strncpy(new_pub->title, title, SOS_DEFAULT_STRING_LEN);
+    new_pub->title        = SOS_intern_name(title);
     new_pub->announced           = 0;
+    new_pub->announced_count     = 0;
+    new_pub->announced_losses    = SOS_daemon_losses(SOS);
     new_pub->elem_count          = 0;
     new_pub->elem_max            = new_size;
     new_pub->meta.channel     = 0;
@@ -1301,6 +1749,17 @@ SOS_pub_init_sized(SOS_runtime *sos_context,
     new_pub->meta.scope_hint  = SOS_SCOPE_DEFAULT;
     new_pub->meta.retain_hint = SOS_RETAIN_DEFAULT;
     new_pub->cache_depth      = SOS->config.options->pub_cache_depth;
+    new_pub->async_publish    = SOS->config.options->async_publish;
+    new_pub->pack_staged      = SOS->config.options->pack_staging;
+    new_pub->stage_head       = NULL;
+    new_pub->coalesce         = SOS->config.options->publish_coalesce;
+    new_pub->aggregate        = SOS->config.options->publish_aggregate;
+    new_pub->pending          = NULL;
+    new_pub->summary          = NULL;
+    new_pub->pending_max      = 0;
+    new_pub->publish_usec     = SOS->config.options->publish_min_usec;
+    new_pub->last_publish     = 0.0;
+    new_pub->publish_deferred = false;
 
     dlog(6, "  ... constructing cache ring buffer.\n");
     int cache_alloc_size = 1;
@@ -1316,9 +1775,10 @@ SOS_pub_init_sized(SOS_runtime *sos_context,
 
     dlog(6, "  ... zero-ing out the strings.\n");
 
-    strncpy(new_pub->node_id, SOS->config.node_id, SOS_DEFAULT_STRING_LEN);
+    new_pub->node_id    = SOS_intern_name(SOS->config.node_id);
     new_pub->process_id = SOS->config.process_id;
-    strncpy(new_pub->prog_name, SOS->config.program_name, SOS_DEFAULT_STRING_LEN);
+    new_pub->prog_name  = SOS_intern_name(SOS->config.program_name);
+    new_pub->prog_ver   = SOS_intern("");
 
     dlog(6, "  ... allocating space for data elements.\n");
     new_pub->data                = malloc(sizeof(SOS_data *) * new_size);
@@ -1328,7 +1788,7 @@ SOS_pub_init_sized(SOS_runtime *sos_context,
         new_pub->data[i] = malloc(sizeof(SOS_data));
             memset(new_pub->data[i], '\0', sizeof(SOS_data));
             new_pub->data[i]->guid      = 0;
-            new_pub->data[i]->name[0]   = '\0';
+            new_pub->data[i]->name      = NULL;
             new_pub->data[i]->type      = SOS_VAL_TYPE_INT;
             new_pub->data[i]->val_len   = 0;
             new_pub->data[i]->val.l_val = 0;
@@ -1357,7 +1817,7 @@ SOS_pub_init_sized(SOS_runtime *sos_context,
     }
 
     dlog(6, "  ... initializing the name table for values.\n");
-    new_pub->name_table = qhashtbl(SOS_DEFAULT_TABLE_SIZE);
+    new_pub->name_table = SOS_name_index_create(SOS_NAME_INDEX_MIN_SIZE);
 
     dlog(6, "  ... done.\n");
     pthread_mutex_unlock(new_pub->lock);
@@ -1441,6 +1901,49 @@ void SOS_pub_config(SOS_pub *pub, SOS_pub_option opt, ...) {
         }
         break; //end: SOS_PUB_OPTION_CACHE
 
+    case SOS_PUB_OPTION_ASYNC:
+        // Nonzero: SOS_publish() hands off to the flush thread.
+        i = va_arg(ap, int);
+        pub->async_publish = (i != 0);
+        break; //end: SOS_PUB_OPTION_ASYNC
+
+    case SOS_PUB_OPTION_STAGED:
+        // Nonzero: packs are staged per thread until SOS_publish().
+        i = va_arg(ap, int);
+        pub->pack_staged = (i != 0);
+        break; //end: SOS_PUB_OPTION_STAGED
+
+    case SOS_PUB_OPTION_COALESCE:
+        // Nonzero: every value is coalesced between publishes.
+        i = va_arg(ap, int);
+        pub->coalesce = (i != 0);
+        break; //end: SOS_PUB_OPTION_COALESCE
+
+    case SOS_PUB_OPTION_RATE_LIMIT:
+        // Minimum usec between two sends of this pub, 0 for no limit.
+        i = va_arg(ap, int);
+        pub->publish_usec = (i > 0) ? i : 0;
+        break; //end: SOS_PUB_OPTION_RATE_LIMIT
+
+    case SOS_PUB_OPTION_AGGREGATE:
+        // Nonzero: fold COUNTER and SAMPLE values between publishes.
+        i = va_arg(ap, int);
+        pub->aggregate = (i != 0);
+        break; //end: SOS_PUB_OPTION_AGGREGATE
+
+    case SOS_PUB_OPTION_PROG_NAME:
+    case SOS_PUB_OPTION_PROG_VER:
+        // The pub's strings are interned, so they are set here rather
+        // than written to in place.  Goes out with the next announce.
+        c = va_arg(ap, char *);
+        if (opt == SOS_PUB_OPTION_PROG_NAME) {
+            SOS_intern_set(&pub->prog_name, c);
+        } else {
+            SOS_intern_set(&pub->prog_ver, c);
+        }
+        pub->announced = 0;
+        break; //end: SOS_PUB_OPTION_PROG_NAME / _PROG_VER
+
     default:
         dlog(1, "WARNING: Invalid option, doing nothing. (%d)\n", opt);
         pthread_mutex_unlock(pub->lock);
@@ -1480,7 +1983,7 @@ void SOS_expand_data( SOS_pub *pub ) {
         pub->data[n] = calloc(1, sizeof(SOS_data));
 
         pub->data[n]->guid      = 0;
-        pub->data[n]->name[0]   = '\0';
+        pub->data[n]->name      = NULL;
         pub->data[n]->type      = SOS_VAL_TYPE_INT;
         pub->data[n]->val_len   = 0;
         pub->data[n]->val.l_val = 0;
@@ -1620,6 +2123,50 @@ char* SOS_uint64_to_str(uint64_t val, char *result, int result_len) {
 
 
 
+// Put a value in the calling thread's stage, without pub->lock.  It gets
+// its place in the pub (by name, or by handle when name is NULL) once
+// SOS_publish() merges it.
+static int
+SOS_pack_staged(SOS_pub *pub, const char *name, SOS_pack_handle_t *handle,
+        long relation_id, SOS_val_type type, const void *val)
+{
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_pack_staged");
+    SOS_val_snap *snap;
+
+    switch (type) {
+    case SOS_VAL_TYPE_INT:
+    case SOS_VAL_TYPE_LONG:
+    case SOS_VAL_TYPE_DOUBLE:
+    case SOS_VAL_TYPE_STRING:
+        break;
+    default:
+        dlog(0, "ERROR: Type %s can not be packed into a staged pub.\n",
+                SOS_ENUM_STR(type, SOS_VAL_TYPE));
+        return -1;
+    }
+
+    snap = SOS_val_snap_alloc();
+    switch (type) {
+    case SOS_VAL_TYPE_INT:    snap->val.i_val = *(const int *)val;    break;
+    case SOS_VAL_TYPE_LONG:   snap->val.l_val = *(const long *)val;   break;
+    case SOS_VAL_TYPE_DOUBLE: snap->val.d_val = *(const double *)val; break;
+    default:                  SOS_val_snap_set_string(snap, (const char *)val);
+                              break;
+    }
+    snap->type        = type;
+    snap->relation_id = relation_id;
+    if (handle != NULL) {
+        snap->elem = handle->elem;
+        snap->guid = handle->guid;
+    }
+    SOS_TIME( snap->time.pack );
+
+    SOS_pack_stage_append(SOS_pack_stage_for_thread(pub), snap, name);
+
+    return 0;
+}
+
+
 int
 SOS_pack(SOS_pub *pub, const char *name,
         SOS_val_type type, const void *val)
@@ -1627,18 +2174,34 @@ SOS_pack(SOS_pub *pub, const char *name,
     SOS_SET_CONTEXT(pub->sos_context, "SOS_pack");
     int rc = -1;
 
-    SOS_val_snap *snap = calloc(1, sizeof(SOS_val_snap));
+    if (pub->pack_staged) {
+        return SOS_pack_staged(pub, name, NULL, 0, type, val);
+    }
+
+    SOS_val_snap *snap = SOS_val_snap_alloc();
     pthread_mutex_lock(pub->lock);
 
     rc = SOS_pack_snap_situate_in_pub(pub, snap, name, type, val);
-    if (rc < 0) { return rc; }
+    if (rc < 0) {
+        pthread_mutex_unlock(pub->lock);
+        SOS_val_snap_destroy(&snap);
+        return rc;
+    }
 
-    rc = SOS_pack_snap_renew_pub_data(pub, snap); if (rc < 0) { return rc; }
-    rc = SOS_pack_snap_add_to_pub_cache(pub, snap); if (rc < 0) { return rc; }
-    rc = SOS_pack_snap_into_val_queue(pub, snap); if (rc < 0) { return rc; }
+    rc = SOS_pack_snap_renew_pub_data(pub, snap);
+    if (rc >= 0) {
+        rc = SOS_pack_snap_add_to_pub_cache(pub, snap);
+    }
+    if (rc < 0) {
+        pthread_mutex_unlock(pub->lock);
+        SOS_val_snap_destroy(&snap);
+        return rc;
+    }
+    // The snap belongs to the queue from here on, even if this fails.
+    rc = SOS_pack_snap_into_val_queue(pub, snap);
 
     pthread_mutex_unlock(pub->lock);
-    return snap->elem;
+    return rc;
 }
 
 int
@@ -1648,22 +2211,439 @@ SOS_pack_related(SOS_pub *pub, long relation_id, const char *name,
     SOS_SET_CONTEXT(pub->sos_context, "SOS_pack");
     int rc = -1;
 
-    SOS_val_snap *snap = calloc(1, sizeof(SOS_val_snap));
+    if (pub->pack_staged) {
+        return SOS_pack_staged(pub, name, NULL, relation_id, type, val);
+    }
+
+    SOS_val_snap *snap = SOS_val_snap_alloc();
     pthread_mutex_lock(pub->lock);
 
     rc = SOS_pack_snap_situate_in_pub(pub, snap, name, type, val);
-    if (rc < 0) { return rc; }
+    if (rc < 0) {
+        pthread_mutex_unlock(pub->lock);
+        SOS_val_snap_destroy(&snap);
+        return rc;
+    }
 
     // Apply additional metadata:
     //
     snap->relation_id = relation_id;
     //
 
-    rc = SOS_pack_snap_renew_pub_data(pub, snap); if (rc < 0) { return rc; }
-    rc = SOS_pack_snap_add_to_pub_cache(pub, snap); if (rc < 0) { return rc; }
-    rc = SOS_pack_snap_into_val_queue(pub, snap); if (rc < 0) { return rc; }
-
+    rc = SOS_pack_snap_renew_pub_data(pub, snap);
+    if (rc >= 0) {
+        rc = SOS_pack_snap_add_to_pub_cache(pub, snap);
+    }
+    if (rc < 0) {
+        pthread_mutex_unlock(pub->lock);
+        SOS_val_snap_destroy(&snap);
+        return rc;
+    }
+    // The snap belongs to the queue from here on, even if this fails.
+    rc = SOS_pack_snap_into_val_queue(pub, snap);
+
+    pthread_mutex_unlock(pub->lock);
+    return rc;
+}
+
+
+// Pack a BYTES or array value held in ref.  The pub and the snap take
+// their own references.
+static int
+SOS_pack_ref(SOS_pub *pub, const char *name, SOS_val_type type,
+        SOS_bytes_ref *ref)
+{
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_pack_ref");
+    SOS_val_snap  *snap;
+    int            pos;
+    int            rc;
+
+    pthread_mutex_lock(pub->lock);
+
+    pos = SOS_pub_search(pub, name);
+    if ((pos >= 0) && (pub->data[pos]->type != type)) {
+        pthread_mutex_unlock(pub->lock);
+        dlog(0, "ERROR: \"%s\" is already in pub \"%s\" as %s.\n",
+                name, pub->title,
+                SOS_ENUM_STR(pub->data[pos]->type, SOS_VAL_TYPE));
+        return -1;
+    }
+
+    // Staged pubs take this path too, the payload is never copied into
+    // a stage.
+    snap = SOS_val_snap_alloc();
+    SOS_val_snap_set_bytes(snap, type, ref);
+
+    rc = SOS_pack_snap_place_in_pub(pub, snap, name, type);
+    SOS_pack_snap_renew_pub_data(pub, snap);
+    SOS_pack_snap_add_to_pub_cache(pub, snap);
+    SOS_pack_snap_into_val_queue(pub, snap);
+
+    pthread_mutex_unlock(pub->lock);
+    return rc;
+}
+
+
+int
+SOS_pack_bytes(SOS_pub *pub, const char *name, int byte_count,
+        const void *bytes, SOS_bytes_release_fn release, void *release_ctx)
+{
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_pack_bytes");
+    SOS_bytes_ref *ref;
+    int            rc;
+
+    if ((byte_count < 1) || (bytes == NULL)) {
+        dlog(0, "ERROR: Invalid value (%d bytes) for \"%s\".\n",
+                byte_count, name);
+        return -1;
+    }
+
+    ref = SOS_bytes_ref_create(bytes, byte_count, release, release_ctx);
+    rc  = SOS_pack_ref(pub, name, SOS_VAL_TYPE_BYTES, ref);
+    if (rc < 0) {
+        // Not taken, so the caller still owns the bytes.
+        ref->release = NULL;
+    }
+    SOS_bytes_ref_drop(ref);
+
+    return rc;
+}
+
+
+int
+SOS_pack_vector(SOS_pub *pub, const char *name, SOS_val_type type,
+        int elem_count, const void *values)
+{
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_pack_vector");
+    SOS_bytes_ref *ref;
+    int            rc;
+
+    if (!SOS_VAL_TYPE_IS_ARRAY(type)) {
+        dlog(0, "ERROR: SOS_pack_vector() needs an array type, not %s.\n",
+                SOS_ENUM_STR(type, SOS_VAL_TYPE));
+        return -1;
+    }
+    if ((elem_count < 1) || (values == NULL)) {
+        dlog(0, "ERROR: Invalid value (%d elements) for \"%s\".\n",
+                elem_count, name);
+        return -1;
+    }
+
+    ref = SOS_bytes_ref_create(values,
+            (elem_count * SOS_VAL_TYPE_ARRAY_ELEM_SIZE(type)), NULL, NULL);
+    rc  = SOS_pack_ref(pub, name, type, ref);
+    SOS_bytes_ref_drop(ref);
+
+    return rc;
+}
+
+
+static const void *
+SOS_pack_array_val(SOS_val_type type, const void *array, int index)
+{
+    switch (type) {
+    case SOS_VAL_TYPE_INT:    return (const void *) &((const int *) array)[index];
+    case SOS_VAL_TYPE_LONG:   return (const void *) &((const long *) array)[index];
+    case SOS_VAL_TYPE_DOUBLE: return (const void *) &((const double *) array)[index];
+    case SOS_VAL_TYPE_STRING: return (const void *) ((char * const *) array)[index];
+    default:                  return NULL;
+    }
+}
+
+
+int
+SOS_pack_array(SOS_pub *pub, const char **names,
+        int elem_count, SOS_val_type type, const void *array)
+{
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_pack_array");
+    SOS_val_snap **snap_list;
+    int i;
+    int rc;
+
+    if (elem_count < 1) { return 0; }
+
+    switch (type) {
+    case SOS_VAL_TYPE_INT:
+    case SOS_VAL_TYPE_LONG:
+    case SOS_VAL_TYPE_DOUBLE:
+    case SOS_VAL_TYPE_STRING:
+        break;
+    default:
+        dlog(0, "ERROR: Invalid type sent to SOS_pack_array."
+                " (%d)\n", (int) type);
+        return -1;
+    }
+
+    snap_list = (SOS_val_snap **) malloc(elem_count * sizeof(SOS_val_snap *));
+    SOS_val_snap_alloc_list(snap_list, elem_count);
+
+    pthread_mutex_lock(pub->lock);
+
+    for (i = 0; i < elem_count; i++) {
+        rc = SOS_pack_snap_situate_in_pub(pub, snap_list[i], names[i],
+                type, SOS_pack_array_val(type, array, i));
+        if (rc < 0) {
+            dlog(0, "ERROR: Unable to pack \"%s\", stopping at %d of %d.\n",
+                    names[i], i, elem_count);
+            break;
+        }
+        SOS_pack_snap_renew_pub_data(pub, snap_list[i]);
+        SOS_pack_snap_add_to_pub_cache(pub, snap_list[i]);
+    }
+    if (i > 0) {
+        SOS_pack_snap_list_into_val_queue(pub, snap_list, i);
+    }
+    // Anything past a failure was never queued:
+    SOS_val_snap_destroy_list(&snap_list[i], (elem_count - i));
+
     pthread_mutex_unlock(pub->lock);
+    free(snap_list);
+    return i;
+}
+
+
+// Add a new, still EMPTY, value [name] to the pub and return its position.
+// CONCURRENCY: Assumes pub->lock is held.
+static int
+SOS_pub_add_elem(SOS_pub *pub, const char *name, SOS_val_type type)
+{
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_pub_add_elem");
+    SOS_data *data;
+    int       pos;
+
+    // Check if we need to expand the pub
+    if (pub->elem_count >= pub->elem_max) {
+        SOS_expand_data(pub);
+    }
+
+    // Force a pub announce at the next SOS_publish().
+    pub->announced = 0;
+
+    // Add this new value [name] to the pub...
+    pos = pub->elem_count;
+    pub->elem_count++;
+
+    data = pub->data[pos];
+
+    // Set some defaults. These will get updated later...
+    data->type  = type;
+    data->guid  = SOS_uid_next(SOS->uid.my_guid_pool);
+    data->val.c_val = NULL;
+    data->val_len = 0;
+    SOS_intern_set(&data->name, name);
+
+    SOS_name_index_put(pub->name_table, name, pos);
+
+    return pos;
+}
+
+
+int
+SOS_pack_handle_get(SOS_pub *pub, const char *name,
+        SOS_val_type type, SOS_pack_handle_t *handle)
+{
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_pack_handle_get");
+    int pos;
+
+    handle->elem = -1;
+    handle->guid = 0;
+    handle->type = type;
+
+    switch (type) {
+    case SOS_VAL_TYPE_INT:
+    case SOS_VAL_TYPE_LONG:
+    case SOS_VAL_TYPE_DOUBLE:
+    case SOS_VAL_TYPE_STRING:
+        break;
+    default:
+        dlog(0, "ERROR: Handles can not be used to pack type %s.\n",
+                SOS_ENUM_STR(type, SOS_VAL_TYPE));
+        return -1;
+    }
+
+    pthread_mutex_lock(pub->lock);
+
+    pos = SOS_pub_search(pub, name);
+    if (pos < 0) {
+        pos = SOS_pub_add_elem(pub, name, type);
+    } else if (pub->data[pos]->type != type) {
+        dlog(0, "ERROR: \"%s\" was already packed as a %s, not a %s.\n",
+                name, SOS_ENUM_STR(pub->data[pos]->type, SOS_VAL_TYPE),
+                SOS_ENUM_STR(type, SOS_VAL_TYPE));
+        pthread_mutex_unlock(pub->lock);
+        return -1;
+    }
+
+    handle->elem = pos;
+    handle->guid = pub->data[pos]->guid;
+
+    pthread_mutex_unlock(pub->lock);
+    return pos;
+}
+
+
+int
+SOS_val_set_meta(SOS_pub *pub, const char *name,
+        SOS_val_freq freq, SOS_val_semantic semantic)
+{
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_val_set_meta");
+    int pos;
+
+    pthread_mutex_lock(pub->lock);
+
+    pos = SOS_pub_search(pub, name);
+    if (pos < 0) {
+        dlog(0, "ERROR: \"%s\" has not been packed into pub \"%s\".\n",
+                name, pub->title);
+        pthread_mutex_unlock(pub->lock);
+        return -1;
+    }
+
+    if ((pub->data[pos]->meta.freq != freq)
+     || (pub->data[pos]->meta.semantic != semantic)) {
+        pub->data[pos]->meta.freq     = freq;
+        pub->data[pos]->meta.semantic = semantic;
+        // Changed hints only reach the daemon in a full announce.
+        pub->announced       = 0;
+        pub->announced_count = 0;
+    }
+
+    pthread_mutex_unlock(pub->lock);
+    return pos;
+}
+
+
+// Fill in a snap for the value behind a handle, without touching the
+// name table.  Returns -1 if the handle does not belong to this pub.
+// CONCURRENCY: Assumes pub->lock is held.
+static int
+SOS_pack_snap_from_handle(SOS_pub *pub, SOS_val_snap *snap,
+        SOS_pack_handle_t handle, const void *val)
+{
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_pack_snap_from_handle");
+    SOS_data *data;
+
+    if ((handle.elem < 0) || (handle.elem >= pub->elem_count)
+     || (pub->data[handle.elem]->guid != handle.guid)) {
+        dlog(0, "ERROR: Invalid handle (elem %d) for pub \"%s\".\n",
+                handle.elem, pub->title);
+        return -1;
+    }
+    data = pub->data[handle.elem];
+
+    switch (handle.type) {
+    case SOS_VAL_TYPE_INT:    snap->val.i_val = *(const int *)val;    break;
+    case SOS_VAL_TYPE_LONG:   snap->val.l_val = *(const long *)val;   break;
+    case SOS_VAL_TYPE_DOUBLE: snap->val.d_val = *(const double *)val; break;
+    case SOS_VAL_TYPE_STRING: SOS_val_snap_set_string(snap, (const char *)val);
+                              break;
+    default:                  return -1;
+    }
+
+    snap->elem        = handle.elem;
+    snap->guid        = data->guid;
+    snap->pub_guid    = pub->guid;
+    snap->frame       = pub->frame;
+    snap->type        = data->type;
+
+    return snap->elem;
+}
+
+
+int
+SOS_pack_by_handle(SOS_pub *pub, SOS_pack_handle_t handle, const void *val)
+{
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_pack_by_handle");
+    SOS_val_snap *snap;
+
+    if (pub->pack_staged) {
+        if (SOS_pack_staged(pub, NULL, &handle, 0, handle.type, val) < 0) {
+            return -1;
+        }
+        return handle.elem;
+    }
+
+    snap = SOS_val_snap_alloc();
+    pthread_mutex_lock(pub->lock);
+
+    if (SOS_pack_snap_from_handle(pub, snap, handle, val) < 0) {
+        pthread_mutex_unlock(pub->lock);
+        SOS_val_snap_destroy(&snap);
+        return -1;
+    }
+
+    SOS_pack_snap_renew_pub_data(pub, snap);
+    SOS_pack_snap_add_to_pub_cache(pub, snap);
+    SOS_pack_snap_into_val_queue(pub, snap);
+
+    pthread_mutex_unlock(pub->lock);
+    return handle.elem;
+}
+
+
+int
+SOS_pack_array_by_handle(SOS_pub *pub, const SOS_pack_handle_t *handles,
+        int elem_count, const void *array)
+{
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_pack_array_by_handle");
+    SOS_val_snap **snap_list;
+    int i;
+
+    if (elem_count < 1) { return 0; }
+
+    snap_list = (SOS_val_snap **) malloc(elem_count * sizeof(SOS_val_snap *));
+    SOS_val_snap_alloc_list(snap_list, elem_count);
+
+    pthread_mutex_lock(pub->lock);
+
+    for (i = 0; i < elem_count; i++) {
+        if ((handles[i].type != handles[0].type)
+         || (SOS_pack_snap_from_handle(pub, snap_list[i], handles[i],
+                SOS_pack_array_val(handles[0].type, array, i)) < 0)) {
+            dlog(0, "ERROR: Bad handle, stopping at %d of %d.\n",
+                    i, elem_count);
+            break;
+        }
+        SOS_pack_snap_renew_pub_data(pub, snap_list[i]);
+        SOS_pack_snap_add_to_pub_cache(pub, snap_list[i]);
+    }
+    if (i > 0) {
+        SOS_pack_snap_list_into_val_queue(pub, snap_list, i);
+    }
+    // Anything past a failure was never queued:
+    SOS_val_snap_destroy_list(&snap_list[i], (elem_count - i));
+
+    pthread_mutex_unlock(pub->lock);
+    free(snap_list);
+    return i;
+}
+
+
+// Give a snap that already holds its value a place in the pub, adding the
+// value to the pub if needed.
+// CONCURRENCY: Assumes pub->lock is held.
+static int
+SOS_pack_snap_place_in_pub(SOS_pub *pub, SOS_val_snap *snap,
+        const char *name, SOS_val_type type)
+{
+    SOS_data *data;
+
+    // SOS_pub_search() returns the pub->data[] index, or -1 if the value
+    //   is not in the pub yet.
+    int pos = SOS_pub_search(pub, name);
+
+    if (pos < 0) {
+        // Value does NOT EXIST in the pub.
+        pos = SOS_pub_add_elem(pub, name, type);
+    }
+    data = pub->data[pos];
+
+    snap->elem        = pos;
+    snap->guid        = data->guid;
+    snap->pub_guid    = pub->guid;
+    snap->frame       = pub->frame;
+    snap->type        = data->type;
+
     return snap->elem;
 }
 
@@ -1678,8 +2658,7 @@ int SOS_pack_snap_situate_in_pub(SOS_pub *pub, SOS_val_snap *snap,
     case SOS_VAL_TYPE_INT:    snap->val.i_val = *(int *)val;    break;
     case SOS_VAL_TYPE_LONG:   snap->val.l_val = *(long *)val;   break;
     case SOS_VAL_TYPE_DOUBLE: snap->val.d_val = *(double *)val; break;
-    case SOS_VAL_TYPE_STRING: snap->val.c_val = strdup((char *)val);
-                              snap->val_len   = strlen(snap->val.c_val);
+    case SOS_VAL_TYPE_STRING: SOS_val_snap_set_string(snap, (const char *)val);
                               break;
     case SOS_VAL_TYPE_BYTES:
         fprintf(stderr, "WARNING: SOS_pack(...) used to pack SOS_VAL_TYPE_BYTES."
@@ -1691,6 +2670,13 @@ int SOS_pack_snap_situate_in_pub(SOS_pub *pub, SOS_val_snap *snap,
         return -1;
         break;
 
+    case SOS_VAL_TYPE_INT_ARRAY:
+    case SOS_VAL_TYPE_LONG_ARRAY:
+    case SOS_VAL_TYPE_DOUBLE_ARRAY:
+        dlog(0, "ERROR: Arrays are packed with SOS_pack_vector().\n");
+        return -1;
+        break;
+
     default:
         dlog(0, "ERROR: Invalid type sent to SOS_pack."
                 " (%d)\n", (int) type);
@@ -1698,55 +2684,7 @@ int SOS_pack_snap_situate_in_pub(SOS_pub *pub, SOS_val_snap *snap,
         break;
     }
 
-    // NOTE: Regarding indexing...
-    // The hash table will return NULL if a value is not present.
-    // The pub->data[elem] index is zero-indexed, so indices are stored +1, to
-    //   differentiate between empty and the first position.  The value
-    //   returned by SOS_pub_search() is the actual array index to be used.
-    int pos = SOS_pub_search(pub, name);
-
-    SOS_data *data;
-
-    if (pos < 0) {
-        // Value does NOT EXIST in the pub.
-        // Check if we need to expand the pub
-        if (pub->elem_count >= pub->elem_max) {
-            SOS_expand_data(pub);
-        }
-
-        // Force a pub announce at the next SOS_publish().
-        pub->announced = 0;
-
-        // Add this new value [name] to the pub...
-        pos = pub->elem_count;
-        pub->elem_count++;
-
-        // REMINDER: (pos + 1) is correct.
-        // We're storing it's "N'th element" position
-        // rather than it's array index.
-        // See SOS_pub_search(...) for details.
-        pub->name_table->put(pub->name_table, name,
-                (void *) ((long)(pos + 1)));
-
-        data = pub->data[pos];
-
-        // Set some defaults. These will get updated later...
-        data->type  = type;
-        data->guid  = SOS_uid_next(SOS->uid.my_guid_pool);
-        data->val.c_val = NULL;
-        data->val_len = 0;
-        strncpy(data->name, name, SOS_DEFAULT_STRING_LEN);
-
-    } else {
-        // Name ALREADY EXISTS in the pub...
-        data = pub->data[pos];
-    }
-
-    snap->elem        = pos;
-    snap->guid        = data->guid;
-    snap->pub_guid    = pub->guid;
-    snap->frame       = pub->frame;
-    snap->type        = data->type;
+    SOS_pack_snap_place_in_pub(pub, snap, name, type);
 
     // The value has already been put in the snap at the top of the function.
     // We leave with the correct placement and guid of this value, and a snap
@@ -1761,37 +2699,40 @@ int SOS_pack_snap_renew_pub_data(SOS_pub *pub, SOS_val_snap *snap) {
 
     // Update the value in the pub->data[elem] position.
     SOS_data *data = pub->data[snap->elem];
+    SOS_bytes_ref *old_ref;
 
     switch(snap->type) {
 
     case SOS_VAL_TYPE_STRING:
-        if (data->val.c_val != NULL) {
-            free(data->val.c_val);
-        }
+        // The pub shares the snap's interned string.
+        SOS_intern_drop(data->val.c_val);
         if (snap->val.c_val != NULL) {
-            data->val.c_val = strndup(snap->val.c_val, SOS_DEFAULT_STRING_LEN);
-            data->val_len   = strlen(snap->val.c_val);
+            data->val.c_val = SOS_intern_retain(snap->val.c_val);
+            data->val_len   = snap->val_len;
         } else {
             dlog(0, "WARNING: You packed a null value for pub(%s)->data[%d]!\n",
                  pub->title, snap->elem);
-            data->val.c_val = (char *) malloc(1 * sizeof(unsigned char));
-            *data->val.c_val = '\0';
+            data->val.c_val = SOS_intern("");
             data->val_len = 0;
         }
         break;
 
     case SOS_VAL_TYPE_BYTES:
-        //Should not be able to get here...
-        fprintf(stderr, "ERROR: SOS_VAL_TYPE_BYTES was used in SOS_pack(...)."
-                " This is unsupported.\n"
-                "ERROR: Please use SOS_pack_bytes(...) instead.\n"
-                "ERROR: Somehow libsos passed beyond its safety"
-                " guard and has\n"
-                "ERROR: modified the state of the publication handle.\n"
-                "ERROR: Since safety/consistency can no longer be guaranteed,\n"
-                "ERROR: SOS will now terminate. Please update your code.\n");
-        fflush(stderr);
-        exit(EXIT_FAILURE);
+    case SOS_VAL_TYPE_INT_ARRAY:
+    case SOS_VAL_TYPE_LONG_ARRAY:
+    case SOS_VAL_TYPE_DOUBLE_ARRAY:
+        // The pub shares the snap's bytes rather than copying them.
+        old_ref = data->bytes_ref;
+        if (snap->bytes_ref != NULL) {
+            SOS_bytes_ref_retain(snap->bytes_ref);
+            data->bytes_ref = snap->bytes_ref;
+        } else {
+            data->bytes_ref = SOS_bytes_ref_create(snap->val.bytes,
+                    snap->val_len, NULL, NULL);
+        }
+        SOS_bytes_ref_drop(old_ref);
+        data->val.bytes = data->bytes_ref->bytes;
+        data->val_len   = data->bytes_ref->len;
         break;
 
     case SOS_VAL_TYPE_INT:
@@ -1851,15 +2792,7 @@ int SOS_pack_snap_list_into_pub_cache(SOS_pub *pub, SOS_val_snap **snap_list) {
     }
 
     // Free up any existing entries before inserting the new list:
-    SOS_val_snap *snap;
-    SOS_val_snap *next_snap;
-
-    snap = pub->cache[insert_pos];
-    while (snap != NULL) {
-       SOS_val_snap *next_snap = snap->next_snap;
-       SOS_val_snap_destroy(&snap);
-       snap = next_snap;
-    }
+    SOS_val_snap_destroy_chain(pub->cache[insert_pos]);
 
     // Emplace this new list:
     pub->cache[insert_pos] = snap_list[0];
@@ -1902,32 +2835,17 @@ int SOS_pack_snap_add_to_pub_cache(SOS_pub *pub, SOS_val_snap *snap) {
     //       because these two snaps have different lifecycles.
     dlog(8, "pub->cache_depth == %d\n", pub->cache_depth);
     // ...
-    SOS_val_snap *snap_copy =
-        (SOS_val_snap *) calloc(1, sizeof(SOS_val_snap));
-    // Copy all the static member values of the snap:
-    memcpy(snap_copy, snap, sizeof(SOS_val_snap));
-    // Strings and Bytes need to be alloc'ed and copied in seperately:
-    switch (snap_copy->type) {
-        case SOS_VAL_TYPE_STRING:
-            snap_copy->val.c_val =
-                (char *) calloc(snap_copy->val_len, sizeof(char));
-            memcpy(snap_copy->val.c_val, snap->val.c_val, snap_copy->val_len);
-            break;
-        case SOS_VAL_TYPE_BYTES:
-            snap_copy->val.bytes =
-                (void *) calloc(snap_copy->val_len, sizeof(unsigned char));
-            memcpy(snap_copy->val.bytes, snap->val.bytes, snap_copy->val_len);
-            break;
-    }
+    SOS_val_snap *snap_copy = SOS_val_snap_alloc();
+    SOS_val_snap_copy(snap_copy, snap);
 
     // Now that we have a copy, let's timestamp it:
     SOS_TIME(snap_copy->time.recv);
 
     // We have a new snap, push it down into the cache in the current frame.
-    snap->next_snap = pub->cache[pub->cache_head];
-    snap->prev_snap = NULL;
+    snap_copy->next_snap = pub->cache[pub->cache_head];
+    snap_copy->prev_snap = NULL;
     //
-    pub->cache[pub->cache_head] = snap;
+    pub->cache[pub->cache_head] = snap_copy;
 
     // Done.
     return snap->elem;
@@ -1935,6 +2853,7 @@ int SOS_pack_snap_add_to_pub_cache(SOS_pub *pub, SOS_val_snap *snap) {
 
 int SOS_pack_snap_into_val_queue(SOS_pub *pub, SOS_val_snap *snap) {
     SOS_SET_CONTEXT(pub->sos_context, "SOS_pack_snap_into_val_queue");
+    int elem;
 
     if (pub->snap_queue == NULL) {
         dlog(0, "WARNING: Tried to pack a snap into a pub->snap_queue"
@@ -1944,6 +2863,12 @@ int SOS_pack_snap_into_val_queue(SOS_pub *pub, SOS_val_snap *snap) {
         return snap->elem;
     }
 
+    elem = snap->elem;
+    if (SOS_coalesce_snap(pub, snap)) {
+        // The snap may already be gone.
+        return elem;
+    }
+
     pthread_mutex_lock(pub->snap_queue->sync_lock);
     pipe_push(pub->snap_queue->intake, (void *) &snap, 1);
     pub->snap_queue->elem_count++;
@@ -1952,50 +2877,43 @@ int SOS_pack_snap_into_val_queue(SOS_pub *pub, SOS_val_snap *snap) {
     return snap->elem;
 }
 
-void SOS_val_snap_destroy(SOS_val_snap **snap_var) {
-    SOS_val_snap *snap = *snap_var;
+int SOS_pack_snap_list_into_val_queue(SOS_pub *pub,
+        SOS_val_snap **snap_list, int count)
+{
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_pack_snap_list_into_val_queue");
+    int queued;
+    int i;
 
-    if (snap == NULL) {
-        return;
+    if (pub->snap_queue == NULL) {
+        dlog(0, "WARNING: Tried to pack snaps into a pub->snap_queue"
+                " that is NULL.  Doing nothing.\n");
+        return 0;
     }
 
-    switch (snap->type) {
-        case SOS_VAL_TYPE_STRING:
-            if (snap->val.c_val != NULL) {
-                free(snap->val.c_val);
-            }
-            break;
-        case SOS_VAL_TYPE_BYTES:
-            if (snap->val.bytes != NULL) {
-                free(snap->val.bytes);
-            }
-            break;
-
+    queued = 0;
+    for (i = 0; i < count; i++) {
+        if (!SOS_coalesce_snap(pub, snap_list[i])) {
+            snap_list[queued++] = snap_list[i];
+        }
     }
-    memset(snap, 0, sizeof(SOS_val_snap));
-    free(snap);
-    *snap_var = NULL;
-    return;
+    if (queued == 0) {
+        return count;
+    }
+
+    pthread_mutex_lock(pub->snap_queue->sync_lock);
+    pipe_push(pub->snap_queue->intake, (void *) snap_list, queued);
+    pub->snap_queue->elem_count += queued;
+    pthread_mutex_unlock(pub->snap_queue->sync_lock);
+
+    return count;
 }
 
 
 int
 SOS_pub_search(SOS_pub *pub, const char *name)
 {
-    long i;
-
-    i = (long) pub->name_table->get(pub->name_table, name);
-
-    // NOTE: Regarding indexing...
-    // If the name does not exist, i==0... since the data elements are
-    // zero-indexed, we subtract 1 from i so that 'does not exist' is
-    // returned as -1. This is accounted for when values are initially
-    // packed, as the name is added to the name_table with the index being
-    // (i + 1)'ed.
-
-    i--;
-
-    return i;
+    // Returns -1 (SOS_NAME_INDEX_NOT_FOUND) if the name does not exist.
+    return SOS_name_index_get(pub->name_table, name);
 }
 
 
@@ -2003,7 +2921,9 @@ void
 SOS_pub_destroy(SOS_pub *pub)
 {
     SOS_SET_CONTEXT(pub->sos_context, "SOS_pub_destroy");
+    SOS_val_snap **snap_list;
     int elem;
+    int count;
 
     if (SOS->config.offline_test_mode != true) {
         // TODO: { PUB DESTROY } Right now this only works in offline test mode
@@ -2015,31 +2935,59 @@ SOS_pub_destroy(SOS_pub *pub)
 
     if (pub == NULL) { return; }
 
+    SOS_async_forget_pub(pub);
+    SOS_coalesce_forget_pub(pub);
+
     _sos_lock_pub(pub,__func__);
 
     dlog(6, "Freeing pub components:\n");
+    dlog(6, "  ... pack stages\n");
+    SOS_pack_stage_destroy_all(pub);
+    dlog(6, "  ... coalesced snaps\n");
+    for (elem = 0; elem < pub->pending_max; elem++) {
+        if (pub->pending[elem] != NULL) {
+            SOS_val_snap_destroy(&pub->pending[elem]);
+        }
+    }
+    free(pub->pending);
+    free(pub->summary);
     dlog(6, "  ... snapshot queue\n");
     pthread_mutex_lock(pub->snap_queue->sync_lock);
+    // Unsent snaps still hold references to their strings and bytes:
+    if (pub->snap_queue->elem_count > 0) {
+        snap_list = (SOS_val_snap **)
+            malloc(pub->snap_queue->elem_count * sizeof(SOS_val_snap *));
+        count = pipe_pop(pub->snap_queue->outlet, (void *) snap_list,
+                pub->snap_queue->elem_count);
+        SOS_val_snap_destroy_list(snap_list, count);
+        free(snap_list);
+        pub->snap_queue->elem_count = 0;
+    }
+    pthread_mutex_unlock(pub->snap_queue->sync_lock);
     pthread_mutex_destroy(pub->snap_queue->sync_lock);
     pipe_producer_free(pub->snap_queue->intake);
     pipe_consumer_free(pub->snap_queue->outlet);
     dlog(6, "  ... element data: ");
     for (elem = 0; elem < pub->elem_max; elem++) {
         if (pub->data[elem]->type == SOS_VAL_TYPE_STRING) {
-            if (pub->data[elem]->val.c_val != NULL) {
-                 free(pub->data[elem]->val.c_val);
-            }
-
+            SOS_intern_drop(pub->data[elem]->val.c_val);
         }
+        SOS_intern_drop(pub->data[elem]->name);
+        SOS_bytes_ref_drop(pub->data[elem]->bytes_ref);
         if (pub->data[elem] != NULL) { free(pub->data[elem]); }
     }
     dlog(6, "done. (%d element capacity)\n", pub->elem_max);
     dlog(6, "  ... element pointer array\n");
     if (pub->data != NULL) { free(pub->data); }
     dlog(6, "  ... name table\n");
-    pub->name_table->free(pub->name_table);
+    SOS_name_index_destroy(pub->name_table);
     dlog(6, "  ... lock\n");
     pthread_mutex_destroy(pub->lock);
+    dlog(6, "  ... strings\n");
+    SOS_intern_drop(pub->node_id);
+    SOS_intern_drop(pub->prog_name);
+    SOS_intern_drop(pub->prog_ver);
+    SOS_intern_drop(pub->title);
     dlog(6, "  ... pub handle itself\n");
     if (pub != NULL) { free(pub); }
     dlog(6, "  done.\n");
@@ -2071,8 +3019,11 @@ SOS_val_snap_queue_to_buffer(
     SOS_SET_CONTEXT(pub->sos_context, "SOS_val_snap_queue_to_buffer");
     SOS_msg_header header;
     SOS_val_snap *snap;
+    SOS_val_snap  prev;
     char pack_fmt[SOS_DEFAULT_STRING_LEN] = {0};
+    bool compact;
     int offset;
+    int start;
     int count;
 
     pthread_mutex_lock(pub->snap_queue->sync_lock);
@@ -2080,7 +3031,6 @@ SOS_val_snap_queue_to_buffer(
     if (pub->snap_queue->elem_count < 1) {
         dlog(4, "  ... nothing to do for pub(%s)\n", pub->guid_str);
         pthread_mutex_unlock(pub->snap_queue->sync_lock);
-        _sos_unlock_pub(pub,__func__);
         return;
     }
 
@@ -2108,10 +3058,17 @@ SOS_val_snap_queue_to_buffer(
     header.msg_from = SOS->my_guid;
     header.ref_guid = pub->guid;
 
-    offset = 0;
-    SOS_msg_zip(buffer, header, 0, &offset);
+    start = buffer->len;
+    offset = start;
+    SOS_msg_zip(buffer, header, start, &offset);
 
-    SOS_buffer_pack(buffer, &offset, "i", snap_count);
+    // A negative count marks the compact encoding, which daemons that
+    // predate it read as an empty message rather than as garbage.
+    compact = ((SOS->daemon != NULL)
+        && (SOS->daemon->wire_flags & SOS_WIRE_COMPACT_SNAPS));
+    memset(&prev, 0, sizeof(SOS_val_snap));
+    SOS_buffer_pack(buffer, &offset, "i",
+            (compact ? -snap_count : snap_count));
 
     dlog(6, "     ... processing snaps extracted from the queue\n");
 
@@ -2122,30 +3079,20 @@ SOS_val_snap_queue_to_buffer(
 
         SOS_TIME(snap->time.send);
 
-        SOS_buffer_pack(buffer, &offset, "iggiiidddl",
-                        snap->elem,
-                        snap->guid,
-                        snap->relation_id,
-                        snap->semantic,
-                        snap->type,
-                        snap->val_len,
-                        snap->time.pack,
-                        snap->time.send,
-                        snap->time.recv,
-                        snap->frame);
+        // The receiver reads the value by snap->type, so that is what
+        // decides how it goes out here, too.
+        if (compact) {
+            SOS_record_pack_snap_delta(buffer, &offset, snap, &prev);
+        } else {
+            SOS_record_pack_snap(buffer, &offset, snap);
+        }
 
-        switch (pub->data[snap->elem]->type) {
+        switch (snap->type) {
 
         case SOS_VAL_TYPE_INT:
-            SOS_buffer_pack(buffer, &offset, "i", snap->val.i_val);
-            break;
-
         case SOS_VAL_TYPE_LONG:
-            SOS_buffer_pack(buffer, &offset, "l", snap->val.l_val);
-            break;
-
         case SOS_VAL_TYPE_DOUBLE:
-            SOS_buffer_pack(buffer, &offset, "d", snap->val.d_val);
+            // Packed with the record.
             break;
 
         case SOS_VAL_TYPE_STRING:
@@ -2155,29 +3102,33 @@ SOS_val_snap_queue_to_buffer(
         case SOS_VAL_TYPE_BYTES:
             SOS_buffer_pack_bytes(buffer, &offset,
                     snap->val_len, snap->val.bytes);
+            break;
+
+        case SOS_VAL_TYPE_INT_ARRAY:
+        case SOS_VAL_TYPE_LONG_ARRAY:
+        case SOS_VAL_TYPE_DOUBLE_ARRAY:
+            SOS_buffer_pack_array(buffer, &offset, snap->type,
+                    (snap->val_len / SOS_VAL_TYPE_ARRAY_ELEM_SIZE(snap->type)),
+                    snap->val.bytes);
+            break;
 
         default:
             dlog(0, "ERROR: Invalid type (%d) at index %d of"
                     " pub->guid == %" SOS_GUID_FMT ".\n",
-                    pub->data[snap->elem]->type,
+                    snap->type,
                     snap->elem,
                     pub->guid);
             break;
         }//switch
-
-        if (destroy_snaps == true) {
-            if (pub->data[snap->elem]->type == SOS_VAL_TYPE_STRING) {
-                free(snap->val.c_val);
-            } else if (pub->data[snap->elem]->type == SOS_VAL_TYPE_BYTES) {
-                free(snap->val.bytes);
-            }
-            free(snap);
-        }
     }//for
 
-    header.msg_size = offset;
-    offset = 0;
-    SOS_msg_zip(buffer, header, 0, &offset);
+    if (destroy_snaps == true) {
+        SOS_val_snap_destroy_list(snap_list, snap_count);
+    }
+    free(snap_list);
+
+    header.msg_size = offset - start;
+    SOS_msg_seal(buffer, header, start, &offset);
 
     dlog(6, "     ... done   (buf_len == %d)\n", header.msg_size);
 
@@ -2194,8 +3145,13 @@ SOS_val_snap_queue_from_buffer(
     SOS_SET_CONTEXT(buffer->sos_context, "SOS_val_snap_queue_from_buffer");
     SOS_msg_header header;
     char           unpack_fmt[SOS_DEFAULT_STRING_LEN] = {0};
+    SOS_val_snap   prev;
+    bool           compact;
     int            offset;
+    int            peek;
+    int            elem_count;
     int            string_len;
+    int            rc;
 
     if (pub == NULL) {
         dlog(0, "WARNING! Attempting to build snap_queue for a"
@@ -2220,6 +3176,19 @@ SOS_val_snap_queue_from_buffer(
     int snap_count = 0;
     SOS_buffer_unpack(buffer, &offset, "i", &snap_count);
 
+    // See SOS_val_snap_queue_to_buffer() for the compact encoding.
+    compact = (snap_count < 0);
+    if (compact) {
+        snap_count = -snap_count;
+    }
+    memset(&prev, 0, sizeof(SOS_val_snap));
+
+    if (snap_count > (buffer->len - offset)) {
+        dlog(0, "ERROR: Message claims %d val_snaps in %d bytes."
+                "  Ignoring it.\n", snap_count, (buffer->len - offset));
+        return;
+    }
+
     if (snap_count < 1) {
       dlog(1, "WARNING: Attempted to process buffer with ZERO val_snaps."
               " This is unusual.\n");
@@ -2246,23 +3215,25 @@ SOS_val_snap_queue_from_buffer(
     }
 
     for (snap_index = 0; snap_index < snap_count; snap_index++) {
-        snap_list[snap_index]
-                = (SOS_val_snap *) calloc(1, sizeof(SOS_val_snap));
+        snap_list[snap_index] = SOS_val_snap_alloc();
         snap = snap_list[snap_index];
 
         snap->pub_guid = pub->guid;
 
-        SOS_buffer_unpack(buffer, &offset, "iggiiidddl",
-                          &snap->elem,
-                          &snap->guid,
-                          &snap->relation_id,
-                          &snap->semantic,
-                          &snap->type,
-                          &snap->val_len,
-                          &snap->time.pack,
-                          &snap->time.send,
-                          &snap->time.recv,
-                          &snap->frame);
+        if (compact) {
+            rc = SOS_record_unpack_snap_delta(buffer, &offset, snap, &prev);
+        } else {
+            rc = SOS_record_unpack_snap(buffer, &offset, snap);
+        }
+        if (rc < 0) {
+            dlog(0, "ERROR: Truncated val_snap %d of %d at offset %d of"
+                    " pub->guid == %" SOS_GUID_FMT ".  Keeping the"
+                    " snaps before it.\n", snap_index, snap_count,
+                    offset, pub->guid);
+            SOS_val_snap_destroy(&snap_list[snap_index]);
+            snap_count = snap_index;
+            break;
+        }
 
         dlog(6, "    ... grabbing element[%d] @ %d/%d(%d) -> type"
                 " == %d, val_len == %d\n",
@@ -2276,21 +3247,19 @@ SOS_val_snap_queue_from_buffer(
         switch (snap->type) {
 
         case SOS_VAL_TYPE_INT:
-            SOS_buffer_unpack(buffer, &offset, "i", &snap->val.i_val);
-            break;
-
         case SOS_VAL_TYPE_LONG:
-            SOS_buffer_unpack(buffer, &offset, "l", &snap->val.l_val);
-            break;
-
         case SOS_VAL_TYPE_DOUBLE:
-            SOS_buffer_unpack(buffer, &offset, "d", &snap->val.d_val);
+            // Unpacked with the record.
             break;
 
         case SOS_VAL_TYPE_STRING:
-            // add one byte for the null terminator.
-            snap->val.c_val = (char *) calloc(sizeof(char), snap->val_len+1);
-            SOS_buffer_unpack(buffer, &offset, "s", snap->val.c_val);
+            snap->val.c_val = NULL;
+            snap->val_len   = SOS_intern_unpack(buffer, &offset,
+                    &snap->val.c_val);
+            if (snap->val_len < 0) {
+                snap->val.c_val = SOS_intern("");
+                snap->val_len   = 0;
+            }
             break;
 
         case SOS_VAL_TYPE_BYTES:
@@ -2301,9 +3270,28 @@ SOS_val_snap_queue_from_buffer(
             offset -= rewind_amt;
             snap->val_len = byte_count;
             snap->val.bytes = (unsigned char *)
-                    calloc(sizeof(unsigned char), (byte_count + 1));
+                    SOS_val_snap_payload(snap, (byte_count + 1));
+            memset(snap->val.bytes, 0, (byte_count + 1));
             SOS_buffer_unpack(buffer, &offset, "b", snap->val.bytes);
             break;
+
+        case SOS_VAL_TYPE_INT_ARRAY:
+        case SOS_VAL_TYPE_LONG_ARRAY:
+        case SOS_VAL_TYPE_DOUBLE_ARRAY:
+            elem_count = 0;
+            peek = offset;
+            SOS_buffer_unpack(buffer, &peek, "i", &elem_count);
+            if ((elem_count < 0) || (elem_count > (buffer->len - peek))) {
+                elem_count = 0;
+            }
+            snap->val_len = elem_count
+                * SOS_VAL_TYPE_ARRAY_ELEM_SIZE(snap->type);
+            snap->val.bytes = SOS_val_snap_payload(snap, snap->val_len);
+            if (SOS_buffer_unpack_array(buffer, &offset, snap->type,
+                    elem_count, snap->val.bytes) < 0) {
+                snap->val_len = 0;
+            }
+            break;
         default:
             dlog(6, "ERROR: Invalid type (%d) at index %d with"
                   " pub->guid == %" SOS_GUID_FMT ".\n",
@@ -2315,24 +3303,20 @@ SOS_val_snap_queue_from_buffer(
 
         // Construct a duplicate list of snapshots for the cache:
         if (ynAddSnapsToCache) {
-            snap_copy = calloc(1, sizeof(SOS_val_snap));
-            memcpy(snap_copy, snap, sizeof(SOS_val_snap));
-            switch (snap->type) {
-            case SOS_VAL_TYPE_STRING:
-                snap_copy->val.c_val = strdup(snap->val.c_val);
-                break;
-            case SOS_VAL_TYPE_BYTES:
-                snap_copy->val.bytes = (void *)
-                                       calloc(snap->val_len, sizeof(unsigned char));
-                memcpy(snap_copy->val.bytes, snap->val.bytes, snap->val_len);
-                break;
-            } // end: switch
+            snap_copy = SOS_val_snap_alloc();
+            SOS_val_snap_copy(snap_copy, snap);
             SOS_TIME(snap_copy->time.recv);
             snap_copy_list[snap_index] = snap_copy;
         } // end: if (cache_depth)
 
     }// end for (snap_index)
 
+    if (snap_count < 1) {
+        if (ynAddSnapsToCache) { free(snap_copy_list); }
+        free(snap_list);
+        return;
+    }
+
     if (ynAddSnapsToCache) {
         // Link up the snap_copies in the array:
         for (snap_index = 0; snap_index < (snap_count - 1); snap_index++) {
@@ -2372,26 +3356,7 @@ SOS_val_snap_queue_from_buffer(
         pthread_mutex_unlock( snap_queue->sync_lock );
     } else {
         // ELSE: There is NO further queue, so free all the snapshots:
-        for (snap_index = 0; snap_index < snap_count; snap_index++) {
-            snap = snap_list[snap_index];
-            switch (snap->type) {
-                case SOS_VAL_TYPE_INT:    snap->val.i_val = 0;   break;
-                case SOS_VAL_TYPE_LONG:   snap->val.l_val = 0;   break;
-                case SOS_VAL_TYPE_DOUBLE: snap->val.d_val = 0.0; break;
-                case SOS_VAL_TYPE_STRING:
-                                          if (snap->val.c_val != NULL) {
-                                              free(snap->val.c_val);
-                                              snap->val.c_val = NULL;
-                                          }
-                                          break;
-                case SOS_VAL_TYPE_BYTES:
-                                          if (snap->val.bytes != NULL) {
-                                              free(snap->val.bytes);
-                                              snap->val.bytes = NULL;
-                                          }
-                                          break;
-            } // end: switch
-        } // end: forall snaps
+        SOS_val_snap_destroy_list(snap_list, snap_count);
     } //end: if no requeue...
 
     free(snap_list);
@@ -2408,20 +3373,36 @@ SOS_announce_to_buffer(SOS_pub *pub, SOS_buffer *buffer) {
     SOS_SET_CONTEXT(pub->sos_context, "SOS_announce_to_buffer");
     SOS_msg_header header;
     int   offset;
+    int   start;
+    int   first;
+    int   losses;
     int   elem;
 
     // CONCURRENCY: This function assumes pub->lock is already held.
 
+    // Only the values added since the last announce are described.  If
+    // nothing was added (the caller reset pub->announced to push out
+    // changed metadata) the whole pub is announced again.  So is a pub
+    // whose last announce may have been lost on the way to the daemon,
+    // as the daemon drops a delta that leaves a gap.
+    losses = SOS_daemon_losses(SOS);
+    first = pub->announced_count;
+    if ((first < 0) || (first >= pub->elem_count)
+     || (pub->announced_losses != losses)) {
+        first = 0;
+    }
+
     header.msg_size = -1;
     header.msg_type = SOS_MSG_TYPE_ANNOUNCE;
     header.msg_from = SOS->my_guid;
     header.ref_guid = pub->guid;
 
-    offset = 0;
-    SOS_msg_zip(buffer, header, 0, &offset);
+    start = buffer->len;
+    offset = start;
+    SOS_msg_zip(buffer, header, start, &offset);
 
     // Pub metadata.
-    SOS_buffer_pack(buffer, &offset, "siiississiiiiiiii",
+    SOS_buffer_pack(buffer, &offset, "siiississiiiiiiiii",
                     pub->node_id,
                     pub->process_id,
                     pub->thread_id,
@@ -2438,27 +3419,20 @@ SOS_announce_to_buffer(SOS_pub *pub, SOS_buffer *buffer) {
                     pub->meta.pri_hint,
                     pub->meta.scope_hint,
                     pub->meta.retain_hint,
-                    pub->cache_depth);
+                    pub->cache_depth,
+                    first);
 
     // Data definitions.
-    for (elem = 0; elem < pub->elem_count; elem++) {
-        SOS_buffer_pack(buffer, &offset, "gsiiiiiig",
-                        pub->data[elem]->guid,
-                        pub->data[elem]->name,
-                        pub->data[elem]->type,
-                        pub->data[elem]->meta.freq,
-                        pub->data[elem]->meta.semantic,
-                        pub->data[elem]->meta.classifier,
-                        pub->data[elem]->meta.pattern,
-                        pub->data[elem]->meta.compare,
-                        pub->data[elem]->meta.relation_id );
+    for (elem = first; elem < pub->elem_count; elem++) {
+        SOS_record_pack_elem(buffer, &offset, pub->data[elem]);
     }
 
     pub->announced = 1;
+    pub->announced_count = pub->elem_count;
+    pub->announced_losses = losses;
 
-    header.msg_size = offset;
-    offset = 0;
-    SOS_msg_zip(buffer, header, 0, &offset);
+    header.msg_size = offset - start;
+    SOS_msg_seal(buffer, header, start, &offset);
 
     return;
 }
@@ -2470,6 +3444,7 @@ void SOS_publish_to_buffer(SOS_pub *pub, SOS_buffer *buffer) {
     long             this_frame;
     double           send_time;
     int              offset;
+    int              start;
     int              elem;
 
     // CONCURRENCY: This function assumes the pub->lock is already held.
@@ -2483,8 +3458,9 @@ void SOS_publish_to_buffer(SOS_pub *pub, SOS_buffer *buffer) {
     header.msg_from = SOS->my_guid;
     header.ref_guid = pub->guid;
 
-    offset = 0;
-    SOS_msg_zip(buffer, header, 0, &offset);
+    start = buffer->len;
+    offset = start;
+    SOS_msg_zip(buffer, header, start, &offset);
 
     // Pack in the frame of these elements:
     SOS_buffer_pack(buffer, &offset, "l", this_frame);
@@ -2501,28 +3477,13 @@ void SOS_publish_to_buffer(SOS_pub *pub, SOS_buffer *buffer) {
              elem, pub->data[elem]->time.pack,
              elem, pub->data[elem]->time.send);
 
-        SOS_buffer_pack(buffer, &offset, "iddilg",
-                        elem,
-                        pub->data[elem]->time.pack,
-                        pub->data[elem]->time.send,
-                        pub->data[elem]->val_len,
-                        pub->data[elem]->meta.semantic,
-                        pub->data[elem]->meta.relation_id);
+        SOS_record_pack_data(buffer, &offset, elem, pub->data[elem]);
 
         switch (pub->data[elem]->type) {
         case SOS_VAL_TYPE_INT:
-            SOS_buffer_pack(buffer, &offset,
-                    "i", pub->data[elem]->val.i_val);
-            break;
-
         case SOS_VAL_TYPE_LONG:
-            SOS_buffer_pack(buffer, &offset,
-                    "l", pub->data[elem]->val.l_val);
-            break;
-
         case SOS_VAL_TYPE_DOUBLE:
-            SOS_buffer_pack(buffer, &offset,
-                    "d", pub->data[elem]->val.d_val);
+            // Packed with the record.
             break;
 
         case SOS_VAL_TYPE_STRING:
@@ -2533,14 +3494,20 @@ void SOS_publish_to_buffer(SOS_pub *pub, SOS_buffer *buffer) {
             break;
 
         case SOS_VAL_TYPE_BYTES:
-            dlog(0, "WARNING: Use of SOS_pack(...) to pack bytes"
-                    " is discouraged.\n");
-            dlog(0, "WARNING: Please use SOS_pack_bytes(...) instead.\n");
             SOS_buffer_pack_bytes(buffer, &offset,
                 pub->data[elem]->val_len,
                 (void *) pub->data[elem]->val.bytes);
             break;
 
+        case SOS_VAL_TYPE_INT_ARRAY:
+        case SOS_VAL_TYPE_LONG_ARRAY:
+        case SOS_VAL_TYPE_DOUBLE_ARRAY:
+            SOS_buffer_pack_array(buffer, &offset, pub->data[elem]->type,
+                (pub->data[elem]->val_len
+                 / SOS_VAL_TYPE_ARRAY_ELEM_SIZE(pub->data[elem]->type)),
+                pub->data[elem]->val.bytes);
+            break;
+
         default:
             dlog(6, "Invalid type (%d) at index %d of pub->guid"
                     " == %" SOS_GUID_FMT ".\n", pub->data[elem]->type,
@@ -2550,9 +3517,124 @@ void SOS_publish_to_buffer(SOS_pub *pub, SOS_buffer *buffer) {
     }//for
 
     // Re-pack the message size now that we know what it is.
-    header.msg_size = offset;
-    offset = 0;
-    SOS_msg_zip(buffer, header, 0, &offset);
+    header.msg_size = offset - start;
+    SOS_msg_seal(buffer, header, start, &offset);
+
+    return;
+}
+
+
+// Move every staged value into the pub, keeping the order each thread
+// packed them in.  They go out with the frame of the SOS_publish() doing
+// the merge, after any values that were packed into the pub directly.
+// CONCURRENCY: Assumes pub->lock is held.
+static void
+SOS_pack_stage_merge(SOS_pub *pub)
+{
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_pack_stage_merge");
+    SOS_pack_stage      *stage;
+    SOS_pack_stage_buf  *buf;
+    SOS_val_snap        *snap;
+    const char          *name;
+    double               pack_time;
+    int                  kept;
+    int                  pos;
+    int                  i;
+
+    for (stage = pub->stage_head; stage != NULL; stage = stage->next_stage) {
+        buf  = SOS_pack_stage_swap(stage);
+        kept = 0;
+        for (i = 0; i < buf->count; i++) {
+            snap = buf->snap[i];
+            name = SOS_pack_stage_name(buf, i);
+            if (name != NULL) {
+                pos = SOS_pub_search(pub, name);
+                if (pos < 0) {
+                    pos = SOS_pub_add_elem(pub, name, snap->type);
+                }
+            } else {
+                pos = snap->elem;
+                if ((pos < 0) || (pos >= pub->elem_count)
+                 || (pub->data[pos]->guid != snap->guid)) {
+                    dlog(0, "ERROR: Invalid handle (elem %d) for pub"
+                            " \"%s\".\n", pos, pub->title);
+                    SOS_val_snap_destroy(&snap);
+                    continue;
+                }
+            }
+            if (pub->data[pos]->type != snap->type) {
+                dlog(0, "ERROR: \"%s\" was already packed as a %s, not a"
+                        " %s.\n", pub->data[pos]->name,
+                        SOS_ENUM_STR(pub->data[pos]->type, SOS_VAL_TYPE),
+                        SOS_ENUM_STR(snap->type, SOS_VAL_TYPE));
+                SOS_val_snap_destroy(&snap);
+                continue;
+            }
+
+            snap->elem     = pos;
+            snap->guid     = pub->data[pos]->guid;
+            snap->pub_guid = pub->guid;
+            snap->frame    = pub->frame;
+
+            // Keep the time the value was staged, not merged:
+            pack_time = snap->time.pack;
+            SOS_pack_snap_renew_pub_data(pub, snap);
+            pub->data[pos]->time.pack = pack_time;
+            snap->time.pack           = pack_time;
+            SOS_pack_snap_add_to_pub_cache(pub, snap);
+
+            buf->snap[kept++] = snap;
+        }
+        if (kept > 0) {
+            SOS_pack_snap_list_into_val_queue(pub, buf->snap, kept);
+        }
+        SOS_pack_stage_reset(buf);
+    }
+
+    return;
+}
+
+
+// Everything one SOS_publish() has to say, in a single message:
+//
+//   [PUB_FRAME header]
+//     [ANNOUNCE]    ...only if the pub changed since it was announced.
+//     [PUBLISH]
+//     [VAL_SNAPS]   ...only if values were packed since the last publish.
+//
+// Each part is a complete message with its own header.  The
+// SOS_*_to_buffer() functions append at buffer->len, so they are
+// simply called one after the other.
+void SOS_pub_frame_to_buffer(SOS_pub *pub, SOS_buffer *buffer) {
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_pub_frame_to_buffer");
+    SOS_msg_header   header;
+    int              offset;
+    int              start;
+
+    // CONCURRENCY: This function assumes the pub->lock is already held.
+
+    header.msg_size = -1;
+    header.msg_type = SOS_MSG_TYPE_PUB_FRAME;
+    header.msg_from = SOS->my_guid;
+    header.ref_guid = pub->guid;
+
+    SOS_pack_stage_merge(pub);
+    SOS_coalesce_release_pending(pub);
+
+    start = buffer->len;
+    offset = start;
+    SOS_msg_zip(buffer, header, start, &offset);
+
+    if ((pub->announced == 0)
+     || (pub->announced_losses != SOS_daemon_losses(SOS))) {
+        SOS_announce_to_buffer(pub, buffer);
+    }
+    SOS_publish_to_buffer(pub, buffer);
+    SOS_val_snap_queue_to_buffer(pub, buffer, true);
+
+    header.msg_size = buffer->len - start;
+    offset = start;
+    SOS_msg_zip(buffer, header, start, &offset);
 
     return;
 }
@@ -2563,6 +3645,7 @@ void SOS_announce_from_buffer(SOS_buffer *buffer, SOS_pub *pub) {
     SOS_msg_header header;
     SOS_data       upd_elem;
     int            offset;
+    int            first;
     int            elem;
 
     pthread_mutex_lock(pub->lock);
@@ -2578,16 +3661,20 @@ void SOS_announce_from_buffer(SOS_buffer *buffer, SOS_pub *pub) {
             "%" SOS_GUID_FMT, pub->guid);
 
     dlog(6, "  ... unpacking the pub definition.\n");
-    SOS_buffer_unpack(buffer, &offset, "siiississiiiiiiii",
-         pub->node_id,
+    // Same layout as SOS_announce_to_buffer() packs ("siiississiii..."),
+    // the strings go straight into the intern table.
+    SOS_intern_unpack(buffer, &offset, &pub->node_id);
+    SOS_buffer_unpack(buffer, &offset, "iii",
         &pub->process_id,
         &pub->thread_id,
-        &pub->comm_rank,
-         pub->prog_name,
-         pub->prog_ver,
+        &pub->comm_rank);
+    SOS_intern_unpack(buffer, &offset, &pub->prog_name);
+    SOS_intern_unpack(buffer, &offset, &pub->prog_ver);
+    SOS_buffer_unpack(buffer, &offset, "is",
         &pub->pragma_len,
-         pub->pragma_msg,
-         pub->title,
+         pub->pragma_msg);
+    SOS_intern_unpack(buffer, &offset, &pub->title);
+    SOS_buffer_unpack(buffer, &offset, "iiiiiiiii",
         &elem,
         &pub->meta.channel,
         &pub->meta.layer,
@@ -2595,7 +3682,8 @@ void SOS_announce_from_buffer(SOS_buffer *buffer, SOS_pub *pub) {
         &pub->meta.pri_hint,
         &pub->meta.scope_hint,
         &pub->meta.retain_hint,
-        &pub->cache_depth);
+        &pub->cache_depth,
+        &first);
 
     dlog(6, "pub->node_id = \"%s\"\n", pub->node_id);
     dlog(6, "pub->process_id = %d\n", pub->process_id);
@@ -2614,12 +3702,32 @@ void SOS_announce_from_buffer(SOS_buffer *buffer, SOS_pub *pub) {
     dlog(6, "pub->meta.scope_hint = %d\n", pub->meta.scope_hint);
     dlog(6, "pub->meta.retain_hint = %d\n", pub->meta.retain_hint);
     dlog(6, "pub->cache_depth = %d\n", pub->cache_depth);
+    dlog(6, "first element described = %d\n", first);
+
+    if ((first < 0) || (first > elem)) {
+        dlog(0, "ERROR: Invalid announce, elements %d..%d of pub"
+                " \"%s\".  Ignoring it.\n", first, elem, pub->title);
+        pthread_mutex_unlock(pub->lock);
+        return;
+    }
+    if (first > pub->elem_count) {
+        // We missed an earlier announce for this pub, and taking this one
+        // would leave the elements in between undefined.  The client
+        // announces the whole pub again once it learns a message was lost.
+        dlog(0, "ERROR: Announce for pub \"%s\" starts at element %d,"
+                " only %d are known.  Ignoring it.\n", pub->title, first,
+                pub->elem_count);
+        pthread_mutex_unlock(pub->lock);
+        return;
+    }
 
     // We shouldn't have a cache yet, so allocate it with the depth that
     // the user has requested.
     if (pub->cache != NULL) {
-        dlog(1, "WARNING: Handling a re-announcement for"
-                " a pub with an existing cache.\n");
+        if (first == 0) {
+            dlog(1, "WARNING: Handling a re-announcement for"
+                    " a pub with an existing cache.\n");
+        }
     } else {
         pub->cache = (SOS_val_snap **)
             calloc(pub->cache_depth, sizeof(SOS_val_snap *));
@@ -2634,21 +3742,16 @@ void SOS_announce_from_buffer(SOS_buffer *buffer, SOS_pub *pub) {
     pub->elem_count = elem;
 
     dlog(6, "  ... unpacking the data definitions.\n");
-    // Unpack the data definitions:
-    elem = 0;
-    for (elem = 0; elem < pub->elem_count; elem++) {
+    // Unpack the data definitions, merging them into what is known:
+    for (elem = first; elem < pub->elem_count; elem++) {
         memset(&upd_elem, 0, sizeof(SOS_data));
 
-        SOS_buffer_unpack(buffer, &offset, "gsiiiiiig",
-            &upd_elem.guid,
-            upd_elem.name,
-            &upd_elem.type,
-            &upd_elem.meta.freq,
-            &upd_elem.meta.semantic,
-            &upd_elem.meta.classifier,
-            &upd_elem.meta.pattern,
-            &upd_elem.meta.compare,
-            &upd_elem.meta.relation_id );
+        if (SOS_record_unpack_elem(buffer, &offset, &upd_elem) < 0) {
+            dlog(0, "ERROR: Truncated announce at element %d of pub"
+                    " \"%s\".  Ignoring the rest of it.\n",
+                    elem, pub->title);
+            break;
+        }
 
         if ((   pub->data[elem]->guid             != upd_elem.guid )
             || (pub->data[elem]->type             != upd_elem.type )
@@ -2665,12 +3768,13 @@ void SOS_announce_from_buffer(SOS_buffer *buffer, SOS_pub *pub) {
 
             pub->data[elem]->sync = SOS_VAL_SYNC_RENEW;
 
-            // Set the element name.
-            snprintf(pub->data[elem]->name, SOS_DEFAULT_STRING_LEN,
-                    "%s", upd_elem.name);
+            // Set the element name, handing over our reference.
+            SOS_intern_drop(pub->data[elem]->name);
+            pub->data[elem]->name = upd_elem.name;
+            upd_elem.name = NULL;
             // Store the name/position pair in the name_table.
-            pub->name_table->put(pub->name_table, pub->data[elem]->name,
-                    (void *) ((long)(elem + 1)));
+            SOS_name_index_put(pub->name_table,
+                    pub->data[elem]->name, elem);
 
             pub->data[elem]->guid             = upd_elem.guid;
             pub->data[elem]->type             = upd_elem.type;
@@ -2693,6 +3797,7 @@ void SOS_announce_from_buffer(SOS_buffer *buffer, SOS_pub *pub) {
             // identical data for this value.  Don't replace it or
             // change its sync status, as already exists in the db.
 
+            SOS_intern_drop(upd_elem.name);
             continue;
         }
 
@@ -2717,6 +3822,8 @@ SOS_publish_from_buffer(
     long            this_frame;
     int             offset;
     int             elem;
+    int             byte_count;
+    int             peek;
 
     pthread_mutex_lock(pub->lock);
 
@@ -2751,16 +3858,15 @@ SOS_publish_from_buffer(
         dlog(7, "Unpacking next message @ offset %d of %d...\n",
                 offset, header.msg_size);
 
-        SOS_buffer_unpack(buffer, &offset, "i", &elem);
+        if (SOS_record_unpack_data(buffer, &offset, pub, &elem) < 0) {
+            dlog(0, "ERROR: Invalid or truncated value at offset %d of"
+                    " pub->guid == %" SOS_GUID_FMT ".\n",
+                    offset, pub->guid);
+            pthread_mutex_unlock(pub->lock);
+            return;
+        }
         data = pub->data[elem];
 
-        SOS_buffer_unpack(buffer, &offset, "ddilg",
-                          &data->time.pack,
-                          &data->time.send,
-                          &data->val_len,
-                          &data->meta.semantic,
-                          &data->meta.relation_id);
-
         dlog(7, "pub->data[%d]->time.pack == %lf"
                 "   pub->data[%d]->time.send == %lf\n",
              elem, data->time.pack,
@@ -2769,28 +3875,67 @@ SOS_publish_from_buffer(
         switch (data->type) {
 
         case SOS_VAL_TYPE_INT:
-            SOS_buffer_unpack(buffer, &offset, "i", &data->val.i_val);
-            break;
-
         case SOS_VAL_TYPE_LONG:
-            SOS_buffer_unpack(buffer, &offset, "l", &data->val.l_val);
-            break;
-
         case SOS_VAL_TYPE_DOUBLE:
-            SOS_buffer_unpack(buffer, &offset, "d", &data->val.d_val);
+            // Unpacked with the record.
             break;
 
         case SOS_VAL_TYPE_STRING:
-            if (data->val.c_val != NULL) {
-                free(data->val.c_val );
+            data->val_len = SOS_intern_unpack(buffer, &offset,
+                    &data->val.c_val);
+            if (data->val_len < 0) {
+                dlog(0, "ERROR: Invalid string at index %d of"
+                        " pub->guid == %" SOS_GUID_FMT ".\n",
+                        elem, pub->guid);
+                data->val_len = 0;
+                pthread_mutex_unlock(pub->lock);
+                return;
             }
-            data->val.c_val = (char *) malloc(1 + data->val_len);
-            memset(data->val.c_val, '\0', (1 + data->val_len));
-            SOS_buffer_unpack(buffer, &offset, "s", data->val.c_val);
             dlog(8, "[STRING] Extracted pub message string: %s\n",
                     data->val.c_val);
             break;
 
+        case SOS_VAL_TYPE_BYTES:
+            SOS_buffer_unpack(buffer, &offset, "i", &byte_count);
+            if ((byte_count < 0) || ((offset + byte_count) > buffer->len)) {
+                dlog(0, "ERROR: Invalid byte count (%d) at index %d of"
+                        " pub->guid == %" SOS_GUID_FMT ".\n",
+                        byte_count, elem, pub->guid);
+                pthread_mutex_unlock(pub->lock);
+                return;
+            }
+            SOS_bytes_ref_drop(data->bytes_ref);
+            data->bytes_ref = SOS_bytes_ref_create(buffer->data + offset,
+                    byte_count, NULL, NULL);
+            data->val.bytes = data->bytes_ref->bytes;
+            data->val_len   = byte_count;
+            offset += byte_count;
+            break;
+
+        case SOS_VAL_TYPE_INT_ARRAY:
+        case SOS_VAL_TYPE_LONG_ARRAY:
+        case SOS_VAL_TYPE_DOUBLE_ARRAY:
+            byte_count = 0;
+            peek = offset;
+            SOS_buffer_unpack(buffer, &peek, "i", &byte_count);
+            if ((byte_count < 0) || (byte_count > (buffer->len - peek))) {
+                byte_count = 0;
+            }
+            byte_count *= SOS_VAL_TYPE_ARRAY_ELEM_SIZE(data->type);
+            SOS_bytes_ref_drop(data->bytes_ref);
+            data->bytes_ref = SOS_bytes_ref_alloc(byte_count);
+            data->val.bytes = data->bytes_ref->bytes;
+            data->val_len   = 0;
+            if (SOS_buffer_unpack_array(buffer, &offset, data->type,
+                    (byte_count / SOS_VAL_TYPE_ARRAY_ELEM_SIZE(data->type)),
+                    data->bytes_ref->bytes) < 0) {
+                pthread_mutex_unlock(pub->lock);
+                return;
+            }
+            data->val.bytes = data->bytes_ref->bytes;
+            data->val_len   = byte_count;
+            break;
+
         default:
             dlog(6, "Invalid type (%d) at index %d of pub->guid"
                     " == %" SOS_GUID_FMT ".\n", data->type, elem, pub->guid);
@@ -2852,33 +3997,28 @@ SOS_publish( SOS_pub *pub ) {
     SOS_buffer *pub_buf;
     SOS_buffer *rep_buf;
 
+    if (SOS_coalesce_defer_publish(pub)) {
+        return;
+    }
+
+    if (pub->async_publish && (SOS->task.async != NULL)) {
+        dlog(6, "Queueing the publish for the flush thread.\n");
+        SOS_async_publish(pub);
+        return;
+    }
+
     pub_buf = NULL;
     rep_buf = NULL;
     SOS_buffer_init(SOS, &pub_buf);
     SOS_buffer_init_sized(SOS, &rep_buf, SOS_DEFAULT_REPLY_LEN);
 
-    // CONCURRENCY: Announce will lock the pub, so don't lock it yet...
-
-    if (pub->announced == 0) {
-        dlog(6, "AUTO-ANNOUNCING this pub...\n");
-        SOS_announce(pub);
-    }
-
     pthread_mutex_lock(pub->lock);
 
     dlog(6, "Preparing a publish message...\n");
-    dlog(6, "  ... placing the publish message in a buffer.\n");
-    SOS_publish_to_buffer(pub, pub_buf);
+    dlog(6, "  ... placing the pub frame in a buffer.\n");
+    SOS_pub_frame_to_buffer(pub, pub_buf);
     dlog(6, "  ... sending the buffer to the daemon.\n");
     SOS_send_to_daemon(pub_buf, rep_buf);
-
-    dlog(6, "  ... checking for val_snap queue entries.\n");
-    SOS_buffer_wipe(pub_buf);
-    SOS_val_snap_queue_to_buffer(pub, pub_buf, true);
-    if (pub_buf->len > 0) {
-        dlog(6, "  ... sending the buffer to the daemon.\n");
-        SOS_send_to_daemon(pub_buf, rep_buf);
-    }
     dlog(6, "  ... done.\n");
 
     SOS_buffer_destroy(pub_buf);
@@ -50,6 +50,13 @@
 
 #define SOS_DEFAULT_SERVER_HOST     "localhost"
 #define SOS_DEFAULT_SERVER_PORT     "22500"
+// Local clients reach the daemon on this AF_UNIX socket, named for its
+// port.  A leading '@' is a Linux abstract name, with no file behind it.
+#ifdef __linux__
+#define SOS_DEFAULT_UNIX_SOCKET     "@sosd.%s"
+#else
+#define SOS_DEFAULT_UNIX_SOCKET     "/tmp/sosd.%s.sock"
+#endif
 #define SOS_DEFAULT_MSG_TIMEOUT     2048
 #define SOS_DEFAULT_TIMEOUT_SEC     2.0
 #define SOS_DEFAULT_BUFFER_MAX      4096
@@ -61,7 +68,10 @@
 #define SOS_DEFAULT_RING_SIZE       65536
 #define SOS_DEFAULT_TABLE_SIZE      655360
 #define SOS_DEFAULT_GUID_BLOCK      8001027
+#define SOS_DEFAULT_GUID_LOW_WATER  (SOS_DEFAULT_GUID_BLOCK / 4)
 #define SOS_DEFAULT_ELEM_MAX        1024
+#define SOS_DEFAULT_ASYNC_QUEUE_DEPTH 64
+#define SOS_DEFAULT_NO_ACK_WINDOW   64
 #define SOS_DEFAULT_UID_MAX         LLONG_MAX
 
 
@@ -86,20 +96,59 @@ extern "C" {
 
     void SOS_pub_config(SOS_pub *pub, SOS_pub_option opt, ...);
 
+    // On a pub with SOS_PUB_OPTION_STAGED set, the pack calls below
+    // return 0 (by handle: the handle's elem) or -1, and the value only
+    // lands in the pub at the next SOS_publish():
     int SOS_pack(SOS_pub *pub, const char *name,
         SOS_val_type pack_type, const void *pack_val_var);
 
     int SOS_pack_related(SOS_pub *pub, long relation_id, const char *name,
         SOS_val_type pack_type, const void *pack_val_var);
 
-    // NOTE: This seems like a nice idea.  Soon.  -CDW
-    //int SOS_pack_array(SOS_pub *pub, const char **names,
-    //        int elem_count, SOS_val_type pack_type, const void *array);
+    // Pack a SOS_VAL_TYPE_BYTES value without copying it.  libsos reads
+    // the caller's memory until it calls release(release_ctx, bytes), once
+    // the value has been sent and replaced.  With release == NULL the bytes
+    // are copied once and the caller may reuse them right away:
+    int SOS_pack_bytes(SOS_pub *pub, const char *name, int byte_count,
+        const void *bytes, SOS_bytes_release_fn release, void *release_ctx);
+
+    // Pack elem_count numbers as one value of SOS_VAL_TYPE_INT_ARRAY,
+    // _LONG_ARRAY, or _DOUBLE_ARRAY.  They are copied once and stay
+    // binary all the way into the daemon's cache and database:
+    int SOS_pack_vector(SOS_pub *pub, const char *name, SOS_val_type type,
+        int elem_count, const void *values);
+
+    // Pack elem_count values at once.  The array holds values of
+    // pack_type (int[], long[], double[], or char*[] for strings):
+    int SOS_pack_array(SOS_pub *pub, const char **names,
+        int elem_count, SOS_val_type pack_type, const void *array);
+
+    // Resolve a value's name once (adding it to the pub if needed) so
+    // that repeated packs can skip the name lookup:
+    int SOS_pack_handle_get(SOS_pub *pub, const char *name,
+        SOS_val_type pack_type, SOS_pack_handle_t *handle);
+
+    int SOS_pack_by_handle(SOS_pub *pub, SOS_pack_handle_t handle,
+        const void *pack_val_var);
+
+    // Same as SOS_pack_array(), by handles that all share one type:
+    int SOS_pack_array_by_handle(SOS_pub *pub,
+        const SOS_pack_handle_t *handles, int elem_count, const void *array);
+
+    // Set the hints for a value already in the pub.  Values with freq
+    // SOS_VAL_FREQ_CONTINUOUS are coalesced between publishes.  See
+    // sos_coalesce.h for what the semantic does there and in pubs that
+    // aggregate:
+    int SOS_val_set_meta(SOS_pub *pub, const char *name,
+        SOS_val_freq freq, SOS_val_semantic semantic);
 
     void SOS_announce(SOS_pub *pub);
 
     void SOS_publish(SOS_pub *pub);
 
+    // Wait until every asynchronous publish has been handed to the daemon.
+    void SOS_flush(SOS_runtime *sos_context);
+
     void SOS_sense_register(SOS_runtime *sos_context, const char *handle);
 
     void SOS_sense_trigger(SOS_runtime *sos_context,
@@ -150,6 +199,10 @@ extern "C" {
     // This puts an individual snapshot into the "next steps" queue,
     // or the "queue to send to the daemon" for clients, for example:
     int SOS_pack_snap_into_val_queue(SOS_pub *pub, SOS_val_snap *snap);
+    //
+    // ...or a whole list of them with one push:
+    int SOS_pack_snap_list_into_val_queue(SOS_pub *pub,
+            SOS_val_snap **snap_list, int count);
     // -----
 
     void  SOS_reference_set(SOS_runtime *sos_context, const char *name, void *pointer);
@@ -168,11 +221,16 @@ extern "C" {
     void SOS_publish_from_buffer(SOS_buffer *buffer,
         SOS_pub *pub, SOS_pipe *optional_snap_queue);
 
+    void SOS_pub_frame_to_buffer(SOS_pub *pub, SOS_buffer *buffer);
+
     void SOS_uid_init(SOS_runtime *sos_context,
         SOS_uid **uid, SOS_guid from, SOS_guid to);
 
     SOS_guid SOS_uid_next(SOS_uid *uid);
 
+    // CONCURRENCY: Assumes uid->lock is held.
+    void SOS_uid_set_block(SOS_uid *uid, SOS_guid from, SOS_guid to);
+
     void SOS_uid_destroy(SOS_uid *uid);
 
     void SOS_val_snap_queue_to_buffer(SOS_pub *pub,
@@ -202,6 +260,7 @@ extern "C" {
             int starting_offset, int *offset_after_header_size_field);
 
     void SOS_send_to_daemon(SOS_buffer *buffer, SOS_buffer *reply);
+    void SOS_shm_transport_init(SOS_runtime *sos_context);
 
 
 
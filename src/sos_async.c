@@ -0,0 +1,380 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sos.h"
+#include "sos_types.h"
+#include "sos_debug.h"
+#include "sos_buffer.h"
+#include "sos_async.h"
+
+
+static void* SOS_THREAD_async_flush(void *args);
+
+
+void
+SOS_async_init(SOS_runtime *sos_context) {
+    SOS_SET_CONTEXT(sos_context, "SOS_async_init");
+    SOS_async_queue *q;
+
+    q = (SOS_async_queue *) calloc(1, sizeof(SOS_async_queue));
+    q->sos_context = SOS;
+    q->running     = true;
+    q->started     = false;
+    q->full_policy = SOS->config.options->async_full_policy;
+    q->depth       = SOS->config.options->async_queue_depth;
+    q->entry       = (SOS_async_entry *)
+        calloc(q->depth, sizeof(SOS_async_entry));
+
+    q->flusher   = (pthread_t *)       calloc(1, sizeof(pthread_t));
+    q->lock      = (pthread_mutex_t *) calloc(1, sizeof(pthread_mutex_t));
+    q->not_empty = (pthread_cond_t *)  calloc(1, sizeof(pthread_cond_t));
+    q->not_full  = (pthread_cond_t *)  calloc(1, sizeof(pthread_cond_t));
+    q->drained   = (pthread_cond_t *)  calloc(1, sizeof(pthread_cond_t));
+    q->idle      = (pthread_cond_t *)  calloc(1, sizeof(pthread_cond_t));
+    pthread_mutex_init(q->lock, NULL);
+    pthread_cond_init(q->not_empty, NULL);
+    pthread_cond_init(q->not_full, NULL);
+    pthread_cond_init(q->drained, NULL);
+    pthread_cond_init(q->idle, NULL);
+
+    dlog(4, "Async publish queue: depth == %d, policy == %s\n",
+            q->depth, SOS_ENUM_STR(q->full_policy, SOS_ASYNC_FULL));
+
+    SOS->task.async = q;
+    return;
+}
+
+
+// CONCURRENCY: Called with q->lock held.
+static void
+SOS_async_start_flusher(SOS_async_queue *q) {
+    SOS_SET_CONTEXT(q->sos_context, "SOS_async_start_flusher");
+    int rc;
+
+    if (q->started) return;
+
+    rc = pthread_create(q->flusher, NULL, SOS_THREAD_async_flush, (void *) q);
+    if (rc != 0) {
+        dlog(0, "ERROR: Unable to start the async publish thread.  (%d)\n",
+                rc);
+        exit(EXIT_FAILURE);
+    }
+    q->started = true;
+    return;
+}
+
+
+// Serialize whatever is dirty in the pub, the same way SOS_publish()
+// does, but leave sending it to someone else.
+static void
+SOS_async_pub_to_entry(SOS_pub *pub, SOS_async_entry *entry) {
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_async_pub_to_entry");
+    int announced;
+    int announced_count;
+    int announced_losses;
+
+    entry->msg = NULL;
+    entry->pub = (void *) pub;
+    SOS_buffer_init(SOS, &entry->msg);
+
+    pthread_mutex_lock(pub->lock);
+    announced        = pub->announced;
+    announced_count  = pub->announced_count;
+    announced_losses = pub->announced_losses;
+    SOS_pub_frame_to_buffer(pub, entry->msg);
+    // Any announce in the frame has already moved these along.
+    entry->announces = ((pub->announced        != announced)
+                     || (pub->announced_count  != announced_count)
+                     || (pub->announced_losses != announced_losses));
+    pthread_mutex_unlock(pub->lock);
+
+    return;
+}
+
+
+static void
+SOS_async_entry_destroy(SOS_async_entry *entry) {
+    if (entry->msg != NULL) SOS_buffer_destroy(entry->msg);
+    entry->msg = NULL;
+    return;
+}
+
+
+// The pub considers everything it announced in this entry as delivered,
+// so have it announce itself in full again or the daemon would never
+// learn of those values.
+// CONCURRENCY: Called with q->lock held, takes pub->lock.
+static void
+SOS_async_entry_drop(SOS_async_entry *entry) {
+    SOS_pub *pub = (SOS_pub *) entry->pub;
+
+    if (entry->announces && (pub != NULL)) {
+        pthread_mutex_lock(pub->lock);
+        pub->announced       = 0;
+        pub->announced_count = 0;
+        pthread_mutex_unlock(pub->lock);
+    }
+    SOS_async_entry_destroy(entry);
+    return;
+}
+
+
+// CONCURRENCY: Called with q->lock held.
+static void
+SOS_async_push(SOS_async_queue *q, SOS_async_entry *entry) {
+    SOS_SET_CONTEXT(q->sos_context, "SOS_async_push");
+    int slot;
+
+    while ((q->count + q->reserved) >= q->depth) {
+        if ((q->full_policy == SOS_ASYNC_FULL_DROP_OLDEST) && (q->count > 0)) {
+            SOS_async_entry_drop(&q->entry[q->head]);
+            q->head = (q->head + 1) % q->depth;
+            q->count--;
+            q->dropped++;
+            dlog(1, "WARNING: Async publish queue is full, dropped the"
+                    " oldest publish.  (%ld so far)\n", q->dropped);
+        } else {
+            pthread_cond_wait(q->not_full, q->lock);
+        }
+    }
+
+    slot = (q->head + q->count) % q->depth;
+    q->entry[slot] = *entry;
+    q->count++;
+    pthread_cond_signal(q->not_empty);
+
+    return;
+}
+
+
+void
+SOS_async_publish(SOS_pub *pub) {
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_async_publish");
+    SOS_async_queue *q = SOS->task.async;
+    SOS_async_entry  entry;
+    SOS_list_entry  *defer;
+
+    pthread_mutex_lock(q->lock);
+    SOS_async_start_flusher(q);
+
+    if ((q->full_policy == SOS_ASYNC_FULL_COALESCE)
+     && ((q->count + q->reserved) >= q->depth)) {
+        // Leave the values dirty and let the flush thread pick this
+        // pub up again once there is room.
+        q->coalesced++;
+        for (defer = q->deferred; defer != NULL; defer = defer->next_entry) {
+            if (defer->ref == (void *) pub) break;
+        }
+        if (defer == NULL) {
+            defer = (SOS_list_entry *) calloc(1, sizeof(SOS_list_entry));
+            defer->ref        = (void *) pub;
+            defer->next_entry = (void *) q->deferred;
+            q->deferred       = defer;
+        }
+        pthread_mutex_unlock(q->lock);
+        dlog(6, "Queue is full, deferred pub \"%s\".\n", pub->title);
+        return;
+    }
+    pthread_mutex_unlock(q->lock);
+
+    SOS_async_pub_to_entry(pub, &entry);
+
+    pthread_mutex_lock(q->lock);
+    SOS_async_push(q, &entry);
+    pthread_mutex_unlock(q->lock);
+
+    return;
+}
+
+
+// Drop any deferred publish of a pub that is going away, and wait out
+// the flush thread if it is serializing the pub right now.
+void
+SOS_async_forget_pub(SOS_pub *pub) {
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_async_forget_pub");
+    SOS_async_queue *q = SOS->task.async;
+    SOS_list_entry  *entry;
+    SOS_list_entry  *prev;
+    int              i;
+
+    if (q == NULL) return;
+
+    pthread_mutex_lock(q->lock);
+    // Its queued publishes still go out, they just no longer refer to it.
+    for (i = 0; i < q->count; i++) {
+        if (q->entry[(q->head + i) % q->depth].pub == (void *) pub) {
+            q->entry[(q->head + i) % q->depth].pub = NULL;
+        }
+    }
+    prev  = NULL;
+    entry = q->deferred;
+    while (entry != NULL) {
+        if (entry->ref == (void *) pub) {
+            if (prev == NULL) {
+                q->deferred = entry->next_entry;
+            } else {
+                prev->next_entry = entry->next_entry;
+            }
+            free(entry);
+            break;
+        }
+        prev  = entry;
+        entry = entry->next_entry;
+    }
+    while (q->current == (void *) pub) {
+        pthread_cond_wait(q->idle, q->lock);
+    }
+    if ((q->count == 0) && (q->deferred == NULL) && (q->in_flight == 0)) {
+        pthread_cond_broadcast(q->drained);
+    }
+    pthread_mutex_unlock(q->lock);
+
+    return;
+}
+
+
+void
+SOS_flush(SOS_runtime *sos_context) {
+    SOS_SET_CONTEXT(sos_context, "SOS_flush");
+    SOS_async_queue *q = SOS->task.async;
+
+    if ((q == NULL) || (q->started == false)) return;
+
+    pthread_mutex_lock(q->lock);
+    pthread_cond_signal(q->not_empty);
+    while ((q->count > 0) || (q->deferred != NULL) || (q->in_flight > 0)) {
+        pthread_cond_wait(q->drained, q->lock);
+    }
+    pthread_mutex_unlock(q->lock);
+
+    return;
+}
+
+
+static void*
+SOS_THREAD_async_flush(void *args) {
+    SOS_async_queue *q = (SOS_async_queue *) args;
+    SOS_SET_CONTEXT(q->sos_context, "SOS_THREAD_async_flush");
+    SOS_async_entry  entry;
+    SOS_list_entry  *defer;
+    SOS_buffer      *reply;
+    SOS_pub         *pub;
+
+    reply = NULL;
+    SOS_buffer_init_sized(SOS, &reply, SOS_DEFAULT_REPLY_LEN);
+
+    pthread_mutex_lock(q->lock);
+    for (;;) {
+        while ((q->count == 0) && (q->deferred == NULL) && q->running) {
+            pthread_cond_wait(q->not_empty, q->lock);
+        }
+        if ((q->count == 0) && (q->deferred == NULL)) {
+            // Only reached once running is false and nothing is left.
+            break;
+        }
+
+        // Deferred (coalesced) pubs get serialized as room opens up,
+        // behind anything they already had queued.
+        // A slot is reserved first so that a publisher cannot take it
+        // while the pub is being serialized.
+        if ((q->deferred != NULL) && ((q->count + q->reserved) < q->depth)) {
+            defer       = q->deferred;
+            q->deferred = defer->next_entry;
+            pub         = (SOS_pub *) defer->ref;
+            free(defer);
+            q->in_flight++;
+            q->reserved++;
+            q->current = (void *) pub;
+            pthread_mutex_unlock(q->lock);
+
+            SOS_async_pub_to_entry(pub, &entry);
+
+            pthread_mutex_lock(q->lock);
+            q->current = NULL;
+            pthread_cond_broadcast(q->idle);
+            q->in_flight--;
+            q->reserved--;
+            SOS_async_push(q, &entry);
+            continue;
+        }
+
+        entry = q->entry[q->head];
+        q->entry[q->head].msg = NULL;
+        q->head = (q->head + 1) % q->depth;
+        q->count--;
+        q->in_flight++;
+        pthread_cond_signal(q->not_full);
+        pthread_mutex_unlock(q->lock);
+
+        dlog(6, "Sending a queued publish to the daemon.\n");
+        SOS_send_to_daemon(entry.msg, reply);
+        SOS_buffer_wipe(reply);
+        SOS_async_entry_destroy(&entry);
+
+        pthread_mutex_lock(q->lock);
+        q->in_flight--;
+        if ((q->count == 0) && (q->deferred == NULL) && (q->in_flight == 0)) {
+            pthread_cond_broadcast(q->drained);
+        }
+    }
+    pthread_cond_broadcast(q->drained);
+    pthread_mutex_unlock(q->lock);
+
+    SOS_buffer_destroy(reply);
+    dlog(4, "Leaving thread safely.\n");
+    return NULL;
+}
+
+
+void
+SOS_async_destroy(SOS_runtime *sos_context) {
+    SOS_SET_CONTEXT(sos_context, "SOS_async_destroy");
+    SOS_async_queue *q = SOS->task.async;
+    SOS_list_entry  *entry;
+
+    if (q == NULL) return;
+
+    // The flush thread sends everything still queued before it exits.
+    pthread_mutex_lock(q->lock);
+    q->running = false;
+    pthread_cond_signal(q->not_empty);
+    pthread_mutex_unlock(q->lock);
+    if (q->started) {
+        pthread_join(*q->flusher, NULL);
+    }
+
+    if ((q->dropped > 0) || (q->coalesced > 0)) {
+        dlog(1, "Async publish: %ld dropped, %ld coalesced.\n",
+                q->dropped, q->coalesced);
+    }
+
+    while (q->count > 0) {
+        SOS_async_entry_destroy(&q->entry[q->head]);
+        q->head = (q->head + 1) % q->depth;
+        q->count--;
+    }
+    while (q->deferred != NULL) {
+        entry       = q->deferred;
+        q->deferred = entry->next_entry;
+        free(entry);
+    }
+
+    pthread_cond_destroy(q->not_empty);
+    pthread_cond_destroy(q->not_full);
+    pthread_cond_destroy(q->drained);
+    pthread_cond_destroy(q->idle);
+    pthread_mutex_destroy(q->lock);
+    free(q->not_empty);
+    free(q->not_full);
+    free(q->drained);
+    free(q->idle);
+    free(q->lock);
+    free(q->flusher);
+    free(q->entry);
+    free(q);
+
+    SOS->task.async = NULL;
+    return;
+}
@@ -0,0 +1,43 @@
+#ifndef SOS_ASYNC_H
+#define SOS_ASYNC_H
+
+/*
+ *   Asynchronous publishing.
+ *
+ *   A pub with async_publish set (SOS_ASYNC_PUBLISH, or per-pub through
+ *   SOS_pub_config(pub, SOS_PUB_OPTION_ASYNC, 1)) only serializes its
+ *   values during SOS_publish().  The buffers go into a bounded queue and
+ *   a libsos thread sends them to the daemon.  SOS_flush() waits for that
+ *   queue to empty.
+ *
+ *   When the queue is full, SOS_ASYNC_FULL_POLICY selects what happens:
+ *     BLOCK        ...the publishing thread waits for room.
+ *     DROP_OLDEST  ...the oldest queued publish is discarded.  If it
+ *                     announced values, its pub announces all of them
+ *                     again with its next publish.
+ *     COALESCE     ...the publish is deferred.  Its values stay dirty in
+ *                     the pub and go out together with the next publish
+ *                     once the queue has room.
+ */
+
+#include "sos.h"
+#include "sos_types.h"
+#include "sos_buffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    void SOS_async_init(SOS_runtime *sos_context);
+
+    void SOS_async_publish(SOS_pub *pub);
+
+    void SOS_async_forget_pub(SOS_pub *pub);
+
+    void SOS_async_destroy(SOS_runtime *sos_context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -31,6 +31,22 @@
 #define SOS_buffer_unpack754_32(i) (SOS_buffer_unpack754((i), 32, 8))
 #define SOS_buffer_unpack754_64(i) (SOS_buffer_unpack754((i), 64, 11))
 
+// Where a double already is an IEEE-754 binary64 in the same byte order
+// as the integers, it goes on the wire as its own bits, byte-swapped.
+// Elsewhere (or built with -DSOS_BUFFER_PORTABLE_754) pack754() is used.
+#if !defined(SOS_BUFFER_PORTABLE_754) && defined(__BYTE_ORDER__)          \
+    && defined(__FLOAT_WORD_ORDER__)                                      \
+    && (__FLOAT_WORD_ORDER__ == __BYTE_ORDER__)                           \
+    && (__DBL_MANT_DIG__ == 53) && (__DBL_MAX_EXP__ == 1024)
+#define SOS_BUFFER_NATIVE_754 1
+#endif
+
+#if (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define SOS_BUFFER_WIRE64(__u) __builtin_bswap64(__u)
+#else
+#define SOS_BUFFER_WIRE64(__u) (__u)
+#endif
+
 
 void SOS_buffer_init(void *sos_context, SOS_buffer **buffer_obj) {
     SOS_buffer_init_sized_locking(sos_context, buffer_obj, SOS_DEFAULT_BUFFER_MAX, true);
@@ -43,29 +59,234 @@ void SOS_buffer_init_sized(void *sos_context, SOS_buffer **buffer_obj, int max_s
 }
 
 
+// Free buffers, by size class.  A buffer in class (c) has at least
+// (SOS_BUFFER_POOL_MIN << c) bytes of data, all of them zero.
+static pthread_mutex_t  SOS_buffer_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t   SOS_buffer_pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t    SOS_buffer_pool_key;
+static SOS_buffer      *SOS_buffer_pool_shared[SOS_BUFFER_POOL_CLASSES];
+static int              SOS_buffer_pool_shared_count[SOS_BUFFER_POOL_CLASSES];
+
+static __thread SOS_buffer *SOS_buffer_pool_local[SOS_BUFFER_POOL_CLASSES];
+static __thread int         SOS_buffer_pool_local_count[SOS_BUFFER_POOL_CLASSES];
+static __thread bool        SOS_buffer_pool_registered = false;
+
+static SOS_buffer_stats SOS_buffer_pool_totals;
+
+#define SOS_BUFFER_POOL_SIZE(__c) (SOS_BUFFER_POOL_MIN << (__c))
+#define SOS_BUFFER_POOL_CAP(__bytes, __c)                                    \
+    (((__bytes) > SOS_BUFFER_POOL_SIZE(__c))                                  \
+        ? ((__bytes) / SOS_BUFFER_POOL_SIZE(__c)) : 1)
+#define SOS_buffer_stat_add(__field, __n)                                     \
+    __atomic_add_fetch(&SOS_buffer_pool_totals.__field, (__n), __ATOMIC_RELAXED)
+#define SOS_buffer_stat_sub(__field, __n)                                     \
+    __atomic_sub_fetch(&SOS_buffer_pool_totals.__field, (__n), __ATOMIC_RELAXED)
+
+
+// Smallest class that will hold max_size bytes, or -1 if none will.
+static int
+SOS_buffer_pool_class_for(int max_size) {
+    int c = 0;
+    while (SOS_BUFFER_POOL_SIZE(c) < max_size) {
+        if (++c >= SOS_BUFFER_POOL_CLASSES) return -1;
+    }
+    return c;
+}
+
+
+// Largest class a buffer of (max) bytes can stand in for, or -1.
+static int
+SOS_buffer_pool_class_of(int max) {
+    int c = 0;
+    if (max < SOS_BUFFER_POOL_MIN) return -1;
+    while (((c + 1) < SOS_BUFFER_POOL_CLASSES)
+        && (SOS_BUFFER_POOL_SIZE(c + 1) <= max)) {
+        c++;
+    }
+    return c;
+}
+
+
+static void
+SOS_buffer_free(SOS_buffer *buffer) {
+    SOS_buffer_stat_sub(bytes_on_heap, buffer->max);
+    if (buffer->lock != NULL) {
+        pthread_mutex_destroy(buffer->lock);
+        free(buffer->lock);
+    }
+    free(buffer->data);
+    free(buffer);
+    return;
+}
+
+
+// Put a list of buffers on the shared list of class (c), as many as will
+// fit, and free the rest.
+static void
+SOS_buffer_pool_give(int c, SOS_buffer *head) {
+    SOS_buffer *spare = NULL;
+    SOS_buffer *next;
+    int         cap = SOS_BUFFER_POOL_CAP(SOS_BUFFER_POOL_SHARED_BYTES, c);
+
+    pthread_mutex_lock(&SOS_buffer_pool_lock);
+    for (; head != NULL; head = next) {
+        next = (SOS_buffer *) head->next_free;
+        if (SOS_buffer_pool_shared_count[c] < cap) {
+            head->next_free = SOS_buffer_pool_shared[c];
+            SOS_buffer_pool_shared[c] = head;
+            SOS_buffer_pool_shared_count[c]++;
+        } else {
+            head->next_free = spare;
+            spare = head;
+        }
+    }
+    pthread_mutex_unlock(&SOS_buffer_pool_lock);
+
+    for (; spare != NULL; spare = next) {
+        next = (SOS_buffer *) spare->next_free;
+        SOS_buffer_free(spare);
+    }
+    return;
+}
+
+
+// Hand a departing thread's free lists back to the shared ones.
+static void
+SOS_buffer_pool_thread_exit(void *unused) {
+    int c;
+
+    for (c = 0; c < SOS_BUFFER_POOL_CLASSES; c++) {
+        if (SOS_buffer_pool_local[c] == NULL) continue;
+        SOS_buffer_pool_give(c, SOS_buffer_pool_local[c]);
+        SOS_buffer_pool_local[c]       = NULL;
+        SOS_buffer_pool_local_count[c] = 0;
+    }
+    return;
+}
+
+
+static void
+SOS_buffer_pool_make_key(void) {
+    pthread_key_create(&SOS_buffer_pool_key, SOS_buffer_pool_thread_exit);
+    return;
+}
+
+
+static void
+SOS_buffer_pool_register_thread(void) {
+    pthread_once(&SOS_buffer_pool_once, SOS_buffer_pool_make_key);
+    // Any non-NULL value makes pthreads call the destructor at exit.
+    pthread_setspecific(SOS_buffer_pool_key, (void *) &SOS_buffer_pool_key);
+    SOS_buffer_pool_registered = true;
+    return;
+}
+
+
+// Take up to half a local list's worth of class (c) from the shared list.
+static void
+SOS_buffer_pool_refill(int c) {
+    SOS_buffer *tail;
+    int         take;
+    int         want = SOS_BUFFER_POOL_CAP(SOS_BUFFER_POOL_LOCAL_BYTES, c) / 2;
+
+    if (!SOS_buffer_pool_registered) {
+        SOS_buffer_pool_register_thread();
+    }
+
+    pthread_mutex_lock(&SOS_buffer_pool_lock);
+    if (SOS_buffer_pool_shared[c] != NULL) {
+        take = 1;
+        tail = SOS_buffer_pool_shared[c];
+        while ((tail->next_free != NULL) && (take < want)) {
+            tail = (SOS_buffer *) tail->next_free;
+            take++;
+        }
+        SOS_buffer_pool_local[c]          = SOS_buffer_pool_shared[c];
+        SOS_buffer_pool_shared[c]         = (SOS_buffer *) tail->next_free;
+        SOS_buffer_pool_shared_count[c]  -= take;
+        tail->next_free                   = NULL;
+        SOS_buffer_pool_local_count[c]    = take;
+    }
+    pthread_mutex_unlock(&SOS_buffer_pool_lock);
+    return;
+}
+
+
+// Give half of the local list of class (c) to the shared one.
+static void
+SOS_buffer_pool_spill(int c) {
+    SOS_buffer *head;
+    SOS_buffer *tail;
+    int         give;
+    int         i;
+
+    give = SOS_buffer_pool_local_count[c] / 2;
+    if (give < 1) give = 1;
+    head = SOS_buffer_pool_local[c];
+    tail = head;
+    for (i = 1; i < give; i++) { tail = (SOS_buffer *) tail->next_free; }
+
+    SOS_buffer_pool_local[c]        = (SOS_buffer *) tail->next_free;
+    SOS_buffer_pool_local_count[c] -= give;
+    tail->next_free                 = NULL;
+
+    SOS_buffer_pool_give(c, head);
+    return;
+}
+
+
 void SOS_buffer_init_sized_locking(void *sos_context, SOS_buffer **buffer_obj, int max_size, bool locking) {
     SOS_SET_CONTEXT((SOS_runtime *)sos_context, "SOS_buffer_init_sized_locking");
-    SOS_buffer *buffer;
+    SOS_buffer *buffer = NULL;
+    int c;
 
     dlog(15, "Creating buffer:\n");
-    buffer = *buffer_obj = (SOS_buffer *) malloc(sizeof(SOS_buffer));
-    memset(buffer, '\0', sizeof(SOS_buffer));
-    buffer->sos_context = sos_context;
-    buffer->max = max_size;
-    buffer->len = 0;
+    SOS_buffer_stat_add(creates, 1);
 
-    dlog(15, "   ... allocating storage space.\n");
-    buffer->data = (unsigned char *) malloc(buffer->max * sizeof(unsigned char));
+    c = SOS_buffer_pool_class_for(max_size);
+    if (c >= 0) {
+        if (SOS_buffer_pool_local[c] == NULL) {
+            SOS_buffer_pool_refill(c);
+        }
+        buffer = SOS_buffer_pool_local[c];
+        if (buffer != NULL) {
+            dlog(15, "   ... reusing a pooled buffer.\n");
+            SOS_buffer_pool_local[c] = (SOS_buffer *) buffer->next_free;
+            SOS_buffer_pool_local_count[c]--;
+            buffer->next_free = NULL;
+            SOS_buffer_stat_add(pool_hits, 1);
+        }
+    }
 
-    if (buffer->data == NULL) {
-        dlog(18, "ERROR: Unable to allocate buffer space.  Terminating.\n");
-        exit(EXIT_FAILURE);
+    if (buffer == NULL) {
+        buffer = (SOS_buffer *) calloc(1, sizeof(SOS_buffer));
+        if (buffer == NULL) {
+            dlog(0, "ERROR: Unable to allocate a buffer.  Terminating.\n");
+            exit(EXIT_FAILURE);
+        }
+        // Anything that may come back to the pool is given its whole class.
+        buffer->max = (c >= 0) ? SOS_BUFFER_POOL_SIZE(c) : max_size;
+
+        dlog(15, "   ... allocating storage space.\n");
+        buffer->data = (unsigned char *) calloc(buffer->max, sizeof(unsigned char));
+        if (buffer->data == NULL) {
+            dlog(0, "ERROR: Unable to allocate buffer space.  Terminating.\n");
+            exit(EXIT_FAILURE);
+        }
+        SOS_buffer_stat_add(bytes_on_heap, buffer->max);
     }
 
-    memset(buffer->data, 0, buffer->max);
+    *buffer_obj = buffer;
+    buffer->sos_context = sos_context;
+    buffer->len = 0;
+    buffer->is_zipped = false;
+#ifdef USE_MUNGE
+    buffer->ref_cred = NULL;
+#endif
 
+    // A pooled buffer keeps the mutex it was given, if it had one.
     buffer->is_locking = locking;
-    if (locking) {
+    if (locking && (buffer->lock == NULL)) {
         dlog(15, "   ... creating buffer->lock.\n");
         buffer->lock = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t));
         if (buffer->lock == NULL) {
@@ -77,17 +298,21 @@ void SOS_buffer_init_sized_locking(void *sos_context, SOS_buffer **buffer_obj, i
         }
     }
 
-    #ifdef SOSD_DAEMON_SRC
-    SOSD_countof(buffer_creates++);
-    SOSD_countof(buffer_bytes_on_heap += buffer->max);
-    #endif
-
     dlog(15, "   ...done.\n");
 
     return;
 }
 
 
+void SOS_buffer_pool_stats(SOS_buffer_stats *stats) {
+    stats->creates       = __atomic_load_n(&SOS_buffer_pool_totals.creates, __ATOMIC_RELAXED);
+    stats->pool_hits     = __atomic_load_n(&SOS_buffer_pool_totals.pool_hits, __ATOMIC_RELAXED);
+    stats->destroys      = __atomic_load_n(&SOS_buffer_pool_totals.destroys, __ATOMIC_RELAXED);
+    stats->bytes_on_heap = __atomic_load_n(&SOS_buffer_pool_totals.bytes_on_heap, __ATOMIC_RELAXED);
+    return;
+}
+
+
 
 void SOS_buffer_clone(SOS_buffer **dest, SOS_buffer *src) {
     SOS_SET_CONTEXT(src->sos_context, "SOS_buffer_clone");
@@ -135,40 +360,56 @@ void SOS_buffer_unlock(SOS_buffer *buffer) {
 
 void SOS_buffer_destroy(SOS_buffer *buffer) {
     SOS_SET_CONTEXT(buffer->sos_context, "SOS_buffer_destroy");
+    int c;
 
     if (buffer == NULL) {
         dlog(10, "ERROR: You called SOS_buffer_destroy() on a NULL buffer!  Terminating.\n");
         exit(EXIT_FAILURE);
     }
 
-    #ifdef SOSD_DAEMON_SRC
-    SOSD_countof(buffer_destroys++);
-    SOSD_countof(buffer_bytes_on_heap -= buffer->max);
-    #endif
+    SOS_buffer_stat_add(destroys, 1);
 
     dlog(18, "Destroying buffer:\n");
     if (buffer->is_locking) {
+        // Wait out anyone still holding it.
         SOS_buffer_lock(buffer);
-        dlog(18, "   ... destroying mutex.\n");
-        pthread_mutex_destroy(buffer->lock);
-        free(buffer->lock);
+        SOS_buffer_unlock(buffer);
+    }
+
+    c = SOS_buffer_pool_class_of(buffer->max);
+    if (c < 0) {
+        dlog(18, "   ... free'ing buffer\n");
+        SOS_buffer_free(buffer);
+        return;
+    }
+
+    dlog(18, "   ... returning it to the pool\n");
+    SOS_buffer_wipe(buffer);
+    if (!SOS_buffer_pool_registered) {
+        SOS_buffer_pool_register_thread();
+    }
+    buffer->next_free = SOS_buffer_pool_local[c];
+    SOS_buffer_pool_local[c] = buffer;
+    SOS_buffer_pool_local_count[c]++;
+    if (SOS_buffer_pool_local_count[c]
+            > SOS_BUFFER_POOL_CAP(SOS_BUFFER_POOL_LOCAL_BYTES, c)) {
+        SOS_buffer_pool_spill(c);
     }
-    dlog(18, "   ... free'ing data\n");
-    free(buffer->data);
-    dlog(18, "   ... free'ing object\n")
-    free(buffer);
     dlog(18, "   ... done.\n");
     return;
 }
 
 
+// Everything from len up is still zero, only the used part is cleared.
 void SOS_buffer_wipe(SOS_buffer *buffer) {
     SOS_SET_CONTEXT(buffer->sos_context, "SOS_buffer_wipe");
+    int used = buffer->len;
 
     dlog(18, "Wiping out buffer:\n");
-    memset(buffer->data, '\0', buffer->max);
+    if (used > buffer->max) used = buffer->max;
+    if (used > 0) memset(buffer->data, '\0', used);
     buffer->len = 0;
-    dlog(18, "   ... done.   (buffer->max == %d)\n", buffer->max);
+    dlog(18, "   ... done.   (cleared %d of %d bytes)\n", used, buffer->max);
     return;
 }
 
@@ -190,9 +431,7 @@ void SOS_buffer_grow(SOS_buffer *buffer, size_t grow_amount, char *from_func) {
         exit(EXIT_FAILURE);
     } else {
 
-        #ifdef SOSD_DAEMON_SRC
-        SOSD_countof(buffer_bytes_on_heap += grow_amount);
-        #endif
+        SOS_buffer_stat_add(bytes_on_heap, grow_amount);
         dlog(18, "   ... done.\n");
     }
     return;
@@ -215,14 +454,41 @@ void SOS_buffer_trim(SOS_buffer *buffer, size_t to_new_max) {
         exit(EXIT_FAILURE);
     } else {
         buffer->max = to_new_max;
-        #ifdef SOSD_DAEMON_SRC
-        SOSD_countof(buffer_bytes_on_heap -= (original_max - to_new_max));
-        #endif
+        SOS_buffer_stat_sub(bytes_on_heap, (original_max - to_new_max));
         dlog(15, "   ... done.\n");
     }
     return;
 }
 
+// Makes room for at least max_size bytes in one step, for when the whole
+// size is known up front.  The contents move to storage from the pool
+// (rather than being realloc()'ed) and the old storage goes back to it.
+void SOS_buffer_reserve(SOS_buffer *buffer, int max_size) {
+    SOS_SET_CONTEXT(buffer->sos_context, "SOS_buffer_reserve");
+    SOS_buffer    *spare = NULL;
+    unsigned char *data;
+    int            max;
+
+    if (max_size <= buffer->max) return;
+
+    dlog(15, "Reserving %d bytes (was %d).\n", max_size, buffer->max);
+    SOS_buffer_init_sized_locking(buffer->sos_context, &spare, max_size, false);
+    if (buffer->len > 0) {
+        memcpy(spare->data, buffer->data, buffer->len);
+    }
+
+    data         = spare->data;
+    max          = spare->max;
+    spare->data  = buffer->data;
+    spare->max   = buffer->max;
+    spare->len   = buffer->len;
+    buffer->data = data;
+    buffer->max  = max;
+
+    SOS_buffer_destroy(spare);
+    return;
+}
+
 /*
 ** pack754() -- pack a floating point number into IEEE-754 format
 */
@@ -291,6 +557,84 @@ double SOS_buffer_unpack754(uint64_t i, unsigned bits, unsigned expbits)
 }
 
 
+/*
+** packd64() -- store a double into a char buffer as a big-endian IEEE-754
+**              binary64, the same bytes pack754_64() + packi64() give
+*/
+void SOS_buffer_packd64(unsigned char *buf, double d)
+{
+#ifdef SOS_BUFFER_NATIVE_754
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    u = SOS_BUFFER_WIRE64(u);
+    memcpy(buf, &u, sizeof(u));
+#else
+    SOS_buffer_packi64(buf, SOS_buffer_pack754_64(d));
+#endif
+}
+
+
+/*
+** unpackd64() -- unpack a double stored by packd64()
+*/
+double SOS_buffer_unpackd64(unsigned char *buf)
+{
+#ifdef SOS_BUFFER_NATIVE_754
+    uint64_t u;
+    double   d;
+    memcpy(&u, buf, sizeof(u));
+    u = SOS_BUFFER_WIRE64(u);
+    memcpy(&d, &u, sizeof(d));
+    return d;
+#else
+    return SOS_buffer_unpack754_64(SOS_buffer_unpacku64(buf));
+#endif
+}
+
+
+/*
+** packd64_array() / unpackd64_array() -- the same for (count) doubles
+**
+**  A plain loop over whole words, which the compiler turns into vector
+**  byte shuffles.
+*/
+void SOS_buffer_packd64_array(unsigned char *buf, const double *src, int count)
+{
+#ifdef SOS_BUFFER_NATIVE_754
+    uint64_t u;
+    int      i;
+    for (i = 0; i < count; i++) {
+        memcpy(&u, &src[i], sizeof(u));
+        u = SOS_BUFFER_WIRE64(u);
+        memcpy(buf + (i * 8), &u, sizeof(u));
+    }
+#else
+    int i;
+    for (i = 0; i < count; i++) {
+        SOS_buffer_packd64(buf + (i * 8), src[i]);
+    }
+#endif
+}
+
+void SOS_buffer_unpackd64_array(unsigned char *buf, double *dest, int count)
+{
+#ifdef SOS_BUFFER_NATIVE_754
+    uint64_t u;
+    int      i;
+    for (i = 0; i < count; i++) {
+        memcpy(&u, buf + (i * 8), sizeof(u));
+        u = SOS_BUFFER_WIRE64(u);
+        memcpy(&dest[i], &u, sizeof(u));
+    }
+#else
+    int i;
+    for (i = 0; i < count; i++) {
+        dest[i] = SOS_buffer_unpackd64(buf + (i * 8));
+    }
+#endif
+}
+
+
 /*
 ** packi32() -- store a 32-bit int into a char buffer (like htonl())
 */
@@ -401,6 +745,48 @@ uint64_t SOS_buffer_unpacku64(unsigned char *buf)
 }
 
 
+/*
+** packvar() -- store a 64-bit unsigned in 1-10 bytes, 7 bits at a time
+**
+**  Low bits first, with the high bit of each byte set if more follow.
+**  Returns the byte after the last one written.
+*/
+unsigned char* SOS_buffer_packvar(unsigned char *buf, uint64_t u)
+{
+    while (u >= 0x80) {
+        *buf++ = (unsigned char) (u | 0x80);
+        u >>= 7;
+    }
+    *buf++ = (unsigned char) u;
+    return buf;
+}
+
+
+/*
+** unpackvar() -- the reverse, reading no further than end
+**
+**  Returns the number of bytes read, or -1 if the value runs past end
+**  or is longer than a 64-bit value can be.
+*/
+int SOS_buffer_unpackvar(unsigned char *buf, unsigned char *end, uint64_t *u)
+{
+    uint64_t v = 0;
+    int shift  = 0;
+    int i      = 0;
+
+    while ((buf + i) < end) {
+        v |= ((uint64_t) (buf[i] & 0x7f)) << shift;
+        if ((buf[i++] & 0x80) == 0) {
+            *u = v;
+            return i;
+        }
+        shift += 7;
+        if (shift > 63) break;
+    }
+    return -1;
+}
+
+
 
 
 
@@ -424,8 +810,6 @@ int SOS_buffer_pack(SOS_buffer *buffer, int *offset, char *format, ...) {
     unsigned char   *b;   // bytes (raw data array, blob, etc)
     unsigned char    false_b = '\0';
 
-    uint64_t fhold;
-
     int len;
     unsigned int datalen;
 
@@ -474,8 +858,7 @@ int SOS_buffer_pack(SOS_buffer *buffer, int *offset, char *format, ...) {
         case 'd': // float-64
             d = va_arg(ap, double);
             dlog(18, "  ... packing d @ %d:   %lf   [64-bit float]\n", packed_bytes, (double) d);
-            fhold = SOS_buffer_pack754_64(d); // convert to IEEE 754
-            SOS_buffer_packi64(buf, fhold);
+            SOS_buffer_packd64(buf, d);        // as IEEE 754
             buf += 8;
             packed_bytes += 8;
             break;
@@ -589,6 +972,115 @@ SOS_buffer_pack_bytes(SOS_buffer *buffer, int *offset, int byte_count, void *sou
 
 
 
+// Arrays go out as [int32 count][elements], each element in the same
+// encoding SOS_buffer_pack() gives it: 4 bytes for INT, 8 for LONG and
+// DOUBLE.
+int
+SOS_buffer_pack_array(SOS_buffer *buffer, int *offset, int val_type,
+        int elem_count, const void *source)
+{
+    SOS_SET_CONTEXT(buffer->sos_context, "SOS_buffer_pack_array");
+    SOS_val_type     type = (SOS_val_type) val_type;
+    unsigned char   *buf;
+    int              wire_size;
+    int              packed_bytes;
+    int              i;
+
+    if (!SOS_VAL_TYPE_IS_ARRAY(type)) {
+        dlog(0, "ERROR: %s is not an array type.\n",
+                SOS_ENUM_STR(type, SOS_VAL_TYPE));
+        return 0;
+    }
+    if (elem_count < 0) elem_count = 0;
+
+    wire_size = (type == SOS_VAL_TYPE_INT_ARRAY) ? 4 : 8;
+    while ((*offset + 4 + (elem_count * wire_size)) > (buffer->max + 1)) {
+        SOS_buffer_grow(buffer, SOS_DEFAULT_BUFFER_MAX, SOS_WHOAMI);
+    }
+    buf = (buffer->data + *offset);
+
+    dlog(18, "  ... packing %d %s @ %d\n", elem_count,
+            SOS_ENUM_STR(type, SOS_VAL_TYPE), *offset);
+
+    SOS_buffer_packi32(buf, elem_count);
+    buf += 4;
+
+    switch (type) {
+    case SOS_VAL_TYPE_INT_ARRAY:
+        for (i = 0; i < elem_count; i++, buf += 4) {
+            SOS_buffer_packi32(buf, ((const int *) source)[i]);
+        }
+        break;
+    case SOS_VAL_TYPE_LONG_ARRAY:
+        for (i = 0; i < elem_count; i++, buf += 8) {
+            SOS_buffer_packi64(buf, ((const long *) source)[i]);
+        }
+        break;
+    default:
+        SOS_buffer_packd64_array(buf, (const double *) source, elem_count);
+        break;
+    }
+
+    packed_bytes = 4 + (elem_count * wire_size);
+    *offset     += packed_bytes;
+    buffer->len  = (buffer->len > *offset) ? buffer->len : *offset;
+
+    return packed_bytes;
+}
+
+
+// Returns the number of elements placed in dest, or -1 (leaving the
+// offset alone) if there are more than elem_max of them.
+int
+SOS_buffer_unpack_array(SOS_buffer *buffer, int *offset, int val_type,
+        int elem_max, void *dest)
+{
+    SOS_SET_CONTEXT(buffer->sos_context, "SOS_buffer_unpack_array");
+    SOS_val_type     type = (SOS_val_type) val_type;
+    unsigned char   *buf;
+    int              wire_size;
+    int              elem_count;
+    int              i;
+
+    if (!SOS_VAL_TYPE_IS_ARRAY(type)
+     || ((*offset + 4) > buffer->len)) {
+        return -1;
+    }
+
+    wire_size  = (type == SOS_VAL_TYPE_INT_ARRAY) ? 4 : 8;
+    buf        = (buffer->data + *offset);
+    elem_count = SOS_buffer_unpacki32(buf);
+    buf += 4;
+
+    if ((elem_count < 0) || (elem_count > elem_max)
+     || ((*offset + 4 + (elem_count * wire_size)) > buffer->len)) {
+        dlog(0, "ERROR: Invalid array (%d of at most %d elements) @ %d.\n",
+                elem_count, elem_max, *offset);
+        return -1;
+    }
+
+    switch (type) {
+    case SOS_VAL_TYPE_INT_ARRAY:
+        for (i = 0; i < elem_count; i++, buf += 4) {
+            ((int *) dest)[i] = SOS_buffer_unpacki32(buf);
+        }
+        break;
+    case SOS_VAL_TYPE_LONG_ARRAY:
+        for (i = 0; i < elem_count; i++, buf += 8) {
+            ((long *) dest)[i] = SOS_buffer_unpacki64(buf);
+        }
+        break;
+    default:
+        SOS_buffer_unpackd64_array(buf, (double *) dest, elem_count);
+        break;
+    }
+
+    *offset += 4 + (elem_count * wire_size);
+    return elem_count;
+}
+
+
+
 
 
 /*
@@ -618,8 +1110,6 @@ int SOS_buffer_unpack(SOS_buffer *buffer, int *offset, char *format, ...) {
     char     *s;       // string
     unsigned char *b;  // bytes (raw data)
 
-    uint64_t  fhold;
-
     unsigned int len, count;
     unsigned int maxlen;
     int packed_bytes;
@@ -656,8 +1146,7 @@ int SOS_buffer_unpack(SOS_buffer *buffer, int *offset, char *format, ...) {
             break;
         case 'd': // float-64
             d = va_arg(ap, double*);
-            fhold = SOS_buffer_unpacku64(buf);
-            *d = SOS_buffer_unpack754_64(fhold);
+            *d = SOS_buffer_unpackd64(buf);
             dlog(18, "  ... unpacked d @ %d:   %lf   [64-bit double]\n", packed_bytes, *d);
             buf += 8;
             packed_bytes += 8;
@@ -695,8 +1184,8 @@ int SOS_buffer_unpack(SOS_buffer *buffer, int *offset, char *format, ...) {
             if (b == NULL) {
                 b = (unsigned char *) calloc((count + 1), sizeof(unsigned char));
             }
-            memcpy(s, buf, count);
-            dlog(18, "  ... unpacked b @ %d:   \"%s\"   (%d bytes + 4)\n", packed_bytes, b, len);
+            memcpy(b, buf, count);
+            dlog(18, "  ... unpacked b @ %d:   (%d bytes + 4)\n", packed_bytes, len);
             buf += len;
             packed_bytes += len;
             break;
@@ -29,12 +29,46 @@ typedef struct {
     unsigned char       *data;
     int                  len;
     int                  max;
+    void                *next_free;
 #ifdef USE_MUNGE
     char                *ref_cred;
 #endif
 } SOS_buffer;
 
 
+/*
+ *   Destroyed buffers are kept for reuse in power-of-two size classes,
+ *   from SOS_BUFFER_POOL_MIN bytes up through SOS_BUFFER_POOL_CLASSES
+ *   doublings of it.  Each thread keeps up to SOS_BUFFER_POOL_LOCAL_BYTES
+ *   of every class to itself and trades the rest through a shared list,
+ *   which holds up to SOS_BUFFER_POOL_SHARED_BYTES of each class.  Larger
+ *   buffers, and anything past those limits, are freed as before.
+ *
+ *   New buffers start with data[0..max) zeroed.  The pack functions only
+ *   write below len, so that is all that a wipe (or a trip through the
+ *   pool) clears.  Anything written into data[] by hand past a len that
+ *   is later lowered is left for the next user to overwrite.
+ */
+#define SOS_BUFFER_POOL_MIN             512
+#define SOS_BUFFER_POOL_CLASSES         12
+#define SOS_BUFFER_POOL_LOCAL_BYTES     (64 * 1024)
+#define SOS_BUFFER_POOL_SHARED_BYTES    (4 * 1024 * 1024)
+
+typedef struct {
+    uint64_t             creates;
+    uint64_t             pool_hits;
+    uint64_t             destroys;
+    uint64_t             bytes_on_heap;
+} SOS_buffer_stats;
+
+
+// Signed values for packvar(), so small negatives stay small: 0, -1, 1, -2...
+#define SOS_BUFFER_ZIGZAG(__i64)                                            \
+    ((((uint64_t) (__i64)) << 1) ^ ((uint64_t) (((int64_t) (__i64)) >> 63)))
+#define SOS_BUFFER_UNZIGZAG(__u64)                                          \
+    ((int64_t) (((__u64) >> 1) ^ (0 - ((__u64) & 1))))
+
+
 /* Required if included by C++ code. */
 #ifdef __cplusplus
 extern "C" {
@@ -49,6 +83,7 @@ void         SOS_buffer_clone(SOS_buffer **dest, SOS_buffer *src);
 void         SOS_buffer_lock(SOS_buffer *buffer);
 void         SOS_buffer_unlock(SOS_buffer *buffer);
 void         SOS_buffer_destroy(SOS_buffer *buffer);
+void         SOS_buffer_pool_stats(SOS_buffer_stats *stats);
 
              // The following functions do *NOT* lock the buffer...
              // (You should hold the lock already, manually)
@@ -56,14 +91,20 @@ void         SOS_buffer_wipe(SOS_buffer *buffer);
 void         SOS_buffer_grow(SOS_buffer *buffer, size_t grow_amount,
                     char *from_func);
 void         SOS_buffer_trim(SOS_buffer *buffer, size_t to_new_max);
+void         SOS_buffer_reserve(SOS_buffer *buffer, int max_size);
 
 int          SOS_buffer_pack(SOS_buffer *buffer, int *offset, char *format, ...);
 int          SOS_buffer_pack_bytes(SOS_buffer *buffer, int *offset,
                     int byte_count, void *source);
+             // (sos_types.h includes this file, so val_type is an int.)
+int          SOS_buffer_pack_array(SOS_buffer *buffer, int *offset,
+                    int val_type, int elem_count, const void *source);
 
 int          SOS_buffer_unpack(SOS_buffer *buffer, int *offset, char *format, ...);
 void         SOS_buffer_unpack_safestr(SOS_buffer *buffer, int *offset,
                     char **dest);
+int          SOS_buffer_unpack_array(SOS_buffer *buffer, int *offset,
+                    int val_type, int elem_max, void *dest);
 
 uint64_t     SOS_buffer_pack754(long double f, unsigned bits, unsigned expbits);
 double       SOS_buffer_unpack754(uint64_t i, unsigned bits, unsigned expbits);
@@ -72,6 +113,17 @@ void         SOS_buffer_packi64(unsigned char *buf, int64_t i);
 int32_t      SOS_buffer_unpacki32(unsigned char *buf);
 int64_t      SOS_buffer_unpacki64(unsigned char *buf);
 uint64_t     SOS_buffer_unpacku64(unsigned char *buf);
+void         SOS_buffer_packguid(unsigned char *buf, uint64_t g);
+uint64_t     SOS_buffer_unpackguid(unsigned char *buf);
+unsigned char* SOS_buffer_packvar(unsigned char *buf, uint64_t u);
+int          SOS_buffer_unpackvar(unsigned char *buf, unsigned char *end,
+                    uint64_t *u);
+void         SOS_buffer_packd64(unsigned char *buf, double d);
+double       SOS_buffer_unpackd64(unsigned char *buf);
+void         SOS_buffer_packd64_array(unsigned char *buf, const double *src,
+                    int count);
+void         SOS_buffer_unpackd64_array(unsigned char *buf, double *dest,
+                    int count);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,511 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "sos.h"
+#include "sos_types.h"
+#include "sos_debug.h"
+#include "sos_pipe.h"
+#include "sos_snap_pool.h"
+#include "sos_coalesce.h"
+
+
+static void* SOS_THREAD_coalesce_timer(void *args);
+
+
+void
+SOS_coalesce_init(SOS_runtime *sos_context) {
+    SOS_SET_CONTEXT(sos_context, "SOS_coalesce_init");
+    SOS_coalesce_timer *t;
+
+    t = (SOS_coalesce_timer *) calloc(1, sizeof(SOS_coalesce_timer));
+    t->sos_context = SOS;
+    t->running     = true;
+    t->started     = false;
+    t->waiting     = NULL;
+    t->current     = NULL;
+
+    t->timer = (pthread_t *)       calloc(1, sizeof(pthread_t));
+    t->lock  = (pthread_mutex_t *) calloc(1, sizeof(pthread_mutex_t));
+    t->wake  = (pthread_cond_t *)  calloc(1, sizeof(pthread_cond_t));
+    t->idle  = (pthread_cond_t *)  calloc(1, sizeof(pthread_cond_t));
+    pthread_mutex_init(t->lock, NULL);
+    pthread_cond_init(t->wake, NULL);
+    pthread_cond_init(t->idle, NULL);
+
+    SOS->task.coalesce = t;
+    return;
+}
+
+
+#define SOS_COALESCE_KEEP(__field)                                          \
+    switch (semantic) {                                                     \
+    case SOS_VAL_SEMANTIC_TIME_START:                                       \
+        if (prev->val.__field < snap->val.__field) {                        \
+            snap->val.__field = prev->val.__field;                          \
+        }                                                                   \
+        break;                                                              \
+    case SOS_VAL_SEMANTIC_TIME_STOP:                                        \
+        if (prev->val.__field > snap->val.__field) {                        \
+            snap->val.__field = prev->val.__field;                          \
+        }                                                                   \
+        break;                                                              \
+    case SOS_VAL_SEMANTIC_TIME_SPAN:                                        \
+        snap->val.__field += prev->val.__field;                             \
+        break;                                                              \
+    default:                                                                \
+        break;                                                              \
+    }
+
+
+// Fold the older snap's value into the newer one.
+static void
+SOS_coalesce_combine(SOS_val_semantic semantic,
+        SOS_val_snap *prev, SOS_val_snap *snap)
+{
+    switch (snap->type) {
+    case SOS_VAL_TYPE_INT:    SOS_COALESCE_KEEP(i_val); break;
+    case SOS_VAL_TYPE_LONG:   SOS_COALESCE_KEEP(l_val); break;
+    case SOS_VAL_TYPE_DOUBLE: SOS_COALESCE_KEEP(d_val); break;
+    default:                  break;
+    }
+    return;
+}
+
+
+static bool
+SOS_coalesce_is_numeric(SOS_val_type type) {
+    return ((type == SOS_VAL_TYPE_INT)
+         || (type == SOS_VAL_TYPE_LONG)
+         || (type == SOS_VAL_TYPE_DOUBLE));
+}
+
+
+// Size the per-value state to match the pub.
+static void
+SOS_coalesce_grow(SOS_pub *pub) {
+    int max = pub->elem_max;
+
+    if (pub->pending_max >= max) return;
+
+    pub->pending = (SOS_val_snap **)
+        realloc(pub->pending, max * sizeof(SOS_val_snap *));
+    memset(&pub->pending[pub->pending_max], 0,
+            (max - pub->pending_max) * sizeof(SOS_val_snap *));
+    pub->summary = (SOS_val_summary *)
+        realloc(pub->summary, max * sizeof(SOS_val_summary));
+    memset(&pub->summary[pub->pending_max], 0,
+            (max - pub->pending_max) * sizeof(SOS_val_summary));
+    pub->pending_max = max;
+
+    return;
+}
+
+
+// COUNTER: the packed value is added to the running total, and one snap
+// per publish carries the total.  SAMPLE: the packed value only goes into
+// the summary, see SOS_coalesce_release_pending().
+static void
+SOS_coalesce_aggregate(SOS_pub *pub, SOS_val_snap *snap) {
+    SOS_data        *data = pub->data[snap->elem];
+    SOS_val_summary *summary = &pub->summary[snap->elem];
+    SOS_val_snap    *prev;
+    double           x;
+
+    if (data->meta.semantic == SOS_VAL_SEMANTIC_COUNTER) {
+        switch (snap->type) {
+        case SOS_VAL_TYPE_INT:
+            summary->total.i_val += snap->val.i_val;
+            snap->val.i_val = summary->total.i_val;
+            break;
+        case SOS_VAL_TYPE_LONG:
+            summary->total.l_val += snap->val.l_val;
+            snap->val.l_val = summary->total.l_val;
+            break;
+        default:
+            summary->total.d_val += snap->val.d_val;
+            snap->val.d_val = summary->total.d_val;
+            break;
+        }
+        data->val = snap->val;
+
+        prev = pub->pending[snap->elem];
+        pub->pending[snap->elem] = snap;
+        if (prev != NULL) SOS_val_snap_destroy(&prev);
+        return;
+    }
+
+    switch (snap->type) {
+    case SOS_VAL_TYPE_INT:  x = (double) snap->val.i_val; break;
+    case SOS_VAL_TYPE_LONG: x = (double) snap->val.l_val; break;
+    default:                x = snap->val.d_val;          break;
+    }
+    if ((summary->count == 0) || (x < summary->min)) summary->min = x;
+    if ((summary->count == 0) || (x > summary->max)) summary->max = x;
+    summary->count++;
+    summary->sum   += x;
+    summary->sumsq += x * x;
+
+    SOS_val_snap_destroy(&snap);
+    return;
+}
+
+
+// Returns true when the snap was taken in (as the value's pending snap,
+// or into its summary), in which case it must not go into the snap queue.
+// CONCURRENCY: Assumes pub->lock is held.
+bool
+SOS_coalesce_snap(SOS_pub *pub, SOS_val_snap *snap) {
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_coalesce_snap");
+    SOS_data     *data;
+    SOS_val_snap *prev;
+
+    if (SOS->role != SOS_ROLE_CLIENT) return false;
+
+    data = pub->data[snap->elem];
+    if (pub->aggregate && SOS_coalesce_is_numeric(snap->type)
+     && ((data->meta.semantic == SOS_VAL_SEMANTIC_COUNTER)
+      || (data->meta.semantic == SOS_VAL_SEMANTIC_SAMPLE))) {
+        SOS_coalesce_grow(pub);
+        SOS_coalesce_aggregate(pub, snap);
+        return true;
+    }
+
+    if (!pub->coalesce && (data->meta.freq != SOS_VAL_FREQ_CONTINUOUS)) {
+        return false;
+    }
+
+    SOS_coalesce_grow(pub);
+    prev = pub->pending[snap->elem];
+    pub->pending[snap->elem] = snap;
+    if (prev == NULL) return true;
+
+    SOS_coalesce_combine(data->meta.semantic, prev, snap);
+    if (SOS_coalesce_is_numeric(snap->type)) {
+        // The pub shows what will be sent, not just the last value.
+        data->val = snap->val;
+    }
+    SOS_val_snap_destroy(&prev);
+
+    return true;
+}
+
+
+static void
+SOS_coalesce_push(SOS_pub *pub, SOS_val_snap **snap_list, int count) {
+    pthread_mutex_lock(pub->snap_queue->sync_lock);
+    pipe_push(pub->snap_queue->intake, (void *) snap_list, count);
+    pub->snap_queue->elem_count += count;
+    pthread_mutex_unlock(pub->snap_queue->sync_lock);
+    return;
+}
+
+
+// Pack a SAMPLE value's summary as "<name>.count", "<name>.min", ".max",
+// ".sum", and ".sumsq", related to the value it summarizes.
+static void
+SOS_coalesce_emit_summary(SOS_pub *pub, int elem) {
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_coalesce_emit_summary");
+    const char     *part[SOS_VAL_SUMMARY_PARTS] =
+                      { "count", "min", "max", "sum", "sumsq" };
+    SOS_val_summary summary = pub->summary[elem];
+    double          part_val[SOS_VAL_SUMMARY_PARTS] =
+                      { 0.0, summary.min, summary.max, summary.sum,
+                        summary.sumsq };
+    SOS_val_snap   *snap_list[SOS_VAL_SUMMARY_PARTS];
+    SOS_val_snap   *snap;
+    SOS_val_type    type;
+    const void     *val;
+    char            name[SOS_DEFAULT_STRING_LEN + sizeof(".sumsq")];
+    char            base[SOS_DEFAULT_STRING_LEN];
+    SOS_guid        base_guid;
+    int             count;
+    int             rc;
+    int             i;
+
+    // Adding the parts can grow pub->data, so copy what is needed first.
+    strncpy(base, pub->data[elem]->name, SOS_DEFAULT_STRING_LEN - 1);
+    base[SOS_DEFAULT_STRING_LEN - 1] = '\0';
+    base_guid = pub->data[elem]->guid;
+
+    count = 0;
+    for (i = 0; i < SOS_VAL_SUMMARY_PARTS; i++) {
+        // The part names have to fit in a pub data name, uncut, or they
+        // would collide with each other.
+        rc = snprintf(name, sizeof(name), "%s.%s", base, part[i]);
+        if ((rc < 0) || (rc >= SOS_DEFAULT_STRING_LEN)) {
+            dlog(0, "ERROR: Summary name for \"%s\" is too long, skipping"
+                    " its \".%s\".\n", base, part[i]);
+            continue;
+        }
+        type = (i == 0) ? SOS_VAL_TYPE_LONG : SOS_VAL_TYPE_DOUBLE;
+        val  = (i == 0) ? (const void *) &summary.count
+                        : (const void *) &part_val[i];
+
+        snap = SOS_val_snap_alloc();
+        if ((SOS_pack_snap_situate_in_pub(pub, snap, name, type, val) < 0)
+         || (pub->data[snap->elem]->type != type)) {
+            dlog(0, "ERROR: Unable to pack \"%s\" for a summary.\n", name);
+            SOS_val_snap_destroy(&snap);
+            continue;
+        }
+        snap->relation_id = base_guid;
+        SOS_pack_snap_renew_pub_data(pub, snap);
+        SOS_pack_snap_add_to_pub_cache(pub, snap);
+        snap_list[count++] = snap;
+    }
+    if (count > 0) {
+        SOS_coalesce_push(pub, snap_list, count);
+    }
+
+    return;
+}
+
+
+// Move the pending snaps into the snap queue, in pub order, followed by
+// the summaries of any SAMPLE values.
+// CONCURRENCY: Assumes pub->lock is held.
+void
+SOS_coalesce_release_pending(SOS_pub *pub) {
+    SOS_val_snap *snap;
+    int           pending_max;
+    int           count;
+    int           elem;
+
+    if ((pub->pending == NULL) || (pub->snap_queue == NULL)) return;
+
+    pending_max = pub->pending_max;
+    count = 0;
+    for (elem = 0; elem < pending_max; elem++) {
+        if (pub->pending[elem] == NULL) continue;
+        snap = pub->pending[elem];
+        pub->pending[elem]    = NULL;
+        pub->pending[count++] = snap;
+    }
+    if (count > 0) {
+        SOS_coalesce_push(pub, pub->pending, count);
+        memset(pub->pending, 0, count * sizeof(SOS_val_snap *));
+    }
+
+    for (elem = 0; elem < pending_max; elem++) {
+        if (pub->summary[elem].count == 0) continue;
+        SOS_coalesce_emit_summary(pub, elem);
+        pub->summary[elem].count = 0;
+        pub->summary[elem].sum   = 0.0;
+        pub->summary[elem].sumsq = 0.0;
+    }
+
+    return;
+}
+
+
+// Returns true if the publish was left for the timer thread, or false if
+// it should go out now.
+bool
+SOS_coalesce_defer_publish(SOS_pub *pub) {
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_coalesce_defer_publish");
+    SOS_coalesce_timer *t = SOS->task.coalesce;
+    SOS_coalesce_entry *entry;
+    double              now;
+    double              due;
+    bool                deferred;
+    int                 interval;
+    int                 rc;
+
+    if (t == NULL) return false;
+
+    // A daemon that is falling behind can ask for more room than the pub
+    // would otherwise leave between publishes.
+    interval = pub->publish_usec;
+    if (SOS->daemon != NULL) {
+        rc = __atomic_load_n(&SOS->daemon->backoff_usec, __ATOMIC_RELAXED);
+        if (rc > interval) interval = rc;
+    }
+    if (interval < 1) return false;
+
+    deferred = false;
+    pthread_mutex_lock(pub->lock);
+    pthread_mutex_lock(t->lock);
+
+    SOS_TIME(now);
+    due = pub->last_publish + ((double) interval / 1000000.0);
+
+    // The timer thread only publishes what has already waited its turn.
+    // The backoff may have grown since this one was queued, so it goes
+    // out now rather than being left with nothing queued to send it.
+    if ((now >= due) || (t->running == false)
+     || (t->started && pthread_equal(pthread_self(), *t->timer))) {
+        pub->last_publish     = now;
+        pub->publish_deferred = false;
+    } else {
+        deferred = true;
+        if (pub->publish_deferred == false) {
+            entry = (SOS_coalesce_entry *) calloc(1, sizeof(SOS_coalesce_entry));
+            entry->pub        = (void *) pub;
+            entry->due        = due;
+            entry->next_entry = (void *) t->waiting;
+            t->waiting        = entry;
+            pub->publish_deferred = true;
+
+            if (t->started == false) {
+                rc = pthread_create(t->timer, NULL, SOS_THREAD_coalesce_timer,
+                        (void *) t);
+                if (rc != 0) {
+                    dlog(0, "ERROR: Unable to start the publish timer thread."
+                            "  (%d)\n", rc);
+                    exit(EXIT_FAILURE);
+                }
+                t->started = true;
+            }
+            pthread_cond_signal(t->wake);
+        }
+    }
+
+    pthread_mutex_unlock(t->lock);
+    pthread_mutex_unlock(pub->lock);
+
+    if (deferred) {
+        dlog(6, "Deferred a publish of \"%s\".\n", pub->title);
+    }
+    return deferred;
+}
+
+
+// Drop a waiting publish of a pub that is going away.
+void
+SOS_coalesce_forget_pub(SOS_pub *pub) {
+    SOS_SET_CONTEXT(pub->sos_context, "SOS_coalesce_forget_pub");
+    SOS_coalesce_timer *t = SOS->task.coalesce;
+    SOS_coalesce_entry *entry;
+    SOS_coalesce_entry *prev;
+
+    if (t == NULL) return;
+
+    pthread_mutex_lock(t->lock);
+    prev  = NULL;
+    entry = t->waiting;
+    while (entry != NULL) {
+        if (entry->pub == (void *) pub) {
+            if (prev == NULL) {
+                t->waiting = entry->next_entry;
+            } else {
+                prev->next_entry = entry->next_entry;
+            }
+            free(entry);
+            break;
+        }
+        prev  = entry;
+        entry = entry->next_entry;
+    }
+    while (t->current == (void *) pub) {
+        pthread_cond_wait(t->idle, t->lock);
+    }
+    pthread_mutex_unlock(t->lock);
+
+    return;
+}
+
+
+static void*
+SOS_THREAD_coalesce_timer(void *args) {
+    SOS_coalesce_timer *t = (SOS_coalesce_timer *) args;
+    SOS_SET_CONTEXT(t->sos_context, "SOS_THREAD_coalesce_timer");
+    SOS_coalesce_entry *entry;
+    SOS_coalesce_entry *first;
+    SOS_coalesce_entry *first_prev;
+    SOS_coalesce_entry *prev;
+    SOS_pub            *pub;
+    struct timespec     until;
+    double              now;
+    bool                still_waiting;
+
+    pthread_mutex_lock(t->lock);
+    for (;;) {
+        if (t->waiting == NULL) {
+            if (t->running == false) break;
+            pthread_cond_wait(t->wake, t->lock);
+            continue;
+        }
+
+        first      = t->waiting;
+        first_prev = NULL;
+        prev       = t->waiting;
+        for (entry = t->waiting->next_entry; entry != NULL;
+                entry = entry->next_entry) {
+            if (entry->due < first->due) {
+                first      = entry;
+                first_prev = prev;
+            }
+            prev = entry;
+        }
+
+        SOS_TIME(now);
+        if (t->running && (first->due > now)) {
+            until.tv_sec  = (time_t) first->due;
+            until.tv_nsec = (long) ((first->due - (double) until.tv_sec) * 1e9);
+            pthread_cond_timedwait(t->wake, t->lock, &until);
+            continue;
+        }
+
+        if (first_prev == NULL) {
+            t->waiting = first->next_entry;
+        } else {
+            first_prev->next_entry = first->next_entry;
+        }
+        pub = (SOS_pub *) first->pub;
+        free(first);
+        t->current = (void *) pub;
+        pthread_mutex_unlock(t->lock);
+
+        // An SOS_publish() that came due on its own has already sent it.
+        pthread_mutex_lock(pub->lock);
+        still_waiting = pub->publish_deferred;
+        pthread_mutex_unlock(pub->lock);
+        if (still_waiting) {
+            dlog(6, "Sending the deferred publish of \"%s\".\n", pub->title);
+            SOS_publish(pub);
+        }
+
+        pthread_mutex_lock(t->lock);
+        t->current = NULL;
+        pthread_cond_broadcast(t->idle);
+    }
+    pthread_mutex_unlock(t->lock);
+
+    dlog(4, "Leaving thread safely.\n");
+    return NULL;
+}
+
+
+void
+SOS_coalesce_destroy(SOS_runtime *sos_context) {
+    SOS_SET_CONTEXT(sos_context, "SOS_coalesce_destroy");
+    SOS_coalesce_timer *t = SOS->task.coalesce;
+
+    if (t == NULL) return;
+
+    // The timer thread sends every deferred publish right away before
+    // it exits.
+    pthread_mutex_lock(t->lock);
+    t->running = false;
+    pthread_cond_signal(t->wake);
+    pthread_mutex_unlock(t->lock);
+    if (t->started) {
+        pthread_join(*t->timer, NULL);
+    }
+
+    pthread_cond_destroy(t->wake);
+    pthread_cond_destroy(t->idle);
+    pthread_mutex_destroy(t->lock);
+    free(t->wake);
+    free(t->idle);
+    free(t->lock);
+    free(t->timer);
+    free(t);
+
+    SOS->task.coalesce = NULL;
+    return;
+}
@@ -0,0 +1,60 @@
+#ifndef SOS_COALESCE_H
+#define SOS_COALESCE_H
+
+/*
+ *   Client-side coalescing and rate-limited publishing.
+ *
+ *   Coalescing: a value packed several times between two publishes goes
+ *   out as one snap.  This covers every value of a pub with coalesce set
+ *   (SOS_PUBLISH_COALESCE, or SOS_PUB_OPTION_COALESCE), and any value whose
+ *   meta.freq is SOS_VAL_FREQ_CONTINUOUS (see SOS_val_set_meta()).  The
+ *   value that is kept follows meta.semantic:
+ *     TIME_START  ...the smallest one.
+ *     TIME_STOP   ...the largest one.
+ *     TIME_SPAN   ...the sum of them.
+ *     (others)    ...the last one packed.
+ *   Strings always keep the last one.
+ *
+ *   Aggregation: in a pub with aggregate set (SOS_PUBLISH_AGGREGATE, or
+ *   SOS_PUB_OPTION_AGGREGATE) numeric values are also folded by semantic:
+ *     COUNTER     ...each pack adds to a running total, and the total is
+ *                    sent once per publish.
+ *     SAMPLE      ...packs only update a summary.  Each publish sends it
+ *                    as "<name>.count", ".min", ".max", ".sum", and
+ *                    ".sumsq", related to the value (relation_id), and
+ *                    starts a new one.
+ *
+ *   Rate limiting: a pub with publish_usec > 0 (SOS_PUBLISH_MIN_USEC, or
+ *   SOS_PUB_OPTION_RATE_LIMIT) is sent at most once per publish_usec.  A
+ *   SOS_publish() that comes sooner is deferred and a libsos timer thread
+ *   sends it when the interval is up, along with anything packed since.
+ *   While the daemon's ACKs ask for a delay (see SOSD_backpressure()) every
+ *   pub is limited to at least that interval.
+ */
+
+#include "sos.h"
+#include "sos_types.h"
+
+#define SOS_VAL_SUMMARY_PARTS       5
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    void SOS_coalesce_init(SOS_runtime *sos_context);
+
+    bool SOS_coalesce_snap(SOS_pub *pub, SOS_val_snap *snap);
+
+    void SOS_coalesce_release_pending(SOS_pub *pub);
+
+    bool SOS_coalesce_defer_publish(SOS_pub *pub);
+
+    void SOS_coalesce_forget_pub(SOS_pub *pub);
+
+    void SOS_coalesce_destroy(SOS_runtime *sos_context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "sos.h"
+#include "sos_types.h"
+#include "sos_buffer.h"
+#include "sos_intern.h"
+
+// Callers only ever see str, the node is found again by stepping back.
+typedef struct SOS_intern_node {
+    struct SOS_intern_node *next;
+    int                     refs;
+    int                     len;
+    uint32_t                hash;
+    char                    str[];
+} SOS_intern_node;
+
+typedef struct {
+    pthread_mutex_t         lock;
+    SOS_intern_node       **bucket;
+    int                     size;
+    int                     count;
+} SOS_intern_stripe;
+
+#define SOS_INTERN_NODE(__str) \
+    ((SOS_intern_node *) ((__str) - offsetof(SOS_intern_node, str)))
+
+static pthread_once_t    SOS_intern_once = PTHREAD_ONCE_INIT;
+static SOS_intern_stripe SOS_intern_stripe_list[SOS_INTERN_STRIPES];
+
+
+static void
+SOS_intern_init(void) {
+    SOS_intern_stripe *stripe;
+    int i;
+
+    for (i = 0; i < SOS_INTERN_STRIPES; i++) {
+        stripe = &SOS_intern_stripe_list[i];
+        pthread_mutex_init(&stripe->lock, NULL);
+        stripe->size   = SOS_INTERN_MIN_BUCKETS;
+        stripe->count  = 0;
+        stripe->bucket = (SOS_intern_node **)
+            calloc(stripe->size, sizeof(SOS_intern_node *));
+        if (stripe->bucket == NULL) {
+            fprintf(stderr, "ERROR: Unable to allocate the string table.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return;
+}
+
+
+static uint32_t
+SOS_intern_hash(const char *str, int len) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    int i;
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char) str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+// The low bits pick the stripe, the rest pick the bucket within it.
+static SOS_intern_stripe*
+SOS_intern_stripe_for(uint32_t hash) {
+    return &SOS_intern_stripe_list[hash % SOS_INTERN_STRIPES];
+}
+
+#define SOS_INTERN_BUCKET(__stripe, __hash) \
+    (((__hash) / SOS_INTERN_STRIPES) & (uint32_t) ((__stripe)->size - 1))
+
+
+// CONCURRENCY: Called with stripe->lock held.
+static void
+SOS_intern_grow(SOS_intern_stripe *stripe) {
+    SOS_intern_node **old_bucket = stripe->bucket;
+    SOS_intern_node  *node;
+    SOS_intern_node  *next;
+    int old_size = stripe->size;
+    int pos;
+    int i;
+
+    stripe->size   = old_size * 2;
+    stripe->bucket = (SOS_intern_node **)
+        calloc(stripe->size, sizeof(SOS_intern_node *));
+    if (stripe->bucket == NULL) {
+        fprintf(stderr, "ERROR: Unable to grow the string table to %d"
+                " buckets.\n", stripe->size);
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < old_size; i++) {
+        for (node = old_bucket[i]; node != NULL; node = next) {
+            next = node->next;
+            pos  = SOS_INTERN_BUCKET(stripe, node->hash);
+            node->next = stripe->bucket[pos];
+            stripe->bucket[pos] = node;
+        }
+    }
+    free(old_bucket);
+    return;
+}
+
+
+// Interns the first len bytes of str, which need not be terminated there.
+char*
+SOS_intern_len(const char *str, int len) {
+    SOS_intern_stripe *stripe;
+    SOS_intern_node   *node;
+    uint32_t hash;
+    int pos;
+
+    pthread_once(&SOS_intern_once, SOS_intern_init);
+
+    if (len < 0) len = 0;
+    hash   = SOS_intern_hash(str, len);
+    stripe = SOS_intern_stripe_for(hash);
+
+    pthread_mutex_lock(&stripe->lock);
+
+    pos = SOS_INTERN_BUCKET(stripe, hash);
+    for (node = stripe->bucket[pos]; node != NULL; node = node->next) {
+        if ((node->hash == hash) && (node->len == len)
+         && (memcmp(node->str, str, len) == 0)) {
+            __atomic_add_fetch(&node->refs, 1, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&stripe->lock);
+            return node->str;
+        }
+    }
+
+    node = (SOS_intern_node *) malloc(sizeof(SOS_intern_node) + len + 1);
+    if (node == NULL) {
+        fprintf(stderr, "ERROR: Unable to intern a %d byte string.\n", len);
+        exit(EXIT_FAILURE);
+    }
+    node->refs = 1;
+    node->len  = len;
+    node->hash = hash;
+    memcpy(node->str, str, len);
+    node->str[len] = '\0';
+
+    if (stripe->count >= (stripe->size * 2)) {
+        SOS_intern_grow(stripe);
+        pos = SOS_INTERN_BUCKET(stripe, hash);
+    }
+    node->next = stripe->bucket[pos];
+    stripe->bucket[pos] = node;
+    stripe->count++;
+
+    pthread_mutex_unlock(&stripe->lock);
+    return node->str;
+}
+
+
+char*
+SOS_intern(const char *str) {
+    if (str == NULL) str = "";
+    return SOS_intern_len(str, strlen(str));
+}
+
+
+// Names and pub fields keep the length limit they had as fixed arrays.
+char*
+SOS_intern_name(const char *str) {
+    if (str == NULL) str = "";
+    return SOS_intern_len(str, strnlen(str, (SOS_DEFAULT_STRING_LEN - 1)));
+}
+
+
+// The caller already holds a reference, so this never needs the lock.
+char*
+SOS_intern_retain(char *str) {
+    if (str == NULL) return NULL;
+    __atomic_add_fetch(&SOS_INTERN_NODE(str)->refs, 1, __ATOMIC_RELAXED);
+    return str;
+}
+
+
+void
+SOS_intern_drop(char *str) {
+    SOS_intern_stripe *stripe;
+    SOS_intern_node   *node;
+    SOS_intern_node  **link;
+    int refs;
+
+    if (str == NULL) return;
+    node = SOS_INTERN_NODE(str);
+
+    // Only the last reference has to take the lock, as a lookup could
+    // be about to hand the string out again.
+    refs = __atomic_load_n(&node->refs, __ATOMIC_RELAXED);
+    while (refs > 1) {
+        if (__atomic_compare_exchange_n(&node->refs, &refs, (refs - 1),
+                false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return;
+        }
+    }
+
+    stripe = SOS_intern_stripe_for(node->hash);
+    pthread_mutex_lock(&stripe->lock);
+    if (__atomic_sub_fetch(&node->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+        pthread_mutex_unlock(&stripe->lock);
+        return;
+    }
+    link = &stripe->bucket[SOS_INTERN_BUCKET(stripe, node->hash)];
+    while (*link != node) { link = &(*link)->next; }
+    *link = node->next;
+    stripe->count--;
+    pthread_mutex_unlock(&stripe->lock);
+
+    free(node);
+    return;
+}
+
+
+// Points a name or pub field at an interned copy of str, letting go of
+// what it held.
+void
+SOS_intern_set(char **field, const char *str) {
+    char *old = *field;
+    *field = SOS_intern_name(str);
+    SOS_intern_drop(old);
+    return;
+}
+
+
+// Reads a string packed with the "s" format straight into the table,
+// without staging it in a buffer of its own.  Returns its length, or -1
+// (leaving the field and offset alone) if it runs past the message.
+int
+SOS_intern_unpack(SOS_buffer *buffer, int *offset, char **field) {
+    char *old = *field;
+    int   len;
+
+    if ((*offset + 4) > buffer->len) {
+        return -1;
+    }
+    len = SOS_buffer_unpacki32(buffer->data + *offset);
+    if ((len < 0) || (len > (buffer->len - (*offset + 4)))) {
+        return -1;
+    }
+
+    *field = SOS_intern_len((const char *) (buffer->data + *offset + 4), len);
+    SOS_intern_drop(old);
+    *offset += 4 + len;
+    return len;
+}
+
+
+// Distinct strings currently held.
+int
+SOS_intern_count(void) {
+    int count = 0;
+    int i;
+
+    pthread_once(&SOS_intern_once, SOS_intern_init);
+    for (i = 0; i < SOS_INTERN_STRIPES; i++) {
+        pthread_mutex_lock(&SOS_intern_stripe_list[i].lock);
+        count += SOS_intern_stripe_list[i].count;
+        pthread_mutex_unlock(&SOS_intern_stripe_list[i].lock);
+    }
+    return count;
+}
@@ -0,0 +1,51 @@
+#ifndef SOS_INTERN_H
+#define SOS_INTERN_H
+
+/*
+ *   Process-wide table of reference counted, read-only strings.
+ *
+ *   Value names, pub title/node_id/prog_name/prog_ver, and the values of
+ *   STRING snaps are interned, so a string that is packed over and over
+ *   is stored once no matter how many snaps, pubs, and cached copies
+ *   refer to it.  (Grown out of ref/strmalloc.)
+ *
+ *   Every SOS_intern*() or SOS_intern_retain() is matched by one
+ *   SOS_intern_drop().  The strings are shared and must never be written
+ *   to or free()'ed directly, use SOS_intern_set() to change a field.
+ *
+ *   The table is split into SOS_INTERN_STRIPES independently locked
+ *   stripes by hash, and a retain or drop that does not release the last
+ *   reference takes no lock at all.
+ */
+
+#include "sos_types.h"
+#include "sos_buffer.h"
+
+#define SOS_INTERN_STRIPES          16
+#define SOS_INTERN_MIN_BUCKETS      64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    char* SOS_intern(const char *str);
+
+    char* SOS_intern_len(const char *str, int len);
+
+    char* SOS_intern_name(const char *str);
+
+    char* SOS_intern_retain(char *str);
+
+    void  SOS_intern_drop(char *str);
+
+    void  SOS_intern_set(char **field, const char *str);
+
+    int   SOS_intern_unpack(SOS_buffer *buffer, int *offset, char **field);
+
+    int   SOS_intern_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "sos.h"
+#include "sos_name_index.h"
+#include "sos_intern.h"
+
+// Grow once the table is 3/4 full to keep probe runs short.
+#define SOS_NAME_INDEX_FULL(__idx) (((__idx)->count + 1) * 4 > (__idx)->size * 3)
+
+
+static uint32_t
+SOS_name_index_hash(const char *name) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*name != '\0') {
+        hash ^= (unsigned char) *name++;
+        hash *= 16777619u;
+    }
+    // Zero marks an empty slot.
+    return (hash == 0) ? 1 : hash;
+}
+
+
+static SOS_name_index_slot*
+SOS_name_index_find(
+        SOS_name_index_slot *slot,
+        int                  size,
+        uint32_t             hash,
+        const char          *name)
+{
+    int pos = (int) (hash & (uint32_t) (size - 1));
+
+    while (slot[pos].hash != 0) {
+        if ((slot[pos].hash == hash) && (strcmp(slot[pos].key, name) == 0)) {
+            break;
+        }
+        pos = (pos + 1) & (size - 1);
+    }
+    return &slot[pos];
+}
+
+
+static void
+SOS_name_index_grow(SOS_name_index *index) {
+    SOS_name_index_slot *old_slot = index->slot;
+    SOS_name_index_slot *dest;
+    int old_size = index->size;
+    int i;
+
+    index->size = old_size * 2;
+    index->slot = (SOS_name_index_slot *)
+        calloc(index->size, sizeof(SOS_name_index_slot));
+    if (index->slot == NULL) {
+        fprintf(stderr, "ERROR: Unable to grow the name index to %d"
+                " slots.\n", index->size);
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < old_size; i++) {
+        if (old_slot[i].hash == 0) continue;
+        dest = SOS_name_index_find(index->slot, index->size,
+                old_slot[i].hash, old_slot[i].key);
+        *dest = old_slot[i];
+    }
+    free(old_slot);
+    return;
+}
+
+
+SOS_name_index*
+SOS_name_index_create(int initial_size) {
+    SOS_name_index *index;
+    int size;
+
+    size = SOS_NAME_INDEX_MIN_SIZE;
+    while (size < initial_size) { size <<= 1; }
+
+    index = (SOS_name_index *) calloc(1, sizeof(SOS_name_index));
+    if (index == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate a name index.\n");
+        exit(EXIT_FAILURE);
+    }
+    index->size  = size;
+    index->count = 0;
+    index->slot  = (SOS_name_index_slot *)
+        calloc(size, sizeof(SOS_name_index_slot));
+    if (index->slot == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate a name index.\n");
+        exit(EXIT_FAILURE);
+    }
+    return index;
+}
+
+
+int
+SOS_name_index_get(SOS_name_index *index, const char *name) {
+    SOS_name_index_slot *slot;
+
+    slot = SOS_name_index_find(index->slot, index->size,
+            SOS_name_index_hash(name), name);
+    if (slot->hash == 0) {
+        return SOS_NAME_INDEX_NOT_FOUND;
+    }
+    return slot->value;
+}
+
+
+// Adds the name, or replaces the value stored for it.
+void
+SOS_name_index_put(SOS_name_index *index, const char *name, int value) {
+    SOS_name_index_slot *slot;
+    uint32_t hash;
+
+    hash = SOS_name_index_hash(name);
+    slot = SOS_name_index_find(index->slot, index->size, hash, name);
+    if (slot->hash != 0) {
+        slot->value = value;
+        return;
+    }
+
+    if (SOS_NAME_INDEX_FULL(index)) {
+        SOS_name_index_grow(index);
+        slot = SOS_name_index_find(index->slot, index->size, hash, name);
+    }
+
+    slot->hash  = hash;
+    slot->value = value;
+    slot->key   = SOS_intern(name);
+    index->count++;
+    return;
+}
+
+
+void
+SOS_name_index_destroy(SOS_name_index *index) {
+    int i;
+
+    if (index == NULL) return;
+
+    for (i = 0; i < index->size; i++) {
+        if (index->slot[i].hash != 0) SOS_intern_drop(index->slot[i].key);
+    }
+    free(index->slot);
+    free(index);
+    return;
+}
@@ -0,0 +1,35 @@
+#ifndef SOS_NAME_INDEX_H
+#define SOS_NAME_INDEX_H
+
+/*
+ *   Per-pub index from value names to their position in pub->data[].
+ *
+ *   Open addressing with linear probing over a power-of-two table that
+ *   starts small and doubles as names are added, so a pub with a handful
+ *   of values costs a few hundred bytes instead of a full qhashtbl.
+ *   Used the same way by libsos and sosd.
+ */
+
+#include "sos_types.h"
+
+#define SOS_NAME_INDEX_MIN_SIZE     16
+#define SOS_NAME_INDEX_NOT_FOUND    -1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    SOS_name_index* SOS_name_index_create(int initial_size);
+
+    int  SOS_name_index_get(SOS_name_index *index, const char *name);
+
+    void SOS_name_index_put(SOS_name_index *index, const char *name,
+            int value);
+
+    void SOS_name_index_destroy(SOS_name_index *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
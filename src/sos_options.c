@@ -1,5 +1,6 @@
 
 #include <stdio.h>
+#include <strings.h>
 
 #include "sos.h"
 #include "sos_types.h"
@@ -55,6 +56,20 @@ int SOS_options_init(
     opt->batch_environment    = false;
     opt->udp_enabled          = false;
     opt->fwd_shutdown_to_agg  = false;
+    opt->persistent_connection = true;
+    opt->shm_transport        = false;
+    opt->compact_snaps        = true;
+    opt->unix_socket          = true;
+    opt->no_ack               = false;
+    opt->no_ack_window        = SOS_DEFAULT_NO_ACK_WINDOW;
+    opt->backpressure         = true;
+    opt->async_publish        = false;
+    opt->async_queue_depth    = SOS_DEFAULT_ASYNC_QUEUE_DEPTH;
+    opt->async_full_policy    = SOS_ASYNC_FULL_BLOCK;
+    opt->pack_staging         = false;
+    opt->publish_coalesce     = false;
+    opt->publish_aggregate    = false;
+    opt->publish_min_usec     = 0;     //0 == Send every SOS_publish()
 
  
     opt->system_monitor_enabled   = false;
@@ -108,6 +123,120 @@ void SOS_options_load_evar(SOS_options *opt) {
     }
 
 
+    if (SOS_str_opt_is_disabled(getenv("SOS_PERSISTENT_CONNECTION"))) {
+        // Clients hold one connection to the daemon open for their
+        // lifetime unless this is explicitly turned off.
+        opt->persistent_connection = false;
+    } else {
+        opt->persistent_connection = true;
+    }
+
+    if (SOS_str_opt_is_enabled(getenv("SOS_SHM_TRANSPORT"))) {
+        opt->shm_transport = true;
+    } else {
+        opt->shm_transport = false;
+    }
+
+    if (SOS_str_opt_is_disabled(getenv("SOS_COMPACT_SNAPS"))) {
+        // VAL_SNAPS go out delta/varint encoded wherever the other end
+        // agrees to it, unless this is explicitly turned off.
+        opt->compact_snaps = false;
+    } else {
+        opt->compact_snaps = true;
+    }
+
+    if (SOS_str_opt_is_disabled(getenv("SOS_UNIX_SOCKET"))) {
+        // The daemon also listens on an AF_UNIX socket (SOS_CMD_SOCKET,
+        // or one named for its port) that local clients use instead of
+        // loopback TCP, unless this is explicitly turned off.
+        opt->unix_socket = false;
+    } else {
+        opt->unix_socket = true;
+    }
+
+    if (SOS_str_opt_is_enabled(getenv("SOS_NO_ACK"))) {
+        // Ingest messages go out without waiting on their ACK, and only
+        // one in every SOS_NO_ACK_WINDOW asks for one.
+        opt->no_ack = true;
+    } else {
+        opt->no_ack = false;
+    }
+
+    if (getenv("SOS_NO_ACK_WINDOW") != NULL) {
+        opt->no_ack_window = atoi(getenv("SOS_NO_ACK_WINDOW"));
+        if (opt->no_ack_window < 1) {
+            opt->no_ack_window = SOS_DEFAULT_NO_ACK_WINDOW;
+        }
+    }
+
+    if (SOS_str_opt_is_disabled(getenv("SOS_BACKPRESSURE"))) {
+        // Ignore the credits and publish delay a lagging daemon sends
+        // back in its ACKs, and keep sending at full speed.  Mostly
+        // useful for seeing how far behind the daemon falls on its own.
+        opt->backpressure = false;
+    } else {
+        opt->backpressure = true;
+    }
+
+    if (SOS_str_opt_is_enabled(getenv("SOS_ASYNC_PUBLISH"))) {
+        // Every pub ships its publishes from a background thread,
+        // unless SOS_pub_config(..., SOS_PUB_OPTION_ASYNC, 0) says not to.
+        opt->async_publish = true;
+    } else {
+        opt->async_publish = false;
+    }
+
+    if (getenv("SOS_ASYNC_QUEUE_DEPTH") != NULL) {
+        opt->async_queue_depth = atoi(getenv("SOS_ASYNC_QUEUE_DEPTH"));
+        if (opt->async_queue_depth < 1) {
+            opt->async_queue_depth = SOS_DEFAULT_ASYNC_QUEUE_DEPTH;
+        }
+    }
+
+    if (getenv("SOS_ASYNC_FULL_POLICY") != NULL) {
+        char *policy = getenv("SOS_ASYNC_FULL_POLICY");
+        if (strcasecmp(policy, "DROP_OLDEST") == 0) {
+            opt->async_full_policy = SOS_ASYNC_FULL_DROP_OLDEST;
+        } else if (strcasecmp(policy, "COALESCE") == 0) {
+            opt->async_full_policy = SOS_ASYNC_FULL_COALESCE;
+        } else if (strcasecmp(policy, "BLOCK") == 0) {
+            opt->async_full_policy = SOS_ASYNC_FULL_BLOCK;
+        } else {
+            fprintf(stderr, "WARNING: Unknown SOS_ASYNC_FULL_POLICY (%s),"
+                    " using BLOCK.\n", policy);
+            opt->async_full_policy = SOS_ASYNC_FULL_BLOCK;
+        }
+    }
+
+    if (SOS_str_opt_is_enabled(getenv("SOS_PACK_STAGING"))) {
+        // Packing threads stage their values privately and SOS_publish()
+        // merges them, see SOS_pub_config(..., SOS_PUB_OPTION_STAGED, ...).
+        opt->pack_staging = true;
+    } else {
+        opt->pack_staging = false;
+    }
+
+    if (SOS_str_opt_is_enabled(getenv("SOS_PUBLISH_COALESCE"))) {
+        // Repeated packs of a value between publishes become one snap.
+        opt->publish_coalesce = true;
+    } else {
+        opt->publish_coalesce = false;
+    }
+
+    if (SOS_str_opt_is_enabled(getenv("SOS_PUBLISH_AGGREGATE"))) {
+        // COUNTER values become running totals, SAMPLE values summaries.
+        opt->publish_aggregate = true;
+    } else {
+        opt->publish_aggregate = false;
+    }
+
+    if (getenv("SOS_PUBLISH_MIN_USEC") != NULL) {
+        opt->publish_min_usec = atoi(getenv("SOS_PUBLISH_MIN_USEC"));
+        if (opt->publish_min_usec < 0) {
+            opt->publish_min_usec = 0;
+        }
+    }
+
     if (getenv("SOS_DISCOVERY_DIR") != NULL) {
         opt->discovery_dir = getenv("SOS_DISCOVERY_DIR");
     } else {
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "sos.h"
+#include "sos_types.h"
+#include "sos_snap_pool.h"
+#include "sos_pack_stage.h"
+
+
+// The last stage this thread used.  The pub guid guards against a new pub
+// turning up at the address of one that was destroyed.
+static __thread SOS_pub        *SOS_pack_stage_last_pub  = NULL;
+static __thread SOS_guid        SOS_pack_stage_last_guid = 0;
+static __thread SOS_pack_stage *SOS_pack_stage_last      = NULL;
+
+
+SOS_pack_stage*
+SOS_pack_stage_for_thread(SOS_pub *pub) {
+    SOS_pack_stage *stage;
+    pthread_t       self;
+
+    if ((SOS_pack_stage_last_pub == pub)
+     && (SOS_pack_stage_last_guid == pub->guid)) {
+        return SOS_pack_stage_last;
+    }
+
+    self  = pthread_self();
+    stage = __atomic_load_n(&pub->stage_head, __ATOMIC_ACQUIRE);
+    while (stage != NULL) {
+        if (pthread_equal(stage->owner, self)) break;
+        stage = (SOS_pack_stage *) stage->next_stage;
+    }
+
+    if (stage == NULL) {
+        // Only the first pack from each thread gets here.
+        stage = (SOS_pack_stage *) calloc(1, sizeof(SOS_pack_stage));
+        stage->owner = self;
+        pthread_mutex_lock(pub->lock);
+        stage->next_stage = (void *) pub->stage_head;
+        __atomic_store_n(&pub->stage_head, stage, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(pub->lock);
+    }
+
+    SOS_pack_stage_last_pub  = pub;
+    SOS_pack_stage_last_guid = pub->guid;
+    SOS_pack_stage_last      = stage;
+    return stage;
+}
+
+
+// Owner thread only.
+void
+SOS_pack_stage_append(SOS_pack_stage *stage, SOS_val_snap *snap,
+        const char *name)
+{
+    SOS_pack_stage_buf *buf;
+    int                 len;
+
+    __atomic_store_n(&stage->writing, 1, __ATOMIC_SEQ_CST);
+    buf = &stage->buf[__atomic_load_n(&stage->active, __ATOMIC_SEQ_CST)];
+
+    if (buf->count >= buf->max) {
+        buf->max = (buf->max < SOS_PACK_STAGE_MIN_COUNT) ?
+            SOS_PACK_STAGE_MIN_COUNT : (buf->max * 2);
+        buf->snap = (SOS_val_snap **)
+            realloc(buf->snap, buf->max * sizeof(SOS_val_snap *));
+        buf->name_at = (int *) realloc(buf->name_at, buf->max * sizeof(int));
+    }
+
+    buf->name_at[buf->count] = -1;
+    if (name != NULL) {
+        len = strlen(name) + 1;
+        if ((buf->names_len + len) > buf->names_max) {
+            buf->names_max = (buf->names_max + len) * 2;
+            buf->names = (char *) realloc(buf->names, buf->names_max);
+        }
+        memcpy(buf->names + buf->names_len, name, len);
+        buf->name_at[buf->count] = buf->names_len;
+        buf->names_len += len;
+    }
+    buf->snap[buf->count] = snap;
+    buf->count++;
+
+    __atomic_store_n(&stage->writing, 0, __ATOMIC_RELEASE);
+    return;
+}
+
+
+// Points new appends at the other buffer and returns the one holding
+// everything packed so far.  It stays with the caller until it is reset.
+// CONCURRENCY: Assumes pub->lock is held.
+SOS_pack_stage_buf*
+SOS_pack_stage_swap(SOS_pack_stage *stage) {
+    int was_active;
+
+    was_active = __atomic_load_n(&stage->active, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&stage->active, !was_active, __ATOMIC_SEQ_CST);
+
+    // An append that read the old 'active' value is still in progress:
+    while (__atomic_load_n(&stage->writing, __ATOMIC_SEQ_CST)) {
+        sched_yield();
+    }
+
+    return &stage->buf[was_active];
+}
+
+
+const char*
+SOS_pack_stage_name(SOS_pack_stage_buf *buf, int i) {
+    if (buf->name_at[i] < 0) return NULL;
+    return buf->names + buf->name_at[i];
+}
+
+
+// The snaps are left alone, they belong to whoever drained the buffer.
+void
+SOS_pack_stage_reset(SOS_pack_stage_buf *buf) {
+    buf->count     = 0;
+    buf->names_len = 0;
+    return;
+}
+
+
+// CONCURRENCY: Assumes no thread is still packing into the pub.
+void
+SOS_pack_stage_destroy_all(SOS_pub *pub) {
+    SOS_pack_stage *stage;
+    SOS_pack_stage *next;
+    int             b;
+
+    stage = pub->stage_head;
+    while (stage != NULL) {
+        next = (SOS_pack_stage *) stage->next_stage;
+        for (b = 0; b < 2; b++) {
+            SOS_val_snap_destroy_list(stage->buf[b].snap, stage->buf[b].count);
+            free(stage->buf[b].snap);
+            free(stage->buf[b].name_at);
+            free(stage->buf[b].names);
+        }
+        free(stage);
+        stage = next;
+    }
+    pub->stage_head = NULL;
+
+    return;
+}
@@ -0,0 +1,44 @@
+#ifndef SOS_PACK_STAGE_H
+#define SOS_PACK_STAGE_H
+
+/*
+ *   Per-thread pack staging.
+ *
+ *   A pub with pack_staged set (SOS_PACK_STAGING, or per-pub through
+ *   SOS_pub_config(pub, SOS_PUB_OPTION_STAGED, 1)) does not take pub->lock
+ *   in SOS_pack(), SOS_pack_related(), or SOS_pack_by_handle().  Each
+ *   packing thread appends its snaps to its own stage instead, and the
+ *   next SOS_publish() merges every stage into the pub under the lock.
+ *
+ *   A stage has two buffers.  The owning thread only ever appends to the
+ *   active one, and the merging thread flips 'active' and then waits for
+ *   any append already in progress to finish before it drains the other.
+ *   Packing never waits on the merge, or on another packing thread.
+ */
+
+#include "sos_types.h"
+
+#define SOS_PACK_STAGE_MIN_COUNT    64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    SOS_pack_stage*     SOS_pack_stage_for_thread(SOS_pub *pub);
+
+    void                SOS_pack_stage_append(SOS_pack_stage *stage,
+                            SOS_val_snap *snap, const char *name);
+
+    SOS_pack_stage_buf* SOS_pack_stage_swap(SOS_pack_stage *stage);
+
+    const char*         SOS_pack_stage_name(SOS_pack_stage_buf *buf, int i);
+
+    void                SOS_pack_stage_reset(SOS_pack_stage_buf *buf);
+
+    void                SOS_pack_stage_destroy_all(SOS_pub *pub);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
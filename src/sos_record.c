@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sos.h"
+#include "sos_types.h"
+#include "sos_buffer.h"
+#include "sos_intern.h"
+#include "sos_record.h"
+
+
+// Makes room for need more bytes at offset, with one check per record
+// instead of one per field.
+static inline unsigned char*
+SOS_record_reserve(SOS_buffer *buffer, int offset, int need) {
+    while ((offset + need) > buffer->max) {
+        SOS_buffer_grow(buffer, (need + SOS_DEFAULT_BUFFER_MAX),
+                "SOS_record_reserve");
+    }
+    return (buffer->data + offset);
+}
+
+
+static inline void
+SOS_record_commit(SOS_buffer *buffer, int *offset, int packed_bytes) {
+    *offset    += packed_bytes;
+    buffer->len = (buffer->len > *offset) ? buffer->len : *offset;
+    return;
+}
+
+
+// Bytes an INT, LONG, or DOUBLE value adds to its record, 0 otherwise.
+int
+SOS_record_scalar_size(int val_type) {
+    switch ((SOS_val_type) val_type) {
+    case SOS_VAL_TYPE_INT:    return 4;
+    case SOS_VAL_TYPE_LONG:   return 8;
+    case SOS_VAL_TYPE_DOUBLE: return 8;
+    default:                  return 0;
+    }
+}
+
+
+static inline unsigned char*
+SOS_record_put_scalar(unsigned char *buf, SOS_val_type type, SOS_val *val) {
+    switch (type) {
+    case SOS_VAL_TYPE_INT:    SOS_buffer_packi32(buf, val->i_val); return buf + 4;
+    case SOS_VAL_TYPE_LONG:   SOS_buffer_packi64(buf, val->l_val); return buf + 8;
+    case SOS_VAL_TYPE_DOUBLE: SOS_buffer_packd64(buf, val->d_val); return buf + 8;
+    default:                  return buf;
+    }
+}
+
+
+static inline unsigned char*
+SOS_record_get_scalar(unsigned char *buf, SOS_val_type type, SOS_val *val) {
+    switch (type) {
+    case SOS_VAL_TYPE_INT:    val->i_val = SOS_buffer_unpacki32(buf); return buf + 4;
+    case SOS_VAL_TYPE_LONG:   val->l_val = SOS_buffer_unpacki64(buf); return buf + 8;
+    case SOS_VAL_TYPE_DOUBLE: val->d_val = SOS_buffer_unpackd64(buf); return buf + 8;
+    default:                  return buf;
+    }
+}
+
+
+// "iggiiidddl" + scalar value
+int
+SOS_record_pack_snap(SOS_buffer *buffer, int *offset, SOS_val_snap *snap) {
+    int need = SOS_RECORD_SNAP_SIZE + SOS_record_scalar_size(snap->type);
+    unsigned char *buf = SOS_record_reserve(buffer, *offset, need);
+
+    SOS_buffer_packi32(buf,      snap->elem);
+    SOS_buffer_packguid(buf + 4, snap->guid);
+    SOS_buffer_packguid(buf + 12, snap->relation_id);
+    SOS_buffer_packi32(buf + 20, snap->semantic);
+    SOS_buffer_packi32(buf + 24, snap->type);
+    SOS_buffer_packi32(buf + 28, snap->val_len);
+    SOS_buffer_packd64(buf + 32, snap->time.pack);
+    SOS_buffer_packd64(buf + 40, snap->time.send);
+    SOS_buffer_packd64(buf + 48, snap->time.recv);
+    SOS_buffer_packi64(buf + 56, snap->frame);
+    SOS_record_put_scalar(buf + SOS_RECORD_SNAP_SIZE, snap->type, &snap->val);
+
+    SOS_record_commit(buffer, offset, need);
+    return need;
+}
+
+
+int
+SOS_record_unpack_snap(SOS_buffer *buffer, int *offset, SOS_val_snap *snap) {
+    unsigned char *buf = (buffer->data + *offset);
+    SOS_val_type   type;
+    int            need;
+
+    if ((*offset + SOS_RECORD_SNAP_SIZE) > buffer->len) {
+        return -1;
+    }
+    type = (SOS_val_type) SOS_buffer_unpacki32(buf + 24);
+    need = SOS_RECORD_SNAP_SIZE + SOS_record_scalar_size(type);
+    if ((*offset + need) > buffer->len) {
+        return -1;
+    }
+
+    snap->elem        = SOS_buffer_unpacki32(buf);
+    snap->guid        = SOS_buffer_unpackguid(buf + 4);
+    snap->relation_id = SOS_buffer_unpackguid(buf + 12);
+    snap->semantic    = (SOS_val_semantic) SOS_buffer_unpacki32(buf + 20);
+    snap->type        = type;
+    snap->val_len     = SOS_buffer_unpacki32(buf + 28);
+    snap->time.pack   = SOS_buffer_unpackd64(buf + 32);
+    snap->time.send   = SOS_buffer_unpackd64(buf + 40);
+    snap->time.recv   = SOS_buffer_unpackd64(buf + 48);
+    snap->frame       = SOS_buffer_unpacki64(buf + 56);
+    SOS_record_get_scalar(buf + SOS_RECORD_SNAP_SIZE, type, &snap->val);
+
+    *offset += need;
+    return need;
+}
+
+
+// Timestamps are differenced as their IEEE-754 bit patterns.  Close
+// values of the same sign and exponent are close integers that way, and
+// it is exact, where subtracting the doubles would not be.
+static inline int64_t
+SOS_record_time_bits(double d) {
+    int64_t bits;
+    memcpy(&bits, &d, sizeof(double));
+    return bits;
+}
+
+
+static inline double
+SOS_record_bits_time(int64_t bits) {
+    double d;
+    memcpy(&d, &bits, sizeof(double));
+    return d;
+}
+
+
+#define SOS_RECORD_DELTA(__buf, __cur, __prev)                              \
+    SOS_buffer_packvar((__buf), SOS_BUFFER_ZIGZAG(                          \
+        (int64_t) ((uint64_t) (__cur) - (uint64_t) (__prev))))
+
+#define SOS_RECORD_UNDELTA(__field, __prev)                                 \
+    ((uint64_t) (__prev) + (uint64_t) SOS_BUFFER_UNZIGZAG(__field))
+
+
+// Elem, guid, relation_id, semantic, type, val_len, time.pack/send/recv,
+// and frame, each a varint, + scalar value
+int
+SOS_record_pack_snap_delta(SOS_buffer *buffer, int *offset,
+        SOS_val_snap *snap, SOS_val_snap *prev)
+{
+    unsigned char *start = SOS_record_reserve(buffer, *offset,
+            SOS_RECORD_SNAP_DELTA_MAX);
+    unsigned char *buf = start;
+    int packed_bytes;
+
+    buf = SOS_RECORD_DELTA(buf, snap->elem,        prev->elem);
+    buf = SOS_RECORD_DELTA(buf, snap->guid,        prev->guid);
+    buf = SOS_RECORD_DELTA(buf, snap->relation_id, prev->relation_id);
+    buf = SOS_buffer_packvar(buf, (uint32_t) snap->semantic);
+    buf = SOS_buffer_packvar(buf, (uint32_t) snap->type);
+    buf = SOS_buffer_packvar(buf, (uint32_t) snap->val_len);
+    buf = SOS_RECORD_DELTA(buf, SOS_record_time_bits(snap->time.pack),
+                                SOS_record_time_bits(prev->time.pack));
+    buf = SOS_RECORD_DELTA(buf, SOS_record_time_bits(snap->time.send),
+                                SOS_record_time_bits(prev->time.send));
+    buf = SOS_RECORD_DELTA(buf, SOS_record_time_bits(snap->time.recv),
+                                SOS_record_time_bits(prev->time.recv));
+    buf = SOS_RECORD_DELTA(buf, snap->frame,       prev->frame);
+
+    switch (snap->type) {
+    case SOS_VAL_TYPE_INT:
+        buf = SOS_buffer_packvar(buf, SOS_BUFFER_ZIGZAG(snap->val.i_val));
+        break;
+    case SOS_VAL_TYPE_LONG:
+        buf = SOS_buffer_packvar(buf, SOS_BUFFER_ZIGZAG(snap->val.l_val));
+        break;
+    case SOS_VAL_TYPE_DOUBLE:
+        SOS_buffer_packd64(buf, snap->val.d_val);
+        buf += 8;
+        break;
+    default:
+        break;
+    }
+
+    prev->elem        = snap->elem;
+    prev->guid        = snap->guid;
+    prev->relation_id = snap->relation_id;
+    prev->time        = snap->time;
+    prev->frame       = snap->frame;
+
+    packed_bytes = (int) (buf - start);
+    SOS_record_commit(buffer, offset, packed_bytes);
+    return packed_bytes;
+}
+
+
+int
+SOS_record_unpack_snap_delta(SOS_buffer *buffer, int *offset,
+        SOS_val_snap *snap, SOS_val_snap *prev)
+{
+    unsigned char *start = (buffer->data + *offset);
+    unsigned char *end   = (buffer->data + buffer->len);
+    unsigned char *buf   = start;
+    uint64_t       field[11];
+    int            fields;
+    int            i;
+    int            rc;
+
+    if (start >= end) {
+        return -1;
+    }
+
+    // The type (field 4) says whether a scalar value follows as an 11th
+    // varint (INT and LONG), as 8 fixed bytes (DOUBLE), or not at all.
+    fields = 10;
+    for (i = 0; i < fields; i++) {
+        rc = SOS_buffer_unpackvar(buf, end, &field[i]);
+        if (rc < 0) return -1;
+        buf += rc;
+        if ((i == 4) && (((SOS_val_type) field[4] == SOS_VAL_TYPE_INT)
+                      || ((SOS_val_type) field[4] == SOS_VAL_TYPE_LONG))) {
+            fields = 11;
+        }
+    }
+    if (((SOS_val_type) field[4] == SOS_VAL_TYPE_DOUBLE)
+     && ((buf + 8) > end)) {
+        return -1;
+    }
+
+    snap->elem        = (int) SOS_RECORD_UNDELTA(field[0], prev->elem);
+    snap->guid        = SOS_RECORD_UNDELTA(field[1], prev->guid);
+    snap->relation_id = SOS_RECORD_UNDELTA(field[2], prev->relation_id);
+    snap->semantic    = (SOS_val_semantic) field[3];
+    snap->type        = (SOS_val_type) field[4];
+    snap->val_len     = (int) field[5];
+    snap->time.pack   = SOS_record_bits_time(SOS_RECORD_UNDELTA(field[6],
+                            SOS_record_time_bits(prev->time.pack)));
+    snap->time.send   = SOS_record_bits_time(SOS_RECORD_UNDELTA(field[7],
+                            SOS_record_time_bits(prev->time.send)));
+    snap->time.recv   = SOS_record_bits_time(SOS_RECORD_UNDELTA(field[8],
+                            SOS_record_time_bits(prev->time.recv)));
+    snap->frame       = (long) SOS_RECORD_UNDELTA(field[9], prev->frame);
+
+    switch (snap->type) {
+    case SOS_VAL_TYPE_INT:
+        snap->val.i_val = (int) SOS_BUFFER_UNZIGZAG(field[10]);
+        break;
+    case SOS_VAL_TYPE_LONG:
+        snap->val.l_val = (long) SOS_BUFFER_UNZIGZAG(field[10]);
+        break;
+    case SOS_VAL_TYPE_DOUBLE:
+        snap->val.d_val = SOS_buffer_unpackd64(buf);
+        buf += 8;
+        break;
+    default:
+        break;
+    }
+
+    prev->elem        = snap->elem;
+    prev->guid        = snap->guid;
+    prev->relation_id = snap->relation_id;
+    prev->time        = snap->time;
+    prev->frame       = snap->frame;
+
+    *offset += (int) (buf - start);
+    return (int) (buf - start);
+}
+
+
+// "iddilg" + scalar value
+int
+SOS_record_pack_data(SOS_buffer *buffer, int *offset, int elem,
+        SOS_data *data)
+{
+    int need = SOS_RECORD_DATA_SIZE + SOS_record_scalar_size(data->type);
+    unsigned char *buf = SOS_record_reserve(buffer, *offset, need);
+
+    SOS_buffer_packi32(buf,       elem);
+    SOS_buffer_packd64(buf + 4,   data->time.pack);
+    SOS_buffer_packd64(buf + 12,  data->time.send);
+    SOS_buffer_packi32(buf + 20,  data->val_len);
+    SOS_buffer_packi64(buf + 24,  data->meta.semantic);
+    SOS_buffer_packguid(buf + 32, data->meta.relation_id);
+    SOS_record_put_scalar(buf + SOS_RECORD_DATA_SIZE, data->type, &data->val);
+
+    SOS_record_commit(buffer, offset, need);
+    return need;
+}
+
+
+// The element index is checked against the pub before anything is
+// written into pub->data[elem].
+int
+SOS_record_unpack_data(SOS_buffer *buffer, int *offset, SOS_pub *pub,
+        int *elem)
+{
+    unsigned char *buf = (buffer->data + *offset);
+    SOS_data      *data;
+    int            need;
+
+    if ((*offset + SOS_RECORD_DATA_SIZE) > buffer->len) {
+        return -1;
+    }
+    *elem = SOS_buffer_unpacki32(buf);
+    if ((*elem < 0) || (*elem >= pub->elem_count)) {
+        return -1;
+    }
+    data = pub->data[*elem];
+    need = SOS_RECORD_DATA_SIZE + SOS_record_scalar_size(data->type);
+    if ((*offset + need) > buffer->len) {
+        return -1;
+    }
+
+    data->time.pack        = SOS_buffer_unpackd64(buf + 4);
+    data->time.send        = SOS_buffer_unpackd64(buf + 12);
+    data->val_len          = SOS_buffer_unpacki32(buf + 20);
+    data->meta.semantic    = (SOS_val_semantic) SOS_buffer_unpacki64(buf + 24);
+    data->meta.relation_id = SOS_buffer_unpackguid(buf + 32);
+    SOS_record_get_scalar(buf + SOS_RECORD_DATA_SIZE, data->type, &data->val);
+
+    *offset += need;
+    return need;
+}
+
+
+// "gsiiiiiig"
+int
+SOS_record_pack_elem(SOS_buffer *buffer, int *offset, SOS_data *data) {
+    const char *name = (data->name != NULL) ? data->name : "";
+    int name_len = strlen(name);
+    int need = SOS_RECORD_ELEM_SIZE + name_len;
+    unsigned char *buf = SOS_record_reserve(buffer, *offset, need);
+
+    SOS_buffer_packguid(buf, data->guid);
+    SOS_buffer_packi32(buf + 8, name_len);
+    memcpy(buf + 12, name, name_len);
+    buf += 12 + name_len;
+    SOS_buffer_packi32(buf,       data->type);
+    SOS_buffer_packi32(buf + 4,   data->meta.freq);
+    SOS_buffer_packi32(buf + 8,   data->meta.semantic);
+    SOS_buffer_packi32(buf + 12,  data->meta.classifier);
+    SOS_buffer_packi32(buf + 16,  data->meta.pattern);
+    SOS_buffer_packi32(buf + 20,  data->meta.compare);
+    SOS_buffer_packguid(buf + 24, data->meta.relation_id);
+
+    SOS_record_commit(buffer, offset, need);
+    return need;
+}
+
+
+// The name is interned into data->name, dropping what it held.
+int
+SOS_record_unpack_elem(SOS_buffer *buffer, int *offset, SOS_data *data) {
+    unsigned char *buf = (buffer->data + *offset);
+    int name_len;
+    int need;
+
+    if ((*offset + SOS_RECORD_ELEM_SIZE) > buffer->len) {
+        return -1;
+    }
+    name_len = SOS_buffer_unpacki32(buf + 8);
+    if ((name_len < 0)
+     || (name_len > (buffer->len - (*offset + SOS_RECORD_ELEM_SIZE)))) {
+        return -1;
+    }
+    need = SOS_RECORD_ELEM_SIZE + name_len;
+
+    data->guid = SOS_buffer_unpackguid(buf);
+    SOS_intern_drop(data->name);
+    data->name = SOS_intern_len((const char *) (buf + 12), name_len);
+    buf += 12 + name_len;
+    data->type             = (SOS_val_type)     SOS_buffer_unpacki32(buf);
+    data->meta.freq        = (SOS_val_freq)     SOS_buffer_unpacki32(buf + 4);
+    data->meta.semantic    = (SOS_val_semantic) SOS_buffer_unpacki32(buf + 8);
+    data->meta.classifier  = (SOS_val_class)    SOS_buffer_unpacki32(buf + 12);
+    data->meta.pattern     = (SOS_val_pattern)  SOS_buffer_unpacki32(buf + 16);
+    data->meta.compare     = (SOS_val_compare)  SOS_buffer_unpacki32(buf + 20);
+    data->meta.relation_id = SOS_buffer_unpackguid(buf + 24);
+
+    *offset += need;
+    return need;
+}
+
+
+// "gsisiii"
+int
+SOS_record_pack_manifest_row(SOS_buffer *buffer, int *offset, SOS_pub *pub) {
+    const char *title   = (pub->title   != NULL) ? pub->title   : "";
+    const char *node_id = (pub->node_id != NULL) ? pub->node_id : "";
+    int title_len   = strlen(title);
+    int node_id_len = strlen(node_id);
+    int need = SOS_RECORD_MANIFEST_SIZE + title_len + node_id_len;
+    unsigned char *buf = SOS_record_reserve(buffer, *offset, need);
+
+    SOS_buffer_packguid(buf, pub->guid);
+    SOS_buffer_packi32(buf + 8, title_len);
+    memcpy(buf + 12, title, title_len);
+    buf += 12 + title_len;
+    SOS_buffer_packi32(buf,     pub->comm_rank);
+    SOS_buffer_packi32(buf + 4, node_id_len);
+    memcpy(buf + 8, node_id, node_id_len);
+    buf += 8 + node_id_len;
+    SOS_buffer_packi32(buf,     pub->process_id);
+    SOS_buffer_packi32(buf + 4, pub->elem_count);
+    SOS_buffer_packi32(buf + 8, (int) pub->frame);
+
+    SOS_record_commit(buffer, offset, need);
+    return need;
+}
+
+
+// The title and node_id are interned into the row, dropping what it held.
+int
+SOS_record_unpack_manifest_row(SOS_buffer *buffer, int *offset,
+        SOS_manifest_row *row)
+{
+    unsigned char *buf = (buffer->data + *offset);
+    int avail = buffer->len - *offset;
+    int title_len;
+    int node_id_len;
+
+    if (avail < SOS_RECORD_MANIFEST_SIZE) {
+        return -1;
+    }
+    title_len = SOS_buffer_unpacki32(buf + 8);
+    if ((title_len < 0)
+     || (title_len > (avail - SOS_RECORD_MANIFEST_SIZE))) {
+        return -1;
+    }
+    node_id_len = SOS_buffer_unpacki32(buf + 16 + title_len);
+    if ((node_id_len < 0)
+     || (node_id_len > (avail - SOS_RECORD_MANIFEST_SIZE - title_len))) {
+        return -1;
+    }
+
+    row->guid = SOS_buffer_unpackguid(buf);
+    SOS_intern_drop(row->title);
+    row->title = SOS_intern_len((const char *) (buf + 12), title_len);
+    buf += 12 + title_len;
+    row->comm_rank = SOS_buffer_unpacki32(buf);
+    SOS_intern_drop(row->node_id);
+    row->node_id = SOS_intern_len((const char *) (buf + 8), node_id_len);
+    buf += 8 + node_id_len;
+    row->process_id = SOS_buffer_unpacki32(buf);
+    row->elem_count = SOS_buffer_unpacki32(buf + 4);
+    row->frame      = SOS_buffer_unpacki32(buf + 8);
+
+    *offset += SOS_RECORD_MANIFEST_SIZE + title_len + node_id_len;
+    return (SOS_RECORD_MANIFEST_SIZE + title_len + node_id_len);
+}
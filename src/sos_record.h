@@ -0,0 +1,76 @@
+#ifndef SOS_RECORD_H
+#define SOS_RECORD_H
+
+/*
+ *   Pack/unpack for the fixed records that repeat inside messages: a
+ *   val_snap, a PUBLISH element, an ANNOUNCE element, and a manifest row.
+ *
+ *   These write the same bytes SOS_buffer_pack() would for the format
+ *   shown next to each one, but without walking a format string and
+ *   va_arg() per field.  Room for the whole record is made once up front
+ *   when packing, and the whole record is bounds-checked once before
+ *   anything is read when unpacking.
+ *
+ *   The INT, LONG, and DOUBLE values of snaps and PUBLISH elements follow
+ *   their record directly and are handled here as part of it.  Other
+ *   types are left for the caller to pack/unpack after the record.
+ *
+ *   The compact snap record (see SOS_WIRE_COMPACT_SNAPS) sends each field
+ *   as a varint difference from the same field of the snap before it in
+ *   the message.  The caller keeps that snap in *prev, zeroed at the
+ *   start of the message, and these update it.
+ *
+ *   Pack returns the bytes written.  Unpack returns the bytes read, or
+ *   -1 (leaving the offset alone) if the record runs past the message.
+ */
+
+#include "sos_types.h"
+#include "sos_buffer.h"
+
+//   "iggiiidddl"
+#define SOS_RECORD_SNAP_SIZE        64
+//   "iddilg"
+#define SOS_RECORD_DATA_SIZE        40
+//   "gsiiiiiig", less the string
+#define SOS_RECORD_ELEM_SIZE        44
+//   "gsisiii", less the strings
+#define SOS_RECORD_MANIFEST_SIZE    32
+//   Most a compact snap can take: ten varints and a scalar value.
+#define SOS_RECORD_SNAP_DELTA_MAX   110
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int  SOS_record_scalar_size(int val_type);
+
+    int  SOS_record_pack_snap(SOS_buffer *buffer, int *offset,
+            SOS_val_snap *snap);
+    int  SOS_record_unpack_snap(SOS_buffer *buffer, int *offset,
+            SOS_val_snap *snap);
+
+    int  SOS_record_pack_snap_delta(SOS_buffer *buffer, int *offset,
+            SOS_val_snap *snap, SOS_val_snap *prev);
+    int  SOS_record_unpack_snap_delta(SOS_buffer *buffer, int *offset,
+            SOS_val_snap *snap, SOS_val_snap *prev);
+
+    int  SOS_record_pack_data(SOS_buffer *buffer, int *offset,
+            int elem, SOS_data *data);
+    int  SOS_record_unpack_data(SOS_buffer *buffer, int *offset,
+            SOS_pub *pub, int *elem);
+
+    int  SOS_record_pack_elem(SOS_buffer *buffer, int *offset,
+            SOS_data *data);
+    int  SOS_record_unpack_elem(SOS_buffer *buffer, int *offset,
+            SOS_data *data);
+
+    int  SOS_record_pack_manifest_row(SOS_buffer *buffer, int *offset,
+            SOS_pub *pub);
+    int  SOS_record_unpack_manifest_row(SOS_buffer *buffer, int *offset,
+            SOS_manifest_row *row);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sos.h"
+#include "sos_debug.h"
+#include "sos_buffer.h"
+#include "sos_shm.h"
+
+#define SOS_SHM_RECORD_LEN(__len) \
+    ((uint64_t) (((sizeof(int32_t) + (__len)) + 7) & ~((uint64_t) 7)))
+
+
+static bool
+SOS_shm_ring_peer_is_alive(int pid) {
+    if (pid < 1) return true;
+    if ((kill(pid, 0) == -1) && (errno == ESRCH)) {
+        return false;
+    }
+    return true;
+}
+
+
+static int
+SOS_shm_ring_map(SOS_shm_ring *ring, int fd, size_t map_len) {
+    SOS_SET_CONTEXT(ring->sos_context, "SOS_shm_ring_map");
+
+    void *map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        dlog(0, "ERROR: Unable to mmap() shared-memory ring %s.  (%s)\n",
+                ring->name, strerror(errno));
+        return -1;
+    }
+
+    ring->map_len = map_len;
+    ring->ctl     = (SOS_shm_ring_ctl *) map;
+    ring->data    = (unsigned char *) map + sizeof(SOS_shm_ring_ctl);
+
+    return 0;
+}
+
+
+int
+SOS_shm_ring_create(
+        SOS_runtime       *sos_context,
+        SOS_shm_ring     **ring_ptr,
+        const char        *name,
+        size_t             size)
+{
+    SOS_SET_CONTEXT(sos_context, "SOS_shm_ring_create");
+    SOS_shm_ring *ring;
+    size_t        pow2;
+    int           fd;
+
+    *ring_ptr = NULL;
+
+    // Positions are masked rather than taken modulo the ring size:
+    pow2 = 4096;
+    while (pow2 < size) { pow2 <<= 1; }
+
+    ring = (SOS_shm_ring *) calloc(1, sizeof(SOS_shm_ring));
+    ring->sos_context = SOS;
+    strncpy(ring->name, name, SOS_DEFAULT_STRING_LEN - 1);
+    ring->write_lock = (pthread_mutex_t *) calloc(1, sizeof(pthread_mutex_t));
+    pthread_mutex_init(ring->write_lock, NULL);
+
+    fd = shm_open(ring->name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        dlog(0, "ERROR: Unable to create shared-memory ring %s.  (%s)\n",
+                ring->name, strerror(errno));
+        SOS_shm_ring_destroy(ring);
+        return -1;
+    }
+
+    if (ftruncate(fd, sizeof(SOS_shm_ring_ctl) + pow2) < 0) {
+        dlog(0, "ERROR: Unable to size shared-memory ring %s.  (%s)\n",
+                ring->name, strerror(errno));
+        close(fd);
+        shm_unlink(ring->name);
+        SOS_shm_ring_destroy(ring);
+        return -1;
+    }
+
+    if (SOS_shm_ring_map(ring, fd, sizeof(SOS_shm_ring_ctl) + pow2) < 0) {
+        close(fd);
+        shm_unlink(ring->name);
+        SOS_shm_ring_destroy(ring);
+        return -1;
+    }
+    close(fd);
+
+    ring->ctl->head       = 0;
+    ring->ctl->tail       = 0;
+    ring->ctl->size       = (uint64_t) pow2;
+    ring->ctl->closed     = 0;
+    ring->ctl->client_pid = (int) getpid();
+    ring->ctl->daemon_pid = -1;
+
+    dlog(4, "Created shared-memory ring %s (%zu bytes).\n", ring->name, pow2);
+    *ring_ptr = ring;
+    return 0;
+}
+
+
+int
+SOS_shm_ring_attach(
+        SOS_runtime       *sos_context,
+        SOS_shm_ring     **ring_ptr,
+        const char        *name)
+{
+    SOS_SET_CONTEXT(sos_context, "SOS_shm_ring_attach");
+    SOS_shm_ring *ring;
+    struct stat   info;
+    int           fd;
+
+    *ring_ptr = NULL;
+
+    ring = (SOS_shm_ring *) calloc(1, sizeof(SOS_shm_ring));
+    ring->sos_context = SOS;
+    strncpy(ring->name, name, SOS_DEFAULT_STRING_LEN - 1);
+
+    fd = shm_open(ring->name, O_RDWR, 0);
+    if ((fd < 0) || (fstat(fd, &info) < 0)
+     || (info.st_size <= (off_t) sizeof(SOS_shm_ring_ctl))) {
+        dlog(0, "ERROR: Unable to open shared-memory ring %s.  (%s)\n",
+                ring->name, strerror(errno));
+        if (fd > -1) close(fd);
+        SOS_shm_ring_destroy(ring);
+        return -1;
+    }
+
+    if (SOS_shm_ring_map(ring, fd, (size_t) info.st_size) < 0) {
+        close(fd);
+        SOS_shm_ring_destroy(ring);
+        return -1;
+    }
+    close(fd);
+
+    if ((ring->ctl->size + sizeof(SOS_shm_ring_ctl)) != ring->map_len) {
+        dlog(0, "ERROR: Shared-memory ring %s has an invalid size.\n",
+                ring->name);
+        SOS_shm_ring_destroy(ring);
+        return -1;
+    }
+
+    ring->ctl->daemon_pid = (int) getpid();
+
+    dlog(4, "Attached to shared-memory ring %s.  (client pid: %d)\n",
+            ring->name, ring->ctl->client_pid);
+    *ring_ptr = ring;
+    return 0;
+}
+
+
+// Producer side.  Returns 0 when the message is in the ring, or -1 if it
+// cannot be placed there (too large, or the daemon went away), in which
+// case the caller should send it over the socket instead.
+int
+SOS_shm_ring_write(SOS_shm_ring *ring, SOS_buffer *msg) {
+    SOS_SET_CONTEXT(ring->sos_context, "SOS_shm_ring_write");
+    SOS_shm_ring_ctl *ctl = ring->ctl;
+    uint64_t  head;
+    uint64_t  tail;
+    uint64_t  pos;
+    uint64_t  need;
+    uint64_t  until_end;
+    int32_t   marker;
+
+    need = SOS_SHM_RECORD_LEN(msg->len);
+    // Worst case, a wrap marker burns the rest of the ring first:
+    if ((need * 2) > ctl->size) {
+        dlog(4, "Message (%d bytes) is too large for the ring.\n", msg->len);
+        return -1;
+    }
+
+    pthread_mutex_lock(ring->write_lock);
+
+    head = ctl->head;
+    pos  = head & (ctl->size - 1);
+    until_end = ctl->size - pos;
+    if (until_end < need) {
+        need += until_end;
+    }
+
+    for (;;) {
+        tail = __atomic_load_n(&ctl->tail, __ATOMIC_ACQUIRE);
+        if ((ctl->size - (head - tail)) >= need) break;
+        if (!SOS_shm_ring_peer_is_alive(ctl->daemon_pid)) {
+            dlog(0, "ERROR: The daemon draining %s is gone.\n", ring->name);
+            pthread_mutex_unlock(ring->write_lock);
+            return -1;
+        }
+        usleep(SOS_SHM_RING_WAIT_USEC);
+    }
+
+    if (until_end < SOS_SHM_RECORD_LEN(msg->len)) {
+        // Not enough contiguous room before the end, so wrap.
+        if (until_end >= sizeof(int32_t)) {
+            marker = SOS_SHM_RING_WRAP;
+            memcpy(ring->data + pos, &marker, sizeof(int32_t));
+        }
+        head += until_end;
+        pos   = 0;
+    }
+
+    marker = (int32_t) msg->len;
+    memcpy(ring->data + pos, &marker, sizeof(int32_t));
+    memcpy(ring->data + pos + sizeof(int32_t), msg->data, msg->len);
+    head += SOS_SHM_RECORD_LEN(msg->len);
+
+    __atomic_store_n(&ctl->head, head, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(ring->write_lock);
+
+    return 0;
+}
+
+
+// Consumer side.  Returns 1 and a new buffer in *msg when a message was
+// taken off the ring, or 0 when the ring is empty.
+int
+SOS_shm_ring_read(SOS_shm_ring *ring, SOS_buffer **msg) {
+    SOS_SET_CONTEXT(ring->sos_context, "SOS_shm_ring_read");
+    SOS_shm_ring_ctl *ctl = ring->ctl;
+    uint64_t  head;
+    uint64_t  tail;
+    uint64_t  pos;
+    uint64_t  until_end;
+    int32_t   len;
+
+    *msg = NULL;
+
+    tail = ctl->tail;
+    head = __atomic_load_n(&ctl->head, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return 0;
+    }
+
+    pos = tail & (ctl->size - 1);
+    until_end = ctl->size - pos;
+    len = SOS_SHM_RING_WRAP;
+    if (until_end >= sizeof(int32_t)) {
+        memcpy(&len, ring->data + pos, sizeof(int32_t));
+    }
+    if ((len == SOS_SHM_RING_WRAP) || (until_end < SOS_SHM_RECORD_LEN(len))) {
+        tail += until_end;
+        pos   = 0;
+        memcpy(&len, ring->data, sizeof(int32_t));
+    }
+
+    if ((len < (int32_t) sizeof(SOS_msg_header))
+     || (SOS_SHM_RECORD_LEN(len) > ctl->size)) {
+        dlog(0, "ERROR: Corrupt record (len == %d) in shared-memory"
+                " ring %s.  Discarding its contents.\n", len, ring->name);
+        __atomic_store_n(&ctl->tail, head, __ATOMIC_RELEASE);
+        return 0;
+    }
+
+    SOS_buffer_init_sized_locking(SOS, msg, len + 1, false);
+    memcpy((*msg)->data, ring->data + pos + sizeof(int32_t), len);
+    (*msg)->len = len;
+    tail += SOS_SHM_RECORD_LEN(len);
+
+    __atomic_store_n(&ctl->tail, tail, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+
+bool
+SOS_shm_ring_is_drained(SOS_shm_ring *ring) {
+    return (__atomic_load_n(&ring->ctl->tail, __ATOMIC_ACQUIRE)
+            == __atomic_load_n(&ring->ctl->head, __ATOMIC_ACQUIRE));
+}
+
+
+// Called by the daemon to decide when a ring can be let go of.
+bool
+SOS_shm_ring_peer_closed(SOS_shm_ring *ring) {
+    if (__atomic_load_n(&ring->ctl->closed, __ATOMIC_ACQUIRE)) {
+        return true;
+    }
+    return (!SOS_shm_ring_peer_is_alive(ring->ctl->client_pid));
+}
+
+
+// Called by the client before anything goes over the socket, so that the
+// daemon sees messages in the same order they were sent.
+int
+SOS_shm_ring_wait_drained(SOS_shm_ring *ring) {
+    while (!SOS_shm_ring_is_drained(ring)) {
+        if (!SOS_shm_ring_peer_is_alive(ring->ctl->daemon_pid)) {
+            return -1;
+        }
+        usleep(SOS_SHM_RING_WAIT_USEC);
+    }
+    return 0;
+}
+
+
+void
+SOS_shm_ring_destroy(SOS_shm_ring *ring) {
+    if (ring == NULL) return;
+
+    if (ring->ctl != NULL) {
+        munmap((void *) ring->ctl, ring->map_len);
+        ring->ctl  = NULL;
+        ring->data = NULL;
+    }
+    if (ring->write_lock != NULL) {
+        pthread_mutex_destroy(ring->write_lock);
+        free(ring->write_lock);
+    }
+    free(ring);
+
+    return;
+}
@@ -0,0 +1,51 @@
+#ifndef SOS_SHM_H
+#define SOS_SHM_H
+
+/*
+ *   Shared-memory ring transport between a client and its on-node sosd.
+ *
+ *   Each client that enables SOS_SHM_TRANSPORT creates one ring and hands
+ *   its name to the daemon (SOS_MSG_TYPE_SHM_ATTACH).  Afterwards the
+ *   ANNOUNCE, PUBLISH, and VAL_SNAPS messages are written straight into
+ *   the ring and sosd drains them into SOSD.sync.local.queue, without a
+ *   socket round trip per message.  Everything else still uses the socket.
+ *
+ *   Records are [int32 length][message bytes], padded to 8 bytes.  A
+ *   length of SOS_SHM_RING_WRAP means "skip to the start of the ring".
+ */
+
+#include "sos.h"
+#include "sos_types.h"
+#include "sos_buffer.h"
+
+#define SOS_DEFAULT_SHM_RING_SIZE   (4 * 1024 * 1024)
+#define SOS_SHM_RING_WAIT_USEC      50
+#define SOS_SHM_RING_WRAP           -1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int  SOS_shm_ring_create(SOS_runtime *sos_context, SOS_shm_ring **ring,
+            const char *name, size_t size);
+
+    int  SOS_shm_ring_attach(SOS_runtime *sos_context, SOS_shm_ring **ring,
+            const char *name);
+
+    int  SOS_shm_ring_write(SOS_shm_ring *ring, SOS_buffer *msg);
+
+    int  SOS_shm_ring_read(SOS_shm_ring *ring, SOS_buffer **msg);
+
+    bool SOS_shm_ring_is_drained(SOS_shm_ring *ring);
+
+    int  SOS_shm_ring_wait_drained(SOS_shm_ring *ring);
+
+    bool SOS_shm_ring_peer_closed(SOS_shm_ring *ring);
+
+    void SOS_shm_ring_destroy(SOS_shm_ring *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sos.h"
+#include "sos_types.h"
+#include "sos_snap_pool.h"
+#include "sos_intern.h"
+
+
+// The snap has to stay the first member, pool pointers are cast from it.
+typedef struct SOS_snap_slot {
+    SOS_val_snap            snap;
+    struct SOS_snap_slot   *next_free;
+    unsigned char           inline_payload[SOS_SNAP_POOL_INLINE_LEN];
+} SOS_snap_slot;
+
+
+static pthread_mutex_t  SOS_snap_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t   SOS_snap_pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t    SOS_snap_pool_key;
+static SOS_snap_slot   *SOS_snap_pool_shared       = NULL;
+static int              SOS_snap_pool_shared_count = 0;
+
+static __thread SOS_snap_slot *SOS_snap_pool_local       = NULL;
+static __thread int            SOS_snap_pool_local_count = 0;
+static __thread bool           SOS_snap_pool_registered  = false;
+
+
+// Hand a departing thread's free list back to the shared one.
+static void
+SOS_snap_pool_thread_exit(void *unused) {
+    SOS_snap_slot *tail;
+
+    if (SOS_snap_pool_local == NULL) return;
+
+    tail = SOS_snap_pool_local;
+    while (tail->next_free != NULL) { tail = tail->next_free; }
+
+    pthread_mutex_lock(&SOS_snap_pool_lock);
+    tail->next_free             = SOS_snap_pool_shared;
+    SOS_snap_pool_shared        = SOS_snap_pool_local;
+    SOS_snap_pool_shared_count += SOS_snap_pool_local_count;
+    pthread_mutex_unlock(&SOS_snap_pool_lock);
+
+    SOS_snap_pool_local       = NULL;
+    SOS_snap_pool_local_count = 0;
+    return;
+}
+
+
+static void
+SOS_snap_pool_make_key(void) {
+    pthread_key_create(&SOS_snap_pool_key, SOS_snap_pool_thread_exit);
+    return;
+}
+
+
+static void
+SOS_snap_pool_register_thread(void) {
+    pthread_once(&SOS_snap_pool_once, SOS_snap_pool_make_key);
+    // Any non-NULL value makes pthreads call the destructor at exit.
+    pthread_setspecific(SOS_snap_pool_key, (void *) &SOS_snap_pool_key);
+    SOS_snap_pool_registered = true;
+    return;
+}
+
+
+// Take half a local list's worth from the shared list, or a new slab.
+static void
+SOS_snap_pool_refill(void) {
+    SOS_snap_slot *slab;
+    SOS_snap_slot *tail;
+    int            take;
+    int            i;
+
+    if (!SOS_snap_pool_registered) {
+        SOS_snap_pool_register_thread();
+    }
+
+    pthread_mutex_lock(&SOS_snap_pool_lock);
+    if (SOS_snap_pool_shared != NULL) {
+        take = 1;
+        tail = SOS_snap_pool_shared;
+        while ((tail->next_free != NULL)
+            && (take < (SOS_SNAP_POOL_LOCAL_MAX / 2))) {
+            tail = tail->next_free;
+            take++;
+        }
+        SOS_snap_pool_local         = SOS_snap_pool_shared;
+        SOS_snap_pool_shared        = tail->next_free;
+        SOS_snap_pool_shared_count -= take;
+        tail->next_free             = NULL;
+        SOS_snap_pool_local_count   = take;
+        pthread_mutex_unlock(&SOS_snap_pool_lock);
+        return;
+    }
+    pthread_mutex_unlock(&SOS_snap_pool_lock);
+
+    slab = (SOS_snap_slot *) malloc(SOS_SNAP_POOL_SLAB_COUNT
+            * sizeof(SOS_snap_slot));
+    if (slab == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate a slab of %d snaps.\n",
+                SOS_SNAP_POOL_SLAB_COUNT);
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < (SOS_SNAP_POOL_SLAB_COUNT - 1); i++) {
+        slab[i].next_free = &slab[i + 1];
+    }
+    slab[SOS_SNAP_POOL_SLAB_COUNT - 1].next_free = NULL;
+
+    SOS_snap_pool_local       = slab;
+    SOS_snap_pool_local_count = SOS_SNAP_POOL_SLAB_COUNT;
+    return;
+}
+
+
+// Give half of the local list to the shared one.
+static void
+SOS_snap_pool_spill(void) {
+    SOS_snap_slot *head;
+    SOS_snap_slot *tail;
+    int            give;
+    int            i;
+
+    give = SOS_snap_pool_local_count / 2;
+    head = SOS_snap_pool_local;
+    tail = head;
+    for (i = 1; i < give; i++) { tail = tail->next_free; }
+
+    SOS_snap_pool_local        = tail->next_free;
+    SOS_snap_pool_local_count -= give;
+
+    pthread_mutex_lock(&SOS_snap_pool_lock);
+    tail->next_free             = SOS_snap_pool_shared;
+    SOS_snap_pool_shared        = head;
+    SOS_snap_pool_shared_count += give;
+    pthread_mutex_unlock(&SOS_snap_pool_lock);
+
+    return;
+}
+
+
+SOS_val_snap*
+SOS_val_snap_alloc(void) {
+    SOS_snap_slot *slot;
+
+    if (SOS_snap_pool_local == NULL) {
+        SOS_snap_pool_refill();
+    }
+    slot = SOS_snap_pool_local;
+    SOS_snap_pool_local = slot->next_free;
+    SOS_snap_pool_local_count--;
+
+    memset(&slot->snap, 0, sizeof(SOS_val_snap));
+    return &slot->snap;
+}
+
+
+void
+SOS_val_snap_alloc_list(SOS_val_snap **snap_list, int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        snap_list[i] = SOS_val_snap_alloc();
+    }
+    return;
+}
+
+
+// Storage for a BYTES or array value of (len) bytes, owned by the snap.
+void*
+SOS_val_snap_payload(SOS_val_snap *snap, int len) {
+    SOS_snap_slot *slot = (SOS_snap_slot *) snap;
+
+    if ((len >= 0) && (len <= SOS_SNAP_POOL_INLINE_LEN)) {
+        return (void *) slot->inline_payload;
+    }
+    return malloc(len);
+}
+
+
+// String values are interned rather than copied into the payload.
+void
+SOS_val_snap_set_string(SOS_val_snap *snap, const char *str) {
+    snap->type      = SOS_VAL_TYPE_STRING;
+    snap->val.c_val = SOS_intern(str);
+    snap->val_len   = strlen(snap->val.c_val);
+    return;
+}
+
+
+// A reference to (len) bytes of its own, for the caller to fill in.
+SOS_bytes_ref*
+SOS_bytes_ref_alloc(int len) {
+    SOS_bytes_ref *ref;
+
+    ref = (SOS_bytes_ref *) malloc(sizeof(SOS_bytes_ref) + len);
+    if (ref == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate a %d byte value.\n", len);
+        exit(EXIT_FAILURE);
+    }
+    ref->refs        = 1;
+    ref->len         = len;
+    ref->bytes       = (void *) (ref + 1);
+    ref->release     = NULL;
+    ref->release_ctx = NULL;
+    return ref;
+}
+
+
+// With no release function the bytes are copied here, so the caller may
+// reuse its memory as soon as this returns.
+SOS_bytes_ref*
+SOS_bytes_ref_create(const void *bytes, int len,
+        SOS_bytes_release_fn release, void *release_ctx)
+{
+    SOS_bytes_ref *ref;
+
+    if (release == NULL) {
+        ref = SOS_bytes_ref_alloc(len);
+        memcpy(ref->bytes, bytes, len);
+        return ref;
+    }
+
+    ref = SOS_bytes_ref_alloc(0);
+    ref->len         = len;
+    ref->bytes       = (void *) bytes;
+    ref->release     = release;
+    ref->release_ctx = release_ctx;
+    return ref;
+}
+
+
+void
+SOS_bytes_ref_retain(SOS_bytes_ref *ref) {
+    __atomic_add_fetch(&ref->refs, 1, __ATOMIC_RELAXED);
+    return;
+}
+
+
+void
+SOS_bytes_ref_drop(SOS_bytes_ref *ref) {
+    if (ref == NULL) return;
+    if (__atomic_sub_fetch(&ref->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    if (ref->release != NULL) {
+        ref->release(ref->release_ctx, ref->bytes);
+    }
+    free(ref);
+    return;
+}
+
+
+// The snap takes its own reference, the caller keeps theirs.
+void
+SOS_val_snap_set_bytes(SOS_val_snap *snap, SOS_val_type type,
+        SOS_bytes_ref *ref)
+{
+    SOS_bytes_ref_retain(ref);
+    snap->type      = type;
+    snap->bytes_ref = ref;
+    snap->val.bytes = ref->bytes;
+    snap->val_len   = ref->len;
+    return;
+}
+
+
+// Copy a snap, giving the copy its own payload.  Interned strings and
+// referenced bytes are never written to, so those are shared instead.
+void
+SOS_val_snap_copy(SOS_val_snap *dest, const SOS_val_snap *src) {
+    memcpy(dest, src, sizeof(SOS_val_snap));
+
+    switch (src->type) {
+    case SOS_VAL_TYPE_STRING:
+        SOS_intern_retain(src->val.c_val);
+        break;
+    case SOS_VAL_TYPE_BYTES:
+    case SOS_VAL_TYPE_INT_ARRAY:
+    case SOS_VAL_TYPE_LONG_ARRAY:
+    case SOS_VAL_TYPE_DOUBLE_ARRAY:
+        if (src->bytes_ref != NULL) {
+            SOS_bytes_ref_retain(src->bytes_ref);
+            break;
+        }
+        if (src->val.bytes == NULL) break;
+        dest->val.bytes = SOS_val_snap_payload(dest, src->val_len);
+        memcpy(dest->val.bytes, src->val.bytes, src->val_len);
+        break;
+    default:
+        break;
+    }
+    return;
+}
+
+
+static void
+SOS_val_snap_release(SOS_val_snap *snap) {
+    SOS_snap_slot *slot = (SOS_snap_slot *) snap;
+
+    switch (snap->type) {
+    case SOS_VAL_TYPE_BYTES:
+    case SOS_VAL_TYPE_INT_ARRAY:
+    case SOS_VAL_TYPE_LONG_ARRAY:
+    case SOS_VAL_TYPE_DOUBLE_ARRAY:
+        if (snap->bytes_ref != NULL) {
+            SOS_bytes_ref_drop(snap->bytes_ref);
+            break;
+        }
+        if ((snap->val.bytes != NULL)
+         && (snap->val.bytes != (void *) slot->inline_payload)) {
+            free(snap->val.bytes);
+        }
+        break;
+    case SOS_VAL_TYPE_STRING:
+        SOS_intern_drop(snap->val.c_val);
+        break;
+    default:
+        break;
+    }
+
+    if (!SOS_snap_pool_registered) {
+        SOS_snap_pool_register_thread();
+    }
+    slot->next_free = SOS_snap_pool_local;
+    SOS_snap_pool_local = slot;
+    SOS_snap_pool_local_count++;
+    if (SOS_snap_pool_local_count > SOS_SNAP_POOL_LOCAL_MAX) {
+        SOS_snap_pool_spill();
+    }
+    return;
+}
+
+
+void
+SOS_val_snap_destroy(SOS_val_snap **snap_var) {
+    if (*snap_var == NULL) return;
+    SOS_val_snap_release(*snap_var);
+    *snap_var = NULL;
+    return;
+}
+
+
+void
+SOS_val_snap_destroy_list(SOS_val_snap **snap_list, int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        if (snap_list[i] != NULL) SOS_val_snap_release(snap_list[i]);
+    }
+    return;
+}
+
+
+// Release a cache frame: snaps linked through next_snap.
+void
+SOS_val_snap_destroy_chain(SOS_val_snap *snap) {
+    SOS_val_snap *next_snap;
+    while (snap != NULL) {
+        next_snap = (SOS_val_snap *) snap->next_snap;
+        SOS_val_snap_release(snap);
+        snap = next_snap;
+    }
+    return;
+}
@@ -0,0 +1,69 @@
+#ifndef SOS_SNAP_POOL_H
+#define SOS_SNAP_POOL_H
+
+/*
+ *   Pooled allocation of SOS_val_snap objects.
+ *
+ *   Snaps are carved out of slabs of SOS_SNAP_POOL_SLAB_COUNT and never
+ *   handed back to malloc.  Each thread keeps a private free list, so a
+ *   pack or a message unpack normally takes no lock at all; the shared
+ *   list is only touched to move half a thread's worth of snaps at a
+ *   time, which covers the daemon's pattern of one thread unpacking and
+ *   another thread freeing after the DB commit.
+ *
+ *   Every snap carries SOS_SNAP_POOL_INLINE_LEN bytes of room for its
+ *   byte / array payload.  SOS_val_snap_payload() hands that out
+ *   when the value fits and falls back to malloc() when it does not.
+ *   Either way the payload belongs to the snap and is released along with
+ *   it, so it must never be free()'ed directly.
+ *
+ *   STRING values are interned (sos_intern.h) instead, so every snap of
+ *   the same string shares one copy of it.
+ *
+ *   Values from SOS_pack_bytes() and SOS_pack_vector() are the exception:
+ *   the snap holds a counted reference (SOS_bytes_ref) to memory that is
+ *   not its own, and dropping the last reference hands that memory back
+ *   through its release function.
+ */
+
+#include "sos_types.h"
+
+#define SOS_SNAP_POOL_SLAB_COUNT    256
+#define SOS_SNAP_POOL_LOCAL_MAX     1024
+#define SOS_SNAP_POOL_INLINE_LEN    64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    SOS_val_snap* SOS_val_snap_alloc(void);
+
+    void  SOS_val_snap_alloc_list(SOS_val_snap **snap_list, int count);
+
+    void* SOS_val_snap_payload(SOS_val_snap *snap, int len);
+
+    void  SOS_val_snap_set_string(SOS_val_snap *snap, const char *str);
+
+    SOS_bytes_ref* SOS_bytes_ref_alloc(int len);
+
+    SOS_bytes_ref* SOS_bytes_ref_create(const void *bytes, int len,
+            SOS_bytes_release_fn release, void *release_ctx);
+
+    void  SOS_bytes_ref_retain(SOS_bytes_ref *ref);
+
+    void  SOS_bytes_ref_drop(SOS_bytes_ref *ref);
+
+    void  SOS_val_snap_set_bytes(SOS_val_snap *snap, SOS_val_type type,
+            SOS_bytes_ref *ref);
+
+    void  SOS_val_snap_copy(SOS_val_snap *dest, const SOS_val_snap *src);
+
+    void  SOS_val_snap_destroy_list(SOS_val_snap **snap_list, int count);
+
+    void  SOS_val_snap_destroy_chain(SOS_val_snap *snap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
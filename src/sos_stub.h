@@ -66,9 +66,16 @@ extern "C" {
 #define SOS_pub_create(...)                         ;;;
 #define SOS_pack(...)                               ;;; 
 #define SOS_pack_bytes(...)                         ;;;
+#define SOS_pack_vector(...)                        ;;;
+#define SOS_pack_array(...)                         ;;;
+#define SOS_pack_handle_get(...)                    ;;;
+#define SOS_pack_by_handle(...)                     ;;;
+#define SOS_val_set_meta(...)                       ;;;
+#define SOS_pack_array_by_handle(...)               ;;;
 #define SOS_event(...)                              ;;;
 #define SOS_announce(...)                           ;;;
 #define SOS_publish(...)                            ;;;
+#define SOS_flush(...)                              ;;;
 #define SOS_sense_register(...)                     ;;;
 #define SOS_sense_trigger(...)                      ;;;
 #define SOS_finalize(...)                           ;;;
@@ -84,8 +91,10 @@ extern "C" {
 #define SOS_announce_from_buffer(...)               ;;;
 #define SOS_publish_to_buffer(...)                  ;;;
 #define SOS_publish_from_buffer(...)                ;;;
+#define SOS_pub_frame_to_buffer(...)                ;;;
 #define SOS_uid_init(...)                           ;;;
 #define SOS_uid_next(...)                           99999 
+#define SOS_uid_set_block(...)                      ;;;
 #define SOS_uid_destroy(...)                        ;;;
 #define SOS_val_snap_queue_to_buffer(...)           ;;;
 #define SOS_val_snap_queue_from_buffer(...)         ;;;
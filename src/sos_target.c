@@ -5,11 +5,28 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 
 #include "sos.h"
 #include "sos_debug.h"
 #include "sos_target.h"
 
+// A peer closing a persistent connection should show up as an
+// error from send(), not as a SIGPIPE that takes down the process.
+#ifdef MSG_NOSIGNAL
+#define SOS_TARGET_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SOS_TARGET_SEND_FLAGS 0
+#endif
+
+// The fixed part of a message header, "iigg", which leads with msg_size.
+#define SOS_TARGET_HEADER_LEN 24
+// No single message comes close to this, so a header claiming more is
+// garbage or hostile, and is not worth allocating for.
+#define SOS_TARGET_MSG_MAX    (256 * 1024 * 1024)
+
 int
 SOS_target_accept_connection(SOS_socket *target)
 {
@@ -22,6 +39,13 @@ SOS_target_accept_connection(SOS_socket *target)
     target->remote_socket_fd = accept(target->local_socket_fd,
             (struct sockaddr *) &target->peer_addr,
             &target->peer_addr_len);
+    if ((target->remote_socket_fd > -1)
+     && (target->peer_addr.ss_family == AF_UNIX)) {
+        // Local clients have no address to look up.
+        snprintf(target->remote_host, NI_MAXHOST, "%s", SOS_DEFAULT_SERVER_HOST);
+        snprintf(target->remote_port, NI_MAXSERV, "unix");
+        return 0;
+    }
     dlog(6, "  ... getting name info\n");
     i = getnameinfo((struct sockaddr *) &target->peer_addr,
             target->peer_addr_len, target->remote_host,
@@ -36,6 +60,120 @@ SOS_target_accept_connection(SOS_socket *target)
 }
 
 
+// Fills in the address of an AF_UNIX socket path, '@' for abstract names.
+static socklen_t
+SOS_target_unix_addr(const char *path, struct sockaddr_un *addr)
+{
+    size_t len;
+
+    memset(addr, '\0', sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+
+    if (path[0] == '@') {
+        len = strnlen(path + 1, sizeof(addr->sun_path) - 1);
+        memcpy(addr->sun_path + 1, path + 1, len);
+        return (socklen_t) (offsetof(struct sockaddr_un, sun_path) + 1 + len);
+    }
+    strncpy(addr->sun_path, path, sizeof(addr->sun_path) - 1);
+    return (socklen_t) sizeof(struct sockaddr_un);
+}
+
+
+// Has a target on this host try the daemon's AF_UNIX socket before TCP.
+// The socket is SOS_CMD_SOCKET if that is set, or the one named for the
+// target's port.  Returns 1 if the target will try it.
+int
+SOS_target_use_unix(SOS_socket *target)
+{
+    SOS_SET_CONTEXT(target->sos_context, "SOS_target_use_unix");
+    char  hostname[NI_MAXHOST] = {0};
+    char *path = getenv("SOS_CMD_SOCKET");
+
+    target->unix_path[0] = '\0';
+
+    gethostname(hostname, NI_MAXHOST);
+    if ((strcmp(target->remote_host, SOS_DEFAULT_SERVER_HOST) != 0)
+     && (strcmp(target->remote_host, "127.0.0.1") != 0)
+     && (strcmp(target->remote_host, hostname) != 0)) {
+        return 0;
+    }
+
+    if ((path != NULL) && (strlen(path) > 0)) {
+        snprintf(target->unix_path, sizeof(target->unix_path), "%s", path);
+    } else {
+        snprintf(target->unix_path, sizeof(target->unix_path),
+                SOS_DEFAULT_UNIX_SOCKET, target->remote_port);
+    }
+    dlog(6, "Will try the local socket %s first.\n", target->unix_path);
+    return 1;
+}
+
+
+// Listens on target->unix_path, as a second way in alongside TCP.  Unlike
+// the TCP listener this can fail without taking the daemon down, i.e.
+// when another daemon already answers on the same path.
+int
+SOS_target_setup_for_accept_unix(SOS_socket *target)
+{
+    SOS_SET_CONTEXT(target->sos_context, "SOS_target_setup_for_accept_unix");
+    struct sockaddr_un addr;
+    socklen_t          addr_len;
+    int                fd;
+
+    target->local_socket_fd = -1;
+    target->listen_backlog  = 20;
+    target->buffer_len      = SOS_DEFAULT_BUFFER_MAX;
+    target->timeout         = SOS_DEFAULT_MSG_TIMEOUT;
+
+    addr_len = SOS_target_unix_addr(target->unix_path, &addr);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        dlog(0, "WARNING: Unable to create a local socket.  (%s)\n",
+                strerror(errno));
+        return -1;
+    }
+
+    if (target->unix_path[0] != '@') {
+        // A file left behind by a daemon that is gone can be replaced,
+        // one that still answers belongs to somebody.
+        if (connect(fd, (struct sockaddr *) &addr, addr_len) == 0) {
+            dlog(0, "WARNING: Another daemon is listening on %s.\n",
+                    target->unix_path);
+            close(fd);
+            return -1;
+        }
+        close(fd);
+        unlink(target->unix_path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            dlog(0, "WARNING: Unable to create a local socket.  (%s)\n",
+                    strerror(errno));
+            return -1;
+        }
+    }
+
+    if (bind(fd, (struct sockaddr *) &addr, addr_len) == -1) {
+        dlog(0, "WARNING: Unable to bind the local socket %s.  (%s)\n",
+                target->unix_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, target->listen_backlog) == -1) {
+        dlog(0, "WARNING: Unable to listen on the local socket %s.  (%s)\n",
+                target->unix_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    target->local_socket_fd = fd;
+    dlog(1, "Listening on local socket %s.\n", target->unix_path);
+
+    return 0;
+}
+
+
 int
 SOS_target_setup_for_accept(SOS_socket *target)
 {
@@ -176,21 +314,54 @@ SOS_target_recv_n_bytes(
 }
 
 
+// Reads exactly len bytes unless the peer closes or the socket fails.
+static int
+SOS_target_recv_all(int fd, unsigned char *dest, int len) {
+    int got = 0;
+    int rc;
+
+    while (got < len) {
+        rc = recv(fd, (void *) (dest + got), (len - got), MSG_WAITALL);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (rc == 0) break;
+        got += rc;
+    }
+    return got;
+}
+
+
+// A failed receive can leave bytes anywhere up to the reserved size,
+// past what reply->len says was used, so clear all of it.  Otherwise a
+// pooled buffer would come back with stale data past its len.
+static int
+SOS_target_recv_failed(SOS_buffer *reply)
+{
+    memset(reply->data, '\0', reply->max);
+    reply->len = 0;
+    return -1;
+}
+
+
+// The header is read first, so the rest of the message can go straight
+// into a buffer of the right size, and nothing past its end is taken
+// off the socket.
 int
 SOS_target_recv_msg(
         SOS_socket *target,
         SOS_buffer *reply)
 {
     SOS_SET_CONTEXT(target->sos_context, "SOS_target_recv_msg");
-    SOS_msg_header header;
+    int msg_size = 0;
+    int rc;
 
     if (SOS->status == SOS_STATUS_SHUTDOWN) {
         dlog(1, "Ignoring receive call because SOS is shutting down.\n");
         return -1;
     }
 
-    int server_socket_fd = target->remote_socket_fd;
-
     if (reply == NULL) {
         dlog(0, "WARNING: Attempting to receive message into uninitialzied"
                 " buffer.  Attempting to init/proceed...\n");
@@ -198,46 +369,48 @@ SOS_target_recv_msg(
                 SOS_DEFAULT_BUFFER_MAX, false);
     }
 
-    int offset = 0;
-    reply->len = recv(target->remote_socket_fd, reply->data,
-            reply->max, 0);
+    SOS_buffer_reserve(reply, SOS_TARGET_HEADER_LEN);
+    reply->len = SOS_target_recv_all(target->remote_socket_fd, reply->data,
+            SOS_TARGET_HEADER_LEN);
     if (reply->len < 0) {
         //fprintf(stderr, "SOS: recv() call returned an error:\n\t\"%s\"\n",
                 //strerror(errno));
-        return reply->len;
+        return SOS_target_recv_failed(reply);
     }
 
-    memset(&header, '\0', sizeof(SOS_msg_header));
-    if (reply->len >= sizeof(SOS_msg_header)) {
-        offset = 0;
-        SOS_msg_unzip(reply, &header, 0, &offset);
-    } else {
+    if (reply->len == 0) {
+        // Orderly shutdown by the peer, i.e. a client closing its
+        // persistent connection.  Not an error.
+        dlog(6, "Peer closed the connection.\n");
+        return 0;
+    }
+
+    if (reply->len < SOS_TARGET_HEADER_LEN) {
         fprintf(stderr, "SOS: Received malformed message:"
                 " (bytes: %d)\n", reply->len);
-        return -1;
+        return SOS_target_recv_failed(reply);
     }
 
-    // Check the size of the message. We may not have gotten it all.
-    while (header.msg_size > reply->len) {
-        int old = reply->len;
-        while (header.msg_size > reply->max) {
-            //fprintf(stderr, "GROWING:   header.msg_size == %d  >  reply->max == %d\n",
-            //        header.msg_size, reply->max);
-            //fflush(stderr);
-            SOS_buffer_grow(reply, 1 + (header.msg_size - reply->max),
-                    SOS_WHOAMI);
-        }
-        int rest = recv(target->remote_socket_fd, (void *) (reply->data + old),
-                header.msg_size - old, 0);
-        if (rest < 0) {
+    msg_size = SOS_buffer_unpacki32(reply->data);
+    if ((msg_size < SOS_TARGET_HEADER_LEN)
+     || (msg_size > SOS_TARGET_MSG_MAX)) {
+        fprintf(stderr, "SOS: Received malformed message:"
+                " (msg_size: %d)\n", msg_size);
+        return SOS_target_recv_failed(reply);
+    }
+
+    if (msg_size > reply->len) {
+        SOS_buffer_reserve(reply, msg_size);
+        rc = SOS_target_recv_all(target->remote_socket_fd,
+                (reply->data + reply->len), (msg_size - reply->len));
+        if (rc < (msg_size - reply->len)) {
             fprintf(stderr, "SOS: recv() call for reply from"
                     " daemon returned an error:\n\t\"(%s)\"\n",
-                    strerror(errno));
-            return -1;
-        } else {
-            dlog(6, "  ... recv() returned %d more bytes.\n", rest);
+                    (rc < 0) ? strerror(errno) : "connection closed");
+            return SOS_target_recv_failed(reply);
         }
-        reply->len += rest;
+        dlog(6, "  ... recv() returned %d more bytes.\n", rc);
+        reply->len += rc;
     }
 
     dlog(6, "Reply fully received.  reply->len == %d\n", reply->len);
@@ -246,6 +419,87 @@ SOS_target_recv_msg(
 }
 
 
+// Internal: resolve the target address and open a connected socket.
+//           The caller is responsible for holding target->send_lock.
+static int
+SOS_target_open_socket(SOS_socket *target) {
+    SOS_SET_CONTEXT(target->sos_context, "SOS_target_open_socket");
+
+    int retval = 0;
+    int new_fd = -1;
+
+    dlog(8, "Attempting to open server socket...\n");
+
+    if (target->unix_path[0] != '\0') {
+        struct sockaddr_un addr;
+        socklen_t          addr_len;
+
+        addr_len = SOS_target_unix_addr(target->unix_path, &addr);
+        new_fd   = socket(AF_UNIX, SOCK_STREAM, 0);
+        if ((new_fd > -1)
+         && (connect(new_fd, (struct sockaddr *) &addr, addr_len) == 0)) {
+            target->remote_socket_fd = new_fd;
+            dlog(8, "   ...connected to local socket %s."
+                    "  target->remote_socket_fd == %d\n",
+                    target->unix_path, target->remote_socket_fd);
+            return 0;
+        }
+        // The daemon is not offering one, so stop asking.
+        dlog(6, "   ...no local socket at %s, using TCP.\n",
+                target->unix_path);
+        if (new_fd > -1) close(new_fd);
+        new_fd = -1;
+        target->unix_path[0] = '\0';
+    }
+
+    dlog(8, "   ...gathering address info.\n");
+    target->remote_socket_fd = -1;
+    retval = getaddrinfo(target->remote_host, target->remote_port,
+        &target->remote_hint, &target->result_list);
+    if (retval != 0) {
+        dlog(0, "ERROR: Could not get info on target.  (%s:%s)\n",
+            target->remote_host, target->remote_port );
+        return -1;
+    }
+
+    dlog(8, "   ...iterating possible connection techniques.\n");
+    // Iterate the possible connections:
+    for (target->remote_addr = target->result_list ;
+        target->remote_addr != NULL ;
+        target->remote_addr = target->remote_addr->ai_next)
+    {
+        new_fd = socket(target->remote_addr->ai_family,
+            target->remote_addr->ai_socktype,
+            target->remote_addr->ai_protocol);
+        if (new_fd == -1) {
+            continue;
+        }
+
+        retval = connect(new_fd, target->remote_addr->ai_addr,
+            target->remote_addr->ai_addrlen);
+        if (retval != -1) break;
+
+        close(new_fd);
+        new_fd = -1;
+    }
+
+    dlog(8, "   ...freeing unused results.\n");
+    freeaddrinfo( target->result_list );
+
+    if (new_fd == -1) {
+        dlog(0, "ERROR: Unable to connect to target at %s:%s  (%s)\n",
+            target->remote_host, target->remote_port, strerror(errno));
+        return -1;
+    }
+
+    target->remote_socket_fd = new_fd;
+    dlog(8, "   ...successfully connected!"
+            "  target->remote_socket_fd == %d\n", target->remote_socket_fd);
+
+    return 0;
+}
+
+
 int
 SOS_target_init(
         SOS_runtime       *sos_context,
@@ -261,8 +515,12 @@ SOS_target_init(
 
     tgt->is_locking = true;
     tgt->send_lock = (pthread_mutex_t *) calloc(1, sizeof(pthread_mutex_t));
+    pthread_mutex_init(tgt->send_lock, NULL);
     pthread_mutex_lock(tgt->send_lock);
 
+    tgt->is_persistent    = false;
+    tgt->remote_socket_fd = -1;
+
     if (target_host != NULL) {
         strncpy(tgt->remote_host, target_host, NI_MAXHOST);
     } else {
@@ -309,6 +567,11 @@ SOS_target_destroy(SOS_socket *target) {
     SOS_SET_CONTEXT(target->sos_context, "SOS_target_destroy");
 
     pthread_mutex_lock(target->send_lock);
+    if ((target->is_persistent) && (target->remote_socket_fd > -1)) {
+        close(target->remote_socket_fd);
+        target->remote_socket_fd = -1;
+    }
+    pthread_mutex_unlock(target->send_lock);
     pthread_mutex_destroy(target->send_lock);
 
     free(target->send_lock);
@@ -317,71 +580,90 @@ SOS_target_destroy(SOS_socket *target) {
     return 0;
 }
 
+// True if the peer has closed (or reset) a connection we were holding
+// open, without waiting on it.
+static bool
+SOS_target_peer_closed(int fd) {
+    char byte;
+    int  rc;
+
+    rc = recv(fd, &byte, 1, (MSG_PEEK | MSG_DONTWAIT));
+    if (rc == 0) {
+        return true;
+    }
+    if ((rc < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)
+     && (errno != EINTR)) {
+        return true;
+    }
+    return false;
+}
+
 int
 SOS_target_connect(SOS_socket *target) {
     SOS_SET_CONTEXT(target->sos_context, "SOS_target_connect");
 
     int retval = 0;
-    int new_fd = 0;
 
     dlog(8, "Obtaining target send_lock...\n");
     pthread_mutex_lock(target->send_lock);
 
-    dlog(8, "Attempting to open server socket...\n");
-    dlog(8, "   ...gathering address info.\n");
-    target->remote_socket_fd = -1;
-    retval = getaddrinfo(target->remote_host, target->remote_port,
-        &target->remote_hint, &target->result_list);
-    if (retval < 0) {
-        dlog(0, "ERROR: Could not get info on target.  (%s:%s)\n",
-            target->remote_host, target->remote_port );
+    if ((target->is_persistent) && (target->remote_socket_fd > -1)) {
+        if (!SOS_target_peer_closed(target->remote_socket_fd)) {
+            // The connection from a prior exchange is still open, reuse it.
+            dlog(8, "Reusing persistent connection.  (fd == %d)\n",
+                    target->remote_socket_fd);
+            return 0;
+        }
+        // The peer went away (or restarted) while we were idle.  Nothing
+        // has been sent on it yet, so just open a fresh one.
+        dlog(1, "Persistent connection was closed by the peer,"
+                " reconnecting...\n");
+        close(target->remote_socket_fd);
+        target->remote_socket_fd = -1;
+        // Whatever it had not read yet (see SOS_WIRE_NO_ACK) is gone, and
+        // a restarted peer has none of what came before.
+        __atomic_add_fetch(&target->losses, 1, __ATOMIC_RELAXED);
+    }
+
+    retval = SOS_target_open_socket(target);
+    if (retval != 0) {
         pthread_mutex_unlock(target->send_lock);
         return -1;
     }
 
-    dlog(8, "   ...iterating possible connection techniques.\n");
-    // Iterate the possible connections:
-    for (target->remote_addr = target->result_list ;
-        target->remote_addr != NULL ;
-        target->remote_addr = target->remote_addr->ai_next)
-    {
-        new_fd = socket(target->remote_addr->ai_family,
-            target->remote_addr->ai_socktype,
-            target->remote_addr->ai_protocol);
-        if (new_fd == -1) {
-            continue;
-        }
+    return 0;
+}
 
-        retval = connect(new_fd, target->remote_addr->ai_addr,
-            target->remote_addr->ai_addrlen);
-        if (retval != -1) break;
 
-        close(new_fd);
-        new_fd = -1;
-    }
-
-    dlog(8, "   ...freeing unused results.\n");
-    freeaddrinfo( target->result_list );
+// NOTE: The caller must already hold target->send_lock.  This is used
+//       to recover a persistent connection the peer has closed on us.
+int
+SOS_target_reconnect(SOS_socket *target) {
+    SOS_SET_CONTEXT(target->sos_context, "SOS_target_reconnect");
 
-    if (new_fd == -1) {
-        dlog(0, "ERROR: Unable to connect to target at %s:%s  (%s)\n",
-            target->remote_host, target->remote_port, strerror(errno));
+    dlog(4, "Re-establishing connection to target at %s:%s ...\n",
+            target->remote_host, target->remote_port);
 
-        pthread_mutex_unlock(target->send_lock);
-        return -1;
+    if (target->remote_socket_fd > -1) {
+        close(target->remote_socket_fd);
+        target->remote_socket_fd = -1;
     }
+    __atomic_add_fetch(&target->losses, 1, __ATOMIC_RELAXED);
 
-    target->remote_socket_fd = new_fd;
-    dlog(8, "   ...successfully connected!"
-            "  target->remote_socket_fd == %d\n", target->remote_socket_fd);
-
-    return 0;
+    return SOS_target_open_socket(target);
 }
 
 
 int SOS_target_disconnect(SOS_socket *target) {
     SOS_SET_CONTEXT(target->sos_context, "SOS_target_disconnect");
 
+    if ((target->is_persistent) && (target->remote_socket_fd > -1)) {
+        // Leave the connection up for the next exchange.
+        dlog(8, "Releasing target send_lock (connection stays open)...\n");
+        pthread_mutex_unlock(target->send_lock);
+        return 0;
+    }
+
     dlog(8, "Closing target file descriptor... (%d)\n",
             target->remote_socket_fd);
 
@@ -394,19 +676,21 @@ int SOS_target_disconnect(SOS_socket *target) {
     return 0;
 }
 
+// Sends the segments of one message, in order, with as few system calls
+// as the socket allows.  Returns the bytes sent, or -1.
 int
-SOS_target_send_msg(
-        SOS_socket *target,
-        SOS_buffer *msg)
+SOS_target_send_msgv(
+        SOS_socket   *target,
+        struct iovec *iov,
+        int           iov_count)
 {
-    SOS_SET_CONTEXT(msg->sos_context, "SOS_target_send_msg");
+    SOS_SET_CONTEXT(target->sos_context, "SOS_target_send_msgv");
 
-    SOS_msg_header header;
-    int            offset      = 0;
-    int            inset       = 0;
+    struct msghdr  mh;
     int            retval      = 0;
-    double         time_start  = 0.0;
-    double         time_out    = 0.0;
+    int            total_bytes = 0;
+    int            more_bytes  = 0;
+    int            i           = 0;
 
     if (SOS->status == SOS_STATUS_SHUTDOWN) {
         dlog(1, "Suppressing a send.  (SOS_STATUS_SHUTDOWN)\n");
@@ -420,13 +704,13 @@ SOS_target_send_msg(
 
     dlog(6, "Processing a send.\n");
 
-    int more_to_send      = 1;
+    for (i = 0; i < iov_count; i++) {
+        more_bytes += iov[i].iov_len;
+    }
+
     int failed_send_count = 0;
-    int total_bytes_sent  = 0;
-    retval = 0;
 
-    SOS_TIME(time_start);
-    while (more_to_send) {
+    while (more_bytes > 0) {
         if (failed_send_count >= 8) {
             fprintf(stderr, "ERROR: Unable to contact target (%s:%s) after %d attempts.\n",
                     target->remote_host,
@@ -434,13 +718,20 @@ SOS_target_send_msg(
                     failed_send_count);
             fflush(stderr);
             dlog(0, "ERROR: Unable to contact target after 8 attempts.\n");
-            more_to_send = 0;
-            pthread_mutex_unlock(target->send_lock);
             return -1;
         }
-        retval = send(target->remote_socket_fd, (msg->data + total_bytes_sent),
-                msg->len, 0);
+        memset(&mh, 0, sizeof(struct msghdr));
+        mh.msg_iov    = iov;
+        mh.msg_iovlen = iov_count;
+        retval = sendmsg(target->remote_socket_fd, &mh, SOS_TARGET_SEND_FLAGS);
         if (retval < 0) {
+            if ((errno == EPIPE) || (errno == ECONNRESET) || (errno == EBADF)) {
+                // The peer is gone, retrying this socket will not help.
+                dlog(1, "Target connection was closed.  (%s)\n",
+                        strerror(errno));
+                return -1;
+            }
+            if (errno == EINTR) continue;
             failed_send_count++;
             dlog(0, "ERROR: Could not send message to target."
                     " (%s)\n", strerror(errno));
@@ -448,18 +739,63 @@ SOS_target_send_msg(
                     " a brief delay.\n", (8 - failed_send_count));
             usleep(10000);
             continue;
-        } else {
-            total_bytes_sent += retval;
         }
-        if (total_bytes_sent >= msg->len) {
-            more_to_send = 0;
+        total_bytes += retval;
+        more_bytes  -= retval;
+
+        // Step past whatever went out, the rest goes on the next pass.
+        while ((iov_count > 0) && (retval >= (int) iov->iov_len)) {
+            retval -= iov->iov_len;
+            iov++;
+            iov_count--;
+        }
+        if (iov_count > 0) {
+            iov->iov_base  = (unsigned char *) iov->iov_base + retval;
+            iov->iov_len  -= retval;
         }
     }//while
 
     dlog(6, "Send complete...\n");
-    // Done!
 
-    return total_bytes_sent;
+    return total_bytes;
 }
 
 
+int
+SOS_target_send_msg(
+        SOS_socket *target,
+        SOS_buffer *msg)
+{
+    struct iovec iov;
+
+    iov.iov_base = (void *) msg->data;
+    iov.iov_len  = msg->len;
+
+    return SOS_target_send_msgv(target, &iov, 1);
+}
+
+
+// Sends a message that is a zipped header (and anything packed after it)
+// in head, followed by body_len bytes at body that were never copied into
+// it.  Only the size field of the header is rewritten to cover both.
+int
+SOS_target_send_msg_parts(
+        SOS_socket *target,
+        SOS_buffer *head,
+        void       *body,
+        int         body_len)
+{
+    SOS_msg_header header;
+    struct iovec   iov[2];
+    int            offset = 0;
+
+    header.msg_size = head->len + body_len;
+    SOS_msg_seal(head, header, 0, &offset);
+
+    iov[0].iov_base = (void *) head->data;
+    iov[0].iov_len  = head->len;
+    iov[1].iov_base = body;
+    iov[1].iov_len  = body_len;
+
+    return SOS_target_send_msgv(target, iov, (body_len > 0) ? 2 : 1);
+}
@@ -2,6 +2,8 @@
 #ifndef SOS_TARGET_H
 #define SOS_TARGET_H
 
+#include <sys/uio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -11,12 +13,24 @@ extern "C" {
 
     int SOS_target_connect(SOS_socket *target);
 
+    int SOS_target_reconnect(SOS_socket *target);
+
     int SOS_target_setup_for_accept(SOS_socket *target);
 
+    int SOS_target_setup_for_accept_unix(SOS_socket *target);
+
+    int SOS_target_use_unix(SOS_socket *target);
+
     int SOS_target_accept_connection(SOS_socket *target);
 
     int SOS_target_send_msg(SOS_socket *target, SOS_buffer *msg);
 
+    int SOS_target_send_msgv(SOS_socket *target, struct iovec *iov,
+            int iov_count);
+
+    int SOS_target_send_msg_parts(SOS_socket *target, SOS_buffer *head,
+            void *body, int body_len);
+
     int SOS_target_recv_msg(SOS_socket *target, SOS_buffer *reply);
 
     int SOS_target_recv_n_bytes(void *dest_ptr,
@@ -12,6 +12,7 @@
 #include <limits.h>
 #include <inttypes.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
 
 #include "sos_qhashtbl.h"
@@ -56,6 +57,8 @@
     MSG_TYPE(SOS_MSG_TYPE_SENSITIVITY)          \
     MSG_TYPE(SOS_MSG_TYPE_DESENSITIZE)          \
     MSG_TYPE(SOS_MSG_TYPE_TRIGGERPULL)          \
+    MSG_TYPE(SOS_MSG_TYPE_SHM_ATTACH)           \
+    MSG_TYPE(SOS_MSG_TYPE_PUB_FRAME)            \
     MSG_TYPE(SOS_MSG_TYPE___MAX)
 
 #define FOREACH_RECEIVES(RECEIVES)              \
@@ -72,6 +75,13 @@
 
 #define FOREACH_PUB_OPTION(PUB_OPTION)          \
     PUB_OPTION(SOS_PUB_OPTION_CACHE)            \
+    PUB_OPTION(SOS_PUB_OPTION_ASYNC)            \
+    PUB_OPTION(SOS_PUB_OPTION_STAGED)           \
+    PUB_OPTION(SOS_PUB_OPTION_COALESCE)         \
+    PUB_OPTION(SOS_PUB_OPTION_RATE_LIMIT)       \
+    PUB_OPTION(SOS_PUB_OPTION_AGGREGATE)        \
+    PUB_OPTION(SOS_PUB_OPTION_PROG_NAME)        \
+    PUB_OPTION(SOS_PUB_OPTION_PROG_VER)         \
     PUB_OPTION(SOS_PUB_OPTION___MAX)
 
 #define FOREACH_QUERY_STATE(QUERY_STATE)        \
@@ -98,6 +108,9 @@
     VAL_TYPE(SOS_VAL_TYPE_DOUBLE)               \
     VAL_TYPE(SOS_VAL_TYPE_STRING)               \
     VAL_TYPE(SOS_VAL_TYPE_BYTES)                \
+    VAL_TYPE(SOS_VAL_TYPE_INT_ARRAY)            \
+    VAL_TYPE(SOS_VAL_TYPE_LONG_ARRAY)           \
+    VAL_TYPE(SOS_VAL_TYPE_DOUBLE_ARRAY)         \
     VAL_TYPE(SOS_VAL_TYPE___MAX)
 
 #define FOREACH_VAL_SYNC(VAL_SYNC)              \
@@ -233,6 +246,12 @@
     LOCALE(SOS_LOCALE_APPLICATION)              \
     LOCALE(SOS_LOCALE___MAX)
 
+#define FOREACH_ASYNC_FULL(ASYNC_FULL)          \
+    ASYNC_FULL(SOS_ASYNC_FULL_BLOCK)            \
+    ASYNC_FULL(SOS_ASYNC_FULL_DROP_OLDEST)      \
+    ASYNC_FULL(SOS_ASYNC_FULL_COALESCE)         \
+    ASYNC_FULL(SOS_ASYNC_FULL___MAX)
+
 
 #define GENERATE_ENUM(ENUM) ENUM,
 #define GENERATE_STRING(STRING) #STRING,
@@ -260,6 +279,7 @@ typedef enum { FOREACH_LAYER(GENERATE_ENUM)         } SOS_layer;
 typedef enum { FOREACH_NATURE(GENERATE_ENUM)        } SOS_nature;
 typedef enum { FOREACH_RETAIN(GENERATE_ENUM)        } SOS_retain;
 typedef enum { FOREACH_LOCALE(GENERATE_ENUM)        } SOS_locale;
+typedef enum { FOREACH_ASYNC_FULL(GENERATE_ENUM)    } SOS_async_full;
 
 static const char *SOS_ROLE_str[] __attribute__((__unused__)) =          { FOREACH_ROLE(GENERATE_STRING)         };
 static const char *SOS_STATUS_str[] __attribute__((__unused__)) =        { FOREACH_STATUS(GENERATE_STRING)       };
@@ -284,6 +304,7 @@ static const char *SOS_LAYER_str[] __attribute__((__unused__)) =         { FOREA
 static const char *SOS_NATURE_str[] __attribute__((__unused__)) =        { FOREACH_NATURE(GENERATE_STRING)       };
 static const char *SOS_RETAIN_str[] __attribute__((__unused__)) =        { FOREACH_RETAIN(GENERATE_STRING)       };
 static const char *SOS_LOCALE_str[] __attribute__((__unused__)) =        { FOREACH_LOCALE(GENERATE_STRING)       };
+static const char *SOS_ASYNC_FULL_str[] __attribute__((__unused__)) =    { FOREACH_ASYNC_FULL(GENERATE_STRING)   };
 
 #define SOS_ENUM_IN_RANGE(__SOS_var_name, __SOS_max_name)  (__SOS_var_name >= 0 && __SOS_var_name < __SOS_max_name)
 #define SOS_ENUM_STR(__SOS_var_name, __SOS_enum_type)  SOS_ENUM_IN_RANGE(__SOS_var_name, (__SOS_enum_type ## ___MAX)) ? __SOS_enum_type ## _str[__SOS_var_name] : "** " #__SOS_enum_type " is INVALID **"
@@ -319,9 +340,35 @@ typedef union {
     long                l_val;
     double              d_val;
     char               *c_val;
-    void               *bytes;   // addr of SOS_buffer object w/the byte array
+    void               *bytes;
+    int                *ia_val;
+    long               *la_val;
+    double             *da_val;
 } SOS_val;
 
+// Arrays are kept like BYTES, with val_len counting bytes, not elements.
+#define SOS_VAL_TYPE_IS_ARRAY(__type)                                       \
+    (((__type) == SOS_VAL_TYPE_INT_ARRAY)                                   \
+  || ((__type) == SOS_VAL_TYPE_LONG_ARRAY)                                  \
+  || ((__type) == SOS_VAL_TYPE_DOUBLE_ARRAY))
+
+#define SOS_VAL_TYPE_ARRAY_ELEM_SIZE(__type)                                \
+    (((__type) == SOS_VAL_TYPE_INT_ARRAY)  ? sizeof(int)  :                 \
+     ((__type) == SOS_VAL_TYPE_LONG_ARRAY) ? sizeof(long) : sizeof(double))
+
+// Called once nothing in libsos refers to a SOS_pack_bytes() payload.
+typedef void (*SOS_bytes_release_fn)(void *release_ctx, void *bytes);
+
+// A SOS_VAL_TYPE_BYTES or array payload shared by the pub and its snaps.  It is
+// either the caller's own memory (release != NULL) or a private copy.
+typedef struct {
+    int                 refs;
+    int                 len;
+    void               *bytes;
+    SOS_bytes_release_fn release;
+    void               *release_ctx;
+} SOS_bytes_ref;
+
 typedef struct {
     long                init_flag;
     uint32_t            crc32_at_set;
@@ -362,20 +409,29 @@ typedef struct {
     SOS_val_type        type;
     int                 val_len;
     SOS_val             val;
+    SOS_bytes_ref      *bytes_ref;
     void               *next_snap;
     void               *prev_snap;
 } SOS_val_snap;
 
+// A value's position in its pub, resolved once by SOS_pack_handle_get().
+typedef struct {
+    int                 elem;
+    SOS_guid            guid;
+    SOS_val_type        type;
+} SOS_pack_handle_t;
+
 typedef struct {
     SOS_guid            guid;
     int                 val_len;
     SOS_val             val;
+    SOS_bytes_ref      *bytes_ref;
     SOS_val_type        type;
     SOS_val_meta        meta;
     SOS_val_state       state;
     SOS_val_sync        sync;
     SOS_time            time;
-    char                name[SOS_DEFAULT_STRING_LEN];
+    char               *name;       // interned, see sos_intern.h
 } SOS_data;
 
 typedef struct {
@@ -387,6 +443,47 @@ typedef struct {
     SOS_retain          retain_hint;
 } SOS_pub_meta;
 
+// Running state of a COUNTER or SAMPLE value, see sos_coalesce.c.
+typedef struct {
+    SOS_val             total;
+    long                count;
+    double              min;
+    double              max;
+    double              sum;
+    double              sumsq;
+} SOS_val_summary;
+
+// Values packed by one thread into a staged pub, see sos_pack_stage.c.
+typedef struct {
+    SOS_val_snap      **snap;
+    int                *name_at;    // offset into names, -1: packed by handle
+    int                 count;
+    int                 max;
+    char               *names;
+    int                 names_len;
+    int                 names_max;
+} SOS_pack_stage_buf;
+
+typedef struct {
+    pthread_t           owner;
+    int                 active;
+    int                 writing;
+    SOS_pack_stage_buf  buf[2];
+    void               *next_stage;
+} SOS_pack_stage;
+
+typedef struct {
+    uint32_t            hash;
+    int                 value;
+    char               *key;
+} SOS_name_index_slot;
+
+typedef struct {
+    int                 size;
+    int                 count;
+    SOS_name_index_slot *slot;
+} SOS_name_index;
+
 typedef struct {
     void               *sos_context;
     pthread_mutex_t    *lock;
@@ -398,22 +495,36 @@ typedef struct {
     int                 comm_rank;
     SOS_pub_meta        meta;
     int                 announced;
+    int                 announced_count;
+    int                 announced_losses;
+    bool                async_publish;
+    bool                pack_staged;
+    SOS_pack_stage     *stage_head;
+    bool                coalesce;
+    bool                aggregate;
+    SOS_val_snap      **pending;
+    SOS_val_summary    *summary;
+    int                 pending_max;
+    int                 publish_usec;
+    double              last_publish;
+    bool                publish_deferred;
     long                frame;
     int                 elem_max;
     int                 elem_count;
     int                 pragma_len;
     unsigned char       pragma_msg[SOS_DEFAULT_STRING_LEN];
-    char                node_id[SOS_DEFAULT_STRING_LEN];
-    char                prog_name[SOS_DEFAULT_STRING_LEN];
-    char                prog_ver[SOS_DEFAULT_STRING_LEN];
-    char                title[SOS_DEFAULT_STRING_LEN];
+    // Interned, see sos_intern.h:
+    char               *node_id;
+    char               *prog_name;
+    char               *prog_ver;
+    char               *title;
     //
     SOS_val_snap      **cache;
     int                 cache_head;
     int                 cache_depth;
     //
     SOS_data          **data;
-    qhashtbl_t         *name_table;
+    SOS_name_index     *name_table;
     SOS_pipe           *snap_queue;
 } SOS_pub;
 
@@ -470,6 +581,13 @@ typedef struct {
     int                 buffer_len;
     int                 listen_backlog;
     bool                is_locking;
+    bool                is_persistent;
+    int                 wire_flags;     // SOS_WIRE_*, agreed at REGISTER
+    int                 unacked;        // Sent under SOS_WIRE_NO_ACK since an ACK
+    int                 credits;        // From the last ACK, 0 == no limit
+    int                 backoff_usec;   // From the last ACK
+    int                 losses;         // Times messages may have been lost
+    char                unix_path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
     pthread_mutex_t    *send_lock;
     SOS_buffer         *recv_part;
     struct sockaddr_storage   peer_addr;
@@ -487,6 +605,16 @@ typedef struct {
 #endif
 } SOS_msg_header;
 
+// Encodings both ends of a connection have agreed to at REGISTER.  Each
+// side offers what it can take, and the reply carries the overlap.
+#define SOS_WIRE_COMPACT_SNAPS      0x0001
+#define SOS_WIRE_NO_ACK             0x0002
+
+// Set in the msg_type of an ANNOUNCE, PUBLISH, VAL_SNAPS, or PUB_FRAME
+// sent under SOS_WIRE_NO_ACK to say the sender is not waiting on its ACK.
+// The daemon strips it before the message goes any further.
+#define SOS_MSG_NO_ACK              0x40000000
+
 typedef struct {
     void               *sos_context;
     SOS_role            role;
@@ -516,6 +644,21 @@ typedef struct {
     bool                batch_environment;
     bool                udp_enabled;
     bool                fwd_shutdown_to_agg;
+    bool                persistent_connection;
+    bool                shm_transport;
+    bool                compact_snaps;
+    bool                unix_socket;
+    bool                no_ack;
+    int                 no_ack_window;
+    bool                backpressure;
+    //
+    bool                async_publish;
+    int                 async_queue_depth;
+    SOS_async_full      async_full_policy;
+    bool                pack_staging;
+    bool                publish_coalesce;
+    bool                publish_aggregate;
+    int                 publish_min_usec;
     //
     bool                system_monitor_enabled;
     int                 system_monitor_freq_usec;
@@ -548,11 +691,24 @@ typedef struct {
 } SOS_config;
 
 
+// A range of ids handed out by fetch-and-add on next.  Used up blocks stay
+// allocated until SOS_uid_destroy(), a late caller may still be adding.
 typedef struct {
-    void               *sos_context;
     SOS_guid            next;
     SOS_guid            last;
+    void               *retired;
+} SOS_uid_block;
+
+typedef struct {
+    void               *sos_context;
+    SOS_uid_block      *block;
+    SOS_uid_block      *spare;
+    SOS_guid            low_water;
+    bool                prefetching;
+    bool                prefetch_started;
+    pthread_t           prefetcher;
     pthread_mutex_t    *lock;
+    pthread_cond_t     *prefetched;     // Signaled when prefetching ends
 } SOS_uid;
 
 typedef struct {
@@ -561,6 +717,55 @@ typedef struct {
 } SOS_unique_set;
 
 
+// Publishes waiting for the background flush thread (see sos_async.c).
+typedef struct {
+    SOS_buffer         *msg;
+    void               *pub;
+    bool                announces;      // msg carries an ANNOUNCE
+} SOS_async_entry;
+
+typedef struct {
+    void               *sos_context;
+    bool                running;
+    bool                started;
+    pthread_t          *flusher;
+    pthread_mutex_t    *lock;
+    pthread_cond_t     *not_empty;
+    pthread_cond_t     *not_full;
+    pthread_cond_t     *drained;
+    pthread_cond_t     *idle;
+    SOS_async_full      full_policy;
+    SOS_async_entry    *entry;
+    int                 depth;
+    int                 head;
+    int                 count;
+    int                 in_flight;
+    int                 reserved;
+    SOS_list_entry     *deferred;
+    void               *current;
+    long                dropped;
+    long                coalesced;
+} SOS_async_queue;
+
+// Rate-limited publishes waiting for their turn (see sos_coalesce.c).
+typedef struct {
+    void               *pub;
+    double              due;
+    void               *next_entry;
+} SOS_coalesce_entry;
+
+typedef struct {
+    void               *sos_context;
+    bool                running;
+    bool                started;
+    pthread_t          *timer;
+    pthread_mutex_t    *lock;
+    pthread_cond_t     *wake;
+    pthread_cond_t     *idle;
+    SOS_coalesce_entry *waiting;
+    void               *current;
+} SOS_coalesce_timer;
+
 typedef struct {
     bool                feedback_active;
     pthread_t          *feedback;
@@ -571,8 +776,41 @@ typedef struct {
     qhashtbl_t         *reference_table;
     pthread_mutex_t    *reference_table_lock;
     pthread_mutex_t    *global_cache_lock;
+    SOS_async_queue    *async;
+    SOS_coalesce_timer *coalesce;
 } SOS_task_set;
 
+// Control block at the front of a shared-memory ring.  Lives in memory
+// mapped by both a client (the only producer) and sosd (the consumer).
+typedef struct {
+    volatile uint64_t   head;
+    volatile uint64_t   tail;
+    uint64_t            size;
+    volatile int        closed;
+    int                 client_pid;
+    int                 daemon_pid;
+} SOS_shm_ring_ctl;
+
+typedef struct {
+    void               *sos_context;
+    char                name[SOS_DEFAULT_STRING_LEN];
+    size_t              map_len;
+    SOS_shm_ring_ctl   *ctl;
+    unsigned char      *data;
+    pthread_mutex_t    *write_lock;
+} SOS_shm_ring;
+
+// One pub's row of a SOSA manifest reply.  The strings are interned.
+typedef struct {
+    SOS_guid            guid;
+    char               *title;
+    int                 comm_rank;
+    char               *node_id;
+    int                 process_id;
+    int                 elem_count;
+    int                 frame;
+} SOS_manifest_row;
+
 typedef struct {
     SOS_config          config;
     SOS_role            role;
@@ -580,6 +818,7 @@ typedef struct {
     SOS_unique_set      uid;
     SOS_task_set        task;
     SOS_socket         *daemon;
+    SOS_shm_ring       *shm_ring;
     SOS_guid            my_guid;
 #ifdef USE_MUNGE
     char               *my_cred;
@@ -15,6 +15,8 @@
 #include "sos_types.h"
 #include "sos_debug.h"
 #include "sos_target.h"
+#include "sos_intern.h"
+#include "sos_record.h"
 
 
 void SOSA_cache_to_results(
@@ -159,8 +161,11 @@ void SOSA_cache_to_results(
                                 val_str = val_numeric_str; break;
                             }
                         case SOS_VAL_TYPE_BYTES:
-                            snprintf(val_numeric_str, 128, "(bytes)");
-                            val_str = val_numeric_str; break;
+                        case SOS_VAL_TYPE_INT_ARRAY:
+                        case SOS_VAL_TYPE_LONG_ARRAY:
+                        case SOS_VAL_TYPE_DOUBLE_ARRAY:
+                            // These go into the results as they are.
+                            val_str = NULL; break;
                         default:
                             snprintf(val_numeric_str, 128, "(unknown type)");
                             val_str = val_numeric_str; break;
@@ -180,7 +185,12 @@ void SOSA_cache_to_results(
                         SOSA_results_put(results, 10, row, pub->data[snap->elem]->name);
                         SOSA_results_put(results, 11, row, val_type_str);
                         SOSA_results_put(results, 12, row, val_guid_str);
-                        SOSA_results_put(results, 13, row, val_str);
+                        if (val_str != NULL) {
+                            SOSA_results_put(results, 13, row, val_str);
+                        } else {
+                            SOSA_results_put_bytes(results, 13, row,
+                                    snap->val.bytes, snap->val_len);
+                        }
 
                         snap = next_snap;
                         row++;
@@ -439,14 +449,7 @@ SOSA_pub_manifest_to_buffer(
             
             matching_pubs++;
 
-            SOS_buffer_pack(reply, &offset, "gsisiii",
-                    pub->guid,
-                    pub->title,
-                    pub->comm_rank,
-                    pub->node_id,
-                    pub->process_id,
-                    pub->elem_count,
-                    pub->frame);
+            SOS_record_pack_manifest_row(reply, &offset, pub);
 
             if (pub->frame > max_frame_overall) {
                 max_frame_overall = pub->frame;
@@ -590,13 +593,8 @@ SOSA_refresh_pub_manifest(
     SOSA_results_put_name(manifest, 5, "pub_elem_count");
     SOSA_results_put_name(manifest, 6, "pub_frame");
 
-    SOS_guid  pub_guid        = 0;
-    char     *pub_title       = NULL;
-    int       pub_comm_rank   = -1;
-    char     *pub_node_id     = NULL;
-    int       pub_process_id  = -1;
-    int       pub_elem_count  = -1;
-    int       pub_frame       = -1;
+    SOS_manifest_row pub_row;
+    memset(&pub_row, 0, sizeof(SOS_manifest_row));
 
     char str_pub_guid         [128] = {0};
     char str_pub_comm_rank    [128] = {0};
@@ -606,32 +604,31 @@ SOSA_refresh_pub_manifest(
 
     int row = 0;
     for (row = 0; row < matching_pubs; row++) {
-        SOS_buffer_unpack(reply, &offset, "g", &pub_guid);
-        SOS_buffer_unpack_safestr(reply, &offset, &pub_title); 
-        SOS_buffer_unpack(reply, &offset, "i", &pub_comm_rank);        
-        SOS_buffer_unpack_safestr(reply, &offset, &pub_node_id);
-        SOS_buffer_unpack(reply, &offset, "iii", 
-                &pub_process_id,
-                &pub_elem_count,
-                &pub_frame);
-
-        snprintf(str_pub_guid,        128, "%" SOS_GUID_FMT, pub_guid);
-        snprintf(str_pub_comm_rank,   128, "%d", pub_comm_rank);
-        snprintf(str_pub_process_id,  128, "%d", pub_process_id);
-        snprintf(str_pub_elem_count,  128, "%d", pub_elem_count);
-        snprintf(str_pub_frame,       128, "%d", pub_frame);
+        if (SOS_record_unpack_manifest_row(reply, &offset, &pub_row) < 0) {
+            dlog(0, "ERROR: Manifest reply ends after %d of %d rows.\n",
+                    row, matching_pubs);
+            break;
+        }
+
+        snprintf(str_pub_guid,        128, "%" SOS_GUID_FMT, pub_row.guid);
+        snprintf(str_pub_comm_rank,   128, "%d", pub_row.comm_rank);
+        snprintf(str_pub_process_id,  128, "%d", pub_row.process_id);
+        snprintf(str_pub_elem_count,  128, "%d", pub_row.elem_count);
+        snprintf(str_pub_frame,       128, "%d", pub_row.frame);
 
 
         SOSA_results_put(manifest,   0, row, str_pub_guid);
-        SOSA_results_put(manifest,   1, row, pub_title);
+        SOSA_results_put(manifest,   1, row, pub_row.title);
         SOSA_results_put(manifest,   2, row, str_pub_comm_rank);
-        SOSA_results_put(manifest,   3, row, pub_node_id);
+        SOSA_results_put(manifest,   3, row, pub_row.node_id);
         SOSA_results_put(manifest,   4, row, str_pub_process_id);
         SOSA_results_put(manifest,   5, row, str_pub_elem_count);
         SOSA_results_put(manifest,   6, row, str_pub_frame);
 
         manifest->row_count = (row + 1);
     }
+    SOS_intern_drop(pub_row.title);
+    SOS_intern_drop(pub_row.node_id);
     // Done.
     // ----------
 
@@ -668,7 +665,45 @@ SOSA_results_put(
     if (results->row_count < (row + 1)) { results->row_count = (row + 1); }
     if (results->col_count < (col + 1)) { results->col_count = (col + 1); }
 
-    results->data[row][col] = strdup((const char *) strval);
+    results->data[row][col]     = strdup((const char *) strval);
+    results->data_len[row][col] = 0;
+
+    return;
+}
+
+
+// Binary cells (arrays, blobs) are kept as-is, with a trailing '\0' so
+// that they can still be handled as strings when they hold text.
+void
+SOSA_results_put_bytes(
+    SOSA_results       *results,
+    int                 col,
+    int                 row,
+    const void         *bytes,
+    int                 len)
+{
+    SOS_SET_CONTEXT(results->sos_context, "SOSA_results_put_bytes");
+
+    if ((bytes == NULL) || (len < 1)) {
+        SOSA_results_put(results, col, row, NULL);
+        return;
+    }
+
+    dlog(9, "SOSA_results_put_bytes(%d, %d) == (%d bytes)\n",
+        row, col, len);
+
+    if ((col >= results->col_max) || (row >= results->row_max)) {
+        SOSA_results_grow_to(results, col, row);
+    }
+
+    if (results->data[row][col] != NULL) { free(results->data[row][col]); }
+
+    if (results->row_count < (row + 1)) { results->row_count = (row + 1); }
+    if (results->col_count < (col + 1)) { results->col_count = (col + 1); }
+
+    results->data[row][col] = (char *) calloc((len + 1), sizeof(char));
+    memcpy(results->data[row][col], bytes, len);
+    results->data_len[row][col] = len;
 
     return;
 }
@@ -771,17 +806,37 @@ void SOSA_results_to_buffer(SOS_buffer *buffer, SOSA_results *results) {
         SOS_buffer_pack(buffer, &offset, "s", results->col_names[col]);
     }
 
+    int binary_count = 0;
+
     dlog(7, "   ... packing data.  (row_count == %d, col_count == %d\n",
             results->row_count, results->col_count);
     for (row = 0; row < results->row_count; row++) {
         for (col = 0; col < results->col_count; col++) {
+            if (results->data_len[row][col] > 0) {
+                SOS_buffer_pack_bytes(buffer, &offset,
+                        results->data_len[row][col], results->data[row][col]);
+                binary_count++;
+                continue;
+            }
             SOS_buffer_pack(buffer, &offset, "s", results->data[row][col]);
         }
     }
 
+    // Both kinds of cell look alike on the wire, so the binary ones
+    // are listed at the end:
+    dlog(7, "   ... packing %d binary cell positions.\n", binary_count);
+    SOS_buffer_pack(buffer, &offset, "i", binary_count);
+    for (row = 0; row < results->row_count; row++) {
+        for (col = 0; col < results->col_count; col++) {
+            if (results->data_len[row][col] > 0) {
+                SOS_buffer_pack(buffer, &offset, "iii",
+                        row, col, results->data_len[row][col]);
+            }
+        }
+    }
+
     header.msg_size = offset;
-    offset = 0;
-    SOS_msg_zip(buffer, header, 0, &offset);
+    SOS_msg_seal(buffer, header, 0, &offset);
     dlog(7, "   ... done.\n");
 
     return;
@@ -851,6 +906,25 @@ void SOSA_results_from_buffer(SOSA_results *results, SOS_buffer *buffer) {
         }
     }
 
+    int binary_count = 0;
+    int binary_len   = 0;
+    int i;
+
+    if (offset < header.msg_size) {
+        SOS_buffer_unpack(buffer, &offset, "i", &binary_count);
+    }
+    dlog(7, "   ... %d binary cells.\n", binary_count);
+    for (i = 0; i < binary_count; i++) {
+        SOS_buffer_unpack(buffer, &offset, "iii", &row, &col, &binary_len);
+        if ((row < 0) || (row >= row_incoming)
+         || (col < 0) || (col >= col_incoming)) {
+            dlog(0, "ERROR: Invalid binary cell (%d, %d) in results.\n",
+                    row, col);
+            break;
+        }
+        results->data_len[row][col] = binary_len;
+    }
+
     results->col_count = col_incoming;
     results->row_count = row_incoming;
 
@@ -862,6 +936,17 @@ void SOSA_results_from_buffer(SOSA_results *results, SOS_buffer *buffer) {
 
 
 
+// Binary cells are summarized rather than printed.
+static const char*
+SOSA_results_cell_str(SOSA_results *results, int row, int col, char *note) {
+    if (results->data_len[row][col] > 0) {
+        snprintf(note, 64, "(%d bytes)", results->data_len[row][col]);
+        return note;
+    }
+    return results->data[row][col];
+}
+
+
 void SOSA_results_output_to(FILE *fptr, SOSA_results *results, const char *title, int options) {
     SOS_SET_CONTEXT(results->sos_context, "SOSA_results_output_to");
 
@@ -888,8 +973,10 @@ void SOSA_results_output_to(FILE *fptr, SOSA_results *results, const char *title
     int    row = 0;
     int    col = 0;
     double time_now = 0.0;
+    char   binary_note[64];
     SOS_TIME(time_now);
 
+
     switch(output_mode) {
     case SOSA_OUTPUT_JSON:
         
@@ -907,7 +994,8 @@ void SOSA_results_output_to(FILE *fptr, SOSA_results *results, const char *title
 
             fprintf(fptr, "\t\t\"result_row\": \"%d\",\n", row);
             for (col = 0; col < results->col_count; col++) {
-                fprintf(fptr, "\t\t\"%s\": \"%s\"", results->col_names[col], results->data[row][col]);
+                fprintf(fptr, "\t\t\"%s\": \"%s\"", results->col_names[col],
+                        SOSA_results_cell_str(results, row, col, binary_note));
                 if (col < (results->col_count - 1)) {
                     fprintf(fptr, ",\n");
                 } else {
@@ -953,7 +1041,7 @@ void SOSA_results_output_to(FILE *fptr, SOSA_results *results, const char *title
         for (row = 0; row < results->row_count; row++) {
             fprintf(fptr, "\"%d\",",  row);
             for (col = 0; col < results->col_count; col++) {
-                fprintf(fptr, "\"%s\"", results->data[row][col]);
+                fprintf(fptr, "\"%s\"", SOSA_results_cell_str(results, row, col, binary_note));
                 if (col == (results->col_count - 1)) { fprintf(fptr, "\n"); }
                 else { fprintf(fptr, ","); }
             }//for:col
@@ -993,18 +1081,22 @@ void SOSA_guid_request(SOS_runtime *sos_context, SOS_uid *uid) {
     
     SOSA_send_to_target_db(msg, reply);
 
+    SOS_guid from;
+    SOS_guid to;
+
     if (reply->len < (2 * sizeof(double))) {
         dlog(0, "WARNING: Malformed UID reply from sosd (db) ...\n");
-        uid->next = -1;
-        uid->last = 0;
+        from = -1;
+        to   = 0;
     } else {
         offset = 0;
         SOS_buffer_unpack(reply, &offset, "gg",
-                          &uid->next,
-                          &uid->last);
+                          &from,
+                          &to);
     }
+    SOS_uid_set_block(uid, from, to);
 
-    dlog(7, "    ... %" SOS_GUID_FMT " -> %" SOS_GUID_FMT " assigned.  Done.\n", uid->next, uid->last);
+    dlog(7, "    ... %" SOS_GUID_FMT " -> %" SOS_GUID_FMT " assigned.  Done.\n", from, to);
 
     SOS_buffer_destroy(msg);
     SOS_buffer_destroy(reply);
@@ -1055,8 +1147,10 @@ void SOSA_results_init_sized(SOS_runtime *sos_context,
     results->row_max     = rows_incoming; 
 
     results->data = (char ***) calloc(results->row_max, sizeof(char **));
+    results->data_len = (int **) calloc(results->row_max, sizeof(int *));
     for (row = 0; row < results->row_max; row++) {
         results->data[row] = (char **) calloc(results->col_max, sizeof(char *));
+        results->data_len[row] = (int *) calloc(results->col_max, sizeof(int));
         for (col = 0; col < results->col_max; col++) {
             results->data[row][col] = NULL;
         }
@@ -1131,10 +1225,14 @@ void SOSA_results_grow_to(SOSA_results *results, int new_col_ask, int new_row_as
             results->data[row] =
                 (char **) realloc(results->data[row],
                         (new_col_max * sizeof(char *)) );
+            results->data_len[row] =
+                (int *) realloc(results->data_len[row],
+                        (new_col_max * sizeof(int)) );
             count_realloc++;
             // Initialize it.
             for (col = results->col_max; col < new_col_max; col++) {
                 results->data[row][col] = NULL;
+                results->data_len[row][col] = 0;
                 count_inits++;
             }
         }
@@ -1147,12 +1245,17 @@ void SOSA_results_grow_to(SOSA_results *results, int new_col_ask, int new_row_as
         results->data =
             (char ***) realloc(results->data,
                     (new_row_max * sizeof(char **)) );
+        results->data_len =
+            (int **) realloc(results->data_len,
+                    (new_row_max * sizeof(int *)) );
         count_realloc++;
         // For each new row...
         for (row = results->row_max; row < new_row_max; row++) {
             // ...add space for columns
             results->data[row] =
                 (char **) calloc(results->col_max, sizeof(char **));
+            results->data_len[row] =
+                (int *) calloc(results->col_max, sizeof(int));
             count_alloc++;
             for (col = 0; col < results->col_max; col++) {
                 // ...and initialize each one.
@@ -1195,6 +1298,7 @@ void SOSA_results_wipe(SOSA_results *results) {
                 free(results->data[row][col]);
                 results->data[row][col] = NULL;
             }
+            results->data_len[row][col] = 0;
         }
     }
 
@@ -1236,10 +1340,12 @@ void SOSA_results_destroy(SOSA_results *results) {
     dlog(7, "    ... free'ing columns...\n");
     for (row = 0; row < results->row_max; row++) {
         free(results->data[row]);
+        free(results->data_len[row]);
     }
 
     dlog(7, "    ... free'ing rows...\n");
     free(results->data);
+    free(results->data_len);
 
     dlog(7, "    ... free'ing column names...\n");
     for (col = 0; col < results->col_max; col++) {
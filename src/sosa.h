@@ -31,6 +31,7 @@ typedef struct {
     int          row_max;
     int          row_count;
     char      ***data;
+    int        **data_len;      // Bytes in a binary cell, 0 for text.
 } SOSA_results;
 
 
@@ -81,6 +82,8 @@ extern "C" {
     void SOSA_results_grow_to(SOSA_results *results, int new_col_max, int new_row_max);
     void SOSA_results_put_name(SOSA_results *results, int col, const char *name);
     void SOSA_results_put(SOSA_results *results, int col, int row, const char *value);
+    void SOSA_results_put_bytes(SOSA_results *results, int col, int row,
+            const void *bytes, int len);
     void SOSA_results_output_to(FILE *file,
             SOSA_results *results, const char *title, int options);
     void SOSA_results_to_buffer(SOS_buffer *buffer, SOSA_results *results);
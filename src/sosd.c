@@ -34,6 +34,8 @@
 #include <time.h>
 #include <sys/socket.h>
 #include <netdb.h>
+#include <poll.h>
+#include <sys/epoll.h>
 
 
 #ifdef SOSD_CLOUD_SYNC_WITH_MPI
@@ -53,6 +55,7 @@
 #include "sos_types.h"
 #include "sos_options.h"
 #include "sosd.h"
+#include "sos_shm.h"
 #include "sosd_db_sqlite.h"
 
 #include "sosa.h"
@@ -68,6 +71,12 @@
  */
 SOSD_global SOSD;
 
+/*
+ *  Client connection the calling listener thread is currently serving.
+ *  The SOSD_handle_*() functions send their replies here.
+ */
+__thread SOS_socket *SOSD_reply_to = NULL;
+
 void SOSD_display_logo(void);
 
 int main(int argc, char *argv[])  {
@@ -331,6 +340,9 @@ int main(int argc, char *argv[])  {
     SOS_target_init(SOSD.sos_context, &SOSD.sos_context->daemon,
             SOSD.net->local_host,
             SOSD.net->port_number);
+    if (SOSD.unix_net != NULL) {
+        SOS_target_use_unix(SOSD.sos_context->daemon);
+    }
 
     if (SOS->config.options->db_disabled) {
         dlog(1, "Skipping database initialization..."
@@ -385,6 +397,12 @@ int main(int argc, char *argv[])  {
     SOSD.sync.sense_list_lock = calloc(1, sizeof(pthread_mutex_t));
     pthread_mutex_init(SOSD.sync.sense_list_lock, NULL);
 
+    dlog(1, "   ... Creating mutex: shm_list_lock\n");
+    SOSD.sync.shm_list_lock = calloc(1, sizeof(pthread_mutex_t));
+    pthread_mutex_init(SOSD.sync.shm_list_lock, NULL);
+    SOSD.sync.shm_list_head = NULL;
+    SOSD_sync_context_init(SOS, &SOSD.sync.shm, 0, SOSD_THREAD_shm_drain);
+
     dlog(1, "   ... Creating mutex: global_cache_lock\n");
     SOSD.sos_context->task.global_cache_lock = calloc(1, sizeof(pthread_mutex_t));
     pthread_mutex_init(SOSD.sos_context->task.global_cache_lock, NULL);
@@ -406,6 +424,11 @@ int main(int argc, char *argv[])  {
     //
     SOSD_listen_loop();
     //
+    // Stop pulling from shared-memory rings before the queues close...
+    //
+    pthread_cond_signal(SOSD.sync.shm.cond);
+    pthread_join(*SOSD.sync.shm.handler, NULL);
+    //
     // Wait for the database to be done flushing...
     //
     if (SOS->config.options->db_disabled == false) {
@@ -500,6 +523,14 @@ int main(int argc, char *argv[])  {
     }
     dlog(1, "Closing the socket.\n");
     shutdown(SOSD.net->local_socket_fd, SHUT_RDWR);
+    if (SOSD.unix_net != NULL) {
+        close(SOSD.unix_net->local_socket_fd);
+        if (SOSD.unix_net->unix_path[0] != '@') {
+            unlink(SOSD.unix_net->unix_path);
+        }
+        free(SOSD.unix_net);
+        SOSD.unix_net = NULL;
+    }
     #if (SOSD_CLOUD_SYNC > 0)
     dlog(1, "Detaching from the cloud of sosd daemons.\n");
     SOSD_cloud_finalize();
@@ -529,17 +560,149 @@ int main(int argc, char *argv[])  {
 
 
 // The main loop for listening to the on-node socket.
-// Messages received here are placed in the local_sync queue
-//     for processing, so we can go back and grab the next
-//     socket message ASAP.
+// This thread only accepts new connections.  Each client connection is
+//     registered with SOSD.listen.epoll_fd and serviced by a pool of
+//     SOSD_THREAD_listen_worker threads, so one slow handler does not
+//     stall every other client on the node.
+// Messages received by the workers are placed in the local_sync queue
+//     for processing, so they can go back and grab the next socket
+//     message ASAP.
 void SOSD_listen_loop() {
     SOS_SET_CONTEXT(SOSD.sos_context, "SOSD_listen_loop");
-    SOS_msg_header header;
-    SOS_buffer    *buffer;
-    SOS_buffer    *rapid_reply;
-    int            recv_len;
-    int            offset;
-    int            i;
+    struct pollfd       watch[2];
+    struct epoll_event  event;
+    SOS_socket         *listener;
+    SOS_socket         *conn;
+    int                 watch_count;
+    int                 worker;
+    int                 w;
+    int                 i;
+
+    SOSD.listen.epoll_fd = epoll_create1(0);
+    if (SOSD.listen.epoll_fd < 0) {
+        dlog(0, "ERROR: Unable to create the epoll instance for the"
+                " listener threads.  (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    SOSD.listen.thread_count = SOSD_DEFAULT_LISTEN_THREADS;
+    if (getenv("SOS_LISTEN_THREADS") != NULL) {
+        SOSD.listen.thread_count = atoi(getenv("SOS_LISTEN_THREADS"));
+        if (SOSD.listen.thread_count < 1) {
+            SOSD.listen.thread_count = 1;
+        }
+    }
+
+    dlog(1, "Launching %d listener worker threads...\n",
+            SOSD.listen.thread_count);
+    SOSD.listen.threads = (pthread_t *)
+        calloc(SOSD.listen.thread_count, sizeof(pthread_t));
+    for (worker = 0; worker < SOSD.listen.thread_count; worker++) {
+        pthread_create(&SOSD.listen.threads[worker], NULL,
+                SOSD_THREAD_listen_worker, NULL);
+    }
+
+    // The TCP port, and the local socket if there is one.
+    memset(watch, '\0', sizeof(watch));
+    watch[0].fd     = SOSD.net->local_socket_fd;
+    watch[0].events = POLLIN;
+    watch_count     = 1;
+    if (SOSD.unix_net != NULL) {
+        watch[1].fd     = SOSD.unix_net->local_socket_fd;
+        watch[1].events = POLLIN;
+        watch_count     = 2;
+    }
+
+    dlog(1, "Entering main loop...\n");
+    while (SOSD.daemon.running) {
+
+        dlog(5, "Listening for a connection...\n");
+        watch[0].revents = 0;
+        watch[1].revents = 0;
+        i = poll(watch, watch_count, SOSD_LISTEN_POLL_MSEC);
+        if (i < 0) {
+            if (errno != EINTR) {
+                dlog(0, "ERROR: poll() on the listening socket failed."
+                        "  (%s)\n", strerror(errno));
+            }
+            continue;
+        } else if (i == 0) {
+            // Timed out, go check if we're still running.
+            continue;
+        }
+
+        for (w = 0; w < watch_count; w++) {
+            if ((watch[w].revents & POLLIN) == 0) continue;
+            listener = (w == 0) ? SOSD.net : SOSD.unix_net;
+
+            i = SOS_target_accept_connection(listener);
+            while ((i < 0) && (listener == SOSD.net)) {
+                dlog(0, "WARNING: Unable to accept a connection on port %d!\n",
+                        SOSD.net->port_number);
+                SOSD.net->port_number += 1;
+                snprintf(SOSD.net->local_port, NI_MAXSERV, "%d",
+                        SOSD.net->port_number);
+                dlog(0, "WARNING: Automatically moving to the next port: %d ...\n",
+                        SOSD.net->port_number);
+                SOSD_setup_socket();
+                watch[0].fd = SOSD.net->local_socket_fd;
+                i = SOS_target_accept_connection(SOSD.net);
+            }
+
+            if (listener->remote_socket_fd < 0) {
+                dlog(0, "WARNING: accept() failed.  (%s)\n", strerror(errno));
+                continue;
+            }
+
+            dlog(5, "Accepted connection.  (fd == %d)\n",
+                    listener->remote_socket_fd);
+
+            // Each connection gets its own copy of the listening socket's
+            // description, with the client's descriptor and address in it.
+            conn = (SOS_socket *) malloc(sizeof(SOS_socket));
+            memcpy(conn, listener, sizeof(SOS_socket));
+            listener->remote_socket_fd = -1;
+
+            // EPOLLONESHOT keeps a connection with one worker at a time, so
+            // messages from a client are still handled in the order sent.
+            memset(&event, '\0', sizeof(struct epoll_event));
+            event.events   = EPOLLIN | EPOLLONESHOT;
+            event.data.ptr = (void *) conn;
+            if (epoll_ctl(SOSD.listen.epoll_fd, EPOLL_CTL_ADD,
+                        conn->remote_socket_fd, &event) < 0) {
+                dlog(0, "ERROR: Unable to watch the new connection."
+                        "  (%s)\n", strerror(errno));
+                close(conn->remote_socket_fd);
+                free(conn);
+            }
+        }
+    }
+
+    dlog(1, "Joining listener worker threads...\n");
+    for (worker = 0; worker < SOSD.listen.thread_count; worker++) {
+        pthread_join(SOSD.listen.threads[worker], NULL);
+    }
+    free(SOSD.listen.threads);
+    SOSD.listen.threads = NULL;
+    close(SOSD.listen.epoll_fd);
+    SOSD.listen.epoll_fd = -1;
+
+    dlog(1, "Leaving the socket listening loop.\n");
+
+    return;
+}
+
+
+void* SOSD_THREAD_listen_worker(void *args) {
+    SOS_SET_CONTEXT(SOSD.sos_context, "SOSD_THREAD_listen_worker");
+    SOS_msg_header      header;
+    SOS_buffer         *buffer;
+    SOS_buffer         *rapid_reply;
+    struct epoll_event  event;
+    SOS_socket         *conn;
+    bool                no_ack;
+    int                 offset;
+    int                 i;
 
     buffer = NULL;
     rapid_reply = NULL;
@@ -548,53 +711,46 @@ void SOSD_listen_loop() {
     SOS_buffer_init_sized_locking(SOS, &rapid_reply,
             SOS_DEFAULT_BUFFER_MAX, false);
 
-    dlog(5, "Assembling rapid_reply for val_snaps...\n");
-    SOSD_PACK_ACK(rapid_reply);
-
-    dlog(1, "Entering main loop...\n");
     while (SOSD.daemon.running) {
-        SOS_buffer_wipe(buffer);
-
-        dlog(5, "Listening for a message...\n");
-        //SOSD.net->peer_addr_len = sizeof(SOSD.net->peer_addr);
-        //SOSD.net->remote_socket_fd = accept(SOSD.net->local_socket_fd,
-        //        (struct sockaddr *) &SOSD.net->peer_addr,
-        //        &SOSD.net->peer_addr_len);
-        //i = getnameinfo((struct sockaddr *) &SOSD.net->peer_addr,
-        //        SOSD.net->peer_addr_len, SOSD.net->remote_host,
-        //        NI_MAXHOST, SOSD.net->remote_port, NI_MAXSERV,
-        //        NI_NUMERICSERV);
-        //if (i != 0) {
-        //    dlog(0, "Error calling getnameinfo() on client connection."
-        //            "  (%s)\n", strerror(errno));
-        //    break;
-        //}
-
-        i = SOS_target_accept_connection(SOSD.net);
-        while (i < 0) {
-            dlog(0, "WARNING: Unable to accept a connection on port %d!\n",
-                    SOSD.net->port_number);
-            SOSD.net->port_number += 1;
-            snprintf(SOSD.net->local_port, NI_MAXSERV, "%d",
-                    SOSD.net->port_number);
-            dlog(0, "WARNING: Automatically moving to the next port: %d ...\n",
-                    SOSD.net->port_number);
-            SOSD_setup_socket();
-            i = SOS_target_accept_connection(SOSD.net);
+        i = epoll_wait(SOSD.listen.epoll_fd, &event, 1, SOSD_LISTEN_POLL_MSEC);
+        if (i < 1) {
+            if ((i < 0) && (errno != EINTR)) {
+                dlog(0, "ERROR: epoll_wait() failed.  (%s)\n",
+                        strerror(errno));
+            }
+            continue;
         }
 
+        conn = (SOS_socket *) event.data.ptr;
+        SOSD_reply_to = conn;
 
-        dlog(5, "Accepted connection.  Attempting to receive message...\n");
-        i = SOS_target_recv_msg(SOSD.net, buffer);
-        if (i < sizeof(SOS_msg_header)) {
-            printf(".");
-            SOS_target_disconnect(SOSD.net);
+        SOS_buffer_wipe(buffer);
+        i = SOS_target_recv_msg(conn, buffer);
+        if (i < (int) sizeof(SOS_msg_header)) {
+            // The client hung up (or sent garbage), drop it.
+            dlog(5, "Closing client connection.  (fd == %d)\n",
+                    conn->remote_socket_fd);
+            epoll_ctl(SOSD.listen.epoll_fd, EPOLL_CTL_DEL,
+                    conn->remote_socket_fd, NULL);
+            close(conn->remote_socket_fd);
+            free(conn);
+            SOSD_reply_to = NULL;
             continue;
         }
 
         offset = 0;
         SOS_msg_unzip(buffer, &header, 0, &offset);
 
+        // The sender is not waiting on an ACK for this one, see
+        // SOS_WIRE_NO_ACK.  Nothing past here expects to see the bit.
+        no_ack = false;
+        if (header.msg_type & SOS_MSG_NO_ACK) {
+            no_ack = true;
+            header.msg_type = (SOS_msg_type)
+                (header.msg_type & ~SOS_MSG_NO_ACK);
+            SOS_buffer_packi32(buffer->data + sizeof(int), header.msg_type);
+        }
+
         dlog(5, "Received connection.\n");
         dlog(5, "  ... msg_size == %d         (buffer->len == %d)\n",
                 header.msg_size, buffer->len);
@@ -622,6 +778,7 @@ void SOSD_listen_loop() {
         case SOS_MSG_TYPE_ANNOUNCE:
         case SOS_MSG_TYPE_PUBLISH:
         case SOS_MSG_TYPE_VAL_SNAPS:
+        case SOS_MSG_TYPE_PUB_FRAME:
             pthread_mutex_lock(SOSD.sync.local.queue->sync_lock);
             pipe_push(SOSD.sync.local.queue->intake, (void *) &buffer, 1);
             SOSD.sync.local.queue->elem_count++;
@@ -629,9 +786,17 @@ void SOSD_listen_loop() {
             buffer = NULL;
             SOS_buffer_init_sized_locking(SOS, &buffer,
                     SOS_DEFAULT_BUFFER_MAX, false);
+            if (no_ack) {
+                SOSD_countof(socket_acks_skipped++);
+                break;
+            }
+            // Built fresh each time, so it carries the credits as of
+            // this message.
+            SOS_buffer_wipe(rapid_reply);
+            SOSD_PACK_ACK(rapid_reply);
             dlog(5, "  ... sending ACK w/reply->len == %d\n", rapid_reply->len);
 
-            i = send( SOSD.net->remote_socket_fd, (void *) rapid_reply->data,
+            i = send( conn->remote_socket_fd, (void *) rapid_reply->data,
                     rapid_reply->len, 0);
 
             if (i == -1) {
@@ -646,6 +811,7 @@ void SOSD_listen_loop() {
 
         case SOS_MSG_TYPE_ECHO:         SOSD_handle_echo        (buffer); break;
         case SOS_MSG_TYPE_SHUTDOWN:     SOSD_handle_shutdown    (buffer); break;
+        case SOS_MSG_TYPE_SHM_ATTACH:   SOSD_handle_shm_attach  (buffer); break;
         case SOS_MSG_TYPE_CHECK_IN:     SOSD_handle_check_in    (buffer); break;
         case SOS_MSG_TYPE_PROBE:        SOSD_handle_probe       (buffer); break;
         case SOS_MSG_TYPE_MANIFEST:     SOSD_handle_manifest    (buffer); break;
@@ -658,15 +824,25 @@ void SOSD_listen_loop() {
         default:                        SOSD_handle_unknown     (buffer); break;
         }
 
-        SOS_target_disconnect(SOSD.net);
+        // Hand the connection back to epoll for its next message.
+        SOSD_reply_to = NULL;
+        event.events   = EPOLLIN | EPOLLONESHOT;
+        event.data.ptr = (void *) conn;
+        if (epoll_ctl(SOSD.listen.epoll_fd, EPOLL_CTL_MOD,
+                    conn->remote_socket_fd, &event) < 0) {
+            dlog(0, "ERROR: Unable to re-arm client connection."
+                    "  (%s)\n", strerror(errno));
+            close(conn->remote_socket_fd);
+            free(conn);
+        }
     }
 
     SOS_buffer_destroy(buffer);
     SOS_buffer_destroy(rapid_reply);
 
-    dlog(1, "Leaving the socket listening loop.\n");
+    dlog(1, "Leaving the listener worker loop.\n");
 
-    return;
+    return NULL;
 }
 
 /* -------------------------------------------------- */
@@ -722,6 +898,116 @@ void* SOSD_THREAD_system_monitor(void *args) {
     return NULL; //Stops the PGI compiler from complaining.
 }
 
+// Pulls messages out of the clients' shared-memory rings (see sos_shm.h)
+// and hands them to the local_sync thread, the same as if they had come
+// in over the socket.  Rings whose client has finalized or died are
+// released once they are empty.
+void* SOSD_THREAD_shm_drain(void *args) {
+    SOSD_sync_context *my = (SOSD_sync_context *) args;
+    SOS_SET_CONTEXT(my->sos_context, "SOSD_THREAD_shm_drain");
+    struct timeval   now;
+    struct timespec  wait;
+    SOS_list_entry  *entry;
+    SOS_list_entry  *prev;
+    SOS_list_entry  *next;
+    SOS_shm_ring    *ring;
+    SOS_buffer      *batch[SOSD_SHM_DRAIN_BATCH];
+    int              count;
+    int              drained;
+    int              idle_usec;
+
+    idle_usec = SOSD_SHM_DRAIN_IDLE_USEC;
+    pthread_mutex_lock(my->lock);
+
+    while (SOSD.daemon.running) {
+        pthread_mutex_lock(SOSD.sync.shm_list_lock);
+        if (SOSD.sync.shm_list_head == NULL) {
+            pthread_mutex_unlock(SOSD.sync.shm_list_lock);
+            gettimeofday(&now, NULL);
+            wait.tv_sec  = 1 + now.tv_sec;
+            wait.tv_nsec = 1000 * now.tv_usec;
+            pthread_cond_timedwait(my->cond, my->lock, &wait);
+            continue;
+        }
+
+        drained = 0;
+        prev    = NULL;
+        entry   = SOSD.sync.shm_list_head;
+        while (entry != NULL) {
+            ring = (SOS_shm_ring *) entry->ref;
+            next = (SOS_list_entry *) entry->next_entry;
+
+            count = 0;
+            while ((count < SOSD_SHM_DRAIN_BATCH)
+                && (SOS_shm_ring_read(ring, &batch[count]) == 1)) {
+                SOSD_countof(socket_messages++);
+                SOSD_countof(socket_bytes_recv += batch[count]->len);
+                count++;
+            }
+
+            if (count > 0) {
+                pthread_mutex_lock(SOSD.sync.local.queue->sync_lock);
+                pipe_push(SOSD.sync.local.queue->intake,
+                        (void *) batch, count);
+                SOSD.sync.local.queue->elem_count += count;
+                pthread_mutex_unlock(SOSD.sync.local.queue->sync_lock);
+                drained += count;
+            } else if (SOS_shm_ring_peer_closed(ring)
+                    && SOS_shm_ring_is_drained(ring)) {
+                dlog(4, "Releasing shared-memory ring %s.\n", ring->name);
+                if (prev == NULL) {
+                    SOSD.sync.shm_list_head = next;
+                } else {
+                    prev->next_entry = next;
+                }
+                SOS_shm_ring_destroy(ring);
+                free(entry);
+                entry = next;
+                continue;
+            }
+
+            prev  = entry;
+            entry = next;
+        }
+        pthread_mutex_unlock(SOSD.sync.shm_list_lock);
+
+        // The rings have no way to wake us, so poll them, backing off the
+        // longer they stay empty.  A new ring or shutdown signals my->cond.
+        if (drained > 0) {
+            idle_usec = SOSD_SHM_DRAIN_IDLE_USEC;
+        } else {
+            gettimeofday(&now, NULL);
+            wait.tv_sec  = now.tv_sec;
+            wait.tv_nsec = 1000 * (now.tv_usec + idle_usec);
+            if (wait.tv_nsec >= 1000000000) {
+                wait.tv_sec  += wait.tv_nsec / 1000000000;
+                wait.tv_nsec  = wait.tv_nsec % 1000000000;
+            }
+            pthread_cond_timedwait(my->cond, my->lock, &wait);
+            idle_usec *= 2;
+            if (idle_usec > SOSD_SHM_DRAIN_IDLE_MAX_USEC) {
+                idle_usec = SOSD_SHM_DRAIN_IDLE_MAX_USEC;
+            }
+        }
+    }
+
+    pthread_mutex_lock(SOSD.sync.shm_list_lock);
+    entry = SOSD.sync.shm_list_head;
+    while (entry != NULL) {
+        next = (SOS_list_entry *) entry->next_entry;
+        SOS_shm_ring_destroy((SOS_shm_ring *) entry->ref);
+        free(entry);
+        entry = next;
+    }
+    SOSD.sync.shm_list_head = NULL;
+    pthread_mutex_unlock(SOSD.sync.shm_list_lock);
+
+    pthread_mutex_unlock(my->lock);
+    dlog(1, "Leaving thread safely.\n");
+    pthread_exit(NULL);
+}
+
+
 void* SOSD_THREAD_feedback_sync(void *args) {
     SOSD_sync_context *my = (SOSD_sync_context *) args;
     SOS_SET_CONTEXT(my->sos_context, "SOSD_THREAD_feedback_sync");
@@ -905,14 +1191,17 @@ void* SOSD_THREAD_feedback_sync(void *args) {
             SOS_msg_zip(delivery, header, 0, &offset);
             int after_header = offset;
 
-            dlog(5, "Packing the payload data into the delivery buffer.\n");
-            // Pack the payload message into the delivery.
-            SOS_buffer_pack_bytes(delivery, &offset, payload->size, payload->data);
-
-            dlog(5, "Re-signing it with the known size now (%d)...\n", offset);
-            header.msg_size = offset;
-            offset = 0;
-            SOS_msg_zip(delivery, header, 0, &offset);
+            // The payload goes out behind the header as its own segment,
+            // framed the way SOS_buffer_pack_bytes() would frame it.
+            void *payload_data = payload->data;
+            int   payload_size = payload->size;
+            unsigned char empty_payload = '\0';
+            if (payload_size < 1) {
+                payload_data = &empty_payload;
+                payload_size = 1;
+            }
+            SOS_buffer_pack(delivery, &offset, "i", payload_size);
+            dlog(5, "Delivery will be %d bytes.\n", (offset + payload_size));
 
             pthread_mutex_lock(SOSD.sync.sense_list_lock);
             SOSD_sensitivity_entry *sense = SOSD.sync.sense_list_head;
@@ -961,9 +1250,8 @@ void* SOSD_THREAD_feedback_sync(void *args) {
                     fprintf(stderr, "\n");
                     fprintf(stderr, "   delivery->len == %d\n", delivery->len);
                     fprintf(stderr, "   delivery->max == %d\n", delivery->max);
-                    fprintf(stderr, "   delivery->data[offset_after_header"
-                            " + 4] == \"%s\"\n",
-                            (char *)(delivery->data + after_header + 4));
+                    fprintf(stderr, "   payload_data == \"%s\"\n",
+                            (char *) payload_data);
                     fprintf(stderr, "\n");
                     fprintf(stderr, "   payload->size == %d\n", payload->size);
                     fprintf(stderr, "   payload->data == %s\n", (char *) payload->data);
@@ -971,7 +1259,8 @@ void* SOSD_THREAD_feedback_sync(void *args) {
                     fprintf(stderr, "\n");
                     fflush(stderr);
                     **/
-                    SOS_target_send_msg(sense->target, delivery);
+                    SOS_target_send_msg_parts(sense->target, delivery,
+                            payload_data, payload_size);
                     SOS_target_disconnect(sense->target);
                 }
                 prev_sense = sense;
@@ -1059,6 +1348,7 @@ void* SOSD_THREAD_local_sync(void *args) {
         case SOS_MSG_TYPE_ANNOUNCE:   SOSD_handle_announce   (buffer); break;
         case SOS_MSG_TYPE_PUBLISH:    SOSD_handle_publish    (buffer); break;
         case SOS_MSG_TYPE_VAL_SNAPS:  SOSD_handle_val_snaps  (buffer); break;
+        case SOS_MSG_TYPE_PUB_FRAME:  SOSD_handle_pub_frame  (buffer); break;
         default:
             dlog(0, "ERROR: An invalid message type (%d) was"
                     " placed in the local_sync queue!\n", header.msg_type);
@@ -1343,7 +1633,7 @@ SOSD_handle_desensitize(SOS_buffer *msg) {
     SOS_buffer_init_sized_locking(SOS, &reply, 64, false);
     SOSD_PACK_ACK(reply);
 
-    rc = SOS_target_send_msg(SOSD.net, reply);
+    rc = SOS_target_send_msg(SOSD_reply_to, reply);
 
     dlog(5, "Replying with reply->len == %d bytes, rc == %d\n",
             reply->len, rc);
@@ -1408,7 +1698,7 @@ SOSD_handle_cache_grab(SOS_buffer *msg) {
     SOS_buffer *reply = NULL;
     SOS_buffer_init_sized(SOS, &reply, SOS_DEFAULT_REPLY_LEN);
     SOSD_PACK_ACK(reply);
-    int rc = SOS_target_send_msg(SOSD.net, reply);
+    int rc = SOS_target_send_msg(SOSD_reply_to, reply);
     dlog(5, "replying with reply->len == %d bytes, rc == %d\n",
             reply->len, rc);
     if (rc == -1) {
@@ -1438,7 +1728,7 @@ SOSD_handle_cache_size(SOS_buffer *msg) {
     SOS_buffer *reply = NULL;
     SOS_buffer_init_sized(SOS, &reply, SOS_DEFAULT_REPLY_LEN);
     SOSD_PACK_ACK(reply);
-    int rc = SOS_target_send_msg(SOSD.net, reply);
+    int rc = SOS_target_send_msg(SOSD_reply_to, reply);
     dlog(5, "replying with reply->len == %d bytes, rc == %d\n",
             reply->len, rc);
     if (rc == -1) {
@@ -1532,7 +1822,7 @@ SOSD_handle_unregister(SOS_buffer *msg) {
     SOS_buffer_init_sized_locking(SOS, &reply, 64, false);
     SOSD_PACK_ACK(reply);
 
-    rc = SOS_target_send_msg(SOSD.net, reply);
+    rc = SOS_target_send_msg(SOSD_reply_to, reply);
 
     dlog(5, "Replying with reply->len == %d bytes, rc == %d\n",
             reply->len, rc);
@@ -1608,7 +1898,7 @@ SOSD_handle_sensitivity(SOS_buffer *msg) {
     SOS_buffer_init_sized_locking(SOS, &reply, 256, false);
     SOSD_PACK_ACK(reply);
     int rc = 0;
-    SOS_target_send_msg(SOSD.net, reply);
+    SOS_target_send_msg(SOSD_reply_to, reply);
     dlog(5, "replying with reply->len == %d bytes, rc == %d\n",
             reply->len, rc);
     if (rc == -1) {
@@ -1637,7 +1927,7 @@ SOSD_handle_triggerpull(SOS_buffer *msg) {
 
     // Send an ACK message to the trigger-pulling client.
     int rc;
-    rc = SOS_target_send_msg(SOSD.net, reply);
+    rc = SOS_target_send_msg(SOSD_reply_to, reply);
 
     if (rc == -1) {
             dlog(0, "Error sending a response.  (%s)\n", strerror(errno));
@@ -1743,7 +2033,7 @@ void SOSD_handle_query(SOS_buffer *buffer) {
     SOS_buffer *reply = NULL;
     SOS_buffer_init_sized(SOS, &reply, SOS_DEFAULT_REPLY_LEN);
     SOSD_PACK_ACK(reply);
-    rc = SOS_target_send_msg(SOSD.net, reply);
+    rc = SOS_target_send_msg(SOSD_reply_to, reply);
     dlog(5, "replying with reply->len == %d bytes, rc == %d\n",
             reply->len, rc);
     if (rc == -1) {
@@ -1758,6 +2048,66 @@ void SOSD_handle_query(SOS_buffer *buffer) {
 
 
 
+void SOSD_handle_shm_attach(SOS_buffer *buffer) {
+    SOS_SET_CONTEXT(buffer->sos_context, "SOSD_handle_shm_attach");
+    SOS_msg_header  header;
+    SOS_shm_ring   *ring = NULL;
+    SOS_list_entry *entry;
+    SOS_buffer     *reply;
+    char           *name = NULL;
+    int             offset;
+    int             rc;
+
+    dlog(5, "header.msg_type = SOS_MSG_TYPE_SHM_ATTACH\n");
+
+    offset = 0;
+    SOS_msg_unzip(buffer, &header, 0, &offset);
+    SOS_buffer_unpack_safestr(buffer, &offset, &name);
+
+    rc = -1;
+    if ((name != NULL)
+     && (SOS_shm_ring_attach(SOS, &ring, name) == 0)) {
+        entry = (SOS_list_entry *) calloc(1, sizeof(SOS_list_entry));
+        entry->ref = (void *) ring;
+        pthread_mutex_lock(SOSD.sync.shm_list_lock);
+        entry->next_entry = (void *) SOSD.sync.shm_list_head;
+        SOSD.sync.shm_list_head = entry;
+        pthread_mutex_unlock(SOSD.sync.shm_list_lock);
+        pthread_cond_signal(SOSD.sync.shm.cond);
+        rc = 0;
+    }
+    free(name);
+
+    reply = NULL;
+    SOS_buffer_init_sized_locking(SOS, &reply, SOS_DEFAULT_REPLY_LEN, false);
+
+    header.msg_size = -1;
+    header.msg_type = SOS_MSG_TYPE_SHM_ATTACH;
+    header.msg_from = SOS->config.comm_rank;
+    header.ref_guid = 0;
+
+    offset = 0;
+    SOS_msg_zip(reply, header, 0, &offset);
+    SOS_buffer_pack(reply, &offset, "i", rc);
+
+    header.msg_size = offset;
+    offset = 0;
+    SOS_msg_zip(reply, header, 0, &offset);
+
+    rc = send(SOSD_reply_to->remote_socket_fd, (void *) reply->data,
+            reply->len, 0);
+    if (rc == -1) {
+        dlog(0, "Error sending a response.  (%s)\n", strerror(errno));
+    } else {
+        SOSD_countof(socket_bytes_sent += rc);
+    }
+
+    SOS_buffer_destroy(reply);
+
+    return;
+}
+
+
 void SOSD_handle_echo(SOS_buffer *buffer) {
     SOS_SET_CONTEXT(buffer->sos_context, "SOSD_handle_echo");
     dlog(5, "header.msg_type = SOS_MSG_TYPE_ECHO\n");
@@ -1770,7 +2120,7 @@ void SOSD_handle_echo(SOS_buffer *buffer) {
 
     dlog(5, "Message unzipped.  Sending it back to the sender.\n");
 
-    rc = send(SOSD.net->remote_socket_fd, (void *) buffer->data,
+    rc = send(SOSD_reply_to->remote_socket_fd, (void *) buffer->data,
             buffer->len, 0);
     if (rc == -1) {
         dlog(0, "Error sending a response.  (%s)\n", strerror(errno));
@@ -1802,10 +2152,11 @@ void SOSD_handle_val_snaps(SOS_buffer *buffer) {
     pub = (SOS_pub *) SOSD.pub_table->get(SOSD.pub_table,pub_guid_str);
 
     if (pub == NULL) {
+        // NOTE: The buffer belongs to SOSD_THREAD_local_sync, which
+        //       forwards or destroys it after this returns.
         dlog(0, "ERROR: No pub exists for header.ref_guid"
                 " == %" SOS_GUID_FMT "\n", header.ref_guid);
-        dlog(0, "ERROR: Destroying message and returning.\n");
-        SOS_buffer_destroy(buffer);
+        dlog(0, "ERROR: Ignoring these snaps.\n");
         return;
     }
 
@@ -1834,6 +2185,65 @@ void SOSD_handle_val_snaps(SOS_buffer *buffer) {
 
 
 
+// Apply each part of a SOS_pub_frame_to_buffer() message in order.
+// The parts are handed to the usual handlers as views into this
+// buffer, so nothing is copied.  Only the local_sync thread calls
+// this, so no other message for the pub is applied in between.
+void SOSD_handle_pub_frame(SOS_buffer *buffer) {
+    SOS_SET_CONTEXT(buffer->sos_context, "SOSD_handle_pub_frame");
+    SOS_msg_header  header;
+    SOS_msg_header  part_header;
+    SOS_buffer      part;
+    int             offset;
+    int             part_start;
+
+    dlog(5, "header.msg_type = SOS_MSG_TYPE_PUB_FRAME\n");
+
+    offset = 0;
+    SOS_msg_unzip(buffer, &header, 0, &offset);
+
+    if ((header.msg_size > buffer->len) || (header.msg_size < offset)) {
+        dlog(0, "ERROR: Pub frame claims %d bytes, but %d arrived."
+                "  Ignoring it.\n", header.msg_size, buffer->len);
+        return;
+    }
+
+    while (offset < header.msg_size) {
+        part_start = offset;
+        SOS_msg_unzip(buffer, &part_header, part_start, &offset);
+
+        if ((part_header.msg_size < (offset - part_start))
+         || ((part_start + part_header.msg_size) > header.msg_size)) {
+            dlog(0, "ERROR: Malformed part at offset %d of a pub frame."
+                    "  Ignoring the rest of it.\n", part_start);
+            return;
+        }
+
+        part            = *buffer;
+        part.is_locking = false;
+        part.lock       = NULL;
+        part.data       = buffer->data + part_start;
+        part.len        = part_header.msg_size;
+        part.max        = buffer->max - part_start;
+
+        switch (part_header.msg_type) {
+        case SOS_MSG_TYPE_ANNOUNCE:   SOSD_handle_announce  (&part); break;
+        case SOS_MSG_TYPE_PUBLISH:    SOSD_handle_publish   (&part); break;
+        case SOS_MSG_TYPE_VAL_SNAPS:  SOSD_handle_val_snaps (&part); break;
+        default:
+            dlog(0, "ERROR: Unexpected message type (%d) inside a"
+                    " pub frame.  Skipping it.\n", part_header.msg_type);
+            break;
+        }
+
+        offset = part_start + part_header.msg_size;
+    }
+
+    return;
+}
+
+
+
 void SOSD_handle_register(SOS_buffer *buffer) {
     SOS_SET_CONTEXT(buffer->sos_context, "SOSD_handle_register");
     SOS_msg_header header;
@@ -1864,6 +2274,25 @@ void SOSD_handle_register(SOS_buffer *buffer) {
     SOS_buffer_unpack(buffer, &offset, "i",
             &client_uid);
 
+    // Older clients make no offer, and get the defaults.
+    int wire_flags = 0;
+    if (offset < header.msg_size) {
+        SOS_buffer_unpack(buffer, &offset, "i",
+                &wire_flags);
+    }
+    wire_flags &= SOSD_wire_flags();
+#ifdef SOSD_CLOUD_SYNC_WITH_SOCKET
+    // Listeners forward what clients send to their aggregator untouched,
+    // so they offer no more than it agreed to.  (The other transports
+    // assume daemons of the same build.)
+    if ((SOS->role == SOS_ROLE_LISTENER)
+     && (SOSD.daemon.cloud_aggregator != NULL)) {
+        // Skipping ACKs is only between the client and this daemon.
+        wire_flags &= (SOS_WIRE_NO_ACK | __atomic_load_n(
+                &SOSD.daemon.cloud_aggregator->wire_flags, __ATOMIC_RELAXED));
+    }
+#endif
+
     if ((client_version_major != SOS_VERSION_MAJOR)
         || (client_version_minor != SOS_VERSION_MINOR)) {
         fprintf(stderr, "CRITICAL WARNING: SOS client library (%d.%d) and"
@@ -1929,6 +2358,10 @@ void SOSD_handle_register(SOS_buffer *buffer) {
         SOS_buffer_pack(reply, &offset, "i",
                 server_uid);
 
+        //Pack in the encodings we both can use
+        SOS_buffer_pack(reply, &offset, "i",
+                wire_flags);
+
         header.msg_size = offset;
         offset = 0;
         SOS_msg_zip(reply, header, 0, &offset);
@@ -1939,7 +2372,7 @@ void SOSD_handle_register(SOS_buffer *buffer) {
         SOSD_PACK_ACK(reply);
     }
 
-    i = send( SOSD.net->remote_socket_fd, (void *) reply->data, reply->len, 0 );
+    i = send( SOSD_reply_to->remote_socket_fd, (void *) reply->data, reply->len, 0 );
 
     if (i == -1) {
         dlog(0, "Error sending a response.  (%s)\n", strerror(errno));
@@ -1987,7 +2420,7 @@ void SOSD_handle_guid_block(SOS_buffer *buffer) {
     offset = 0;
     SOS_msg_zip(reply, header, 0, &offset);
 
-    i = send( SOSD.net->remote_socket_fd, (void *) reply->data, reply->len, 0 );
+    i = send( SOSD_reply_to->remote_socket_fd, (void *) reply->data, reply->len, 0 );
 
     if (i == -1) {
         dlog(0, "Error sending a response.  (%s)\n", strerror(errno));
@@ -2171,7 +2604,7 @@ void SOSD_handle_shutdown(SOS_buffer *buffer) {
     dlog(5, "Replying to the client who submitted the shutdown"
             " request in situ...\n");
     SOSD_PACK_ACK(reply);
-    i = send(SOSD.net->remote_socket_fd, (void *) reply->data,
+    i = send(SOSD_reply_to->remote_socket_fd, (void *) reply->data,
             reply->len, 0);
     if (i == -1) {
         dlog(0, "Error sending a response.  (%s)\n", strerror(errno));
@@ -2267,7 +2700,7 @@ void SOSD_handle_check_in(SOS_buffer *buffer) {
         dlog(1, "Replying to CHECK_IN with SOS_FEEDBACK_EXEC_FUNCTION(%s)"
                 "...\n", function_name);
 
-        i = send( SOSD.net->remote_socket_fd, (void *) reply->data,
+        i = send( SOSD_reply_to->remote_socket_fd, (void *) reply->data,
                 reply->len, 0 );
         if (i == -1) {
             dlog(0, "Error sending a response.  (%s)\n", strerror(errno));
@@ -2304,7 +2737,7 @@ void SOSD_handle_probe(SOS_buffer *buffer) {
     dlog(5, "Assembling probe data structure...\n");
 
     int offset = 0;
-    SOS_msg_unzip(buffer, &header, 0, &offset);
+    SOS_msg_zip(reply, header, 0, &offset);
 
     uint64_t queue_depth_local     = SOSD.sync.local.queue->elem_count;
     uint64_t queue_depth_cloud     = 0;
@@ -2331,7 +2764,16 @@ void SOSD_handle_probe(SOS_buffer *buffer) {
     current = SOSD.daemon.countof;
     if (SOS_DEBUG > 0) { pthread_mutex_unlock(SOSD.daemon.countof.lock_stats); }
 
-    SOS_buffer_pack(reply, &offset, "ggggggggggggggggggggg",
+    // Buffers are counted by the library, along with how many of them
+    // came out of its pool rather than from malloc().
+    SOS_buffer_stats buffer_stats;
+    SOS_buffer_pool_stats(&buffer_stats);
+    current.buffer_creates       = buffer_stats.creates;
+    current.buffer_bytes_on_heap = buffer_stats.bytes_on_heap;
+    current.buffer_destroys      = buffer_stats.destroys;
+    current.buffer_pool_hits     = buffer_stats.pool_hits;
+
+    SOS_buffer_pack(reply, &offset, "ggggggggggggggggggggggg",
                     current.thread_local_wakeup,
                     current.thread_cloud_wakeup,
                     current.thread_db_wakeup,
@@ -2339,6 +2781,7 @@ void SOSD_handle_probe(SOS_buffer *buffer) {
                     current.socket_messages,
                     current.socket_bytes_recv,
                     current.socket_bytes_sent,
+                    current.socket_acks_skipped,
                     current.mpi_sends,
                     current.mpi_bytes,
                     current.db_transactions,
@@ -2351,6 +2794,7 @@ void SOSD_handle_probe(SOS_buffer *buffer) {
                     current.buffer_creates,
                     current.buffer_bytes_on_heap,
                     current.buffer_destroys,
+                    current.buffer_pool_hits,
                     current.pipe_creates,
                     current.pub_handles);
 
@@ -2390,10 +2834,13 @@ void SOSD_handle_probe(SOS_buffer *buffer) {
                     vm_peak,
                     vm_size);
 
+    header.msg_size = offset;
+    SOS_msg_seal(reply, header, 0, &offset);
+
     // Buffer is now ready to send...
 
     dlog(5, "   ...sending probe results, len = %d\n", reply->len);
-    i = send( SOSD.net->remote_socket_fd, (void *) reply->data,
+    i = send( SOSD_reply_to->remote_socket_fd, (void *) reply->data,
             reply->len, 0 );
     if (i == -1) {
         dlog(0, "Error sending a response.  (%s)\n", strerror(errno));
@@ -2415,7 +2862,7 @@ void SOSD_handle_manifest(SOS_buffer *buffer) {
     SOSA_pub_manifest_to_buffer(SOSD.sos_context, &reply, buffer, SOSD.pub_list_head);
 
     int i = -1;
-    i = send(SOSD.net->remote_socket_fd, (void *) reply->data,
+    i = send(SOSD_reply_to->remote_socket_fd, (void *) reply->data,
             reply->len, 0);
     if (i < 0) {
         dlog(0, "Error sending a response.  (%s)\n", strerror(errno));
@@ -2457,7 +2904,7 @@ void SOSD_handle_unknown(SOS_buffer *buffer) {
 
     SOSD_PACK_ACK(reply);
 
-    i = send(SOSD.net->remote_socket_fd, (void *) reply->data,
+    i = send(SOSD_reply_to->remote_socket_fd, (void *) reply->data,
             reply->len, 0);
     if (i == -1) {
         dlog(0, "Error sending a response.  (%s)\n", strerror(errno));
@@ -2477,6 +2924,24 @@ void SOSD_setup_socket() {
     SOS_SET_CONTEXT(SOSD.sos_context, "SOSD_setup_socket");
     SOS_target_setup_for_accept(SOSD.net);
     gethostname(SOSD.net->local_host, NI_MAXHOST);
+
+    // Local clients get a socket of their own, alongside the TCP port.
+    // It is named for the port first asked for, so this is skipped when
+    // the TCP listener moves on to another port.
+    if ((SOSD.unix_net == NULL) && (SOS->config.options->unix_socket)) {
+        SOSD.unix_net = (SOS_socket *) calloc(1, sizeof(SOS_socket));
+        SOSD.unix_net->sos_context = SOSD.sos_context;
+        SOSD.unix_net->remote_socket_fd = -1;
+        snprintf(SOSD.unix_net->remote_host, NI_MAXHOST, "%s",
+                SOS_DEFAULT_SERVER_HOST);
+        snprintf(SOSD.unix_net->remote_port, NI_MAXSERV, "%s",
+                SOSD.net->local_port);
+        SOS_target_use_unix(SOSD.unix_net);
+        if (SOS_target_setup_for_accept_unix(SOSD.unix_net) != 0) {
+            free(SOSD.unix_net);
+            SOSD.unix_net = NULL;
+        }
+    }
     return;
 }
 
@@ -2590,8 +3055,9 @@ void SOSD_init() {
     #endif
     // Set up the GUID pool for daemon-internal pub handles.
     SOSD.sos_context->uid.my_guid_pool = SOSD.guid;
+    SOSD.guid->low_water = (SOS_guid) SOS_DEFAULT_GUID_BLOCK * 16;
     dlog(1, "  ... (%" SOS_GUID_FMT " ---> %" SOS_GUID_FMT ")\n",
-            SOSD.guid->next, SOSD.guid->last);
+            SOSD.guid->block->next, SOSD.guid->block->last);
 
     // [hashtable]
     dlog(1, "Setting up a hash table for pubs...\n");
@@ -2632,6 +3098,75 @@ SOSD_sync_context_init(
     return;
 }
 
+// The SOS_WIRE_* encodings this daemon can read.
+int
+SOSD_wire_flags(void) {
+    SOS_SET_CONTEXT(SOSD.sos_context, "SOSD_wire_flags");
+    int flags = 0;
+
+    if (SOS->config.options->compact_snaps) {
+        flags |= SOS_WIRE_COMPACT_SNAPS;
+    }
+    flags |= SOS_WIRE_NO_ACK;
+    return flags;
+}
+
+
+// How far behind the daemon is, as ACKs tell it to clients.  Until one of
+// its queues is SOSD_RING_QUEUE_TRIGGER_PCT full this is 0 (no limit on
+// the messages a client sends between ACKs) and no delay.  Past that the
+// credits shrink toward one message per ACK, and the delay clients put
+// between publishes grows toward SOSD_ACK_BACKOFF_MAX_USEC.
+int
+SOSD_backpressure(int *backoff_usec) {
+    SOS_pipe *queue[4];
+    double    fill;
+    double    over;
+    int       i;
+
+    queue[0] = SOSD.sync.local.queue;
+    queue[1] = SOSD.sync.cloud_send.queue;
+    queue[2] = SOSD.sync.db.queue;
+    queue[3] = SOSD.db.snap_queue;
+
+    fill = 0.0;
+    for (i = 0; i < 4; i++) {
+        if ((queue[i] != NULL) && (SOSD_check_sync_saturation(queue[i]))
+         && (SOSD_queue_fill(queue[i]) > fill)) {
+            fill = SOSD_queue_fill(queue[i]);
+        }
+    }
+
+    *backoff_usec = 0;
+    if (fill == 0.0) {
+        return 0;
+    }
+
+    over = (fill - SOSD_RING_QUEUE_TRIGGER_PCT)
+        / (1.0 - SOSD_RING_QUEUE_TRIGGER_PCT);
+    if (over > 1.0) over = 1.0;
+    *backoff_usec = (int) (over * SOSD_ACK_BACKOFF_MAX_USEC);
+    i = (int) ((1.0 - over) * SOS_DEFAULT_NO_ACK_WINDOW);
+    return (i > 1) ? i : 1;
+}
+
+
+// Appends the current credits and delay to an ACK, from one look at the
+// queues so the two always agree.  Clients that predate them stop
+// reading at the end of the header.
+void
+SOSD_pack_backpressure(SOS_buffer *buffer, int *offset) {
+    int credits;
+    int backoff_usec;
+
+    credits = SOSD_backpressure(&backoff_usec);
+    SOS_buffer_pack(buffer, offset, "ii",
+            credits,
+            backoff_usec);
+    return;
+}
+
+
 void
 SOSD_claim_guid_block(
         SOS_uid *id,
@@ -2640,24 +3175,32 @@ SOSD_claim_guid_block(
         SOS_guid *pool_to)
 {
     SOS_SET_CONTEXT(id->sos_context, "SOSD_claim_guid_block");
+    SOS_uid_block *block;
+    SOS_guid       mark;
 
-    pthread_mutex_lock( id->lock );
+    // The daemon's range never changes, so the same fetch-and-add that
+    // SOS_uid_next() uses carves client blocks out of it without a lock.
+    block      = __atomic_load_n(&id->block, __ATOMIC_ACQUIRE);
+    *pool_from = __atomic_fetch_add(&block->next, (SOS_guid) size + 1,
+            __ATOMIC_RELAXED);
 
-    if ((id->next + size) > id->last) {
+    if ((*pool_from + size) > block->last) {
         // This is basically a failure case if any more GUIDs are requested.
-        *pool_from = id->next;
-        *pool_to   = id->last;
-        id->next   = id->last + 1;
+        *pool_to   = block->last;
     } else {
-        *pool_from = id->next;
-        *pool_to   = id->next + size;
-        id->next   = id->next + size + 1;
+        *pool_to   = *pool_from + size;
         dlog(6, "served GUID block: %" SOS_GUID_FMT " ----> %"
                 SOS_GUID_FMT "\n",
                 *pool_from, *pool_to);
     }
 
-    pthread_mutex_unlock( id->lock );
+    // There is nobody to prefetch from, but say so once while there is
+    // still time to do something about it.
+    mark = block->last - id->low_water;
+    if ((id->low_water > 0) && (*pool_from <= mark) && (*pool_to > mark)) {
+        dlog(0, "WARNING: Fewer than %" SOS_GUID_FMT " GUIDs are left in"
+                " this daemon's range.\n", id->low_water);
+    }
 
     return;
 }
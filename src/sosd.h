@@ -32,6 +32,7 @@
 #define SOSD_DEFAULT_LOCK_FILE       "sosd.lock"
 #define SOSD_DEFAULT_LOG_FILE        "sosd.log"
 #define SOSD_RING_QUEUE_TRIGGER_PCT  0.7
+#define SOSD_ACK_BACKOFF_MAX_USEC    250000
 
 #define SOSD_DEFAULT_K_MEAN_CENTERS  24
 #define SOSD_DEFAULT_CENTROID_COUNT  12
@@ -42,6 +43,13 @@
 
 #define SOSD_DEFAULT_CLOUD_PORT      22700
 
+#define SOSD_LISTEN_POLL_MSEC        1000
+#define SOSD_DEFAULT_LISTEN_THREADS  4
+
+#define SOSD_SHM_DRAIN_BATCH         64
+#define SOSD_SHM_DRAIN_IDLE_USEC     100
+#define SOSD_SHM_DRAIN_IDLE_MAX_USEC 5000
+
 #define SOSD_LOCAL_SYNC_WAIT_SEC     0
 #define SOSD_CLOUD_SYNC_WAIT_SEC     0
 #define SOSD_DB_SYNC_WAIT_SEC        0
@@ -115,6 +123,7 @@ typedef struct {
     uint64_t            socket_messages;
     uint64_t            socket_bytes_recv;
     uint64_t            socket_bytes_sent;
+    uint64_t            socket_acks_skipped;
     uint64_t            mpi_sends;
     uint64_t            mpi_bytes;
     uint64_t            db_transactions;
@@ -127,6 +136,7 @@ typedef struct {
     uint64_t            buffer_creates;
     uint64_t            buffer_bytes_on_heap;
     uint64_t            buffer_destroys;
+    uint64_t            buffer_pool_hits;
     uint64_t            pipe_creates;
     uint64_t            pub_handles;
 } SOSD_counts;
@@ -255,18 +265,31 @@ typedef struct {
     SOSD_sync_context    db;
     SOSD_sync_context    system_monitor;
     SOSD_sync_context    feedback;
+    SOSD_sync_context    shm;
     qhashtbl_t          *km2d_table;
     //
     pthread_mutex_t         *sense_list_lock;
     SOSD_sensitivity_entry  *sense_list_head;
+    //
+    pthread_mutex_t         *shm_list_lock;
+    SOS_list_entry          *shm_list_head;
 } SOSD_sync_set;
 
 
+typedef struct {
+    int                  epoll_fd;
+    int                  thread_count;
+    pthread_t           *threads;
+} SOSD_listen_set;
+
+
 typedef struct {
     SOS_runtime         *sos_context;
     SOSD_runtime         daemon;
     SOSD_db              db;
     SOS_socket          *net;
+    SOS_socket          *unix_net;
+    SOSD_listen_set      listen;
     SOS_uid             *guid;
     SOSD_sync_set        sync;
     qhashtbl_t          *pub_table;
@@ -278,6 +301,7 @@ typedef struct {
  *  Daemon root 'global' data structure:
  */
 extern SOSD_global SOSD;
+extern __thread SOS_socket *SOSD_reply_to;
 
 
 /* Required if included by C++ code. */
@@ -311,8 +335,10 @@ extern "C" {
     void* SOSD_THREAD_db_sync(void *args);
     void* SOSD_THREAD_system_monitor(void *args);
     void* SOSD_THREAD_feedback_sync(void *args);
+    void* SOSD_THREAD_shm_drain(void *args);
 
     void  SOSD_listen_loop(void);
+    void* SOSD_THREAD_listen_worker(void *args);
     void  SOSD_send_to_self(SOS_buffer *msg, SOS_buffer *reply);
 
     void  SOSD_handle_register(SOS_buffer *buffer);
@@ -322,6 +348,7 @@ extern "C" {
     void  SOSD_handle_publish(SOS_buffer *buffer);
     void  SOSD_handle_echo(SOS_buffer *buffer);
     void  SOSD_handle_val_snaps(SOS_buffer *buffer);
+    void  SOSD_handle_pub_frame(SOS_buffer *buffer);
     void  SOSD_handle_shutdown(SOS_buffer *buffer);
     void  SOSD_handle_check_in(SOS_buffer *buffer);
     void  SOSD_handle_probe(SOS_buffer *buffer);
@@ -333,11 +360,16 @@ extern "C" {
     void  SOSD_handle_desensitize(SOS_buffer *buffer);
     void  SOSD_handle_triggerpull(SOS_buffer *buffer);
     void  SOSD_handle_kmean_data(SOS_buffer *buffer);
+    void  SOSD_handle_shm_attach(SOS_buffer *buffer);
     void  SOSD_handle_unknown(SOS_buffer *buffer);
 
     void  SOSD_claim_guid_block( SOS_uid *uid, int size,
             SOS_guid *pool_from, SOS_guid *pool_to );
 
+    int   SOSD_wire_flags(void);
+    int   SOSD_backpressure(int *backoff_usec);
+    void  SOSD_pack_backpressure(SOS_buffer *buffer, int *offset);
+
     void  SOSD_apply_announce( SOS_pub *pub, SOS_buffer *buffer );
     void  SOSD_apply_publish( SOS_pub *pub, SOS_buffer *buffer );
 
@@ -369,7 +401,10 @@ extern "C" {
     }
 
 
-#define SOSD_check_sync_saturation(__pub_mon) (((double) __pub_mon->ring->elem_count / (double) __pub_mon->ring->elem_max) > SOSD_RING_QUEUE_TRIGGER_PCT) ? 1 : 0
+// The queues are unbounded, so fullness is measured against the depth
+// they are expected to stay under.
+#define SOSD_queue_fill(__queue) ((double) (__queue)->elem_count / (double) SOS_DEFAULT_PIPE_DEPTH)
+#define SOSD_check_sync_saturation(__queue) ((SOSD_queue_fill(__queue) > SOSD_RING_QUEUE_TRIGGER_PCT) ? 1 : 0)
 
 #define SOSD_PACK_ACK(__buffer) {                                       \
         if (__buffer == NULL) {                                         \
@@ -386,9 +421,9 @@ extern "C" {
         header.ref_guid = 0;                             \
         offset = 0;                                      \
         SOS_msg_zip(__buffer, header, 0, &offset);       \
+        SOSD_pack_backpressure(__buffer, &offset);       \
         header.msg_size = offset;                        \
-        offset = 0;                                      \
-        SOS_msg_zip(__buffer, header, 0, &offset);       \
+        SOS_msg_seal(__buffer, header, 0, &offset);      \
     }
 
 
@@ -11,6 +11,7 @@ bool SOSD_cloud_shutdown_underway = false;
 
 bool SOSD_sockets_ready_to_listen = false;
 void SOSD_socket_register_connection(SOS_buffer *msg);
+void SOSD_socket_handle_register_ack(SOS_buffer *msg);
 
 void SOSD_cloud_listen_loop(void) {
     SOS_SET_CONTEXT(SOSD.sos_context, "SOSD_cloud_listen_loop");
@@ -86,6 +87,7 @@ void SOSD_cloud_process_buffer(SOS_buffer *buffer) {
         case SOS_MSG_TYPE_ANNOUNCE:
         case SOS_MSG_TYPE_PUBLISH:
         case SOS_MSG_TYPE_VAL_SNAPS:
+        case SOS_MSG_TYPE_PUB_FRAME:
             pthread_mutex_lock(SOSD.sync.local.queue->sync_lock);
             pipe_push(SOSD.sync.local.queue->intake, &msg, 1);
             SOSD.sync.local.queue->elem_count++;
@@ -118,6 +120,7 @@ void SOSD_cloud_process_buffer(SOS_buffer *buffer) {
             dlog(1, "sosd(%d) received ACK message"
                 " from rank %" SOS_GUID_FMT " !\n",
                     SOSD.sos_context->config.comm_rank, header.msg_from);
+            SOSD_socket_handle_register_ack(msg);
             break;
 
         default:    SOSD_handle_unknown    (msg); break;
@@ -157,6 +160,13 @@ void SOSD_socket_register_connection(SOS_buffer *msg) {
     SOS_buffer_unpack_safestr(msg, &offset, &remote_host);
     SOS_buffer_unpack(msg, &offset, "i", &remote_port);
 
+    // Older listeners make no offer, and get the defaults.
+    int wire_flags = 0;
+    if (offset < header.msg_size) {
+        SOS_buffer_unpack(msg, &offset, "i", &wire_flags);
+    }
+    wire_flags &= SOSD_wire_flags();
+
     SOS_socket *rmt_tgt = NULL;
 
     SOS_target_init(SOS, &rmt_tgt, remote_host, remote_port);
@@ -188,6 +198,9 @@ void SOSD_socket_register_connection(SOS_buffer *msg) {
         header.msg_from,
         header.ref_guid);
 
+    // The encodings this listener may forward to us.
+    SOS_buffer_pack(reply, &offset, "i", wire_flags);
+
     header.msg_size = offset;
     offset = 0;
     SOS_buffer_pack(reply, &offset, "i",
@@ -204,6 +217,34 @@ void SOSD_socket_register_connection(SOS_buffer *msg) {
 }
 
 
+// The aggregator's answer to our REGISTER says which encodings it will
+// take, and so which ones we can offer our own clients.
+void SOSD_socket_handle_register_ack(SOS_buffer *msg) {
+    SOS_SET_CONTEXT(SOSD.sos_context, "SOSD_socket_handle_register_ack");
+    SOS_msg_header header;
+    int            wire_flags;
+    int            offset;
+
+    if ((SOS->role != SOS_ROLE_LISTENER)
+     || (SOSD.daemon.cloud_aggregator == NULL)) {
+        return;
+    }
+
+    offset = 0;
+    SOS_msg_unzip(msg, &header, 0, &offset);
+    if (offset >= header.msg_size) {
+        return;
+    }
+    wire_flags = 0;
+    SOS_buffer_unpack(msg, &offset, "i", &wire_flags);
+    __atomic_store_n(&SOSD.daemon.cloud_aggregator->wire_flags,
+            (wire_flags & SOSD_wire_flags()), __ATOMIC_RELAXED);
+
+    dlog(1, "Aggregator agreed to wire_flags 0x%x.\n", wire_flags);
+    return;
+}
+
+
 // NOTE: Trigger pulls do not flow UP FROM the node where
 //       they are pulled (at this time).  They go "downstream"
 //       from AGGREGATOR->LISTENER and LISTENER->LOCALAPPS
@@ -558,6 +599,7 @@ int SOSD_cloud_init(int *argc, char ***argv) {
             header.ref_guid);
 
         SOS_buffer_pack(buffer, &offset, "si", tgt->local_host, tgt->port_number);
+        SOS_buffer_pack(buffer, &offset, "i", SOSD_wire_flags());
 
         header.msg_size = offset;
         offset = 0;
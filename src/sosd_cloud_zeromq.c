@@ -109,6 +109,7 @@ void SOSD_cloud_process_buffer(SOS_buffer *buffer) {
         case SOS_MSG_TYPE_ANNOUNCE:
         case SOS_MSG_TYPE_PUBLISH:
         case SOS_MSG_TYPE_VAL_SNAPS:
+        case SOS_MSG_TYPE_PUB_FRAME:
             pthread_mutex_lock(SOSD.sync.local.queue->sync_lock);
             pipe_push(SOSD.sync.local.queue->intake, &msg, 1);
             SOSD.sync.local.queue->elem_count++;
@@ -18,6 +18,7 @@
 #include "sos_debug.h"
 #include "sos_types.h"
 #include "sos_target.h"
+#include "sos_snap_pool.h"
 #include "sosd_db_sqlite.h"
 #include "sosa.h"
 
@@ -581,6 +582,12 @@ void SOSD_db_handle_sosa_query(SOSD_db_task *task) {
             dlog(7, "   ... results->data[%d][ | | | ... | ]\n", row_incoming);
             SOSA_results_grow_to(results, col_incoming, row_incoming);
             for (col = 0; col < col_incoming; col++) {
+                if (sqlite3_column_type(sosa_statement, col) == SQLITE_BLOB) {
+                    SOSA_results_put_bytes(results, col, row_incoming,
+                        sqlite3_column_blob(sosa_statement, col),
+                        sqlite3_column_bytes(sosa_statement, col));
+                    continue;
+                }
                 val = (const char *) sqlite3_column_text(sosa_statement, col);
                 SOSA_results_put(results, col, row_incoming, val);
             }//for:col
@@ -757,6 +764,12 @@ void SOSD_db_insert_data( SOS_pub *pub ) {
         case SOS_VAL_TYPE_STRING:
             val = pub->data[i]->val.c_val;
             break;
+        case SOS_VAL_TYPE_BYTES:
+        case SOS_VAL_TYPE_INT_ARRAY:
+        case SOS_VAL_TYPE_LONG_ARRAY:
+        case SOS_VAL_TYPE_DOUBLE_ARRAY:
+            val = NULL;
+            break;
         default:
             dlog(5, "ERROR: Attempting to insert an invalid"
                     " data type.  pub[%s]->data[%d]->type == %d  (Skipping...)\n",
@@ -895,6 +908,11 @@ void SOSD_db_insert_vals( SOS_pipe *queue, SOS_pipe *re_queue ) {
         case SOS_VAL_TYPE_STRING:
             val = snap_list[snap_index]->val.c_val;
             break;
+        case SOS_VAL_TYPE_BYTES:
+        case SOS_VAL_TYPE_INT_ARRAY:
+        case SOS_VAL_TYPE_LONG_ARRAY:
+        case SOS_VAL_TYPE_DOUBLE_ARRAY:
+            break;
         default:
             dlog(5, "     ... error: invalid value type.  (%d)\n", val_type);
             break;
@@ -904,7 +922,13 @@ void SOSD_db_insert_vals( SOS_pipe *queue, SOS_pipe *re_queue ) {
         val_insert_count++;
 
         CALL_SQLITE (bind_int64  (stmt_insert_val, 1,  guid         ));
-        if (val != NULL) {
+        if ((val_type == SOS_VAL_TYPE_BYTES)
+         || SOS_VAL_TYPE_IS_ARRAY(val_type)) {
+            // Arrays are stored in the daemon's byte order.
+            CALL_SQLITE (bind_blob   (stmt_insert_val, 2,
+                        snap_list[snap_index]->val.bytes,
+                        snap_list[snap_index]->val_len, SQLITE_STATIC ));
+        } else if (val != NULL) {
             CALL_SQLITE (bind_text   (stmt_insert_val, 2,  val, -1 , SQLITE_STATIC ));
         } else {
             CALL_SQLITE (bind_text   (stmt_insert_val, 2,  "", 1, SQLITE_STATIC ));
@@ -1043,22 +1067,8 @@ void SOSD_db_insert_vals( SOS_pipe *queue, SOS_pipe *re_queue ) {
     // ----- Done... re-queue or free the snaps now.
 
     if (re_queue == NULL) {
-        // Roll through and free the snaps.
-        for (snap_index = 0; snap_index < snap_count ; snap_index++) {
-            switch(val_type) {
-            case SOS_VAL_TYPE_STRING:
-                // memory controlled by SQLite
-                //free(snap_list[snap_index]->val.c_val);
-                break;
-            case SOS_VAL_TYPE_BYTES:  
-                // memory controlled by SQLite
-                //free(snap_list[snap_index]->val.bytes); 
-                break;
-            default: 
-                break;
-            }
-            free(snap_list[snap_index]);
-        }
+        // The statements are reset, nothing refers to the values now.
+        SOS_val_snap_destroy_list(snap_list, snap_count);
     } else {
        // Inject this snap queue into the next one en masse.
        dlog(5, "Re-queue'ing this snap queue to send to the aggregator.\n");
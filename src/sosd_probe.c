@@ -110,6 +110,7 @@ int main(int argc, char *argv[]) {
                 "socket_messages,"
                 "socket_bytes_recv,"
                 "socket_bytes_sent,"
+                "socket_acks_skipped,"
                 "mpi_sends,"
                 "mpi_bytes,"
                 "db_transactions,"
@@ -122,6 +123,7 @@ int main(int argc, char *argv[]) {
                 "buffer_creates,"
                 "buffer_bytes_on_heap,"
                 "buffer_destroys,"
+                "buffer_pool_hits,"
                 "pipe_creates,"
                 "pub_handles,"
                 "vm_peak,"
@@ -186,7 +188,7 @@ int main(int argc, char *argv[]) {
                           &queue_depth_db_snaps);
 
         SOSD_counts current;
-        SOS_buffer_unpack(reply, &offset, "ggggggggggggggggggggg",
+        SOS_buffer_unpack(reply, &offset, "ggggggggggggggggggggggg",
                           &current.thread_local_wakeup,
                           &current.thread_cloud_wakeup,
                           &current.thread_db_wakeup,
@@ -194,6 +196,7 @@ int main(int argc, char *argv[]) {
                           &current.socket_messages,
                           &current.socket_bytes_recv,
                           &current.socket_bytes_sent,
+                          &current.socket_acks_skipped,
                           &current.mpi_sends,
                           &current.mpi_bytes,
                           &current.db_transactions,
@@ -206,6 +209,7 @@ int main(int argc, char *argv[]) {
                           &current.buffer_creates,
                           &current.buffer_bytes_on_heap,
                           &current.buffer_destroys,
+                          &current.buffer_pool_hits,
                           &current.pipe_creates,
                           &current.pub_handles);
 
@@ -232,7 +236,8 @@ int main(int argc, char *argv[]) {
                    "%" SOS_GUID_FMT ",%" SOS_GUID_FMT ",%" SOS_GUID_FMT ","
                    "%" SOS_GUID_FMT ",%" SOS_GUID_FMT ",%" SOS_GUID_FMT ","
                    "%" SOS_GUID_FMT ",%" SOS_GUID_FMT ",%" SOS_GUID_FMT ","
-                   "%" SOS_GUID_FMT ",%" SOS_GUID_FMT "\n",
+                   "%" SOS_GUID_FMT ","
+                   "%" SOS_GUID_FMT ",%" SOS_GUID_FMT ",%" SOS_GUID_FMT "\n",
                    time_now,
                    (rtt_at_reply - rtt_at_probe),
                    header.msg_from,
@@ -247,6 +252,7 @@ int main(int argc, char *argv[]) {
                    current.socket_messages,
                    current.socket_bytes_recv,
                    current.socket_bytes_sent,
+                   current.socket_acks_skipped,
                    current.mpi_sends,
                    current.mpi_bytes,
                    current.db_transactions,
@@ -259,6 +265,7 @@ int main(int argc, char *argv[]) {
                    current.buffer_creates,
                    current.buffer_bytes_on_heap,
                    current.buffer_destroys,
+                   current.buffer_pool_hits,
                    current.pipe_creates,
                    current.pub_handles,
                    vm_peak,
@@ -303,6 +310,8 @@ int main(int argc, char *argv[]) {
                     SOS_GUID_FMT "\",\n", current.socket_bytes_recv);
             fprintf(GLOBAL_out, "\t\"socket_bytes_sent\": \"%"
                     SOS_GUID_FMT "\",\n", current.socket_bytes_sent);
+            fprintf(GLOBAL_out, "\t\"socket_acks_skipped\": \"%"
+                    SOS_GUID_FMT "\",\n", current.socket_acks_skipped);
             fprintf(GLOBAL_out, "\t\"mpi_sends\": \"%"
                     SOS_GUID_FMT "\",\n", current.mpi_sends);
             fprintf(GLOBAL_out, "\t\"mpi_bytes\": \"%"
@@ -327,6 +336,8 @@ int main(int argc, char *argv[]) {
                     SOS_GUID_FMT "\",\n", current.buffer_bytes_on_heap);
             fprintf(GLOBAL_out, "\t\"buffer_destroys\": \"%"
                     SOS_GUID_FMT "\",\n", current.buffer_destroys);
+            fprintf(GLOBAL_out, "\t\"buffer_pool_hits\": \"%"
+                    SOS_GUID_FMT "\",\n", current.buffer_pool_hits);
             fprintf(GLOBAL_out, "\t\"pipe_creates\": \"%"
                     SOS_GUID_FMT "\",\n", current.pipe_creates);
             fprintf(GLOBAL_out, "\t\"pub_handles\": \"%"
@@ -329,7 +329,7 @@ extern "C" void SOSD_add_pid_to_track(SOS_pub *pid_pub) {
     my_pub->snap_queue = SOSD.db.snap_queue;
 
     my_pub->process_id = pid_pub->process_id;
-    strncpy(my_pub->prog_name, pid_pub->prog_name, SOS_DEFAULT_STRING_LEN);
+    SOS_pub_config(my_pub, SOS_PUB_OPTION_PROG_NAME, pid_pub->prog_name);
 
     SOS_announce(my_pub);
 
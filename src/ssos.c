@@ -426,7 +426,7 @@ SSOS_init(
         fprintf(stderr, "SSOS (PID:%d) -- Failed to create pub handle.\n",
             getpid());
     } else {
-        strncpy(g_pub->prog_name, prog_name, SOS_DEFAULT_STRING_LEN);
+        SOS_pub_config(g_pub, SOS_PUB_OPTION_PROG_NAME, prog_name);
         g_sos_is_online = 1;
     }
 
@@ -538,7 +538,7 @@ SSOS_set_option(
     switch (option_key) {
 
         case SSOS_OPT_PROG_VERSION:
-            strncpy(g_pub->prog_ver, option_value, SOS_DEFAULT_STRING_LEN);
+            SOS_pub_config(g_pub, SOS_PUB_OPTION_PROG_VER, option_value);
             break;
 
         case SSOS_OPT_COMM_RANK:
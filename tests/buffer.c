@@ -1,7 +1,11 @@
 
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 #include "sos.h"
+#include "sos_target.h"
 #include "test.h"
 #include "buffer.h"
 
@@ -15,6 +19,8 @@ int SOS_test_buffer() {
     SOS_test_section_start(1, "SOS_buffer_grow");
 
     SOS_test_run(2, "buffer_grow", SOS_test_buffer_grow(), pass_fail, error_total);
+    SOS_test_run(2, "buffer_pool", SOS_test_buffer_pool(), pass_fail, error_total);
+    SOS_test_run(2, "buffer_pool_short_recv", SOS_test_buffer_pool_short_recv(), pass_fail, error_total);
 
     SOS_test_section_report(1, "SOS_buffer_grow", error_total);
 
@@ -46,3 +52,102 @@ int SOS_test_buffer_grow() {
     return PASS;
 }
 
+
+
+// A destroyed buffer comes back from the next init of its size class,
+// with the bytes it used cleared.
+int SOS_test_buffer_pool() {
+    SOS_buffer_stats before;
+    SOS_buffer_stats after;
+    SOS_buffer *buffer;
+    SOS_buffer *again;
+    int offset = 0;
+    int i;
+
+    SOS_buffer_init_sized_locking(TEST_sos, &buffer, 3000, true);
+    if (buffer->max < 3000) {
+        SOS_buffer_destroy(buffer);
+        return FAIL;
+    }
+    SOS_buffer_pack(buffer, &offset, "ils", 42, 42, "forty-two");
+    SOS_buffer_destroy(buffer);
+
+    SOS_buffer_pool_stats(&before);
+    SOS_buffer_init_sized_locking(TEST_sos, &again, 2500, false);
+    SOS_buffer_pool_stats(&after);
+
+    if ((again != buffer)
+     || (again->len != 0)
+     || (again->is_locking)
+     || (after.pool_hits != (before.pool_hits + 1))) {
+        SOS_buffer_destroy(again);
+        return FAIL;
+    }
+    for (i = 0; i < again->max; i++) {
+        if (again->data[i] != 0) {
+            SOS_buffer_destroy(again);
+            return FAIL;
+        }
+    }
+
+    SOS_buffer_destroy(again);
+    return PASS;
+}
+
+
+// A receive that stops partway through a message body still hands its
+// buffer back to the pool clean.
+int SOS_test_buffer_pool_short_recv() {
+    SOS_socket *source;
+    SOS_buffer *msg;
+    SOS_buffer *buffer;
+    SOS_buffer *again;
+    int offset = 0;
+    int sv[2];
+    int rc;
+    int i;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        return FAIL;
+    }
+
+    // A header promising 2000 bytes, then only part of the body.
+    SOS_buffer_init_sized_locking(TEST_sos, &msg, 512, false);
+    SOS_buffer_pack(msg, &offset, "iigg", 2000, SOS_MSG_TYPE_ECHO,
+            (SOS_guid) 0, (SOS_guid) 0);
+    memset(msg->data + offset, 0xAB, 100);
+    rc = write(sv[1], msg->data, (offset + 100));
+    close(sv[1]);
+    SOS_buffer_destroy(msg);
+    if (rc != (offset + 100)) {
+        close(sv[0]);
+        return FAIL;
+    }
+
+    SOS_target_init(TEST_sos, &source, "localhost", 0);
+    source->remote_socket_fd = sv[0];
+
+    SOS_buffer_init_sized_locking(TEST_sos, &buffer, 3000, false);
+    rc = SOS_target_recv_msg(source, buffer);
+    close(sv[0]);
+    SOS_target_destroy(source);
+    SOS_buffer_destroy(buffer);
+    if (rc >= 0) {
+        return FAIL;
+    }
+
+    SOS_buffer_init_sized_locking(TEST_sos, &again, 2500, false);
+    if (again != buffer) {
+        SOS_buffer_destroy(again);
+        return FAIL;
+    }
+    for (i = 0; i < again->max; i++) {
+        if (again->data[i] != 0) {
+            SOS_buffer_destroy(again);
+            return FAIL;
+        }
+    }
+
+    SOS_buffer_destroy(again);
+    return PASS;
+}
@@ -3,6 +3,8 @@
 
 int SOS_test_buffer();
 int SOS_test_buffer_grow();
+int SOS_test_buffer_pool();
+int SOS_test_buffer_pool_short_recv();
 
 
 #endif
@@ -1,10 +1,14 @@
 
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 
 #include "sos.h"
 #include "test.h"
 #include "pack.h"
 #include "sos_buffer.h"
+#include "sos_intern.h"
+#include "sos_record.h"
 
 #define ATTEMPT_MAX   20000
 
@@ -18,7 +22,10 @@ int SOS_test_pack() {
     SOS_test_run(2, "pack_int", SOS_test_pack_int(), pass_fail, error_total);
     SOS_test_run(2, "pack_long", SOS_test_pack_long(), pass_fail, error_total);
     SOS_test_run(2, "pack_double", SOS_test_pack_double(), pass_fail, error_total);
+    SOS_test_run(2, "pack_double_wire", SOS_test_pack_double_wire(), pass_fail, error_total);
     SOS_test_run(2, "pack_string", SOS_test_pack_string(), pass_fail, error_total);
+    SOS_test_run(2, "pack_record", SOS_test_pack_record(), pass_fail, error_total);
+    SOS_test_run(2, "pack_record_delta", SOS_test_pack_record_delta(), pass_fail, error_total);
 
     SOS_test_section_report(1, "SOS_buffer_pack", error_total);
 
@@ -107,6 +114,57 @@ int SOS_test_pack_double() {
     return PASS;
 }
 
+int SOS_test_pack_double_wire() {
+    unsigned char wire[8 * 64];
+    unsigned char one[8] = { 0x3f, 0xf0, 0, 0, 0, 0, 0, 0 };
+    double special[6] = { 0.0, -0.0, 1.0, -2.5, 4.9e-324, HUGE_VAL };
+    double input[64];
+    double output[64];
+    int attempt = 0;
+    int i;
+
+    /* Big-endian IEEE-754 on the wire, whatever the host does. */
+    SOS_buffer_packd64(wire, 1.0);
+    if (memcmp(wire, one, 8) != 0) {
+        return FAIL;
+    }
+
+    /* Values pack754() could not carry now make the trip exactly. */
+    for (i = 0; i < 6; i++) {
+        SOS_buffer_packd64(wire, special[i]);
+        output[0] = SOS_buffer_unpackd64(wire);
+        if (memcmp(&output[0], &special[i], sizeof(double)) != 0) {
+            return FAIL;
+        }
+    }
+
+    /* Normal values are still the same bytes pack754() gives. */
+    for (attempt = 0; attempt < ATTEMPT_MAX; attempt++) {
+        random_double(&input[0]);
+        if (input[0] == 0.0) continue;
+        SOS_buffer_packd64(wire, input[0]);
+        if (SOS_buffer_unpacku64(wire) != SOS_buffer_pack754(input[0], 64, 11)) {
+            return FAIL;
+        }
+    }
+
+    /* The bulk routines match one-at-a-time packing. */
+    for (i = 0; i < 64; i++) { random_double(&input[i]); }
+    SOS_buffer_packd64_array(wire, input, 64);
+    for (i = 0; i < 64; i++) {
+        SOS_buffer_packd64(one, input[i]);
+        if (memcmp(one, wire + (i * 8), 8) != 0) {
+            return FAIL;
+        }
+    }
+    SOS_buffer_unpackd64_array(wire, output, 64);
+    if (memcmp(input, output, sizeof(input)) != 0) {
+        return FAIL;
+    }
+
+    return PASS;
+}
+
 int SOS_test_pack_string() {
     SOS_buffer *buffer;
     char input[512] = {0};
@@ -132,3 +190,185 @@ int SOS_test_pack_string() {
 
     return PASS;
 }
+
+int SOS_test_pack_record() {
+    SOS_buffer   *fmt_buf;
+    SOS_buffer   *rec_buf;
+    SOS_val_snap  input;
+    SOS_val_snap  output;
+    SOS_data      elem_in;
+    SOS_data      elem_out;
+    int fmt_offset = 0;
+    int rec_offset = 0;
+    int attempt = 0;
+    int result = PASS;
+
+    SOS_buffer_init(TEST_sos, &fmt_buf);
+    SOS_buffer_init(TEST_sos, &rec_buf);
+    memset(&input, 0, sizeof(SOS_val_snap));
+    memset(&elem_in, 0, sizeof(SOS_data));
+    memset(&elem_out, 0, sizeof(SOS_data));
+
+    /* Snaps go out as the same bytes the "iggiiidddl" format gave. */
+    for (attempt = 0; (attempt < ATTEMPT_MAX) && (result == PASS); attempt++) {
+        input.elem        = random() % 1000;
+        input.guid        = ((SOS_guid) random() << 32) | random();
+        input.relation_id = random();
+        input.semantic    = SOS_VAL_SEMANTIC_TIME_SPAN;
+        input.type        = SOS_VAL_TYPE_DOUBLE;
+        input.val_len     = sizeof(double);
+        input.frame       = random();
+        random_double(&input.time.pack);
+        random_double(&input.time.send);
+        random_double(&input.time.recv);
+        random_double(&input.val.d_val);
+
+        fmt_offset = 0;
+        SOS_buffer_pack(fmt_buf, &fmt_offset, "iggiiidddld",
+            input.elem, input.guid, input.relation_id, input.semantic,
+            input.type, input.val_len, input.time.pack, input.time.send,
+            input.time.recv, input.frame, input.val.d_val);
+        rec_offset = 0;
+        SOS_record_pack_snap(rec_buf, &rec_offset, &input);
+        if ((rec_offset != fmt_offset)
+         || (memcmp(fmt_buf->data, rec_buf->data, rec_offset) != 0)) {
+            result = FAIL;
+            break;
+        }
+
+        memset(&output, 0, sizeof(SOS_val_snap));
+        rec_offset = 0;
+        SOS_record_unpack_snap(rec_buf, &rec_offset, &output);
+        if ((rec_offset != fmt_offset)
+         || (output.guid != input.guid)
+         || (output.frame != input.frame)
+         || (memcmp(&output.time, &input.time, sizeof(SOS_time)) != 0)
+         || (memcmp(&output.val.d_val, &input.val.d_val, sizeof(double)) != 0)) {
+            result = FAIL;
+        }
+    }
+
+    /* A record cut short is refused without moving the offset. */
+    rec_buf->len = SOS_RECORD_SNAP_SIZE;
+    rec_offset = 0;
+    if ((SOS_record_unpack_snap(rec_buf, &rec_offset, &output) != -1)
+     || (rec_offset != 0)) {
+        result = FAIL;
+    }
+
+    /* Announce elements, with the name coming back interned. */
+    elem_in.guid             = 12345;
+    elem_in.name             = SOS_intern("example.value");
+    elem_in.type             = SOS_VAL_TYPE_STRING;
+    elem_in.meta.classifier  = SOS_VAL_CLASS_DATA;
+    elem_in.meta.relation_id = 678;
+    fmt_offset = 0;
+    SOS_buffer_pack(fmt_buf, &fmt_offset, "gsiiiiiig", elem_in.guid,
+        elem_in.name, elem_in.type, elem_in.meta.freq,
+        elem_in.meta.semantic, elem_in.meta.classifier,
+        elem_in.meta.pattern, elem_in.meta.compare,
+        elem_in.meta.relation_id);
+    rec_offset = 0;
+    rec_buf->len = 0;
+    SOS_record_pack_elem(rec_buf, &rec_offset, &elem_in);
+    if ((rec_offset != fmt_offset)
+     || (memcmp(fmt_buf->data, rec_buf->data, rec_offset) != 0)) {
+        result = FAIL;
+    }
+    rec_offset = 0;
+    SOS_record_unpack_elem(rec_buf, &rec_offset, &elem_out);
+    if ((elem_out.name != elem_in.name)
+     || (elem_out.meta.relation_id != elem_in.meta.relation_id)) {
+        result = FAIL;
+    }
+    SOS_intern_drop(elem_in.name);
+    SOS_intern_drop(elem_out.name);
+
+    SOS_buffer_destroy(fmt_buf);
+    SOS_buffer_destroy(rec_buf);
+
+    return result;
+}
+
+int SOS_test_pack_record_delta() {
+    SOS_buffer   *buffer;
+    SOS_val_snap  input[64];
+    SOS_val_snap  output;
+    SOS_val_snap  prev;
+    double        now = 1.5e9;
+    int offset = 0;
+    int i;
+    int result = PASS;
+
+    SOS_buffer_init(TEST_sos, &buffer);
+    memset(input, 0, sizeof(input));
+
+    /* What one publish of a pub looks like: neighbouring values, close
+     * guids, the same frame, and timestamps microseconds apart. */
+    for (i = 0; i < 64; i++) {
+        input[i].elem        = (i * 7) % 13;
+        input[i].guid        = 4000000000ULL + (i * 3);
+        input[i].relation_id = (i % 2) ? 0 : input[i].guid - 1;
+        input[i].semantic    = SOS_VAL_SEMANTIC_TIME_SPAN;
+        input[i].type        = (SOS_val_type) (i % 3);
+        input[i].val_len     = 8;
+        input[i].time.pack   = now + (i * 1.0e-6);
+        input[i].time.send   = now + 0.25;
+        input[i].frame       = 1000 + (i / 32);
+        switch (input[i].type) {
+        case SOS_VAL_TYPE_INT:    input[i].val.i_val = -i; break;
+        case SOS_VAL_TYPE_LONG:   input[i].val.l_val = (long) i << 40; break;
+        default:                  random_double(&input[i].val.d_val); break;
+        }
+    }
+    input[63].time.recv = -0.0;
+    input[63].guid      = 1;
+
+    memset(&prev, 0, sizeof(SOS_val_snap));
+    for (i = 0; i < 64; i++) {
+        SOS_record_pack_snap_delta(buffer, &offset, &input[i], &prev);
+    }
+    /* Well under half of the 64 bytes (+ value) each would take. */
+    if (offset > (64 * 32)) {
+        result = FAIL;
+    }
+
+    offset = 0;
+    memset(&prev, 0, sizeof(SOS_val_snap));
+    for (i = 0; (i < 64) && (result == PASS); i++) {
+        memset(&output, 0, sizeof(SOS_val_snap));
+        if (SOS_record_unpack_snap_delta(buffer, &offset, &output, &prev) < 0) {
+            result = FAIL;
+            break;
+        }
+        if ((output.elem != input[i].elem)
+         || (output.guid != input[i].guid)
+         || (output.relation_id != input[i].relation_id)
+         || (output.type != input[i].type)
+         || (output.frame != input[i].frame)
+         || (memcmp(&output.time, &input[i].time, sizeof(SOS_time)) != 0)
+         || (memcmp(&output.val, &input[i].val, sizeof(SOS_val)) != 0)) {
+            result = FAIL;
+        }
+    }
+
+    /* Nothing is read past the end of the message. */
+    if ((result == PASS) && (offset != buffer->len)) {
+        result = FAIL;
+    }
+    buffer->len -= 1;
+    offset = 0;
+    memset(&prev, 0, sizeof(SOS_val_snap));
+    for (i = 0; i < 64; i++) {
+        if (SOS_record_unpack_snap_delta(buffer, &offset, &output, &prev) < 0) {
+            break;
+        }
+    }
+    if (i != 63) {
+        result = FAIL;
+    }
+
+    SOS_buffer_destroy(buffer);
+
+    return result;
+}
@@ -5,6 +5,9 @@ int SOS_test_pack();
 int SOS_test_pack_int();
 int SOS_test_pack_long();
 int SOS_test_pack_double();
+int SOS_test_pack_double_wire();
 int SOS_test_pack_string();
+int SOS_test_pack_record();
+int SOS_test_pack_record_delta();
 
 #endif
@@ -1,7 +1,11 @@
 #include <stdio.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "sos.h"
+#include "sos_intern.h"
+#include "sos_async.h"
+#include "sos_coalesce.h"
 #include "test.h"
 #include "pub.h"
 
@@ -17,7 +21,20 @@ int SOS_test_pub() {
     SOS_test_run(2, "pub_create", SOS_test_pub_create(), pass_fail, error_total);
     SOS_test_run(2, "pub_growth", SOS_test_pub_growth(), pass_fail, error_total);
     SOS_test_run(2, "pub_duplicates", SOS_test_pub_growth(), pass_fail, error_total);
+    SOS_test_run(2, "pub_search", SOS_test_pub_search(), pass_fail, error_total);
     SOS_test_run(2, "pub_values", SOS_test_pub_values(), pass_fail, error_total);
+    SOS_test_run(2, "pub_pack_array", SOS_test_pub_pack_array(), pass_fail, error_total);
+    SOS_test_run(2, "pub_pack_handle", SOS_test_pub_pack_handle(), pass_fail, error_total);
+    SOS_test_run(2, "pub_announce_delta", SOS_test_pub_announce_delta(), pass_fail, error_total);
+    SOS_test_run(2, "pub_pack_staged", SOS_test_pub_pack_staged(), pass_fail, error_total);
+    SOS_test_run(2, "pub_coalesce", SOS_test_pub_coalesce(), pass_fail, error_total);
+    SOS_test_run(2, "pub_aggregate", SOS_test_pub_aggregate(), pass_fail, error_total);
+    SOS_test_run(2, "pub_pack_bytes", SOS_test_pub_pack_bytes(), pass_fail, error_total);
+    SOS_test_run(2, "pub_pack_vector", SOS_test_pub_pack_vector(), pass_fail, error_total);
+    SOS_test_run(2, "pub_intern", SOS_test_pub_intern(), pass_fail, error_total);
+    SOS_test_run(2, "pub_async_destroy", SOS_test_pub_async_destroy(), pass_fail, error_total);
+    SOS_test_run(2, "pub_async_drop_announce", SOS_test_pub_async_drop_announce(), pass_fail, error_total);
+    SOS_test_run(2, "pub_defer_backoff", SOS_test_pub_defer_backoff(), pass_fail, error_total);
 
     SOS_test_section_report(1, "SOS_pub", error_total);
 
@@ -125,6 +142,37 @@ int SOS_test_pub_duplicates() {
 }
 
 
+int SOS_test_pub_search() {
+    char val_name[512] = {0};
+    int attempt = 0;
+    SOS_pub *pub;
+
+    SOS_pub_init(TEST_sos, &pub, "test_pub_search", SOS_NATURE_DEFAULT);
+
+    // Enough names to push the name index through several resizes.
+    for (attempt = 0; attempt < (ATTEMPT_MAX * 4); attempt++) {
+        snprintf(val_name, 512, "search_%d", attempt);
+        SOS_pack(pub, val_name, SOS_VAL_TYPE_INT, &attempt);
+    }
+
+    for (attempt = 0; attempt < (ATTEMPT_MAX * 4); attempt++) {
+        snprintf(val_name, 512, "search_%d", attempt);
+        if (SOS_pub_search(pub, val_name) != attempt) {
+            SOS_pub_destroy(pub);
+            return FAIL;
+        }
+    }
+
+    if (SOS_pub_search(pub, "search_missing") != -1) {
+        SOS_pub_destroy(pub);
+        return FAIL;
+    }
+
+    SOS_pub_destroy(pub);
+    return PASS;
+}
+
+
 int SOS_test_pub_values() {
     int attempt = 0;
     int index = 0;
@@ -304,3 +352,835 @@ int SOS_test_pub_values() {
     return PASS;
 
 }
+
+
+int SOS_test_pub_pack_array() {
+    int attempt = 0;
+    int index = 0;
+    SOS_pub *pub;
+    SOS_buffer *buffer;
+    double diff;
+
+    char    names[ATTEMPT_MAX][100];
+    const char *name_list[ATTEMPT_MAX];
+    SOS_pack_handle_t handles[ATTEMPT_MAX];
+    double  reference_d[ATTEMPT_MAX];
+
+    for (attempt = 0; attempt < ATTEMPT_MAX; attempt++) {
+        snprintf(names[attempt], 100, "ARRAY(%d)", attempt);
+        name_list[attempt] = names[attempt];
+        random_double(&reference_d[attempt]);
+    }
+
+    SOS_pub_init(TEST_sos, &pub, "test_pub_pack_array", SOS_NATURE_DEFAULT);
+    SOS_buffer_init(TEST_sos, &buffer);
+
+    if (SOS_pack_array(pub, name_list, ATTEMPT_MAX,
+                SOS_VAL_TYPE_DOUBLE, reference_d) != ATTEMPT_MAX) {
+        SOS_pub_destroy(pub);
+        SOS_buffer_destroy(buffer);
+        return FAIL;
+    }
+
+    if (pub->elem_count != ATTEMPT_MAX) {
+        SOS_pub_destroy(pub);
+        SOS_buffer_destroy(buffer);
+        return FAIL;
+    }
+
+    /* Re-pack new values through handles. */
+    for (attempt = 0; attempt < ATTEMPT_MAX; attempt++) {
+        SOS_pack_handle_get(pub, names[attempt], SOS_VAL_TYPE_DOUBLE,
+                &handles[attempt]);
+        random_double(&reference_d[attempt]);
+    }
+    if (SOS_pack_array_by_handle(pub, handles, ATTEMPT_MAX,
+                reference_d) != ATTEMPT_MAX) {
+        SOS_pub_destroy(pub);
+        SOS_buffer_destroy(buffer);
+        return FAIL;
+    }
+
+    for (attempt = 0; attempt < ATTEMPT_MAX; attempt++) {
+        index = SOS_pub_search(pub, names[attempt]);
+        if (index != handles[attempt].elem) { SOS_pub_destroy(pub); SOS_buffer_destroy(buffer); return FAIL; }
+        diff = pub->data[index]->val.d_val - reference_d[attempt];
+        if (diff < 0) { diff *= -1; }
+        if (diff > 0.000000000001L) {
+            SOS_pub_destroy(pub);
+            SOS_buffer_destroy(buffer);
+            return FAIL;
+        }
+    }
+
+    /* Both batches are in the snap queue, and get released from it. */
+    if (pub->snap_queue->elem_count != (ATTEMPT_MAX * 2)) {
+        SOS_pub_destroy(pub);
+        SOS_buffer_destroy(buffer);
+        return FAIL;
+    }
+    SOS_val_snap_queue_to_buffer(pub, buffer, true);
+    if (pub->snap_queue->elem_count != 0) {
+        SOS_pub_destroy(pub);
+        SOS_buffer_destroy(buffer);
+        return FAIL;
+    }
+
+    SOS_buffer_destroy(buffer);
+    SOS_pub_destroy(pub);
+    return PASS;
+}
+
+
+int SOS_test_pub_pack_handle() {
+    int attempt = 0;
+    SOS_pub *pub;
+    SOS_pub *other;
+    SOS_pack_handle_t h_int;
+    SOS_pack_handle_t h_str;
+    SOS_pack_handle_t h_bad;
+    char c_val[60] = {0};
+    int pos_str;
+    int pos_int;
+
+    SOS_pub_init(TEST_sos, &pub, "test_pub_pack_handle", SOS_NATURE_DEFAULT);
+    SOS_pub_init(TEST_sos, &other, "test_pub_pack_handle_other", SOS_NATURE_DEFAULT);
+
+    /* Resolving a new name adds it and returns its position... */
+    pos_str = SOS_pack_handle_get(pub, "label", SOS_VAL_TYPE_STRING, &h_str);
+    pos_int = SOS_pack_handle_get(pub, "counter", SOS_VAL_TYPE_INT, &h_int);
+    if ((pos_str < 0) || (pos_int < 0) || (pos_int == pos_str)
+     || (pos_int != h_int.elem)
+     || (pos_int != SOS_pub_search(pub, "counter"))) {
+        SOS_pub_destroy(pub); SOS_pub_destroy(other); return FAIL;
+    }
+    /* ...and resolving it again finds the same one. */
+    if ((SOS_pack_handle_get(pub, "counter", SOS_VAL_TYPE_INT, &h_bad)
+                != pos_int)
+     || (h_bad.guid != h_int.guid)) {
+        SOS_pub_destroy(pub); SOS_pub_destroy(other); return FAIL;
+    }
+    /* ...but not as some other type. */
+    if (SOS_pack_handle_get(pub, "counter", SOS_VAL_TYPE_DOUBLE, &h_bad) != -1) {
+        SOS_pub_destroy(pub); SOS_pub_destroy(other); return FAIL;
+    }
+
+    for (attempt = 0; attempt < ATTEMPT_MAX; attempt++) {
+        random_string(c_val, 60);
+        SOS_pack_by_handle(pub, h_int, &attempt);
+        SOS_pack_by_handle(pub, h_str, c_val);
+    }
+
+    if ((pub->elem_count != 2)
+     || (pub->data[h_int.elem]->val.i_val != (ATTEMPT_MAX - 1))
+     || (strncmp(pub->data[h_str.elem]->val.c_val, c_val, 60) != 0)) {
+        SOS_pub_destroy(pub); SOS_pub_destroy(other); return FAIL;
+    }
+
+    /* Handles do not carry over to other pubs. */
+    SOS_pack(other, "counter", SOS_VAL_TYPE_INT, &attempt);
+    if (SOS_pack_by_handle(other, h_int, &attempt) != -1) {
+        SOS_pub_destroy(pub); SOS_pub_destroy(other); return FAIL;
+    }
+
+    SOS_pub_destroy(pub);
+    SOS_pub_destroy(other);
+    return PASS;
+}
+
+
+int SOS_test_pub_announce_delta() {
+    int attempt = 0;
+    int full_len = 0;
+    double d_val = 1.5;
+    char val_name[64] = {0};
+    SOS_pub *pub;
+    SOS_pub *mirror;
+    SOS_buffer *buffer;
+
+    SOS_pub_init(TEST_sos, &pub, "test_pub_announce_delta", SOS_NATURE_DEFAULT);
+    SOS_pub_init(TEST_sos, &mirror, "test_pub_announce_mirror", SOS_NATURE_DEFAULT);
+    SOS_buffer_init(TEST_sos, &buffer);
+
+    for (attempt = 0; attempt < 100; attempt++) {
+        snprintf(val_name, 64, "first_%d", attempt);
+        SOS_pack(pub, val_name, SOS_VAL_TYPE_INT, &attempt);
+    }
+    SOS_announce_to_buffer(pub, buffer);
+    SOS_announce_from_buffer(buffer, mirror);
+    full_len = buffer->len;
+
+    /* Only the two new values are described the second time around. */
+    SOS_pack(pub, "second_0", SOS_VAL_TYPE_INT, &attempt);
+    SOS_pack(pub, "second_1", SOS_VAL_TYPE_DOUBLE, &d_val);
+    SOS_buffer_wipe(buffer);
+    SOS_announce_to_buffer(pub, buffer);
+    if (buffer->len >= (full_len / 10)) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub); SOS_pub_destroy(mirror);
+        return FAIL;
+    }
+    SOS_announce_from_buffer(buffer, mirror);
+
+    if ((mirror->elem_count != 102)
+     || (SOS_pub_search(mirror, "first_42") != 42)
+     || (SOS_pub_search(mirror, "second_1") != 101)
+     || (mirror->data[101]->guid != pub->data[101]->guid)
+     || (mirror->data[101]->type != SOS_VAL_TYPE_DOUBLE)) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub); SOS_pub_destroy(mirror);
+        return FAIL;
+    }
+
+    /* A delta that would leave a gap, after one that was lost, is
+     * ignored... */
+    SOS_pack(pub, "third_0", SOS_VAL_TYPE_INT, &attempt);
+    SOS_buffer_wipe(buffer);
+    SOS_announce_to_buffer(pub, buffer);
+    SOS_pack(pub, "fourth_0", SOS_VAL_TYPE_DOUBLE, &d_val);
+    SOS_buffer_wipe(buffer);
+    SOS_announce_to_buffer(pub, buffer);
+    SOS_announce_from_buffer(buffer, mirror);
+    if ((mirror->elem_count != 102)
+     || (SOS_pub_search(mirror, "fourth_0") >= 0)) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub); SOS_pub_destroy(mirror);
+        return FAIL;
+    }
+
+    /* ...and once the client knows messages were lost, it describes the
+     * whole pub again. */
+    pub->announced_losses--;
+    SOS_pack(pub, "fifth_0", SOS_VAL_TYPE_INT, &attempt);
+    SOS_buffer_wipe(buffer);
+    SOS_pub_frame_to_buffer(pub, buffer);
+    if (buffer->len < full_len) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub); SOS_pub_destroy(mirror);
+        return FAIL;
+    }
+    SOS_buffer_wipe(buffer);
+    SOS_announce_to_buffer(pub, buffer);
+    SOS_announce_from_buffer(buffer, mirror);
+    if ((mirror->elem_count != 105)
+     || (SOS_pub_search(mirror, "third_0") != 102)
+     || (mirror->data[103]->type != SOS_VAL_TYPE_DOUBLE)
+     || (SOS_pub_search(mirror, "fifth_0") != 104)) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub); SOS_pub_destroy(mirror);
+        return FAIL;
+    }
+
+    SOS_buffer_destroy(buffer);
+    SOS_pub_destroy(pub);
+    SOS_pub_destroy(mirror);
+    return PASS;
+}
+
+
+#define STAGED_THREADS  4
+
+typedef struct {
+    SOS_pub *pub;
+    int      id;
+} staged_packer;
+
+static void* SOS_test_pub_staged_packer(void *args) {
+    staged_packer *packer = (staged_packer *) args;
+    char val_name[64] = {0};
+    int attempt;
+    long l_val;
+
+    snprintf(val_name, 64, "thread_%d", packer->id);
+    for (attempt = 0; attempt < ATTEMPT_MAX; attempt++) {
+        l_val = attempt;
+        SOS_pack(packer->pub, val_name, SOS_VAL_TYPE_INT, &attempt);
+        SOS_pack(packer->pub, "shared", SOS_VAL_TYPE_LONG, &l_val);
+    }
+    return NULL;
+}
+
+
+int SOS_test_pub_pack_staged() {
+    int i;
+    int pos;
+    double d_val = 1.5;
+    SOS_pub *pub;
+    SOS_buffer *buffer;
+    pthread_t thread[STAGED_THREADS];
+    staged_packer packer[STAGED_THREADS];
+
+    SOS_pub_init(TEST_sos, &pub, "test_pub_pack_staged", SOS_NATURE_DEFAULT);
+    SOS_pub_config(pub, SOS_PUB_OPTION_STAGED, 1);
+    SOS_buffer_init(TEST_sos, &buffer);
+
+    for (i = 0; i < STAGED_THREADS; i++) {
+        packer[i].pub = pub;
+        packer[i].id  = i;
+        pthread_create(&thread[i], NULL, SOS_test_pub_staged_packer, &packer[i]);
+    }
+    for (i = 0; i < STAGED_THREADS; i++) {
+        pthread_join(thread[i], NULL);
+    }
+
+    /* Nothing reaches the pub until it is framed for a publish. */
+    if (pub->elem_count != 0) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+    SOS_pub_frame_to_buffer(pub, buffer);
+    if ((pub->elem_count != (STAGED_THREADS + 1))
+     || (pub->data[SOS_pub_search(pub, "shared")]->val.l_val != (ATTEMPT_MAX - 1))) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+    pos = SOS_pub_search(pub, "thread_2");
+    if ((pos < 0) || (pub->data[pos]->val.i_val != (ATTEMPT_MAX - 1))) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+
+    /* A value staged as the wrong type is dropped at the merge. */
+    SOS_pack(pub, "thread_2", SOS_VAL_TYPE_DOUBLE, &d_val);
+    SOS_buffer_wipe(buffer);
+    SOS_pub_frame_to_buffer(pub, buffer);
+    if ((pub->data[pos]->type != SOS_VAL_TYPE_INT)
+     || (pub->data[pos]->val.i_val != (ATTEMPT_MAX - 1))) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+
+    SOS_buffer_destroy(buffer);
+    SOS_pub_destroy(pub);
+    return PASS;
+}
+
+
+int SOS_test_pub_coalesce() {
+    int attempt = 0;
+    int hot;
+    int cold;
+    double span = 1.5;
+    SOS_pub *pub;
+    SOS_buffer *buffer;
+
+    SOS_pub_init(TEST_sos, &pub, "test_pub_coalesce", SOS_NATURE_DEFAULT);
+    SOS_buffer_init(TEST_sos, &buffer);
+
+    /* Only values hinted as CONTINUOUS coalesce in a plain pub... */
+    SOS_pack(pub, "hot", SOS_VAL_TYPE_INT, &attempt);
+    SOS_pack(pub, "cold", SOS_VAL_TYPE_INT, &attempt);
+    SOS_pack(pub, "span", SOS_VAL_TYPE_DOUBLE, &span);
+    hot  = SOS_val_set_meta(pub, "hot", SOS_VAL_FREQ_CONTINUOUS,
+            SOS_VAL_SEMANTIC_TIME_STOP);
+    cold = SOS_pub_search(pub, "cold");
+    SOS_pub_frame_to_buffer(pub, buffer);
+
+    for (attempt = ATTEMPT_MAX; attempt > 0; attempt--) {
+        SOS_pack(pub, "hot", SOS_VAL_TYPE_INT, &attempt);
+        SOS_pack(pub, "cold", SOS_VAL_TYPE_INT, &attempt);
+    }
+    if ((pub->snap_queue->elem_count != ATTEMPT_MAX)
+     || (pub->pending[hot] == NULL)
+     || (pub->pending[hot]->val.i_val != ATTEMPT_MAX)
+     || (pub->data[hot]->val.i_val != ATTEMPT_MAX)
+     || (pub->data[cold]->val.i_val != 1)) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+
+    /* ...and every value once the pub coalesces. */
+    SOS_pub_config(pub, SOS_PUB_OPTION_COALESCE, 1);
+    SOS_val_set_meta(pub, "span", SOS_VAL_FREQ_DEFAULT,
+            SOS_VAL_SEMANTIC_TIME_SPAN);
+    SOS_buffer_wipe(buffer);
+    SOS_pub_frame_to_buffer(pub, buffer);
+    for (attempt = 0; attempt < 4; attempt++) {
+        SOS_pack(pub, "span", SOS_VAL_TYPE_DOUBLE, &span);
+        SOS_pack(pub, "cold", SOS_VAL_TYPE_INT, &attempt);
+    }
+    if ((pub->snap_queue->elem_count != 0)
+     || (pub->data[SOS_pub_search(pub, "span")]->val.d_val != (4 * span))
+     || (pub->data[cold]->val.i_val != 3)) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+
+    /* Framing a publish hands them over. */
+    SOS_buffer_wipe(buffer);
+    SOS_pub_frame_to_buffer(pub, buffer);
+    if ((pub->pending[cold] != NULL) || (pub->snap_queue->elem_count != 0)) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+
+    SOS_buffer_destroy(buffer);
+    SOS_pub_destroy(pub);
+    return PASS;
+}
+
+
+int SOS_test_pub_aggregate() {
+    int attempt = 0;
+    int bytes;
+    int sum;
+    double lat;
+    SOS_pub *pub;
+    SOS_buffer *buffer;
+
+    SOS_pub_init(TEST_sos, &pub, "test_pub_aggregate", SOS_NATURE_DEFAULT);
+    SOS_pub_config(pub, SOS_PUB_OPTION_AGGREGATE, 1);
+    SOS_buffer_init(TEST_sos, &buffer);
+
+    SOS_pack(pub, "bytes", SOS_VAL_TYPE_INT, &attempt);
+    lat = 0.0;
+    SOS_pack(pub, "latency", SOS_VAL_TYPE_DOUBLE, &lat);
+    bytes = SOS_val_set_meta(pub, "bytes", SOS_VAL_FREQ_DEFAULT,
+            SOS_VAL_SEMANTIC_COUNTER);
+    SOS_val_set_meta(pub, "latency", SOS_VAL_FREQ_DEFAULT,
+            SOS_VAL_SEMANTIC_SAMPLE);
+    SOS_pub_frame_to_buffer(pub, buffer);
+
+    sum = 0;
+    for (attempt = 1; attempt <= ATTEMPT_MAX; attempt++) {
+        sum += attempt;
+        lat = (double) attempt;
+        SOS_pack(pub, "bytes", SOS_VAL_TYPE_INT, &attempt);
+        SOS_pack(pub, "latency", SOS_VAL_TYPE_DOUBLE, &lat);
+    }
+    /* One total, no samples. */
+    if ((pub->snap_queue->elem_count != 0)
+     || (pub->pending[bytes] == NULL)
+     || (pub->data[bytes]->val.i_val != sum)) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+
+    SOS_buffer_wipe(buffer);
+    SOS_pub_frame_to_buffer(pub, buffer);
+    if ((SOS_pub_search(pub, "latency.sumsq") < 0)
+     || (pub->data[SOS_pub_search(pub, "latency.count")]->val.l_val != ATTEMPT_MAX)
+     || (pub->data[SOS_pub_search(pub, "latency.min")]->val.d_val != 1.0)
+     || (pub->data[SOS_pub_search(pub, "latency.max")]->val.d_val != (double) ATTEMPT_MAX)
+     || (pub->data[SOS_pub_search(pub, "latency.sum")]->val.d_val != (double) sum)) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+
+    /* The counter keeps running across publishes. */
+    attempt = 5;
+    SOS_pack(pub, "bytes", SOS_VAL_TYPE_INT, &attempt);
+    if (pub->data[bytes]->val.i_val != (sum + 5)) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+
+    SOS_buffer_destroy(buffer);
+    SOS_pub_destroy(pub);
+    return PASS;
+}
+
+
+static void SOS_test_release_bytes(void *ctx, void *bytes) {
+    (*(int *) ctx)++;
+    return;
+}
+
+
+int SOS_test_pub_pack_bytes() {
+    unsigned char blob[4096];
+    int released = 0;
+    int elem;
+    int found;
+    int i;
+    SOS_pub *pub;
+    SOS_buffer *buffer;
+
+    SOS_pub_init(TEST_sos, &pub, "test_pub_pack_bytes", SOS_NATURE_DEFAULT);
+    SOS_buffer_init(TEST_sos, &buffer);
+
+    for (i = 0; i < sizeof(blob); i++) { blob[i] = (unsigned char) (i * 7); }
+
+    /* The pub and the queued snaps all refer to the caller's memory. */
+    for (i = 0; i < 3; i++) {
+        elem = SOS_pack_bytes(pub, "blob", sizeof(blob), blob,
+                SOS_test_release_bytes, &released);
+    }
+    if ((elem < 0)
+     || (pub->data[elem]->val.bytes != (void *) blob)
+     || (pub->data[elem]->val_len != sizeof(blob))
+     || (pub->snap_queue->elem_count != 3)
+     || (released != 0)
+     || (SOS_pack(pub, "blob", SOS_VAL_TYPE_BYTES, blob) >= 0)) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+
+    /* Once sent, only the pub still holds on to it. */
+    SOS_pub_frame_to_buffer(pub, buffer);
+    found = 0;
+    for (i = 0; (i + sizeof(blob)) <= buffer->len; i++) {
+        if (memcmp(buffer->data + i, blob, sizeof(blob)) == 0) found++;
+    }
+    if ((found != 4) || (released != 2)) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+
+    /* Without a release function the bytes are copied. */
+    SOS_pack_bytes(pub, "blob", 16, blob, NULL, NULL);
+    blob[0]++;
+    if ((released != 3)
+     || (pub->data[elem]->val.bytes == (void *) blob)
+     || (((unsigned char *) pub->data[elem]->val.bytes)[0] == blob[0])) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+
+    SOS_buffer_destroy(buffer);
+    SOS_pub_destroy(pub);
+    return PASS;
+}
+
+
+int SOS_test_pub_pack_vector() {
+    double values[24];
+    double check[24];
+    long   longs[3] = { -1, 0, 1L << 40 };
+    long   long_check[3];
+    int offset;
+    int elem;
+    int i;
+    SOS_pub *pub;
+    SOS_buffer *buffer;
+
+    SOS_pub_init(TEST_sos, &pub, "test_pub_pack_vector", SOS_NATURE_DEFAULT);
+    SOS_buffer_init(TEST_sos, &buffer);
+
+    for (i = 0; i < 24; i++) { values[i] = (i * 0.5) - 3.25; }
+
+    /* The pub keeps its own copy of the values. */
+    elem = SOS_pack_vector(pub, "coords", SOS_VAL_TYPE_DOUBLE_ARRAY, 24, values);
+    values[0] = 99.0;
+    if ((elem < 0)
+     || (pub->data[elem]->type != SOS_VAL_TYPE_DOUBLE_ARRAY)
+     || (pub->data[elem]->val_len != (24 * sizeof(double)))
+     || (pub->data[elem]->val.da_val == values)
+     || (pub->data[elem]->val.da_val[0] != -3.25)
+     || (pub->data[elem]->val.da_val[23] != 8.25)
+     || (SOS_pack(pub, "coords", SOS_VAL_TYPE_DOUBLE_ARRAY, values) >= 0)
+     || (SOS_pack_vector(pub, "coords", SOS_VAL_TYPE_DOUBLE, 1, values) >= 0)) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+    SOS_pub_frame_to_buffer(pub, buffer);
+    SOS_buffer_wipe(buffer);
+
+    /* Elements make the round trip through a buffer intact. */
+    offset = 0;
+    SOS_buffer_pack_array(buffer, &offset, SOS_VAL_TYPE_DOUBLE_ARRAY, 24,
+            pub->data[elem]->val.da_val);
+    SOS_buffer_pack_array(buffer, &offset, SOS_VAL_TYPE_LONG_ARRAY, 3, longs);
+    offset = 0;
+    if ((SOS_buffer_unpack_array(buffer, &offset, SOS_VAL_TYPE_DOUBLE_ARRAY,
+                    24, check) != 24)
+     || (memcmp(check, pub->data[elem]->val.da_val, sizeof(check)) != 0)
+     || (SOS_buffer_unpack_array(buffer, &offset, SOS_VAL_TYPE_LONG_ARRAY,
+                    2, long_check) >= 0)) {
+        SOS_buffer_destroy(buffer); SOS_pub_destroy(pub);
+        return FAIL;
+    }
+
+    SOS_buffer_destroy(buffer);
+    SOS_pub_destroy(pub);
+    return PASS;
+}
+
+
+int SOS_test_pub_intern() {
+    char value[SOS_DEFAULT_STRING_LEN];
+    int before;
+    int elem_a;
+    int elem_b;
+    int grown;
+    int i;
+    SOS_pub *pub_a;
+    SOS_pub *pub_b;
+
+    before = SOS_intern_count();
+    SOS_pub_init(TEST_sos, &pub_a, "test_pub_intern", SOS_NATURE_DEFAULT);
+    SOS_pub_init(TEST_sos, &pub_b, "test_pub_intern", SOS_NATURE_DEFAULT);
+
+    /* Both pubs, and every queued snap, share one copy of each string. */
+    for (i = 0; i < 100; i++) {
+        snprintf(value, sizeof(value), "state.%d", (i % 4));
+        elem_a = SOS_pack(pub_a, "intern.state", SOS_VAL_TYPE_STRING, value);
+        elem_b = SOS_pack(pub_b, "intern.state", SOS_VAL_TYPE_STRING, value);
+    }
+    grown = SOS_intern_count() - before;
+    if ((elem_a < 0) || (elem_b < 0)
+     || (pub_a->title != pub_b->title)
+     || (pub_a->data[elem_a]->name != pub_b->data[elem_b]->name)
+     || (pub_a->data[elem_a]->val.c_val != pub_b->data[elem_b]->val.c_val)
+     || (strcmp(pub_a->data[elem_a]->val.c_val, "state.3") != 0)
+     || (pub_a->data[elem_a]->val_len != 7)) {
+        SOS_pub_destroy(pub_a); SOS_pub_destroy(pub_b);
+        return FAIL;
+    }
+
+    /* At most the pubs' four strings, one name, and four values. */
+    SOS_pub_config(pub_a, SOS_PUB_OPTION_PROG_VER, "v1.0");
+    if ((grown > 9) || (strcmp(pub_a->prog_ver, "v1.0") != 0)) {
+        SOS_pub_destroy(pub_a); SOS_pub_destroy(pub_b);
+        return FAIL;
+    }
+
+    /* Nothing is left behind once the pubs are gone. */
+    SOS_pub_destroy(pub_a);
+    SOS_pub_destroy(pub_b);
+    if (SOS_intern_count() != before) {
+        return FAIL;
+    }
+
+    return PASS;
+}
+
+
+static int SOS_test_pub_async_destroyed = 0;
+
+static void* SOS_test_pub_async_destroyer(void *pub) {
+    SOS_pub_destroy((SOS_pub *) pub);
+    __atomic_store_n(&SOS_test_pub_async_destroyed, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int SOS_test_pub_async_destroy() {
+    struct timespec ts;
+    SOS_async_queue *q;
+    SOS_list_entry *defer;
+    pthread_t destroyer;
+    SOS_pub *pub;
+    SOS_pub *other;
+    bool waiting;
+    int i = 1;
+
+    /* Online, the runtime already has a flush thread talking to sosd. */
+    if (TEST_sos->task.async != NULL) {
+        return NOTEST;
+    }
+    SOS_async_init(TEST_sos);
+    q = TEST_sos->task.async;
+
+    SOS_pub_init(TEST_sos, &pub, "test_pub_async_destroy", SOS_NATURE_DEFAULT);
+    SOS_pub_init(TEST_sos, &other, "test_pub_async_other", SOS_NATURE_DEFAULT);
+    SOS_pack(pub, "value", SOS_VAL_TYPE_INT, &i);
+    SOS_pack(other, "value", SOS_VAL_TYPE_INT, &i);
+
+    /* Leave a deferred publish of the pub, and hold the pub so the flush
+     * thread stops partway through serializing it. */
+    defer = (SOS_list_entry *) calloc(1, sizeof(SOS_list_entry));
+    defer->ref = (void *) pub;
+    pthread_mutex_lock(q->lock);
+    q->deferred = defer;
+    pthread_mutex_unlock(q->lock);
+    pthread_mutex_lock(pub->lock);
+    SOS_async_publish(other);
+
+    ts.tv_sec  = 0;
+    ts.tv_nsec = 1000000;
+    waiting = false;
+    for (i = 0; (i < 5000) && (!waiting); i++) {
+        pthread_mutex_lock(q->lock);
+        waiting = (q->current == (void *) pub);
+        pthread_mutex_unlock(q->lock);
+        if (!waiting) nanosleep(&ts, NULL);
+    }
+
+    /* Destroying the pub has to wait for the flush thread to let go. */
+    SOS_test_pub_async_destroyed = 0;
+    pthread_create(&destroyer, NULL, SOS_test_pub_async_destroyer,
+            (void *) pub);
+    ts.tv_nsec = 50000000;
+    nanosleep(&ts, NULL);
+    if (__atomic_load_n(&SOS_test_pub_async_destroyed, __ATOMIC_ACQUIRE)) {
+        waiting = false;
+    }
+    pthread_mutex_unlock(pub->lock);
+    pthread_join(destroyer, NULL);
+
+    /* ...and by the time it is gone, the flush thread is done with it. */
+    pthread_mutex_lock(q->lock);
+    if (q->current == (void *) pub) {
+        waiting = false;
+    }
+    pthread_mutex_unlock(q->lock);
+
+    SOS_async_destroy(TEST_sos);
+    SOS_pub_destroy(other);
+
+    return (waiting) ? PASS : FAIL;
+}
+
+
+
+/* Apply the ANNOUNCE parts of a pub frame to a pub, as sosd would. */
+static void SOS_test_pub_frame_announce(SOS_buffer *frame, SOS_pub *mirror) {
+    SOS_msg_header header;
+    SOS_msg_header part_header;
+    SOS_buffer view;
+    SOS_buffer part;
+    int offset = 0;
+    int part_start;
+
+    view = *frame;
+    view.is_locking = false;
+    view.lock = NULL;
+    SOS_msg_unzip(&view, &header, 0, &offset);
+    while (offset < header.msg_size) {
+        part_start = offset;
+        SOS_msg_unzip(&view, &part_header, part_start, &offset);
+        if (part_header.msg_type == SOS_MSG_TYPE_ANNOUNCE) {
+            part      = view;
+            part.data = view.data + part_start;
+            part.len  = part_header.msg_size;
+            part.max  = view.max - part_start;
+            SOS_announce_from_buffer(&part, mirror);
+        }
+        offset = part_start + part_header.msg_size;
+    }
+    return;
+}
+
+/* Dropping a queued publish that announced values does not leave them
+ * unknown to the daemon. */
+int SOS_test_pub_async_drop_announce() {
+    struct timespec ts;
+    SOS_async_queue *q;
+    SOS_list_entry *defer;
+    SOS_async_full policy;
+    SOS_pub *blocker;
+    SOS_pub *other;
+    SOS_pub *pub;
+    SOS_pub *mirror;
+    char val_name[64] = {0};
+    bool waiting;
+    bool complete;
+    int depth;
+    int round;
+    int i = 1;
+
+    if (TEST_sos->task.async != NULL) {
+        return NOTEST;
+    }
+    /* One slot goes to the stalled blocker, leaving room for two. */
+    policy = TEST_sos->config.options->async_full_policy;
+    depth  = TEST_sos->config.options->async_queue_depth;
+    TEST_sos->config.options->async_full_policy = SOS_ASYNC_FULL_DROP_OLDEST;
+    TEST_sos->config.options->async_queue_depth = 3;
+    SOS_async_init(TEST_sos);
+    TEST_sos->config.options->async_full_policy = policy;
+    TEST_sos->config.options->async_queue_depth = depth;
+    q = TEST_sos->task.async;
+
+    SOS_pub_init(TEST_sos, &blocker, "test_pub_drop_blocker", SOS_NATURE_DEFAULT);
+    SOS_pub_init(TEST_sos, &other, "test_pub_drop_other", SOS_NATURE_DEFAULT);
+    SOS_pub_init(TEST_sos, &pub, "test_pub_drop_announce", SOS_NATURE_DEFAULT);
+    SOS_pub_init(TEST_sos, &mirror, "test_pub_drop_mirror", SOS_NATURE_DEFAULT);
+    SOS_pack(blocker, "value", SOS_VAL_TYPE_INT, &i);
+    SOS_pack(other, "value", SOS_VAL_TYPE_INT, &i);
+
+    /* Stall the flush thread on the blocker so nothing leaves the queue. */
+    defer = (SOS_list_entry *) calloc(1, sizeof(SOS_list_entry));
+    defer->ref = (void *) blocker;
+    pthread_mutex_lock(q->lock);
+    q->deferred = defer;
+    pthread_mutex_unlock(q->lock);
+    pthread_mutex_lock(blocker->lock);
+    SOS_async_publish(other);
+
+    ts.tv_sec  = 0;
+    ts.tv_nsec = 1000000;
+    waiting = false;
+    for (i = 0; (i < 5000) && (!waiting); i++) {
+        pthread_mutex_lock(q->lock);
+        waiting = (q->current == (void *) blocker);
+        pthread_mutex_unlock(q->lock);
+        if (!waiting) nanosleep(&ts, NULL);
+    }
+
+    /* Every publish adds values, and pushes an older one out. */
+    for (round = 0; round < 4; round++) {
+        for (i = 0; i < 5; i++) {
+            snprintf(val_name, 64, "round_%d_%d", round, i);
+            SOS_pack(pub, val_name, SOS_VAL_TYPE_INT, &i);
+        }
+        SOS_async_publish(pub);
+    }
+
+    pthread_mutex_lock(q->lock);
+    for (i = 0; i < q->count; i++) {
+        SOS_test_pub_frame_announce(q->entry[(q->head + i) % q->depth].msg,
+                mirror);
+    }
+    complete = ((q->dropped == 3) && (mirror->elem_count == pub->elem_count));
+    for (i = 0; complete && (i < pub->elem_count); i++) {
+        if ((mirror->data[i]->name == NULL)
+         || (SOS_pub_search(mirror, pub->data[i]->name) != i)) {
+            complete = false;
+        }
+    }
+    pthread_mutex_unlock(q->lock);
+
+    pthread_mutex_unlock(blocker->lock);
+    SOS_async_destroy(TEST_sos);
+    SOS_pub_destroy(mirror);
+    SOS_pub_destroy(pub);
+    SOS_pub_destroy(other);
+    SOS_pub_destroy(blocker);
+
+    return (waiting && complete) ? PASS : FAIL;
+}
+
+/* A deferred publish still goes out when the wait between publishes
+ * grows after the timer thread was handed it. */
+int SOS_test_pub_defer_backoff() {
+    struct timespec ts;
+    SOS_pub *pub;
+    bool sent;
+    int i = 1;
+
+    /* Online, the runtime already has a timer thread talking to sosd. */
+    if (TEST_sos->task.coalesce != NULL) {
+        return NOTEST;
+    }
+    SOS_coalesce_init(TEST_sos);
+
+    SOS_pub_init(TEST_sos, &pub, "test_pub_defer_backoff", SOS_NATURE_DEFAULT);
+    SOS_pub_config(pub, SOS_PUB_OPTION_RATE_LIMIT, 20000);
+    SOS_pack(pub, "value", SOS_VAL_TYPE_INT, &i);
+    SOS_publish(pub);
+    SOS_pack(pub, "value", SOS_VAL_TYPE_INT, &i);
+    SOS_publish(pub);
+
+    /* The second one waits on the timer, which then finds the pub asking
+     * for a much longer wait. */
+    pthread_mutex_lock(pub->lock);
+    if (pub->publish_deferred == false) {
+        pthread_mutex_unlock(pub->lock);
+        SOS_coalesce_destroy(TEST_sos);
+        SOS_pub_destroy(pub);
+        return FAIL;
+    }
+    pub->publish_usec = 10000000;
+    pthread_mutex_unlock(pub->lock);
+
+    sent = false;
+    ts.tv_sec  = 0;
+    ts.tv_nsec = 1000000;
+    for (i = 0; (i < 2000) && (!sent); i++) {
+        nanosleep(&ts, NULL);
+        pthread_mutex_lock(pub->lock);
+        sent = (pub->publish_deferred == false);
+        pthread_mutex_unlock(pub->lock);
+    }
+
+    SOS_coalesce_destroy(TEST_sos);
+    SOS_pub_destroy(pub);
+
+    return (sent) ? PASS : FAIL;
+}
@@ -5,6 +5,19 @@ int SOS_test_pub();
 int SOS_test_pub_create();
 int SOS_test_pub_growth();
 int SOS_test_pub_duplicates();
+int SOS_test_pub_search();
 int SOS_test_pub_values();
+int SOS_test_pub_pack_array();
+int SOS_test_pub_pack_handle();
+int SOS_test_pub_announce_delta();
+int SOS_test_pub_pack_staged();
+int SOS_test_pub_coalesce();
+int SOS_test_pub_aggregate();
+int SOS_test_pub_pack_bytes();
+int SOS_test_pub_pack_vector();
+int SOS_test_pub_intern();
+int SOS_test_pub_async_destroy();
+int SOS_test_pub_async_drop_announce();
+int SOS_test_pub_defer_backoff();
 
 #endif